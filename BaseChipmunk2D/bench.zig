@@ -0,0 +1,302 @@
+//!zig-autodoc-section: BaseChipmunk2D\\bench.zig
+//! bench.zig :
+//!  Benchmarks for Chipmunk2D.
+//!  Runs every benchmark for each task pool size and each space or shape count
+//!  given, and writes one JSON object per result line to stdout:
+//!    zig build bench -Doptimize=ReleaseFast -- --spaces=1,10,100,1000
+//!      --threads=1,2,4,8 > results.jsonl
+//!  serial_us is the time of one cpSpaceStep() or single query call, and
+//!  pooled_us the same work done by cpSpaceStepMany() or a batch query.
+// Build using Zig 0.16.0
+
+//=============================================================================
+//#region MARK: GLOBAL
+//=============================================================================
+const std = @import("std");
+const Io = std.Io;
+var appinit: std.process.Init = undefined;
+
+const cp = @cImport({
+  @cInclude("lib/chipmunk/include/chipmunk/chipmunk.h");
+  @cInclude("lib/chipmunk/include/chipmunk/cpHastySpace.h");
+});
+const ctime = @cImport({
+  @cInclude("time.h");
+});
+
+const Mode = enum { stepmany, pointquery, segmentquery };
+
+const Config = struct {
+  benchmarks: []const Mode = &.{ .stepmany, .pointquery, .segmentquery },
+  spaces: []const usize = &.{ 1, 10, 100, 1000 },
+  threads: []const usize = &.{ 1, 2, 4 },
+  bodies: usize = 30,
+  steps: usize = 120,
+  shapes: []const usize = &.{ 1000, 10000, 100000 },
+  queries: usize = 100000,
+  seed: u64 = 301,
+};
+var cfg: Config = .{};
+
+const usage =
+  \\Usage: bench [--name=value ...]
+  \\  --benchmarks=LIST  stepmany,pointquery,segmentquery (default all)
+  \\  --spaces=LIST      space counts of stepmany (default 1,10,100,1000)
+  \\  --threads=LIST     task pool sizes, 0 for one per processor (default 1,2,4)
+  \\  --bodies=N         balls in each space (default 30)
+  \\  --steps=N          steps timed for each result (default 120)
+  \\  --shapes=LIST      shape counts of the query benchmarks (default 1000,10000,100000)
+  \\  --queries=N        queries timed for each result (default 100000)
+  \\  --seed=N           random seed (default 301)
+  \\
+;
+
+const dt = 1.0 / 60.0;
+
+//#endregion ==================================================================
+//#region MARK: MAIN
+//=============================================================================
+pub fn main(init: std.process.Init) !void {
+  appinit = init;
+  const arena = init.arena.allocator();
+  const args = try init.minimal.args.toSlice(arena);
+  parseArgs(arena, args) catch |err| {
+    std.debug.print("{s}", .{usage});
+    if (err == error.Help) return;
+    return err;
+  };
+  defer cp.cpTaskPoolSetThreads(1);
+
+  for (cfg.benchmarks) |mode| {
+    for (cfg.threads) |nthreads| {
+      cp.cpTaskPoolSetThreads(@intCast(nthreads));
+      switch (mode) {
+        .stepmany => for (cfg.spaces) |nspaces| try stepMany(nspaces),
+        .pointquery, .segmentquery => for (cfg.shapes) |nshapes| try query(mode, nshapes),
+      }
+    }
+  }
+}
+
+//#endregion ==================================================================
+//#region MARK: BENCH
+//=============================================================================
+/// Step the same set of spaces with cpSpaceStep() one by one and with
+/// cpSpaceStepMany() through the task pool.
+fn stepMany(nspaces: usize) !void {
+  const gpa = appinit.gpa;
+  const serial = try gpa.alloc(?*cp.cpSpace, nspaces);
+  defer gpa.free(serial);
+  const pooled = try gpa.alloc(?*cp.cpSpace, nspaces);
+  defer gpa.free(pooled);
+  for (serial, pooled, 0..) |*s, *p, i| {
+    s.* = ballPile(i, cfg.bodies);
+    p.* = ballPile(i, cfg.bodies);
+  }
+  defer {
+    for (serial, pooled) |s, p| {
+      freeSpace(s);
+      freeSpace(p);
+    }
+  }
+
+  const t0 = nanos();
+  for (0..cfg.steps) |_| {
+    for (serial) |space| cp.cpSpaceStep(space, dt);
+  }
+  const t1 = nanos();
+  for (0..cfg.steps) |_| cp.cpSpaceStepMany(pooled.ptr, @intCast(nspaces), dt);
+  const t2 = nanos();
+
+  try report(.stepmany, nspaces, nspaces * cfg.steps, t1 - t0, t2 - t1);
+}
+
+/// Run cfg.queries nearest point or first segment queries over a space of
+/// nshapes shapes, one call per query and as a single batch.
+fn query(mode: Mode, nshapes: usize) !void {
+  const gpa = appinit.gpa;
+  var prng = std.Random.DefaultPrng.init(cfg.seed);
+  const rand = prng.random();
+  const width = @sqrt(@as(f64, @floatFromInt(nshapes))) * 4;
+
+  const space = cp.cpSpaceNew();
+  defer freeSpace(space);
+  for (0..nshapes) |i| {
+    const pos = cp.cpVect{ .x = rand.float(f64) * width, .y = rand.float(f64) * width };
+    if (i % 2 == 1) {
+      _ = cp.cpSpaceAddShape(space, cp.cpCircleShapeNew(cp.cpSpaceGetStaticBody(space), 0.5 + rand.float(f64), pos));
+    } else {
+      const body = cp.cpSpaceAddBody(space, cp.cpBodyNew(1.0, 1.0));
+      cp.cpBodySetPosition(body, pos);
+      _ = cp.cpSpaceAddShape(space, cp.cpBoxShapeNew(body, 1 + rand.float(f64), 1 + rand.float(f64), 0));
+    }
+  }
+  cp.cpSpaceStep(space, dt);
+
+  const n = cfg.queries;
+  const starts = try gpa.alloc(cp.cpVect, n);
+  defer gpa.free(starts);
+  const ends = try gpa.alloc(cp.cpVect, n);
+  defer gpa.free(ends);
+  for (starts, ends) |*a, *b| {
+    a.* = cp.cpVect{ .x = rand.float(f64) * width, .y = rand.float(f64) * width };
+    b.* = cp.cpVect{ .x = a.x + (rand.float(f64) - 0.5) * 20, .y = a.y + (rand.float(f64) - 0.5) * 20 };
+  }
+  const points = try gpa.alloc(cp.cpPointQueryInfo, n);
+  defer gpa.free(points);
+  const segments = try gpa.alloc(cp.cpSegmentQueryInfo, n);
+  defer gpa.free(segments);
+
+  const filter = cp.CP_SHAPE_FILTER_ALL;
+  var ns: [2]u64 = undefined;
+  // the first round only warms up the caches
+  for (0..2) |_| {
+    const t0 = nanos();
+    if (mode == .pointquery) {
+      for (starts, points) |a, *p| _ = cp.cpSpacePointQueryNearest(space, a, 5, filter, p);
+    } else {
+      for (starts, ends, segments) |a, b, *sq| _ = cp.cpSpaceSegmentQueryFirst(space, a, b, 0.25, filter, sq);
+    }
+    const t1 = nanos();
+    if (mode == .pointquery) {
+      cp.cpSpacePointQueryNearestBatch(space, starts.ptr, @intCast(n), 5, filter, points.ptr);
+    } else {
+      cp.cpSpaceSegmentQueryFirstBatch(space, starts.ptr, ends.ptr, @intCast(n), 0.25, filter, segments.ptr);
+    }
+    ns = .{ t1 - t0, nanos() - t1 };
+  }
+
+  try report(mode, nshapes, n, ns[0], ns[1]);
+}
+
+/// Write a result as a JSON line to stdout and a summary to stderr.
+/// 'size' is the space count of stepmany and the shape count of queries;
+/// 'ops' is the number of space steps or queries timed by each run.
+fn report(mode: Mode, size: usize, ops: usize, serial_ns: u64, pooled_ns: u64) !void {
+  const n: f64 = @floatFromInt(@max(ops, 1));
+  const serial_us = @as(f64, @floatFromInt(serial_ns)) * 1e-3 / n;
+  const pooled_us = @as(f64, @floatFromInt(pooled_ns)) * 1e-3 / n;
+  const speedup = serial_us / @max(pooled_us, 1e-9);
+  const nthreads = cp.cpTaskPoolGetThreads();
+  const size_name = if (mode == .stepmany) "spaces" else "shapes";
+
+  var buf: [512]u8 = undefined;
+  const line = try std.fmt.bufPrint(&buf,
+    "{{\"benchmark\":\"{s}\",\"{s}\":{d},\"threads\":{d},\"ops\":{d}," ++
+    "\"serial_us\":{d:.3},\"pooled_us\":{d:.3},\"speedup\":{d:.2}}}\n", .{
+    @tagName(mode), size_name, size, nthreads, ops, serial_us, pooled_us, speedup,
+  });
+  try Io.File.stdout().writeStreamingAll(appinit.io, line);
+  std.debug.print("{s:<14} {d:>6} {s} {d:>3} thr: serial {d:>9.3} us, pooled {d:>9.3} us, x{d:.2}\n", .{
+    @tagName(mode), size, size_name, nthreads, serial_us, pooled_us, speedup});
+}
+
+//#endregion ==================================================================
+//#region MARK: UTIL
+//=============================================================================
+/// A pile of balls above the ground; 'seed' shifts them so spaces differ.
+fn ballPile(seed: usize, bodies: usize) ?*cp.cpSpace {
+  const space = cp.cpSpaceNew();
+  cp.cpSpaceSetGravity(space, cp.cpVect{ .x = 0, .y = -100 });
+  const ground = cp.cpSegmentShapeNew(cp.cpSpaceGetStaticBody(space), cp.cpVect{ .x = -50, .y = -15 }, cp.cpVect{ .x = 50, .y = -15 }, 0);
+  cp.cpShapeSetFriction(ground, 1);
+  _ = cp.cpSpaceAddShape(space, ground);
+  for (0..bodies) |i| {
+    const body = cp.cpSpaceAddBody(space, cp.cpBodyNew(1.0, cp.cpMomentForCircle(1.0, 0, 1, cp.cpvzero)));
+    cp.cpBodySetPosition(body, cp.cpVect{
+      .x = @as(f64, @floatFromInt(i % 10)) * 2.5 - 12 + 0.1 * @as(f64, @floatFromInt(seed % 7)),
+      .y = @as(f64, @floatFromInt(i / 10)) * 2.5 + 0.05 * @as(f64, @floatFromInt(seed % 13)),
+    });
+    const shape = cp.cpSpaceAddShape(space, cp.cpCircleShapeNew(body, 1, cp.cpvzero));
+    cp.cpShapeSetFriction(shape, 0.7);
+  }
+  return space;
+}
+
+fn freeShape(space: ?*cp.cpSpace, shape: ?*anyopaque, data: ?*anyopaque) callconv(.c) void {
+  _ = data;
+  cp.cpSpaceRemoveShape(space, @ptrCast(shape));
+  cp.cpShapeFree(@ptrCast(shape));
+}
+
+fn freeBody(space: ?*cp.cpSpace, body: ?*anyopaque, data: ?*anyopaque) callconv(.c) void {
+  _ = data;
+  cp.cpSpaceRemoveBody(space, @ptrCast(body));
+  cp.cpBodyFree(@ptrCast(body));
+}
+
+fn postFreeShape(shape: ?*cp.cpShape, data: ?*anyopaque) callconv(.c) void {
+  const space: ?*cp.cpSpace = @ptrCast(data);
+  _ = cp.cpSpaceAddPostStepCallback(space, freeShape, shape, null);
+}
+
+fn postFreeBody(body: ?*cp.cpBody, data: ?*anyopaque) callconv(.c) void {
+  const space: ?*cp.cpSpace = @ptrCast(data);
+  _ = cp.cpSpaceAddPostStepCallback(space, freeBody, body, null);
+}
+
+/// Free a space with its shapes and bodies; cpSpaceFree() leaves them.
+fn freeSpace(space: ?*cp.cpSpace) void {
+  cp.cpSpaceEachShape(space, postFreeShape, space);
+  cp.cpSpaceEachBody(space, postFreeBody, space);
+  cp.cpSpaceFree(space);
+}
+
+fn nanos() u64 {
+  var ts: ctime.struct_timespec = undefined;
+  _ = ctime.timespec_get(&ts, ctime.TIME_UTC);
+  return @as(u64, @intCast(ts.tv_sec)) * 1000000000 + @as(u64, @intCast(ts.tv_nsec));
+}
+
+fn parseList(arena: std.mem.Allocator, s: []const u8) ![]const usize {
+  const list = try arena.alloc(usize, std.mem.count(u8, s, ",") + 1);
+  var it = std.mem.splitScalar(u8, s, ',');
+  for (list) |*n| n.* = try std.fmt.parseInt(usize, it.next().?, 10);
+  return list;
+}
+
+fn parseArgs(arena: std.mem.Allocator, args: anytype) !void {
+  for (args[1..]) |arg| {
+    if (std.mem.eql(u8, arg, "--help") or std.mem.eql(u8, arg, "-h")) return error.Help;
+    const eq = std.mem.indexOfScalar(u8, arg, '=') orelse {
+      std.debug.print("Bad argument: {s}\n", .{arg});
+      return error.BadArgument;
+    };
+    const name = arg[0..eq];
+    const val = arg[eq + 1 ..];
+    if (std.mem.eql(u8, name, "--benchmarks")) {
+      const list = try arena.alloc(Mode, std.mem.count(u8, val, ",") + 1);
+      var it = std.mem.splitScalar(u8, val, ',');
+      for (list) |*m| {
+        const s = it.next().?;
+        m.* = std.meta.stringToEnum(Mode, s) orelse {
+          std.debug.print("Unknown benchmark: {s}\n", .{s});
+          return error.BadArgument;
+        };
+      }
+      cfg.benchmarks = list;
+    } else if (std.mem.eql(u8, name, "--spaces")) {
+      cfg.spaces = try parseList(arena, val);
+    } else if (std.mem.eql(u8, name, "--threads")) {
+      cfg.threads = try parseList(arena, val);
+    } else if (std.mem.eql(u8, name, "--bodies")) {
+      cfg.bodies = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--steps")) {
+      cfg.steps = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--shapes")) {
+      cfg.shapes = try parseList(arena, val);
+    } else if (std.mem.eql(u8, name, "--queries")) {
+      cfg.queries = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--seed")) {
+      cfg.seed = try std.fmt.parseInt(u64, val, 10);
+    } else {
+      std.debug.print("Unknown option: {s}\n", .{name});
+      return error.BadArgument;
+    }
+  }
+  for (cfg.spaces) |n| if (n == 0 or n > std.math.maxInt(c_int)) return error.BadArgument;
+  if (cfg.queries == 0 or cfg.queries > std.math.maxInt(c_int)) return error.BadArgument;
+}
+
+//#endregion ==================================================================
+//=============================================================================
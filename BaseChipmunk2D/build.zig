@@ -17,6 +17,7 @@ pub fn build(b: *std.Build) void {
 
   const projectname = "BaseChipmunk2D";
   const mainfile = "main.zig";
+  const benchfile = "bench.zig";
 
   const exe = b.addExecutable(.{
     .name = projectname,
@@ -97,6 +98,36 @@ pub fn build(b: *std.Build) void {
   const run_step = b.step("run", "Run the app");
   run_step.dependOn(&run_cmd.step);
 
+//#endregion ==================================================================
+//#region MARK: BENCH
+//=============================================================================
+  const bench = b.addExecutable(.{
+    .name = projectname ++ "Bench",
+    .root_module = b.createModule(.{
+      .root_source_file = b.path(benchfile),
+      .target = target,
+      .optimize = optimize,
+      .link_libc = true,
+    }),
+  });
+  bench.root_module.addIncludePath( b.path(".") );
+  bench.root_module.addIncludePath( b.path("lib/chipmunk/include") );
+  inline for (c_srcs) |c_cpp| {
+    bench.root_module.addCSourceFile(.{
+      .file = b.path(c_cpp),
+      .flags = &.{ "-DNDEBUG" }
+    });
+  }
+  b.installArtifact(bench);
+
+  const bench_cmd = b.addRunArtifact(bench);
+  bench_cmd.step.dependOn(b.getInstallStep());
+  if (b.args) |args| {
+    bench_cmd.addArgs(args);
+  }
+  const bench_step = b.step("bench", "Run the benchmarks (zig build bench -- --help)");
+  bench_step.dependOn(&bench_cmd.step);
+
 //#endregion ==================================================================
 //#region MARK: TEST
 //=============================================================================
@@ -108,6 +139,14 @@ pub fn build(b: *std.Build) void {
       .link_libc = true,
     }),
   });
+  unit_tests.root_module.addIncludePath( b.path(".") );
+  unit_tests.root_module.addIncludePath( b.path("lib/chipmunk/include") );
+  inline for (c_srcs) |c_cpp| {
+    unit_tests.root_module.addCSourceFile(.{
+      .file = b.path(c_cpp),
+      .flags = &.{ "-DNDEBUG" }
+    });
+  }
   const run_unit_tests = b.addRunArtifact(unit_tests);
   const test_step = b.step("test", "Run unit tests");
   test_step.dependOn(&run_unit_tests.step);
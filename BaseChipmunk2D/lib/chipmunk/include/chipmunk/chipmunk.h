@@ -115,6 +115,18 @@ typedef struct cpSpace cpSpace;
 /// Version string.
 CP_EXPORT extern const char *cpVersionString;
 
+/// Running totals of the memory allocations Chipmunk has made on the calling thread.
+/// Take a snapshot before and after a call to see if it touched the allocator.
+typedef struct cpAllocationCounters {
+	/// Number of calls to cpcalloc() and cprealloc().
+	unsigned long allocations;
+	/// Number of calls to cpfree().
+	unsigned long frees;
+} cpAllocationCounters;
+
+/// Get the allocation counters for the calling thread.
+CP_EXPORT cpAllocationCounters cpGetAllocationCounters(void);
+
 /// Calculate the moment of inertia for a circle.
 /// @c r1 and @c r2 are the inner and outer diameters. A solid circle has an inner diameter of 0.
 CP_EXPORT cpFloat cpMomentForCircle(cpFloat m, cpFloat r1, cpFloat r2, cpVect offset);
@@ -14,12 +14,53 @@
 #define MAGIC_EPSILON 1e-5
 
 
+//MARK: Allocation Counters
+
+#if defined(_MSC_VER)
+	#define CP_THREAD_LOCAL __declspec(thread)
+#else
+	#define CP_THREAD_LOCAL __thread
+#endif
+
+extern CP_THREAD_LOCAL cpAllocationCounters cpAllocationCountersTLS;
+
+// Wrap the (possibly user defined) allocator aliases so internal allocations are counted.
+static inline void *
+cpcallocCounted(size_t count, size_t size)
+{
+	cpAllocationCountersTLS.allocations++;
+	return cpcalloc(count, size);
+}
+
+static inline void *
+cpreallocCounted(void *ptr, size_t size)
+{
+	cpAllocationCountersTLS.allocations++;
+	return cprealloc(ptr, size);
+}
+
+static inline void
+cpfreeCounted(void *ptr)
+{
+	if(ptr) cpAllocationCountersTLS.frees++;
+	cpfree(ptr);
+}
+
+#undef cpcalloc
+#undef cprealloc
+#undef cpfree
+#define cpcalloc cpcallocCounted
+#define cprealloc cpreallocCounted
+#define cpfree cpfreeCounted
+
+
 //MARK: cpArray
 
 cpArray *cpArrayNew(int size);
 
 void cpArrayFree(cpArray *arr);
 
+void cpArrayReserve(cpArray *arr, int size);
 void cpArrayPush(cpArray *arr, void *object);
 void *cpArrayPop(cpArray *arr);
 void cpArrayDeleteObj(cpArray *arr, void *obj);
@@ -37,6 +78,7 @@ cpHashSet *cpHashSetNew(int size, cpHashSetEqlFunc eqlFunc);
 void cpHashSetSetDefaultValue(cpHashSet *set, void *default_value);
 
 void cpHashSetFree(cpHashSet *set);
+void cpHashSetReserve(cpHashSet *set, int count);
 
 int cpHashSetCount(cpHashSet *set);
 const void *cpHashSetInsert(cpHashSet *set, cpHashValue hash, const void *ptr, cpHashSetTransFunc trans, void *data);
@@ -50,6 +92,14 @@ typedef cpBool (*cpHashSetFilterFunc)(void *elt, void *data);
 void cpHashSetFilter(cpHashSet *set, cpHashSetFilterFunc func, void *data);
 
 
+//MARK: Task Pool
+
+typedef void (*cpTaskPoolFunc)(void *data, unsigned long index);
+
+// Invokes func once for every index in [0, count) across the shared task pool threads and waits for completion.
+void cpTaskPoolRun(cpTaskPoolFunc func, void *data, unsigned long count);
+
+
 //MARK: Bodies
 
 void cpBodyAddShape(cpBody *body, cpShape *shape);
@@ -65,6 +115,24 @@ void cpBodyRemoveConstraint(cpBody *body, cpConstraint *constraint);
 
 cpSpatialIndex *cpSpatialIndexInit(cpSpatialIndex *index, cpSpatialIndexClass *klass, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
 
+// Preallocate node, leaf and pair pools. Ignored for other spatial index types.
+void cpBBTreeReserve(cpSpatialIndex *index, int leaves, int pairs);
+
+// Maximum number of queries traversing a cpBBTree together.
+#define CP_BBTREE_PACKET_SIZE 16
+
+typedef void (*cpBBTreePacketQueryFunc)(void *obj, int query, void *data);
+typedef cpFloat (*cpBBTreePacketSegmentQueryFunc)(void *obj, int query, void *data);
+
+// Tree queries are read only, so unlike the other index types they can run from several threads at once.
+cpBool cpSpatialIndexIsBBTree(cpSpatialIndex *index);
+
+// Run up to CP_BBTREE_PACKET_SIZE queries with a single walk of the tree.
+// A subtree is only visited by the queries whose bounds (or segments up to t_exit) overlap it.
+// Returns cpFalse without doing anything if the index is not a cpBBTree.
+cpBool cpBBTreeQueryPacket(cpSpatialIndex *index, const cpBB *bbs, int count, cpBBTreePacketQueryFunc func, void *data);
+cpBool cpBBTreeSegmentQueryPacket(cpSpatialIndex *index, const cpVect *a, const cpVect *b, cpFloat *t_exit, int count, cpBBTreePacketSegmentQueryFunc func, void *data);
+
 
 //MARK: Arbiters
 
@@ -268,6 +336,9 @@ void cpSpacePushFreshContactBuffer(cpSpace *space);
 struct cpContact *cpContactBufferGetArray(cpSpace *space);
 void cpSpacePushContacts(cpSpace *space, int count);
 
+struct cpContact *cpSpacePopSleepingContacts(cpSpace *space);
+void cpSpaceRecycleSleepingContacts(cpSpace *space, struct cpContact *contacts);
+
 cpPostStepCallback *cpSpaceGetPostStepCallback(cpSpace *space, void *key);
 
 cpBool cpSpaceArbiterSetFilter(cpArbiter *arb, cpSpace *space);
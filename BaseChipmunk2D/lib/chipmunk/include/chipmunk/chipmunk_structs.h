@@ -408,6 +408,7 @@ struct cpSpace {
 	cpContactBufferHeader *contactBuffersHead;
 	cpHashSet *cachedArbiters;
 	cpArray *pooledArbiters;
+	cpArray *pooledContacts;
 	
 	cpArray *allocatedBuffers;
 	int locked;
@@ -25,3 +25,17 @@ CP_EXPORT unsigned long cpHastySpaceGetThreads(cpSpace *space);
 
 /// When stepping a hasty space, you must use this function.
 CP_EXPORT void cpHastySpaceStep(cpSpace *space, cpFloat dt);
+
+/// Set the number of threads in the process wide task pool shared by all spaces.
+/// The pool starts out single threaded. Passing 0 will use the number of processors reported by the OS.
+/// Must not be called while cpSpaceStepMany() is running.
+CP_EXPORT void cpTaskPoolSetThreads(unsigned long threads);
+
+/// Returns the number of threads in the shared task pool (including the calling thread).
+CP_EXPORT unsigned long cpTaskPoolGetThreads(void);
+
+/// Step @c count independent spaces forward in time by @c dt using the shared task pool.
+/// Whole spaces are handed out to the pool workers, so each space is stepped by exactly one thread using cpSpaceStep().
+/// Hasty spaces can be passed too, but their private solver threads are not used.
+/// Callbacks for different spaces may run concurrently and must not share unsynchronized state.
+CP_EXPORT void cpSpaceStepMany(cpSpace **spaces, int count, cpFloat dt);
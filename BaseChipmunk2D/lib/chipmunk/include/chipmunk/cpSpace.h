@@ -188,6 +188,15 @@ CP_EXPORT void cpSpaceSegmentQuery(cpSpace *space, cpVect start, cpVect end, cpF
 /// Perform a directed line segment query (like a raycast) against the space and return the first shape hit. Returns NULL if no shapes were hit.
 CP_EXPORT cpShape *cpSpaceSegmentQueryFirst(cpSpace *space, cpVect start, cpVect end, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo *out);
 
+/// Run cpSpacePointQueryNearest() for @c count points and write the results to @c out[i].
+/// Queries are grouped into spatially coherent packets that walk the spatial index together,
+/// and the packets are spread across the shared task pool (see cpTaskPoolSetThreads()).
+CP_EXPORT void cpSpacePointQueryNearestBatch(cpSpace *space, const cpVect *points, int count, cpFloat maxDistance, cpShapeFilter filter, cpPointQueryInfo *out);
+/// Run cpSpaceSegmentQueryFirst() for @c count segments and write the results to @c out[i].
+/// Queries are grouped into spatially coherent packets that walk the spatial index together,
+/// and the packets are spread across the shared task pool (see cpTaskPoolSetThreads()).
+CP_EXPORT void cpSpaceSegmentQueryFirstBatch(cpSpace *space, const cpVect *starts, const cpVect *ends, int count, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo *out);
+
 /// Rectangle Query callback function type.
 typedef void (*cpSpaceBBQueryFunc)(cpShape *shape, void *data);
 /// Perform a fast rectangle query on the space calling @c func for each shape found.
@@ -236,6 +245,12 @@ CP_EXPORT void cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count);
 /// Step the space forward in time by @c dt.
 CP_EXPORT void cpSpaceStep(cpSpace *space, cpFloat dt);
 
+/// Preallocate the space's internal pools for about @c arbiters simultaneously colliding shape pairs.
+/// Arbiters, contact buffers and the arbiter cache are recycled from fixed size slabs,
+/// so once the space has been stepped a few times at or below this size cpSpaceStep() will not allocate.
+/// Use cpGetAllocationCounters() to check.
+CP_EXPORT void cpSpaceReserve(cpSpace *space, int arbiters);
+
 
 //MARK: Debug API
 
@@ -35,6 +35,14 @@ cpMessage(const char *condition, const char *file, int line, int isError, int is
 #endif
 }
 
+CP_THREAD_LOCAL cpAllocationCounters cpAllocationCountersTLS = {0, 0};
+
+cpAllocationCounters
+cpGetAllocationCounters(void)
+{
+	return cpAllocationCountersTLS;
+}
+
 #define STR(s) #s
 #define XSTR(s) STR(s)
 
@@ -29,6 +29,15 @@ cpArrayFree(cpArray *arr)
 	}
 }
 
+void
+cpArrayReserve(cpArray *arr, int size)
+{
+	if(size > arr->max){
+		arr->max = size;
+		arr->arr = (void **)cprealloc(arr->arr, arr->max*sizeof(void*));
+	}
+}
+
 void
 cpArrayPush(cpArray *arr, void *object)
 {
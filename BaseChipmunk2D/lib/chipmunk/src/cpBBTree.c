@@ -121,6 +121,22 @@ PairRecycle(cpBBTree *tree, Pair *pair)
 	tree->pooledPairs = pair;
 }
 
+// Allocate a buffer of pairs and pool all of them, returns how many.
+static int
+PairAllocBuffer(cpBBTree *tree)
+{
+	tree = GetMasterTree(tree);
+	
+	int count = CP_BUFFER_BYTES/sizeof(Pair);
+	cpAssertHard(count, "Internal Error: Buffer size is too small.");
+	
+	Pair *buffer = (Pair *)cpcalloc(1, CP_BUFFER_BYTES);
+	cpArrayPush(tree->allocatedBuffers, buffer);
+	
+	for(int i=0; i<count; i++) PairRecycle(tree, buffer + i);
+	return count;
+}
+
 static Pair *
 PairFromPool(cpBBTree *tree)
 {
@@ -128,23 +144,12 @@ PairFromPool(cpBBTree *tree)
 	// TODO: would be lovely to move the pairs stuff into an external data structure.
 	tree = GetMasterTree(tree);
 	
-	Pair *pair = tree->pooledPairs;
+	// Pool is exhausted, make more
+	if(!tree->pooledPairs) PairAllocBuffer(tree);
 	
-	if(pair){
-		tree->pooledPairs = pair->a.next;
-		return pair;
-	} else {
-		// Pool is exhausted, make more
-		int count = CP_BUFFER_BYTES/sizeof(Pair);
-		cpAssertHard(count, "Internal Error: Buffer size is too small.");
-		
-		Pair *buffer = (Pair *)cpcalloc(1, CP_BUFFER_BYTES);
-		cpArrayPush(tree->allocatedBuffers, buffer);
-		
-		// push all but the first one, return the first instead
-		for(int i=1; i<count; i++) PairRecycle(tree, buffer + i);
-		return buffer;
-	}
+	Pair *pair = tree->pooledPairs;
+	tree->pooledPairs = pair->a.next;
+	return pair;
 }
 
 static inline void
@@ -214,26 +219,29 @@ NodeRecycle(cpBBTree *tree, Node *node)
 	tree->pooledNodes = node;
 }
 
+// Allocate a buffer of nodes and pool all of them, returns how many.
+static int
+NodeAllocBuffer(cpBBTree *tree)
+{
+	int count = CP_BUFFER_BYTES/sizeof(Node);
+	cpAssertHard(count, "Internal Error: Buffer size is too small.");
+	
+	Node *buffer = (Node *)cpcalloc(1, CP_BUFFER_BYTES);
+	cpArrayPush(tree->allocatedBuffers, buffer);
+	
+	for(int i=0; i<count; i++) NodeRecycle(tree, buffer + i);
+	return count;
+}
+
 static Node *
 NodeFromPool(cpBBTree *tree)
 {
-	Node *node = tree->pooledNodes;
+	// Pool is exhausted, make more
+	if(!tree->pooledNodes) NodeAllocBuffer(tree);
 	
-	if(node){
-		tree->pooledNodes = node->parent;
-		return node;
-	} else {
-		// Pool is exhausted, make more
-		int count = CP_BUFFER_BYTES/sizeof(Node);
-		cpAssertHard(count, "Internal Error: Buffer size is too small.");
-		
-		Node *buffer = (Node *)cpcalloc(1, CP_BUFFER_BYTES);
-		cpArrayPush(tree->allocatedBuffers, buffer);
-		
-		// push all but the first one, return the first instead
-		for(int i=1; i<count; i++) NodeRecycle(tree, buffer + i);
-		return buffer;
-	}
+	Node *node = tree->pooledNodes;
+	tree->pooledNodes = node->parent;
+	return node;
 }
 
 static inline void
@@ -666,6 +674,195 @@ cpBBTreeQuery(cpBBTree *tree, void *obj, cpBB bb, cpSpatialIndexQueryFunc func,
 	if(tree->root) SubtreeQuery(tree->root, obj, bb, func, data);
 }
 
+//MARK: Packet Query
+
+struct QueryPacket {
+	const cpBB *bbs;
+	const cpVect *a, *b;
+	cpFloat *t_exit;
+	
+	// Reciprocal segment deltas, INFINITY for axis aligned segments.
+	cpVect inv[CP_BBTREE_PACKET_SIZE];
+	
+	cpBBTreePacketQueryFunc func;
+	cpBBTreePacketSegmentQueryFunc segmentFunc;
+	void *data;
+};
+
+static void
+SubtreeQueryPacket(Node *subtree, struct QueryPacket *packet, const unsigned char *active, int activeCount)
+{
+	unsigned char hits[CP_BBTREE_PACKET_SIZE];
+	int hitCount = 0;
+	
+	for(int i=0; i<activeCount; i++){
+		if(cpBBIntersects(subtree->bb, packet->bbs[active[i]])) hits[hitCount++] = active[i];
+	}
+	
+	if(hitCount == 0) return;
+	
+	if(NodeIsLeaf(subtree)){
+		for(int i=0; i<hitCount; i++) packet->func(subtree->obj, hits[i], packet->data);
+	} else {
+		SubtreeQueryPacket(subtree->A, packet, hits, hitCount);
+		SubtreeQueryPacket(subtree->B, packet, hits, hitCount);
+	}
+}
+
+// cpBBSegmentQuery() with the divisions hoisted out since each segment in a packet is tested against many boxes.
+static inline cpFloat
+PacketSegmentQueryBB(struct QueryPacket *packet, int q, cpBB bb)
+{
+	cpVect a = packet->a[q], inv = packet->inv[q];
+	cpFloat tmin = -INFINITY, tmax = INFINITY;
+	
+	if(inv.x == INFINITY){
+		if(a.x < bb.l || bb.r < a.x) return INFINITY;
+	} else {
+		cpFloat t1 = (bb.l - a.x)*inv.x;
+		cpFloat t2 = (bb.r - a.x)*inv.x;
+		tmin = cpfmax(tmin, cpfmin(t1, t2));
+		tmax = cpfmin(tmax, cpfmax(t1, t2));
+	}
+	
+	if(inv.y == INFINITY){
+		if(a.y < bb.b || bb.t < a.y) return INFINITY;
+	} else {
+		cpFloat t1 = (bb.b - a.y)*inv.y;
+		cpFloat t2 = (bb.t - a.y)*inv.y;
+		tmin = cpfmax(tmin, cpfmin(t1, t2));
+		tmax = cpfmin(tmax, cpfmax(t1, t2));
+	}
+	
+	if(tmin <= tmax && 0.0f <= tmax && tmin <= 1.0f){
+		return cpfmax(tmin, 0.0f);
+	} else {
+		return INFINITY;
+	}
+}
+
+// Same as SubtreeSegmentQuery(), used once a packet has narrowed down to a single query.
+static cpFloat
+SubtreeSegmentQueryPacketSingle(Node *subtree, struct QueryPacket *packet, int q, cpFloat t_exit)
+{
+	if(NodeIsLeaf(subtree)){
+		return packet->segmentFunc(subtree->obj, q, packet->data);
+	} else {
+		cpFloat t_a = PacketSegmentQueryBB(packet, q, subtree->A->bb);
+		cpFloat t_b = PacketSegmentQueryBB(packet, q, subtree->B->bb);
+		
+		if(t_a < t_b){
+			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQueryPacketSingle(subtree->A, packet, q, t_exit));
+			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQueryPacketSingle(subtree->B, packet, q, t_exit));
+		} else {
+			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQueryPacketSingle(subtree->B, packet, q, t_exit));
+			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQueryPacketSingle(subtree->A, packet, q, t_exit));
+		}
+		
+		return t_exit;
+	}
+}
+
+static void
+SubtreeSegmentQueryPacket(Node *subtree, struct QueryPacket *packet, const unsigned char *active, int activeCount)
+{
+	if(activeCount == 1){
+		int q = active[0];
+		packet->t_exit[q] = cpfmin(packet->t_exit[q], SubtreeSegmentQueryPacketSingle(subtree, packet, q, packet->t_exit[q]));
+	} else if(NodeIsLeaf(subtree)){
+		for(int i=0; i<activeCount; i++){
+			int q = active[i];
+			packet->t_exit[q] = cpfmin(packet->t_exit[q], packet->segmentFunc(subtree->obj, q, packet->data));
+		}
+	} else {
+		cpFloat t_a[CP_BBTREE_PACKET_SIZE], t_b[CP_BBTREE_PACKET_SIZE];
+		for(int i=0; i<activeCount; i++){
+			int q = active[i];
+			t_a[i] = PacketSegmentQueryBB(packet, q, subtree->A->bb);
+			t_b[i] = PacketSegmentQueryBB(packet, q, subtree->B->bb);
+		}
+		
+		// Every query still visits the closer child first, like SubtreeSegmentQuery():
+		// A with the queries closer to A, then B with everything, then A with the queries closer to B.
+		// t_exit is checked again before each pass since the previous ones may have shortened it.
+		unsigned char hits[CP_BBTREE_PACKET_SIZE];
+		int hitCount;
+		
+		hitCount = 0;
+		for(int i=0; i<activeCount; i++){
+			if(t_a[i] < t_b[i] && t_a[i] < packet->t_exit[active[i]]) hits[hitCount++] = active[i];
+		}
+		if(hitCount) SubtreeSegmentQueryPacket(subtree->A, packet, hits, hitCount);
+		
+		hitCount = 0;
+		for(int i=0; i<activeCount; i++){
+			if(t_b[i] < packet->t_exit[active[i]]) hits[hitCount++] = active[i];
+		}
+		if(hitCount) SubtreeSegmentQueryPacket(subtree->B, packet, hits, hitCount);
+		
+		hitCount = 0;
+		for(int i=0; i<activeCount; i++){
+			if(t_a[i] >= t_b[i] && t_a[i] < packet->t_exit[active[i]]) hits[hitCount++] = active[i];
+		}
+		if(hitCount) SubtreeSegmentQueryPacket(subtree->A, packet, hits, hitCount);
+	}
+}
+
+static int
+PacketActiveList(unsigned char *active, int count)
+{
+	cpAssertHard(count <= CP_BBTREE_PACKET_SIZE, "Internal Error: Query packet is too large.");
+	for(int i=0; i<count; i++) active[i] = (unsigned char)i;
+	return count;
+}
+
+cpBool
+cpSpatialIndexIsBBTree(cpSpatialIndex *index)
+{
+	return (index->klass == Klass());
+}
+
+cpBool
+cpBBTreeQueryPacket(cpSpatialIndex *index, const cpBB *bbs, int count, cpBBTreePacketQueryFunc func, void *data)
+{
+	if(index->klass != Klass()) return cpFalse;
+	
+	cpBBTree *tree = (cpBBTree *)index;
+	if(tree->root){
+		unsigned char active[CP_BBTREE_PACKET_SIZE];
+		struct QueryPacket packet = {bbs, NULL, NULL, NULL, {{0.0f, 0.0f}}, func, NULL, data};
+		SubtreeQueryPacket(tree->root, &packet, active, PacketActiveList(active, count));
+	}
+	
+	return cpTrue;
+}
+
+cpBool
+cpBBTreeSegmentQueryPacket(cpSpatialIndex *index, const cpVect *a, const cpVect *b, cpFloat *t_exit, int count, cpBBTreePacketSegmentQueryFunc func, void *data)
+{
+	if(index->klass != Klass()) return cpFalse;
+	cpAssertHard(count <= CP_BBTREE_PACKET_SIZE, "Internal Error: Query packet is too large.");
+	
+	cpBBTree *tree = (cpBBTree *)index;
+	Node *root = tree->root;
+	if(root){
+		struct QueryPacket packet = {NULL, a, b, t_exit, {{0.0f, 0.0f}}, NULL, func, data};
+		unsigned char active[CP_BBTREE_PACKET_SIZE];
+		int activeCount = 0;
+		
+		for(int i=0; i<count; i++){
+			cpVect delta = cpvsub(b[i], a[i]);
+			packet.inv[i] = cpv(delta.x == 0.0f ? INFINITY : 1.0f/delta.x, delta.y == 0.0f ? INFINITY : 1.0f/delta.y);
+			
+			if(PacketSegmentQueryBB(&packet, i, root->bb) < t_exit[i]) active[activeCount++] = (unsigned char)i;
+		}
+		
+		if(activeCount) SubtreeSegmentQueryPacket(root, &packet, active, activeCount);
+	}
+	
+	return cpTrue;
+}
+
 //MARK: Misc
 
 static int
@@ -829,6 +1026,26 @@ cpBBTreeOptimize(cpSpatialIndex *index)
 	cpfree(nodes);
 }
 
+void
+cpBBTreeReserve(cpSpatialIndex *index, int leaves, int pairs)
+{
+	if(index->klass != &klass) return;
+	cpBBTree *tree = (cpBBTree *)index;
+	
+	cpHashSetReserve(tree->leaves, leaves);
+	
+	// A tree with n leaves has n - 1 internal nodes.
+	int nodes = 0;
+	for(Node *node = tree->pooledNodes; node; node = node->parent) nodes++;
+	for(int count = cpHashSetCount(tree->leaves); nodes + 2*count < 2*leaves;) nodes += NodeAllocBuffer(tree);
+	
+	// Pairs are pooled by the master tree.
+	cpBBTree *master = GetMasterTree(tree);
+	int pooledPairs = 0;
+	for(Pair *pair = master->pooledPairs; pair; pair = pair->a.next) pooledPairs++;
+	while(pooledPairs < pairs) pooledPairs += PairAllocBuffer(master);
+}
+
 //MARK: Debug Draw
 
 //#define CP_BBTREE_DEBUG_DRAW
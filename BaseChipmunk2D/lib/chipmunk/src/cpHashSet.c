@@ -103,26 +103,41 @@ recycleBin(cpHashSet *set, cpHashSetBin *bin)
 	bin->elt = NULL;
 }
 
+// Allocate a buffer of bins and pool all of them, returns how many.
+static int
+allocBins(cpHashSet *set)
+{
+	int count = CP_BUFFER_BYTES/sizeof(cpHashSetBin);
+	cpAssertHard(count, "Internal Error: Buffer size is too small.");
+	
+	cpHashSetBin *buffer = (cpHashSetBin *)cpcalloc(1, CP_BUFFER_BYTES);
+	cpArrayPush(set->allocatedBuffers, buffer);
+	
+	for(int i=0; i<count; i++) recycleBin(set, buffer + i);
+	return count;
+}
+
 static cpHashSetBin *
 getUnusedBin(cpHashSet *set)
 {
+	// Pool is exhausted, make more
+	if(!set->pooledBins) allocBins(set);
+	
 	cpHashSetBin *bin = set->pooledBins;
+	set->pooledBins = bin->next;
+	return bin;
+}
+
+void
+cpHashSetReserve(cpHashSet *set, int count)
+{
+	while(set->size < (unsigned int)count) cpHashSetResize(set);
 	
-	if(bin){
-		set->pooledBins = bin->next;
-		return bin;
-	} else {
-		// Pool is exhausted, make more
-		int count = CP_BUFFER_BYTES/sizeof(cpHashSetBin);
-		cpAssertHard(count, "Internal Error: Buffer size is too small.");
-		
-		cpHashSetBin *buffer = (cpHashSetBin *)cpcalloc(1, CP_BUFFER_BYTES);
-		cpArrayPush(set->allocatedBuffers, buffer);
-		
-		// push all but the first one, return it instead
-		for(int i=1; i<count; i++) recycleBin(set, buffer + i);
-		return buffer;
-	}
+	// Make sure enough bins are pooled for the remaining entries.
+	int pooled = 0;
+	for(cpHashSetBin *bin = set->pooledBins; bin; bin = bin->next) pooled++;
+	
+	while((int)set->entries + pooled < count) pooled += allocBins(set);
 }
 
 int
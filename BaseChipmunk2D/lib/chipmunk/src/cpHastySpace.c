@@ -14,6 +14,7 @@
 
 #ifndef _WIN32
 #include <pthread.h>
+#include <unistd.h> // sysconf
 #elif defined(__MINGW32__)
 #include <pthread.h>
 #else
@@ -698,3 +699,194 @@ cpHastySpaceStep(cpSpace *space, cpFloat dt)
 		}
 	} cpSpaceUnlock(space, cpTrue);
 }
+
+//MARK: Shared Task Pool
+
+// Upper bound on the process wide worker count (including the calling thread).
+#define CP_TASK_POOL_MAX_THREADS 64
+
+// A single set of worker threads shared by every space in the process.
+// Unlike the per-space hasty workers, the pool is sized once for the machine
+// so that stepping many small spaces does not oversubscribe the cores.
+static struct cpTaskPool {
+	cpBool initialized;
+	cpBool quit;
+	
+	// Number of worker threads (including the calling thread)
+	unsigned long num_threads;
+	
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_work, cond_done;
+	
+	// Current batch of tasks. Bumping the generation wakes the workers.
+	cpTaskPoolFunc func;
+	void *data;
+	unsigned long count, next, pending;
+	unsigned long generation;
+	
+	pthread_t threads[CP_TASK_POOL_MAX_THREADS - 1];
+} TaskPool;
+
+// Runs tasks from the current batch until none are left to claim.
+// Must be called with the pool mutex held.
+static void
+TaskPoolDrain(struct cpTaskPool *pool)
+{
+	while(pool->next < pool->count){
+		unsigned long index = pool->next++;
+		cpTaskPoolFunc func = pool->func;
+		void *data = pool->data;
+		
+		pthread_mutex_unlock(&pool->mutex); {
+			func(data, index);
+		} pthread_mutex_lock(&pool->mutex);
+		
+		if(--pool->pending == 0){
+			pthread_cond_broadcast(&pool->cond_done);
+		}
+	}
+}
+
+static void *
+TaskPoolWorkerLoop(void *unused)
+{
+	struct cpTaskPool *pool = &TaskPool;
+	
+	pthread_mutex_lock(&pool->mutex); {
+		unsigned long seen = pool->generation;
+		
+		for(;;){
+			while(pool->generation == seen && !pool->quit){
+				pthread_cond_wait(&pool->cond_work, &pool->mutex);
+			}
+			
+			if(pool->quit) break;
+			
+			seen = pool->generation;
+			TaskPoolDrain(pool);
+		}
+	} pthread_mutex_unlock(&pool->mutex);
+	
+	return NULL;
+}
+
+static void
+TaskPoolHalt(struct cpTaskPool *pool)
+{
+	pthread_mutex_lock(&pool->mutex); {
+		pool->quit = cpTrue;
+		pthread_cond_broadcast(&pool->cond_work);
+	} pthread_mutex_unlock(&pool->mutex);
+	
+	for(unsigned long i=0; i<(pool->num_threads-1); i++){
+		pthread_join(pool->threads[i], NULL);
+	}
+	
+	pool->num_threads = 1;
+	pool->quit = cpFalse;
+}
+
+void
+cpTaskPoolSetThreads(unsigned long threads)
+{
+	struct cpTaskPool *pool = &TaskPool;
+	
+	if(!pool->initialized){
+		pthread_mutex_init(&pool->mutex, NULL);
+		pthread_cond_init(&pool->cond_work, NULL);
+		pthread_cond_init(&pool->cond_done, NULL);
+		
+		pool->num_threads = 1;
+		pool->initialized = cpTrue;
+	} else {
+		TaskPoolHalt(pool);
+	}
+	
+	if(threads == 0){
+#if defined(__APPLE__)
+		size_t size = sizeof(threads);
+		sysctlbyname("hw.ncpu", &threads, &size, NULL, 0);
+#elif defined(_WIN32) && !defined(__MINGW32__)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		threads = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (ncpu > 0 ? (unsigned long)ncpu : 1);
+#endif
+		if(threads == 0) threads = 1;
+	}
+	
+	pool->num_threads = (threads < CP_TASK_POOL_MAX_THREADS ? threads : CP_TASK_POOL_MAX_THREADS);
+	
+	for(unsigned long i=0; i<(pool->num_threads-1); i++){
+		pthread_create(&pool->threads[i], NULL, TaskPoolWorkerLoop, NULL);
+	}
+}
+
+unsigned long
+cpTaskPoolGetThreads(void)
+{
+	return (TaskPool.initialized ? TaskPool.num_threads : 1);
+}
+
+void
+cpTaskPoolRun(cpTaskPoolFunc func, void *data, unsigned long count)
+{
+	struct cpTaskPool *pool = &TaskPool;
+	
+	if(pool->initialized && pool->num_threads > 1 && count > 1){
+		pthread_mutex_lock(&pool->mutex);
+		
+		// Only one batch can be in flight at a time.
+		// Nested or concurrent calls fall through and run on the calling thread.
+		if(!pool->func){
+			pool->func = func;
+			pool->data = data;
+			pool->count = count;
+			pool->next = 0;
+			pool->pending = count;
+			pool->generation++;
+			
+			pthread_cond_broadcast(&pool->cond_work);
+			TaskPoolDrain(pool);
+			
+			while(pool->pending > 0){
+				pthread_cond_wait(&pool->cond_done, &pool->mutex);
+			}
+			
+			pool->func = NULL;
+			pool->data = NULL;
+			pool->count = pool->next = 0;
+			
+			pthread_mutex_unlock(&pool->mutex);
+			return;
+		}
+		
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	
+	for(unsigned long i=0; i<count; i++) func(data, i);
+}
+
+//MARK: Multi-Space Stepping
+
+struct StepManyContext {
+	cpSpace **spaces;
+	cpFloat dt;
+};
+
+static void
+StepManyTask(struct StepManyContext *context, unsigned long index)
+{
+	cpSpaceStep(context->spaces[index], context->dt);
+}
+
+void
+cpSpaceStepMany(cpSpace **spaces, int count, cpFloat dt)
+{
+	if(count <= 0) return;
+	
+	struct StepManyContext context = {spaces, dt};
+	cpTaskPoolRun((cpTaskPoolFunc)StepManyTask, &context, (unsigned long)count);
+}
@@ -139,6 +139,7 @@ cpSpaceInit(cpSpace *space)
 	
 	space->arbiters = cpArrayNew(0);
 	space->pooledArbiters = cpArrayNew(0);
+	space->pooledContacts = cpArrayNew(0);
 	
 	space->contactBuffersHead = NULL;
 	space->cachedArbiters = cpHashSetNew(0, (cpHashSetEqlFunc)arbiterSetEql);
@@ -186,6 +187,7 @@ cpSpaceDestroy(cpSpace *space)
 	
 	cpArrayFree(space->arbiters);
 	cpArrayFree(space->pooledArbiters);
+	cpArrayFree(space->pooledContacts);
 	
 	if(space->allocatedBuffers){
 		cpArrayFreeEach(space->allocatedBuffers, cpfree);
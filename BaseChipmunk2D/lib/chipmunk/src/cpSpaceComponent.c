@@ -50,7 +50,7 @@ cpSpaceActivateBody(cpSpace *space, cpBody *body)
 				arb->stamp = space->stamp;
 				cpArrayPush(space->arbiters, arb);
 				
-				cpfree(contacts);
+				cpSpaceRecycleSleepingContacts(space, contacts);
 			}
 		}
 		
@@ -78,10 +78,9 @@ cpSpaceDeactivateBody(cpSpace *space, cpBody *body)
 		if(body == bodyA || cpBodyGetType(bodyA) == CP_BODY_TYPE_STATIC){
 			cpSpaceUncacheArbiter(space, arb);
 			
-			// Save contact values to a new block of memory so they won't time out
-			size_t bytes = arb->count*sizeof(struct cpContact);
-			struct cpContact *contacts = (struct cpContact *)cpcalloc(1, bytes);
-			memcpy(contacts, arb->contacts, bytes);
+			// Save contact values to a pooled block of memory so they won't time out
+			struct cpContact *contacts = cpSpacePopSleepingContacts(space);
+			memcpy(contacts, arb->contacts, arb->count*sizeof(struct cpContact));
 			arb->contacts = contacts;
 		}
 	}
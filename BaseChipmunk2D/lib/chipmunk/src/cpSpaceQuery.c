@@ -157,6 +157,253 @@ cpSpaceSegmentQueryFirst(cpSpace *space, cpVect start, cpVect end, cpFloat radiu
 	return (cpShape *)out->shape;
 }
 
+//MARK: Batched Query Functions
+
+struct BatchQueryContext {
+	cpSpace *space;
+	const cpVect *starts, *ends;
+	int count;
+	cpFloat radius;
+	cpShapeFilter filter;
+	
+	cpPointQueryInfo *pointOut;
+	cpSegmentQueryInfo *segmentOut;
+	
+	// Query indexes sorted into spatially coherent order.
+	int *order;
+};
+
+struct BatchPacket {
+	struct BatchQueryContext *context;
+	int count;
+	int query[CP_BBTREE_PACKET_SIZE];
+};
+
+typedef struct BatchSortKey {
+	unsigned int key;
+	int index;
+} BatchSortKey;
+
+// LSD radix sort, 8 bits per pass. Stable, and much cheaper than qsort() for large batches.
+static void
+BatchSortKeys(BatchSortKey *keys, BatchSortKey *tmp, int count)
+{
+	for(int shift=0; shift<32; shift+=8){
+		int offsets[256] = {0};
+		for(int i=0; i<count; i++) offsets[(keys[i].key >> shift) & 0xFF]++;
+		
+		for(int i=0, sum=0; i<256; i++){
+			int n = offsets[i];
+			offsets[i] = sum;
+			sum += n;
+		}
+		
+		for(int i=0; i<count; i++) tmp[offsets[(keys[i].key >> shift) & 0xFF]++] = keys[i];
+		
+		BatchSortKey *swap = keys; keys = tmp; tmp = swap;
+	}
+	
+	// An even number of passes leaves the result back in keys.
+}
+
+static unsigned int
+MortonSpread(unsigned int x)
+{
+	x &= 0xFFFF;
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x;
+}
+
+// Sort the queries along a Morton curve through their midpoints so neighboring queries share packets.
+static int *
+BatchQueryOrder(const cpVect *starts, const cpVect *ends, int count)
+{
+	int *order = (int *)cpcalloc(count, sizeof(int));
+	
+	if(count <= CP_BBTREE_PACKET_SIZE){
+		for(int i=0; i<count; i++) order[i] = i;
+		return order;
+	}
+	
+	cpVect *mids = (cpVect *)cpcalloc(count, sizeof(cpVect));
+	cpBB bb = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+	for(int i=0; i<count; i++){
+		mids[i] = (ends ? cpvlerp(starts[i], ends[i], 0.5f) : starts[i]);
+		bb = cpBBExpand(bb, mids[i]);
+	}
+	
+	cpFloat sx = (bb.r > bb.l ? 65535.0f/(bb.r - bb.l) : 0.0f);
+	cpFloat sy = (bb.t > bb.b ? 65535.0f/(bb.t - bb.b) : 0.0f);
+	
+	BatchSortKey *keys = (BatchSortKey *)cpcalloc(2*count, sizeof(BatchSortKey));
+	for(int i=0; i<count; i++){
+		unsigned int x = (unsigned int)((mids[i].x - bb.l)*sx);
+		unsigned int y = (unsigned int)((mids[i].y - bb.b)*sy);
+		keys[i].key = MortonSpread(x) | (MortonSpread(y) << 1);
+		keys[i].index = i;
+	}
+	
+	BatchSortKeys(keys, keys + count, count);
+	for(int i=0; i<count; i++) order[i] = keys[i].index;
+	
+	cpfree(keys);
+	cpfree(mids);
+	return order;
+}
+
+// Other index types keep per query state and must be queried from one thread.
+static cpBool
+BatchQueryThreaded(cpSpace *space)
+{
+	return (cpSpatialIndexIsBBTree(space->dynamicShapes) && cpSpatialIndexIsBBTree(space->staticShapes));
+}
+
+static void
+BatchPacketInit(struct BatchPacket *packet, struct BatchQueryContext *context, unsigned long index)
+{
+	int first = (int)index*CP_BBTREE_PACKET_SIZE;
+	int count = context->count - first;
+	
+	packet->context = context;
+	packet->count = (count < CP_BBTREE_PACKET_SIZE ? count : CP_BBTREE_PACKET_SIZE);
+	for(int i=0; i<packet->count; i++) packet->query[i] = context->order[first + i];
+}
+
+static void
+PointQueryNearestPacketLeaf(cpShape *shape, int i, struct BatchPacket *packet)
+{
+	struct BatchQueryContext *context = packet->context;
+	int q = packet->query[i];
+	cpPointQueryInfo *out = context->pointOut + q;
+	
+	if(!cpShapeFilterReject(shape->filter, context->filter) && !shape->sensor){
+		cpPointQueryInfo info;
+		cpShapePointQuery(shape, context->starts[q], &info);
+		
+		if(info.distance < out->distance) (*out) = info;
+	}
+}
+
+static void
+PointQueryNearestPacket(struct BatchQueryContext *context, unsigned long index)
+{
+	struct BatchPacket packet;
+	BatchPacketInit(&packet, context, index);
+	
+	cpFloat maxDistance = context->radius;
+	cpBB bbs[CP_BBTREE_PACKET_SIZE];
+	for(int i=0; i<packet.count; i++){
+		int q = packet.query[i];
+		cpPointQueryInfo info = {NULL, cpvzero, maxDistance, cpvzero};
+		context->pointOut[q] = info;
+		bbs[i] = cpBBNewForCircle(context->starts[q], cpfmax(maxDistance, 0.0f));
+	}
+	
+	cpSpatialIndex *indexes[] = {context->space->dynamicShapes, context->space->staticShapes};
+	for(int n=0; n<2; n++){
+		if(!cpBBTreeQueryPacket(indexes[n], bbs, packet.count, (cpBBTreePacketQueryFunc)PointQueryNearestPacketLeaf, &packet)){
+			// Not a tree, fall back on one query at a time.
+			for(int i=0; i<packet.count; i++){
+				int q = packet.query[i];
+				struct PointQueryContext pointContext = {context->starts[q], maxDistance, context->filter, NULL};
+				cpSpatialIndexQuery(indexes[n], &pointContext, bbs[i], (cpSpatialIndexQueryFunc)NearestPointQueryNearest, context->pointOut + q);
+			}
+		}
+	}
+}
+
+void
+cpSpacePointQueryNearestBatch(cpSpace *space, const cpVect *points, int count, cpFloat maxDistance, cpShapeFilter filter, cpPointQueryInfo *out)
+{
+	if(count <= 0) return;
+	
+	struct BatchQueryContext context = {space, points, NULL, count, maxDistance, filter, out, NULL, BatchQueryOrder(points, NULL, count)};
+	
+	cpSpaceLock(space); {
+		unsigned long packets = (count + CP_BBTREE_PACKET_SIZE - 1)/CP_BBTREE_PACKET_SIZE;
+		if(BatchQueryThreaded(space)){
+			cpTaskPoolRun((cpTaskPoolFunc)PointQueryNearestPacket, &context, packets);
+		} else {
+			for(unsigned long i=0; i<packets; i++) PointQueryNearestPacket(&context, i);
+		}
+	} cpSpaceUnlock(space, cpTrue);
+	
+	cpfree(context.order);
+}
+
+static cpFloat
+SegmentQueryFirstPacketLeaf(cpShape *shape, int i, struct BatchPacket *packet)
+{
+	struct BatchQueryContext *context = packet->context;
+	int q = packet->query[i];
+	cpSegmentQueryInfo *out = context->segmentOut + q;
+	cpSegmentQueryInfo info;
+	
+	if(
+		!cpShapeFilterReject(shape->filter, context->filter) && !shape->sensor &&
+		cpShapeSegmentQuery(shape, context->starts[q], context->ends[q], context->radius, &info) &&
+		info.alpha < out->alpha
+	){
+		(*out) = info;
+	}
+	
+	return out->alpha;
+}
+
+static void
+SegmentQueryFirstPacket(struct BatchQueryContext *context, unsigned long index)
+{
+	struct BatchPacket packet;
+	BatchPacketInit(&packet, context, index);
+	
+	cpVect a[CP_BBTREE_PACKET_SIZE], b[CP_BBTREE_PACKET_SIZE];
+	cpFloat t_exit[CP_BBTREE_PACKET_SIZE];
+	for(int i=0; i<packet.count; i++){
+		int q = packet.query[i];
+		cpSegmentQueryInfo info = {NULL, context->ends[q], cpvzero, 1.0f};
+		context->segmentOut[q] = info;
+		
+		a[i] = context->starts[q];
+		b[i] = context->ends[q];
+		t_exit[i] = 1.0f;
+	}
+	
+	cpSpatialIndex *indexes[] = {context->space->staticShapes, context->space->dynamicShapes};
+	for(int n=0; n<2; n++){
+		if(!cpBBTreeSegmentQueryPacket(indexes[n], a, b, t_exit, packet.count, (cpBBTreePacketSegmentQueryFunc)SegmentQueryFirstPacketLeaf, &packet)){
+			// Not a tree, fall back on one query at a time.
+			for(int i=0; i<packet.count; i++){
+				int q = packet.query[i];
+				struct SegmentQueryContext segmentContext = {a[i], b[i], context->radius, context->filter, NULL};
+				cpSpatialIndexSegmentQuery(indexes[n], &segmentContext, a[i], b[i], context->segmentOut[q].alpha, (cpSpatialIndexSegmentQueryFunc)SegmentQueryFirst, context->segmentOut + q);
+				t_exit[i] = context->segmentOut[q].alpha;
+			}
+		}
+	}
+}
+
+void
+cpSpaceSegmentQueryFirstBatch(cpSpace *space, const cpVect *starts, const cpVect *ends, int count, cpFloat radius, cpShapeFilter filter, cpSegmentQueryInfo *out)
+{
+	if(count <= 0) return;
+	
+	struct BatchQueryContext context = {space, starts, ends, count, radius, filter, NULL, out, BatchQueryOrder(starts, ends, count)};
+	
+	cpSpaceLock(space); {
+		unsigned long packets = (count + CP_BBTREE_PACKET_SIZE - 1)/CP_BBTREE_PACKET_SIZE;
+		if(BatchQueryThreaded(space)){
+			cpTaskPoolRun((cpTaskPoolFunc)SegmentQueryFirstPacket, &context, packets);
+		} else {
+			for(unsigned long i=0; i<packets; i++) SegmentQueryFirstPacket(&context, i);
+		}
+	} cpSpaceUnlock(space, cpTrue);
+	
+	cpfree(context.order);
+}
+
 //MARK: BB Query Functions
 
 struct BBQueryContext {
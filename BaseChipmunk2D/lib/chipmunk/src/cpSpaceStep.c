@@ -164,21 +164,55 @@ cpSpacePopContacts(cpSpace *space, int count){
 	space->contactBuffersHead->numContacts -= count;
 }
 
+// Contacts of sleeping arbiters are moved out of the contact buffer ring into fixed size blocks.
+typedef struct cpSleepingContacts {
+	struct cpContact contacts[CP_MAX_CONTACTS_PER_ARBITER];
+} cpSleepingContacts;
+
+static void
+cpSpaceAllocSleepingContactsSlab(cpSpace *space)
+{
+	int count = CP_BUFFER_BYTES/sizeof(cpSleepingContacts);
+	cpAssertHard(count, "Internal Error: Buffer size too small.");
+	
+	cpSleepingContacts *buffer = (cpSleepingContacts *)cpcalloc(1, CP_BUFFER_BYTES);
+	cpArrayPush(space->allocatedBuffers, buffer);
+	
+	for(int i=0; i<count; i++) cpArrayPush(space->pooledContacts, buffer + i);
+}
+
+struct cpContact *
+cpSpacePopSleepingContacts(cpSpace *space)
+{
+	if(space->pooledContacts->num == 0) cpSpaceAllocSleepingContactsSlab(space);
+	return ((cpSleepingContacts *)cpArrayPop(space->pooledContacts))->contacts;
+}
+
+void
+cpSpaceRecycleSleepingContacts(cpSpace *space, struct cpContact *contacts)
+{
+	cpArrayPush(space->pooledContacts, contacts);
+}
+
 //MARK: Collision Detection Functions
 
+static void
+cpSpaceAllocArbiterSlab(cpSpace *space)
+{
+	int count = CP_BUFFER_BYTES/sizeof(cpArbiter);
+	cpAssertHard(count, "Internal Error: Buffer size too small.");
+	
+	cpArbiter *buffer = (cpArbiter *)cpcalloc(1, CP_BUFFER_BYTES);
+	cpArrayPush(space->allocatedBuffers, buffer);
+	
+	for(int i=0; i<count; i++) cpArrayPush(space->pooledArbiters, buffer + i);
+}
+
 static void *
 cpSpaceArbiterSetTrans(cpShape **shapes, cpSpace *space)
 {
-	if(space->pooledArbiters->num == 0){
-		// arbiter pool is exhausted, make more
-		int count = CP_BUFFER_BYTES/sizeof(cpArbiter);
-		cpAssertHard(count, "Internal Error: Buffer size too small.");
-		
-		cpArbiter *buffer = (cpArbiter *)cpcalloc(1, CP_BUFFER_BYTES);
-		cpArrayPush(space->allocatedBuffers, buffer);
-		
-		for(int i=0; i<count; i++) cpArrayPush(space->pooledArbiters, buffer + i);
-	}
+	// arbiter pool is exhausted, make more
+	if(space->pooledArbiters->num == 0) cpSpaceAllocArbiterSlab(space);
 	
 	return cpArbiterInit((cpArbiter *)cpArrayPop(space->pooledArbiters), shapes[0], shapes[1]);
 }
@@ -306,6 +340,72 @@ cpSpaceArbiterSetFilter(cpArbiter *arb, cpSpace *space)
 	return cpTrue;
 }
 
+//MARK: Preallocation
+
+void
+cpSpaceReserve(cpSpace *space, int arbiters)
+{
+	cpAssertSpaceUnlocked(space);
+	if(arbiters <= 0) return;
+	
+	// Arbiters, plus room for all of them to be active in the arbiter list.
+	int arbiterSlab = CP_BUFFER_BYTES/sizeof(cpArbiter);
+	int arbiterCount = space->arbiters->num + space->pooledArbiters->num;
+	while(arbiterCount < arbiters){
+		cpArrayReserve(space->pooledArbiters, space->pooledArbiters->num + arbiterSlab);
+		cpSpaceAllocArbiterSlab(space);
+		arbiterCount += arbiterSlab;
+	}
+	
+	cpArrayReserve(space->arbiters, arbiters);
+	cpHashSetReserve(space->cachedArbiters, arbiters);
+	
+	// Sleeping arbiters hold their contacts in pooled blocks.
+	int sleepingSlab = CP_BUFFER_BYTES/sizeof(cpSleepingContacts);
+	while(space->pooledContacts->num < arbiters){
+		cpArrayReserve(space->pooledContacts, space->pooledContacts->num + sleepingSlab);
+		cpSpaceAllocSleepingContactsSlab(space);
+	}
+	
+	// Contact buffers are recycled once they are older than collisionPersistence.
+	// Splice enough expired buffers into the ring to cover that many steps.
+	int perStep = (int)((arbiters*CP_MAX_CONTACTS_PER_ARBITER + CP_CONTACTS_BUFFER_SIZE - 1)/CP_CONTACTS_BUFFER_SIZE);
+	int buffers = perStep*(int)(space->collisionPersistence + 1);
+	cpTimestamp expired = space->stamp - space->collisionPersistence - 1;
+	
+	int existing = 0;
+	cpContactBufferHeader *head = space->contactBuffersHead;
+	if(head){
+		cpContactBufferHeader *buffer = head;
+		do {
+			existing++;
+			buffer = buffer->next;
+		} while(buffer != head);
+	}
+	
+	for(int i=existing; i<buffers; i++){
+		cpContactBufferHeader *buffer = cpSpaceAllocContactBuffer(space);
+		
+		if(!space->contactBuffersHead){
+			space->contactBuffersHead = cpContactBufferHeaderInit(buffer, expired, NULL);
+		} else {
+			// Insert as the tail so it is the next buffer to be reused.
+			cpContactBufferHeaderInit(buffer, expired, space->contactBuffersHead);
+			space->contactBuffersHead->next = buffer;
+		}
+	}
+	
+	// Sleeping shapes move from the dynamic index to the static one, so both need room for all of them.
+	// Each colliding pair of shapes also needs a cached pair in the dynamic tree.
+	int shapes = cpSpatialIndexCount(space->dynamicShapes) + cpSpatialIndexCount(space->staticShapes);
+	cpBBTreeReserve(space->dynamicShapes, shapes, arbiters);
+	cpBBTreeReserve(space->staticShapes, shapes, 0);
+	
+	// Make room for the sleeping bookkeeping.
+	cpArrayReserve(space->rousedBodies, space->dynamicBodies->num);
+	cpArrayReserve(space->sleepingComponents, space->dynamicBodies->num);
+}
+
 //MARK: All Important cpSpaceStep() Function
 
  void
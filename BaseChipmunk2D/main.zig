@@ -13,6 +13,7 @@ const std = @import("std");
 //   @cInclude("C:/zig_workbench/BaseChipmunk/lib/chipmunk/include/chipmunk.h");
 const cp = @cImport({
   @cInclude("lib/chipmunk/include/chipmunk/chipmunk.h");
+  @cInclude("lib/chipmunk/include/chipmunk/cpHastySpace.h");
 });
 
 // Define custom collision types
@@ -142,5 +143,160 @@ test " empty" {
   try std.testing.expect(true);
 }
 
+test " steadyStateStep" {
+  const space: ?*cp.cpSpace = cp.cpSpaceNew();
+  defer cp.cpSpaceFree(space);
+  cp.cpSpaceSetGravity(space, cp.cpVect{ .x = 0, .y = -100 });
+  cp.cpSpaceSetSleepTimeThreshold(space, 0.5);
+
+  const ground = cp.cpSegmentShapeNew(cp.cpSpaceGetStaticBody(space), cp.cpVect{ .x = -50, .y = -15 }, cp.cpVect{ .x = 50, .y = -15 }, 0);
+  cp.cpShapeSetFriction(ground, 1);
+  _ = cp.cpSpaceAddShape(space, ground);
+
+  for (0..40) |i| {
+    const body = cp.cpSpaceAddBody(space, cp.cpBodyNew(1.0, cp.cpMomentForCircle(1.0, 0, 1, cp.cpvzero)));
+    cp.cpBodySetPosition(body, cp.cpVect{ .x = @as(f64, @floatFromInt(i % 10)) * 2.5 - 12, .y = @as(f64, @floatFromInt(i / 10)) * 2.5 });
+    const shape = cp.cpSpaceAddShape(space, cp.cpCircleShapeNew(body, 1, cp.cpvzero));
+    cp.cpShapeSetFriction(shape, 0.7);
+  }
+
+  // Warm up, the balls fall, collide, settle and fall asleep.
+  cp.cpSpaceReserve(space, 256);
+  for (0..60) |_| cp.cpSpaceStep(space, 1.0 / 60.0);
+
+  const before = cp.cpGetAllocationCounters();
+  for (0..600) |_| cp.cpSpaceStep(space, 1.0 / 60.0);
+  const after = cp.cpGetAllocationCounters();
+
+  try std.testing.expectEqual(before.allocations, after.allocations);
+  try std.testing.expectEqual(before.frees, after.frees);
+}
+
+test " reserveFirstStep" {
+  const space: ?*cp.cpSpace = cp.cpSpaceNew();
+  defer cp.cpSpaceFree(space);
+  cp.cpSpaceSetGravity(space, cp.cpVect{ .x = 0, .y = -100 });
+
+  const ground = cp.cpSegmentShapeNew(cp.cpSpaceGetStaticBody(space), cp.cpVect{ .x = -200, .y = -15 }, cp.cpVect{ .x = 200, .y = -15 }, 0);
+  _ = cp.cpSpaceAddShape(space, ground);
+
+  // Overlapping balls, so the first step finds thousands of colliding pairs.
+  for (0..3000) |i| {
+    const body = cp.cpSpaceAddBody(space, cp.cpBodyNew(1.0, cp.cpMomentForCircle(1.0, 0, 1, cp.cpvzero)));
+    cp.cpBodySetPosition(body, cp.cpVect{ .x = @as(f64, @floatFromInt(i % 60)) * 1.5 - 45, .y = @as(f64, @floatFromInt(i / 60)) * 1.5 });
+    _ = cp.cpSpaceAddShape(space, cp.cpCircleShapeNew(body, 1, cp.cpvzero));
+  }
+
+  cp.cpSpaceReserve(space, 20000);
+  const before = cp.cpGetAllocationCounters();
+  cp.cpSpaceStep(space, 1.0 / 60.0);
+  const after = cp.cpGetAllocationCounters();
+
+  try std.testing.expectEqual(before.allocations, after.allocations);
+  try std.testing.expectEqual(before.frees, after.frees);
+}
+
+/// A pile of balls above the ground; 'seed' shifts them so spaces differ.
+fn ballPile(seed: usize, bodies: []?*cp.cpBody) ?*cp.cpSpace {
+  const space = cp.cpSpaceNew();
+  cp.cpSpaceSetGravity(space, cp.cpVect{ .x = 0, .y = -100 });
+  const ground = cp.cpSegmentShapeNew(cp.cpSpaceGetStaticBody(space), cp.cpVect{ .x = -50, .y = -15 }, cp.cpVect{ .x = 50, .y = -15 }, 0);
+  cp.cpShapeSetFriction(ground, 1);
+  _ = cp.cpSpaceAddShape(space, ground);
+  for (bodies, 0..) |*body, i| {
+    body.* = cp.cpSpaceAddBody(space, cp.cpBodyNew(1.0, cp.cpMomentForCircle(1.0, 0, 1, cp.cpvzero)));
+    cp.cpBodySetPosition(body.*, cp.cpVect{
+      .x = @as(f64, @floatFromInt(i % 10)) * 2.5 - 12 + 0.1 * @as(f64, @floatFromInt(seed % 7)),
+      .y = @as(f64, @floatFromInt(i / 10)) * 2.5 + 0.05 * @as(f64, @floatFromInt(seed)),
+    });
+    const shape = cp.cpSpaceAddShape(space, cp.cpCircleShapeNew(body.*, 1, cp.cpvzero));
+    cp.cpShapeSetFriction(shape, 0.7);
+  }
+  return space;
+}
+
+test " stepMany" {
+  const n = 16;
+  var pooled: [n]?*cp.cpSpace = undefined;
+  var serial: [n]?*cp.cpSpace = undefined;
+  var pooled_bodies: [n][30]?*cp.cpBody = undefined;
+  var serial_bodies: [n][30]?*cp.cpBody = undefined;
+  for (0..n) |i| {
+    pooled[i] = ballPile(i, &pooled_bodies[i]);
+    serial[i] = ballPile(i, &serial_bodies[i]);
+  }
+  defer {
+    for (pooled, serial) |a, b| {
+      cp.cpSpaceFree(a);
+      cp.cpSpaceFree(b);
+    }
+  }
+
+  // Spaces stepped through the pool end up where stepping them one by one does.
+  cp.cpTaskPoolSetThreads(4);
+  defer cp.cpTaskPoolSetThreads(1);
+  for (0..120) |_| {
+    cp.cpSpaceStepMany(&pooled, n, 1.0 / 60.0);
+    for (serial) |space| cp.cpSpaceStep(space, 1.0 / 60.0);
+  }
+  for (pooled_bodies, serial_bodies) |pb, sb| {
+    for (pb, sb) |a, b| {
+      try std.testing.expectEqual(cp.cpBodyGetPosition(b), cp.cpBodyGetPosition(a));
+      try std.testing.expectEqual(cp.cpBodyGetAngle(b), cp.cpBodyGetAngle(a));
+    }
+  }
+  // the balls have landed on the ground
+  try std.testing.expect(cp.cpBodyGetPosition(pooled_bodies[0][0]).y < -13);
+}
+
+test " batchQueries" {
+  const space = cp.cpSpaceNew();
+  defer cp.cpSpaceFree(space);
+  var prng = std.Random.DefaultPrng.init(301);
+  const rand = prng.random();
+  const width = 120.0;
+  for (0..1000) |i| {
+    const pos = cp.cpVect{ .x = rand.float(f64) * width, .y = rand.float(f64) * width };
+    if (i % 2 == 1) {
+      _ = cp.cpSpaceAddShape(space, cp.cpCircleShapeNew(cp.cpSpaceGetStaticBody(space), 0.5 + rand.float(f64), pos));
+    } else {
+      const body = cp.cpSpaceAddBody(space, cp.cpBodyNew(1.0, 1.0));
+      cp.cpBodySetPosition(body, pos);
+      _ = cp.cpSpaceAddShape(space, cp.cpBoxShapeNew(body, 1 + rand.float(f64), 1 + rand.float(f64), 0));
+    }
+  }
+  cp.cpSpaceStep(space, 1.0 / 60.0);
+
+  const n = 500;
+  var starts: [n]cp.cpVect = undefined;
+  var ends: [n]cp.cpVect = undefined;
+  for (&starts, &ends) |*a, *b| {
+    a.* = cp.cpVect{ .x = rand.float(f64) * width, .y = rand.float(f64) * width };
+    b.* = cp.cpVect{ .x = a.x + (rand.float(f64) - 0.5) * 20, .y = a.y + (rand.float(f64) - 0.5) * 20 };
+  }
+
+  // Batches match the single queries, on the BBTree and on the spatial hash fallback.
+  cp.cpTaskPoolSetThreads(4);
+  defer cp.cpTaskPoolSetThreads(1);
+  for (0..2) |pass| {
+    if (pass == 1) cp.cpSpaceUseSpatialHash(space, 4, 4096);
+    var points: [n]cp.cpPointQueryInfo = undefined;
+    var segments: [n]cp.cpSegmentQueryInfo = undefined;
+    cp.cpSpacePointQueryNearestBatch(space, &starts, n, 5, cp.CP_SHAPE_FILTER_ALL, &points);
+    cp.cpSpaceSegmentQueryFirstBatch(space, &starts, &ends, n, 0.25, cp.CP_SHAPE_FILTER_ALL, &segments);
+    var hits: usize = 0;
+    for (starts, ends, points, segments) |a, b, point, segment| {
+      var point_info: cp.cpPointQueryInfo = undefined;
+      _ = cp.cpSpacePointQueryNearest(space, a, 5, cp.CP_SHAPE_FILTER_ALL, &point_info);
+      try std.testing.expectEqual(point_info, point);
+      var segment_info: cp.cpSegmentQueryInfo = undefined;
+      _ = cp.cpSpaceSegmentQueryFirst(space, a, b, 0.25, cp.CP_SHAPE_FILTER_ALL, &segment_info);
+      try std.testing.expectEqual(segment_info, segment);
+      if (segment_info.shape != null) hits += 1;
+    }
+    try std.testing.expect(hits > n / 2);
+  }
+}
+
 //#endregion ==================================================================
 //=============================================================================
@@ -0,0 +1,924 @@
+//!zig-autodoc-section: BaseLMDB\\bench.zig
+//! bench.zig :
+//!  db_bench style benchmarks for LMDB.
+//!  Runs every benchmark for each key size, value size, environment flag set
+//!  and DB flag set given, and writes one JSON object per result line to stdout:
+//!    zig build bench -Doptimize=ReleaseFast -- --num=1000000 --value_size=100,1000
+//!      --flags=none,nosync,nosync+writemap --threads=1,4 > results.jsonl
+//!  scan writes its own line, with the pages scanned per second.
+// Build using Zig 0.16.0
+
+//=============================================================================
+//#region MARK: GLOBAL
+//=============================================================================
+const std = @import("std");
+const builtin = @import("builtin");
+const Io = std.Io;
+var appinit: std.process.Init = undefined;
+
+const lmdb = @cImport({
+  @cInclude("lib/LMDB/lmdb.h");
+});
+const midl = @cImport({
+  @cInclude("lib/LMDB/midl.h");
+});
+const ctime = @cImport({
+  @cInclude("time.h");
+});
+const lz = @import("lz.zig").Codec(lmdb);
+
+extern "c" fn remove(path: [*:0]const u8) c_int;
+extern "c" fn posix_fadvise(fd: c_int, offset: i64, len: i64, advice: c_int) c_int;
+const POSIX_FADV_DONTNEED = 4; // Linux value
+
+/// MDB_MAXKEYSIZE of the default build; the env limit is checked on open.
+const max_key = 511;
+
+const Mode = enum { fillseq, fillrandom, fillbulk, overwrite, deleterandom, readrandom, readseq, midlsort, midlmerge, copy, commitq, scan };
+
+const Codec = enum { none, lz };
+
+const FlagSet = struct {
+  name: []const u8,
+  flags: c_uint,
+};
+
+const env_flags = [_]FlagSet{
+  .{ .name = "none", .flags = 0 },
+  .{ .name = "nosync", .flags = lmdb.MDB_NOSYNC },
+  .{ .name = "nometasync", .flags = lmdb.MDB_NOMETASYNC },
+  .{ .name = "writemap", .flags = lmdb.MDB_WRITEMAP },
+  .{ .name = "nordahead", .flags = lmdb.MDB_NORDAHEAD },
+};
+
+const db_flags = [_]FlagSet{
+  .{ .name = "none", .flags = 0 },
+  .{ .name = "prefixkeys", .flags = lmdb.MDB_PREFIXKEYS },
+};
+
+const Config = struct {
+  benchmarks: []const Mode = &.{ .fillseq, .readseq, .readrandom, .fillrandom, .overwrite, .readrandom, .deleterandom },
+  num: usize = 100000,
+  reads: usize = 0, // 0: same as num
+  key_sizes: []const usize = &.{16},
+  value_sizes: []const usize = &.{100},
+  flag_sets: []const FlagSet = &.{env_flags[0]},
+  db_flag_sets: []const FlagSet = &.{db_flags[0]},
+  threads: []const usize = &.{1},
+  batch: usize = 1000,
+  readahead: c_uint = 16,
+  keycache: c_uint = 0,
+  codec: Codec = .none,
+  codec_min: usize = 64,
+  compression_ratio: f64 = 1,
+  mapsize: usize = 1 << 30,
+  path: [:0]const u8 = "bench.mdb",
+  seed: u64 = 301,
+};
+var cfg: Config = .{};
+
+const usage =
+  \\Usage: bench [--name=value ...]
+  \\  --benchmarks=LIST  fillseq,fillrandom,fillbulk,overwrite,deleterandom,readrandom,readseq,
+  \\                     midlsort,midlmerge,copy,commitq,scan
+  \\                     (default fillseq,readseq,readrandom,fillrandom,overwrite,readrandom,deleterandom)
+  \\  --num=N            keys written by each fill (default 100000)
+  \\  --reads=N          lookups of each read benchmark, split over the threads (default num)
+  \\  --key_size=LIST    key sizes in bytes (default 16)
+  \\  --value_size=LIST  value sizes in bytes (default 100)
+  \\  --flags=LIST       env flag sets, each of none,nosync,nometasync,writemap,nordahead
+  \\                     joined with '+' (default none)
+  \\  --db_flags=LIST    DB flag sets, each of none,prefixkeys joined with '+' (default none)
+  \\  --threads=LIST     reader, compacting copy, commitq writer and scan range thread counts
+  \\                     (default 1)
+  \\  --batch=N          writes per transaction, max batches per commitq transaction, and ids
+  \\                     per list of midlsort and midlmerge (default 1000)
+  \\  --readahead=N      leaf pages each scan cursor prefetches; each scan runs without it, then
+  \\                     with it (default 16)
+  \\  --keycache=N       key cache slots for mdb_get, 0 for none (default 0); results give each
+  \\                     benchmark's hits and misses, and the mean times since the env was opened
+  \\  --codec=NAME       value codec, none or lz (default none); a read txn holds the values
+  \\                     it expands until it ends
+  \\  --codec_min=SIZE   smallest value the codec compresses (default 64)
+  \\  --compression_ratio=F
+  \\                     values compress to about this fraction, as in db_bench (default 1)
+  \\  --mapsize=SIZE     map size, with an optional K, M, G or T suffix (default 1G)
+  \\  --db=PATH          database file, removed before each fill and at exit (default bench.mdb)
+  \\  --seed=N           random seed (default 301)
+  \\
+;
+
+//#endregion ==================================================================
+//#region MARK: MAIN
+//=============================================================================
+pub fn main(init: std.process.Init) !void {
+  appinit = init;
+  const arena = init.arena.allocator();
+  const args = try init.minimal.args.toSlice(arena);
+  parseArgs(arena, args) catch |err| {
+    std.debug.print("{s}", .{usage});
+    if (err == error.Help) return;
+    return err;
+  };
+
+  var nmax = cfg.num;
+  if (cfg.reads > nmax) nmax = cfg.reads;
+  const lat = try init.gpa.alloc(u64, nmax);
+  defer init.gpa.free(lat);
+  const order = try init.gpa.alloc(u32, cfg.num);
+  defer init.gpa.free(order);
+
+  for (cfg.key_sizes) |key_size| {
+    for (cfg.value_sizes) |value_size| {
+      for (cfg.flag_sets) |flag_set| {
+        for (cfg.db_flag_sets) |db_flag_set| {
+          const value = try init.gpa.alloc(u8, value_size + 256);
+          defer init.gpa.free(value);
+          var b = Bench{
+            .key_size = key_size,
+            .value_size = value_size,
+            .flag_set = flag_set,
+            .db_flag_set = db_flag_set,
+            .value = value,
+            .order = order,
+            .lat = lat,
+          };
+          try b.run();
+        }
+      }
+    }
+  }
+}
+
+//#endregion ==================================================================
+//#region MARK: BENCH
+//=============================================================================
+/// One environment under test: a key size, a value size and the env and DB
+/// flag sets.
+const Bench = struct {
+  env: ?*lmdb.MDB_env = null,
+  dbi: lmdb.MDB_dbi = 0,
+  key_size: usize,
+  value_size: usize,
+  flag_set: FlagSet,
+  db_flag_set: FlagSet,
+  value: []u8, // random bytes, values start at id % 256
+  order: []u32, // shuffled key ids for fillrandom and deleterandom
+  lat: []u64, // per operation latency in ns
+  kc: lmdb.MDB_kcstat = std.mem.zeroes(lmdb.MDB_kcstat), // key cache counters at the last report
+
+  fn run(b: *Bench) !void {
+    var prng = std.Random.DefaultPrng.init(cfg.seed);
+    const rand = prng.random();
+    fillValue(b.value, rand);
+    for (b.order, 0..) |*o, i| o.* = @intCast(i);
+    rand.shuffle(u32, b.order);
+
+    defer b.close();
+    try b.open();
+    for (cfg.benchmarks) |mode| {
+      switch (mode) {
+        .fillseq, .fillrandom, .overwrite, .deleterandom => {
+          if (mode == .fillseq or mode == .fillrandom) {
+            b.close();
+            try b.open();
+          }
+          try b.write(mode, rand);
+        },
+        .fillbulk => {
+          b.close();
+          try b.open();
+          try b.bulk();
+        },
+        .midlsort, .midlmerge => try b.midlOps(mode),
+        .copy => {
+          for (cfg.threads) |nthreads| try b.copy(nthreads);
+        },
+        .scan => {
+          for (cfg.threads) |nthreads| {
+            try b.scan(nthreads, 0);
+            try b.scan(nthreads, cfg.readahead);
+          }
+        },
+        .commitq => {
+          for (cfg.threads) |nthreads| {
+            b.close();
+            try b.open();
+            try b.commitq(nthreads);
+          }
+        },
+        .readrandom, .readseq => {
+          for (cfg.threads) |nthreads| try b.read(mode, nthreads);
+        },
+      }
+    }
+  }
+
+  /// Open a new, empty environment.
+  fn open(b: *Bench) !void {
+    removeFiles();
+    try b.reopen();
+  }
+
+  /// Open the environment at cfg.path, and its DB.
+  fn reopen(b: *Bench) !void {
+    try check(lmdb.mdb_env_create(&b.env));
+    var maxreaders: usize = 126;
+    for (cfg.threads) |n| maxreaders = @max(maxreaders, n + 2);
+    try check(lmdb.mdb_env_set_maxreaders(b.env, @intCast(maxreaders)));
+    try check(lmdb.mdb_env_set_mapsize(b.env, cfg.mapsize));
+    try check(lmdb.mdb_env_set_keycache(b.env, cfg.keycache));
+    try check(lmdb.mdb_env_open(b.env, cfg.path.ptr, lmdb.MDB_NOSUBDIR | b.flag_set.flags, 0o664));
+    const maxkey: usize = @intCast(lmdb.mdb_env_get_maxkeysize(b.env));
+    if (b.key_size > maxkey) {
+      std.debug.print("key_size {d} is over the max key size {d}\n", .{b.key_size, maxkey});
+      return error.BadArgument;
+    }
+    var txn: ?*lmdb.MDB_txn = null;
+    try check(lmdb.mdb_txn_begin(b.env, null, 0, &txn));
+    var rc = lmdb.mdb_dbi_open(txn, null, b.db_flag_set.flags, &b.dbi);
+    if (rc == lmdb.MDB_SUCCESS and cfg.codec == .lz)
+      rc = lmdb.mdb_set_codec(txn, b.dbi, &lz.enc, &lz.dec, cfg.codec_min, null);
+    if (rc != lmdb.MDB_SUCCESS) lmdb.mdb_txn_abort(txn);
+    try check(rc);
+    try check(lmdb.mdb_txn_commit(txn));
+  }
+
+  fn close(b: *Bench) void {
+    if (b.env == null) return;
+    lmdb.mdb_env_close(b.env);
+    b.env = null;
+    b.kc = std.mem.zeroes(lmdb.MDB_kcstat);
+    removeFiles();
+  }
+
+  /// Write cfg.num keys in transactions of cfg.batch writes; the commit is
+  /// counted in the latency of the last write of each transaction.
+  /// fillseq appends, as sorted loads into LMDB should.
+  fn write(b: *Bench, mode: Mode, rand: std.Random) !void {
+    var kbuf: [max_key]u8 = undefined;
+    const key = kbuf[0..b.key_size];
+    var found: usize = 0;
+    var txn: ?*lmdb.MDB_txn = null;
+    errdefer if (txn != null) lmdb.mdb_txn_abort(txn);
+
+    const start = nanos();
+    for (0..cfg.num) |i| {
+      const t0 = nanos();
+      if (txn == null) try check(lmdb.mdb_txn_begin(b.env, null, 0, &txn));
+      const id: usize = switch (mode) {
+        .fillseq => i,
+        .fillrandom, .deleterandom => b.order[i],
+        else => rand.uintLessThan(usize, cfg.num),
+      };
+      makeKey(key, id);
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      if (mode == .deleterandom) {
+        const rc = lmdb.mdb_del(txn, b.dbi, &k, null);
+        if (rc != lmdb.MDB_NOTFOUND) {
+          try check(rc);
+          found += 1;
+        }
+      } else {
+        var v = lmdb.MDB_val{.mv_size = b.value_size, .mv_data = b.value[id % 256 ..].ptr};
+        try check(lmdb.mdb_put(txn, b.dbi, &k, &v, if (mode == .fillseq) lmdb.MDB_APPEND else 0));
+        found += 1;
+      }
+      if ((i + 1) % cfg.batch == 0 or i + 1 == cfg.num) {
+        const rc = lmdb.mdb_txn_commit(txn);
+        txn = null;
+        try check(rc);
+      }
+      b.lat[i] = nanos() - t0;
+    }
+    try b.report(mode, 1, cfg.num, found, found * (b.key_size + b.value_size), nanos() - start);
+  }
+
+  /// Load cfg.num keys in random order with one mdb_bulk_begin() in one
+  /// transaction; mdb_bulk_end() and the commit are counted in the latency
+  /// of the last put.
+  fn bulk(b: *Bench) !void {
+    var kbuf: [max_key]u8 = undefined;
+    const key = kbuf[0..b.key_size];
+    var txn: ?*lmdb.MDB_txn = null;
+    var handle: ?*lmdb.MDB_bulk = null;
+
+    const start = nanos();
+    try check(lmdb.mdb_txn_begin(b.env, null, 0, &txn));
+    errdefer if (txn != null) lmdb.mdb_txn_abort(txn);
+    try check(lmdb.mdb_bulk_begin(txn, b.dbi, 0, 0, &handle));
+    errdefer if (handle != null) lmdb.mdb_bulk_abort(handle);
+    for (0..cfg.num) |i| {
+      const t0 = nanos();
+      const id: usize = b.order[i];
+      makeKey(key, id);
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      var v = lmdb.MDB_val{.mv_size = b.value_size, .mv_data = b.value[id % 256 ..].ptr};
+      try check(lmdb.mdb_bulk_put(handle, &k, &v));
+      if (i + 1 == cfg.num) {
+        const rc = lmdb.mdb_bulk_end(handle);
+        handle = null;
+        try check(rc);
+        const rc2 = lmdb.mdb_txn_commit(txn);
+        txn = null;
+        try check(rc2);
+      }
+      b.lat[i] = nanos() - t0;
+    }
+    try b.report(.fillbulk, 1, cfg.num, cfg.num, cfg.num * (b.key_size + b.value_size), nanos() - start);
+  }
+
+  /// midlsort sorts the shuffled ids in lists of cfg.batch, as a transaction
+  /// sorts the pages it freed; midlmerge merges those lists, sorted, into one
+  /// list of all cfg.num ids, as freed pages join the env's free page list.
+  /// Each list is one op.
+  fn midlOps(b: *Bench, mode: Mode) !void {
+    const all = midl.mdb_midl_alloc(@intCast(cfg.num));
+    if (all == null) return error.OutOfMemory;
+    defer midl.mdb_midl_free(all);
+    const list = midl.mdb_midl_alloc(@intCast(cfg.batch));
+    if (list == null) return error.OutOfMemory;
+    defer midl.mdb_midl_free(list);
+
+    all[0] = 0;
+    var ops: usize = 0;
+    var ns: u64 = 0;
+    var first: usize = 0;
+    while (first < cfg.num) : (first += cfg.batch) {
+      const n = @min(cfg.batch, cfg.num - first);
+      list[0] = n;
+      for (1..n + 1, b.order[first .. first + n]) |i, id| list[i] = @as(midl.MDB_ID, id) + 2;
+      if (mode == .midlmerge) midl.mdb_midl_sort(list);
+      const t0 = nanos();
+      if (mode == .midlsort) midl.mdb_midl_sort(list) else midl.mdb_midl_xmerge(all, list);
+      b.lat[ops] = nanos() - t0;
+      ns += b.lat[ops];
+      ops += 1;
+    }
+    try b.report(mode, 1, ops, cfg.num, cfg.num * @sizeOf(midl.MDB_ID), ns);
+  }
+
+  /// Make a compacting copy with mdb_env_copy3() to the db path with a
+  /// "-copy" suffix, removed afterwards. The copy is one op.
+  fn copy(b: *Bench, nthreads: usize) !void {
+    var buf: [4096]u8 = undefined;
+    const path = try std.fmt.bufPrintZ(&buf, "{s}-copy", .{cfg.path});
+    _ = remove(path.ptr);
+    defer _ = remove(path.ptr);
+    var last = std.mem.zeroes(lmdb.MDB_cpstat);
+    const start = nanos();
+    try check(lmdb.mdb_env_copy3(b.env, path.ptr, lmdb.MDB_CP_COMPACT, @intCast(nthreads), &copyProgress, &last));
+    b.lat[0] = nanos() - start;
+    var st: lmdb.MDB_stat = undefined;
+    try check(lmdb.mdb_env_stat(b.env, &st));
+    try b.report(.copy, nthreads, 1, last.cs_total, last.cs_total * st.ms_psize, b.lat[0]);
+  }
+
+  /// Load cfg.num keys in random order through the commit queue, split
+  /// over nthreads writers that each submit one put per batch and wait for
+  /// its commit. The committer puts up to cfg.batch batches in each
+  /// transaction, so with more writers each sync is shared by more puts.
+  fn commitq(b: *Bench, nthreads: usize) !void {
+    const writers = try appinit.gpa.alloc(Writer, nthreads);
+    defer appinit.gpa.free(writers);
+    const threads = try appinit.gpa.alloc(std.Thread, nthreads);
+    defer appinit.gpa.free(threads);
+    for (writers, 0..) |*w, t| {
+      const first = t * cfg.num / nthreads;
+      const last = (t + 1) * cfg.num / nthreads;
+      w.* = .{.b = b, .ids = b.order[first..last], .lat = b.lat[first..last]};
+    }
+
+    try check(lmdb.mdb_env_commitq_start(b.env, @intCast(@min(cfg.batch, std.math.maxInt(c_uint)))));
+    const start = nanos();
+    for (threads, writers, 0..) |*th, *w, t| {
+      th.* = std.Thread.spawn(.{}, Writer.run, .{w}) catch |err| {
+        for (threads[0..t]) |started| started.join();
+        _ = lmdb.mdb_env_commitq_stop(b.env);
+        return err;
+      };
+    }
+    for (threads) |th| th.join();
+    const rc = lmdb.mdb_env_commitq_stop(b.env);
+    const ns = nanos() - start;
+    try check(rc);
+    for (writers) |w| try check(w.rc);
+    try b.report(.commitq, nthreads, cfg.num, cfg.num, cfg.num * (b.key_size + b.value_size), ns);
+  }
+
+  /// Scan the whole DB in one read transaction, split by mdb_dbi_partition()
+  /// into nthreads ranges of one cursor and thread each. The DB is first
+  /// dropped from the page cache on Linux, so the leaf page faults are
+  /// taken by the scan, where the cursor readahead can hide them.
+  fn scan(b: *Bench, nthreads: usize, readahead: c_uint) !void {
+    try b.evict();
+    const scanners = try appinit.gpa.alloc(Scanner, nthreads);
+    defer appinit.gpa.free(scanners);
+    const threads = try appinit.gpa.alloc(std.Thread, nthreads);
+    defer appinit.gpa.free(threads);
+    const keys = try appinit.gpa.alloc(lmdb.MDB_val, @max(nthreads, 2) - 1);
+    defer appinit.gpa.free(keys);
+
+    const start = nanos();
+    var txn: ?*lmdb.MDB_txn = null;
+    try check(lmdb.mdb_txn_begin(b.env, null, lmdb.MDB_RDONLY, &txn));
+    defer lmdb.mdb_txn_abort(txn);
+    var nsplit: c_uint = 0;
+    try check(lmdb.mdb_dbi_partition(txn, b.dbi, @intCast(nthreads), keys.ptr, &nsplit));
+    const nranges = nsplit + 1;
+    for (scanners[0..nranges], 0..) |*s, i| {
+      s.* = .{
+        .b = b,
+        .txn = txn,
+        .lo = if (i > 0) &keys[i - 1] else null,
+        .hi = if (i < nsplit) &keys[i] else null,
+        .readahead = readahead,
+      };
+    }
+    for (threads[0..nranges], scanners[0..nranges], 0..) |*th, *s, t| {
+      th.* = std.Thread.spawn(.{}, Scanner.run, .{s}) catch |err| {
+        for (threads[0..t]) |started| started.join();
+        return err;
+      };
+    }
+    for (threads[0..nranges]) |th| th.join();
+    const ns = nanos() - start;
+
+    var found: usize = 0;
+    var bytes: usize = 0;
+    for (scanners[0..nranges]) |s| {
+      try check(s.rc);
+      found += s.found;
+      bytes += s.bytes;
+    }
+    var st: lmdb.MDB_stat = undefined;
+    try check(lmdb.mdb_stat(txn, b.dbi, &st));
+    const pages = st.ms_leaf_pages + st.ms_overflow_pages;
+    const secs = @as(f64, @floatFromInt(@max(ns, 1))) * 1e-9;
+    const pages_per_sec = @as(f64, @floatFromInt(pages)) / secs;
+
+    var buf: [1024]u8 = undefined;
+    const line = try std.fmt.bufPrint(&buf,
+      "{{\"benchmark\":\"scan\",\"key_size\":{d},\"value_size\":{d},\"flags\":\"{s}\",\"db_flags\":\"{s}\"," ++
+      "\"codec\":\"{s}\",\"threads\":{d},\"ranges\":{d},\"readahead\":{d},\"entries\":{d},\"pages\":{d}," ++
+      "\"page_size\":{d},\"secs\":{d:.6},\"pages_per_sec\":{d:.1},\"mb_per_sec\":{d:.2}}}\n", .{
+      b.key_size, b.value_size, b.flag_set.name, b.db_flag_set.name, @tagName(cfg.codec),
+      nthreads, nranges, readahead, found, pages, st.ms_psize, secs, pages_per_sec,
+      @as(f64, @floatFromInt(bytes)) / secs / (1 << 20),
+    });
+    try Io.File.stdout().writeStreamingAll(appinit.io, line);
+    std.debug.print("{s:<12} key {d:>3} value {d:>6} {s:<20} {s:<10} {d:>3} thr: {d:>12.0} pages/s, readahead {d}\n", .{
+      "scan", b.key_size, b.value_size, b.flag_set.name, b.db_flag_set.name, nthreads,
+      pages_per_sec, readahead});
+  }
+
+  /// Sync the env, close it to drop its map and open it again, then drop
+  /// its file from the page cache, where the OS allows it.
+  fn evict(b: *Bench) !void {
+    if (builtin.os.tag != .linux) return;
+    try check(lmdb.mdb_env_sync(b.env, 1));
+    lmdb.mdb_env_close(b.env);
+    b.env = null;
+    b.kc = std.mem.zeroes(lmdb.MDB_kcstat);
+    try b.reopen();
+    var fd: lmdb.mdb_filehandle_t = undefined;
+    try check(lmdb.mdb_env_get_fd(b.env, &fd));
+    _ = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+
+  /// Split the reads over nthreads readers, each in its own read transaction.
+  fn read(b: *Bench, mode: Mode, nthreads: usize) !void {
+    const n = if (cfg.reads != 0) cfg.reads else cfg.num;
+    const readers = try appinit.gpa.alloc(Reader, nthreads);
+    defer appinit.gpa.free(readers);
+    const threads = try appinit.gpa.alloc(std.Thread, nthreads);
+    defer appinit.gpa.free(threads);
+    for (readers, 0..) |*r, t| {
+      const first = t * n / nthreads;
+      r.* = .{
+        .b = b,
+        .mode = mode,
+        .first = first,
+        .lat = b.lat[first .. (t + 1) * n / nthreads],
+        .seed = cfg.seed +% t +% 1,
+      };
+    }
+
+    const start = nanos();
+    for (threads, readers, 0..) |*th, *r, t| {
+      th.* = std.Thread.spawn(.{}, Reader.run, .{r}) catch |err| {
+        for (threads[0..t]) |started| started.join();
+        return err;
+      };
+    }
+    for (threads) |th| th.join();
+    const ns = nanos() - start;
+
+    var found: usize = 0;
+    var bytes: usize = 0;
+    for (readers) |r| {
+      try check(r.rc);
+      found += r.found;
+      bytes += r.bytes;
+    }
+    try b.report(mode, nthreads, n, found, bytes, ns);
+  }
+
+  /// Write a result as a JSON line to stdout and a summary to stderr.
+  fn report(b: *Bench, mode: Mode, nthreads: usize, ops: usize, found: usize, bytes: usize, ns: u64) !void {
+    const lat = b.lat[0..ops];
+    std.mem.sort(u64, lat, {}, std.sort.asc(u64));
+    var sum: f64 = 0;
+    for (lat) |l| sum += @floatFromInt(l);
+    const secs = @as(f64, @floatFromInt(@max(ns, 1))) * 1e-9;
+    const ops_per_sec = @as(f64, @floatFromInt(ops)) / secs;
+
+    var st: lmdb.MDB_stat = undefined;
+    var info: lmdb.MDB_envinfo = undefined;
+    try check(lmdb.mdb_env_stat(b.env, &st));
+    try check(lmdb.mdb_env_info(b.env, &info));
+    var kc: lmdb.MDB_kcstat = undefined;
+    try check(lmdb.mdb_env_keycache_stat(b.env, &kc));
+
+    var buf: [2048]u8 = undefined;
+    const line = try std.fmt.bufPrint(&buf,
+      "{{\"benchmark\":\"{s}\",\"key_size\":{d},\"value_size\":{d},\"flags\":\"{s}\",\"db_flags\":\"{s}\"," ++
+      "\"codec\":\"{s}\",\"compression_ratio\":{d:.2},\"threads\":{d}," ++
+      "\"batch\":{d},\"ops\":{d},\"found\":{d},\"secs\":{d:.6},\"ops_per_sec\":{d:.1},\"mb_per_sec\":{d:.2}," ++
+      "\"latency_ns\":{{\"avg\":{d:.1},\"p50\":{d},\"p90\":{d},\"p99\":{d},\"p999\":{d},\"max\":{d}}}," ++
+      "\"page_size\":{d},\"depth\":{d},\"branch_pages\":{d},\"leaf_pages\":{d},\"overflow_pages\":{d}," ++
+      "\"entries\":{d},\"map_size\":{d},\"map_used\":{d}," ++
+      "\"keycache\":{{\"size\":{d},\"hits\":{d},\"misses\":{d},\"stale\":{d},\"hit_ns\":{d},\"miss_ns\":{d}}}}}\n", .{
+      @tagName(mode), b.key_size, b.value_size, b.flag_set.name, b.db_flag_set.name,
+      @tagName(cfg.codec), cfg.compression_ratio, nthreads, cfg.batch, ops, found, secs, ops_per_sec, @as(f64, @floatFromInt(bytes)) / secs / (1 << 20),
+      sum / @as(f64, @floatFromInt(@max(ops, 1))), percentile(lat, 50), percentile(lat, 90),
+      percentile(lat, 99), percentile(lat, 99.9), percentile(lat, 100),
+      st.ms_psize, st.ms_depth, st.ms_branch_pages, st.ms_leaf_pages, st.ms_overflow_pages,
+      st.ms_entries, info.me_mapsize, (info.me_last_pgno + 1) * st.ms_psize,
+      kc.ks_size, kc.ks_hits - b.kc.ks_hits, kc.ks_misses - b.kc.ks_misses, kc.ks_stale - b.kc.ks_stale,
+      kc.ks_hit_ns, kc.ks_miss_ns,
+    });
+    b.kc = kc;
+    try Io.File.stdout().writeStreamingAll(appinit.io, line);
+    std.debug.print("{s:<12} key {d:>3} value {d:>6} {s:<20} {s:<10} {d:>3} thr: {d:>12.0} ops/s, p50 {d} ns, p99 {d} ns\n", .{
+      @tagName(mode), b.key_size, b.value_size, b.flag_set.name, b.db_flag_set.name, nthreads,
+      ops_per_sec, percentile(lat, 50), percentile(lat, 99)});
+  }
+};
+
+const Reader = struct {
+  b: *Bench,
+  mode: Mode,
+  first: usize,
+  lat: []u64,
+  seed: u64,
+  found: usize = 0,
+  bytes: usize = 0,
+  rc: c_int = 0,
+
+  fn run(r: *Reader) void {
+    r.rc = r.lookups();
+  }
+
+  /// readrandom gets random keys; readseq walks the keys from this reader's
+  /// share of the key space on, wrapping around at the end.
+  fn lookups(r: *Reader) c_int {
+    const b = r.b;
+    var txn: ?*lmdb.MDB_txn = null;
+    var rc = lmdb.mdb_txn_begin(b.env, null, lmdb.MDB_RDONLY, &txn);
+    if (rc != lmdb.MDB_SUCCESS) return rc;
+    defer lmdb.mdb_txn_abort(txn);
+    var kbuf: [max_key]u8 = undefined;
+    const key = kbuf[0..b.key_size];
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v: lmdb.MDB_val = undefined;
+
+    if (r.mode == .readrandom) {
+      var prng = std.Random.DefaultPrng.init(r.seed);
+      const rand = prng.random();
+      for (r.lat) |*l| {
+        makeKey(key, rand.uintLessThan(usize, cfg.num));
+        k = .{.mv_size = key.len, .mv_data = key.ptr};
+        const t0 = nanos();
+        rc = lmdb.mdb_get(txn, b.dbi, &k, &v);
+        l.* = nanos() - t0;
+        if (rc == lmdb.MDB_NOTFOUND) continue;
+        if (rc != lmdb.MDB_SUCCESS) return rc;
+        r.found += 1;
+        r.bytes += k.mv_size + v.mv_size;
+      }
+      return lmdb.MDB_SUCCESS;
+    }
+
+    var cursor: ?*lmdb.MDB_cursor = null;
+    rc = lmdb.mdb_cursor_open(txn, b.dbi, &cursor);
+    if (rc != lmdb.MDB_SUCCESS) return rc;
+    defer lmdb.mdb_cursor_close(cursor);
+    makeKey(key, r.first);
+    var op: lmdb.MDB_cursor_op = lmdb.MDB_SET_RANGE;
+    for (r.lat) |*l| {
+      const t0 = nanos();
+      rc = lmdb.mdb_cursor_get(cursor, &k, &v, op);
+      if (rc == lmdb.MDB_NOTFOUND)
+        rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_FIRST);
+      l.* = nanos() - t0;
+      op = lmdb.MDB_NEXT;
+      if (rc == lmdb.MDB_NOTFOUND) continue;
+      if (rc != lmdb.MDB_SUCCESS) return rc;
+      r.found += 1;
+      r.bytes += k.mv_size + v.mv_size;
+    }
+    return lmdb.MDB_SUCCESS;
+  }
+};
+
+/// One range of a scan, from lo up to but not including hi.
+const Scanner = struct {
+  b: *Bench,
+  txn: ?*lmdb.MDB_txn,
+  lo: ?*lmdb.MDB_val,
+  hi: ?*lmdb.MDB_val,
+  readahead: c_uint,
+  found: usize = 0,
+  bytes: usize = 0,
+  rc: c_int = 0,
+
+  fn run(s: *Scanner) void {
+    s.rc = s.walk();
+  }
+
+  fn walk(s: *Scanner) c_int {
+    const b = s.b;
+    var cursor: ?*lmdb.MDB_cursor = null;
+    var rc = lmdb.mdb_cursor_open(s.txn, b.dbi, &cursor);
+    if (rc != lmdb.MDB_SUCCESS) return rc;
+    defer lmdb.mdb_cursor_close(cursor);
+    var k: lmdb.MDB_val = undefined;
+    var v: lmdb.MDB_val = undefined;
+    if (s.lo) |lo| {
+      k = lo.*;
+      rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_SET_RANGE);
+    } else {
+      rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_FIRST);
+    }
+    if (s.readahead != 0) _ = lmdb.mdb_cursor_readahead(cursor, s.readahead);
+    while (rc == lmdb.MDB_SUCCESS) : (rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_NEXT)) {
+      if (s.hi) |hi| {
+        if (lmdb.mdb_cmp(s.txn, b.dbi, &k, hi) >= 0) break;
+      }
+      s.found += 1;
+      s.bytes += k.mv_size + v.mv_size;
+    }
+    return if (rc == lmdb.MDB_NOTFOUND) lmdb.MDB_SUCCESS else rc;
+  }
+};
+
+const Writer = struct {
+  b: *Bench,
+  ids: []const u32,
+  lat: []u64,
+  id: usize = 0, // key of the batch being submitted
+  rc: c_int = 0,
+
+  fn run(w: *Writer) void {
+    for (w.ids, w.lat) |id, *l| {
+      w.id = id;
+      const t0 = nanos();
+      w.rc = lmdb.mdb_env_commitq_submit(w.b.env, &put, w);
+      l.* = nanos() - t0;
+      if (w.rc != lmdb.MDB_SUCCESS) return;
+    }
+  }
+
+  /// The batch: runs on the committer thread while run() waits.
+  fn put(txn: ?*lmdb.MDB_txn, arg: ?*anyopaque) callconv(.c) c_int {
+    const w: *Writer = @ptrCast(@alignCast(arg));
+    const b = w.b;
+    var kbuf: [max_key]u8 = undefined;
+    const key = kbuf[0..b.key_size];
+    makeKey(key, w.id);
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v = lmdb.MDB_val{.mv_size = b.value_size, .mv_data = b.value[w.id % 256 ..].ptr};
+    return lmdb.mdb_put(txn, b.dbi, &k, &v, 0);
+  }
+};
+
+//#endregion ==================================================================
+//#region MARK: UTIL
+//=============================================================================
+fn copyProgress(stat: [*c]const lmdb.MDB_cpstat, ctx: ?*anyopaque) callconv(.c) c_int {
+  const last: *lmdb.MDB_cpstat = @ptrCast(@alignCast(ctx));
+  last.* = stat.*;
+  return 0;
+}
+
+fn check(rc: c_int) !void {
+  if (rc != lmdb.MDB_SUCCESS) {
+    std.debug.print("LMDB error: {s}\n", .{lmdb.mdb_strerror(rc)});
+    if (rc == lmdb.MDB_MAP_FULL) std.debug.print("Raise --mapsize for this data set.\n", .{});
+    return error.LMDBError;
+  }
+}
+
+fn removeFiles() void {
+  var buf: [4096]u8 = undefined;
+  _ = remove(cfg.path.ptr);
+  const lock = std.fmt.bufPrintZ(&buf, "{s}-lock", .{cfg.path}) catch return;
+  _ = remove(lock.ptr);
+}
+
+fn nanos() u64 {
+  var ts: ctime.struct_timespec = undefined;
+  _ = ctime.timespec_get(&ts, ctime.TIME_UTC);
+  return @as(u64, @intCast(ts.tv_sec)) * 1000000000 + @as(u64, @intCast(ts.tv_nsec));
+}
+
+/// Random bytes that compress to about cfg.compression_ratio of their size,
+/// as in db_bench: each 100 byte piece repeats a shorter random run.
+fn fillValue(value: []u8, rand: std.Random) void {
+  if (cfg.compression_ratio >= 1) return rand.bytes(value);
+  const raw: usize = @max(1, @as(usize, @intFromFloat(100 * cfg.compression_ratio)));
+  var i: usize = 0;
+  while (i < value.len) : (i += 100) {
+    const piece = value[i..@min(i + 100, value.len)];
+    rand.bytes(piece[0..@min(raw, piece.len)]);
+    for (raw..@max(raw, piece.len)) |j| piece[j] = piece[j - raw];
+  }
+}
+
+/// Zero padded decimal id, so the keys sort in id order.
+fn makeKey(key: []u8, id: usize) void {
+  var n = id;
+  var i = key.len;
+  while (i > 0) {
+    i -= 1;
+    key[i] = '0' + @as(u8, @intCast(n % 10));
+    n /= 10;
+  }
+}
+
+/// Nearest rank percentile of sorted samples.
+fn percentile(sorted: []const u64, p: f64) u64 {
+  if (sorted.len == 0) return 0;
+  const rank: usize = @intFromFloat(@ceil(p / 100 * @as(f64, @floatFromInt(sorted.len))));
+  return sorted[@min(@max(rank, 1), sorted.len) - 1];
+}
+
+/// A byte count with an optional K, M, G or T suffix.
+fn parseSize(s: []const u8) !usize {
+  if (s.len == 0) return error.BadArgument;
+  const shift: u6 = switch (std.ascii.toUpper(s[s.len - 1])) {
+    'K' => 10,
+    'M' => 20,
+    'G' => 30,
+    'T' => 40,
+    else => 0,
+  };
+  const n = try std.fmt.parseInt(usize, if (shift != 0) s[0 .. s.len - 1] else s, 10);
+  return std.math.shlExact(usize, n, shift) catch return error.BadArgument;
+}
+
+fn parseList(arena: std.mem.Allocator, s: []const u8) ![]const usize {
+  const list = try arena.alloc(usize, std.mem.count(u8, s, ",") + 1);
+  var it = std.mem.splitScalar(u8, s, ',');
+  for (list) |*n| n.* = try parseSize(it.next().?);
+  return list;
+}
+
+/// Comma separated sets of the flags in known, each joined with '+'.
+fn parseFlagSets(arena: std.mem.Allocator, s: []const u8, known: []const FlagSet) ![]const FlagSet {
+  const list = try arena.alloc(FlagSet, std.mem.count(u8, s, ",") + 1);
+  var it = std.mem.splitScalar(u8, s, ',');
+  for (list) |*set| {
+    set.* = .{.name = it.next().?, .flags = 0};
+    var flags = std.mem.splitScalar(u8, set.name, '+');
+    next: while (flags.next()) |f| {
+      for (known) |kf| {
+        if (std.mem.eql(u8, f, kf.name)) {
+          set.flags |= kf.flags;
+          continue :next;
+        }
+      }
+      std.debug.print("Unknown flag: {s}\n", .{f});
+      return error.BadArgument;
+    }
+  }
+  return list;
+}
+
+fn parseArgs(arena: std.mem.Allocator, args: anytype) !void {
+  for (args[1..]) |arg| {
+    if (std.mem.eql(u8, arg, "--help") or std.mem.eql(u8, arg, "-h")) return error.Help;
+    const eq = std.mem.indexOfScalar(u8, arg, '=') orelse {
+      std.debug.print("Bad argument: {s}\n", .{arg});
+      return error.BadArgument;
+    };
+    const name = arg[0..eq];
+    const val = arg[eq + 1 ..];
+    if (std.mem.eql(u8, name, "--benchmarks")) {
+      const list = try arena.alloc(Mode, std.mem.count(u8, val, ",") + 1);
+      var it = std.mem.splitScalar(u8, val, ',');
+      for (list) |*m| {
+        const s = it.next().?;
+        m.* = std.meta.stringToEnum(Mode, s) orelse {
+          std.debug.print("Unknown benchmark: {s}\n", .{s});
+          return error.BadArgument;
+        };
+      }
+      cfg.benchmarks = list;
+    } else if (std.mem.eql(u8, name, "--flags")) {
+      cfg.flag_sets = try parseFlagSets(arena, val, &env_flags);
+    } else if (std.mem.eql(u8, name, "--db_flags")) {
+      cfg.db_flag_sets = try parseFlagSets(arena, val, &db_flags);
+    } else if (std.mem.eql(u8, name, "--num")) {
+      cfg.num = try parseSize(val);
+    } else if (std.mem.eql(u8, name, "--reads")) {
+      cfg.reads = try parseSize(val);
+    } else if (std.mem.eql(u8, name, "--key_size")) {
+      cfg.key_sizes = try parseList(arena, val);
+    } else if (std.mem.eql(u8, name, "--value_size")) {
+      cfg.value_sizes = try parseList(arena, val);
+    } else if (std.mem.eql(u8, name, "--threads")) {
+      cfg.threads = try parseList(arena, val);
+    } else if (std.mem.eql(u8, name, "--batch")) {
+      cfg.batch = try parseSize(val);
+    } else if (std.mem.eql(u8, name, "--readahead")) {
+      cfg.readahead = try std.fmt.parseInt(c_uint, val, 10);
+    } else if (std.mem.eql(u8, name, "--keycache")) {
+      cfg.keycache = try std.fmt.parseInt(c_uint, val, 10);
+    } else if (std.mem.eql(u8, name, "--codec")) {
+      cfg.codec = std.meta.stringToEnum(Codec, val) orelse {
+        std.debug.print("Unknown codec: {s}\n", .{val});
+        return error.BadArgument;
+      };
+    } else if (std.mem.eql(u8, name, "--codec_min")) {
+      cfg.codec_min = try parseSize(val);
+    } else if (std.mem.eql(u8, name, "--compression_ratio")) {
+      cfg.compression_ratio = try std.fmt.parseFloat(f64, val);
+      if (!(cfg.compression_ratio > 0 and cfg.compression_ratio <= 1)) return error.BadArgument;
+    } else if (std.mem.eql(u8, name, "--mapsize")) {
+      cfg.mapsize = try parseSize(val);
+    } else if (std.mem.eql(u8, name, "--db")) {
+      cfg.path = val;
+    } else if (std.mem.eql(u8, name, "--seed")) {
+      cfg.seed = try std.fmt.parseInt(u64, val, 10);
+    } else {
+      std.debug.print("Unknown option: {s}\n", .{name});
+      return error.BadArgument;
+    }
+  }
+
+  // keys must hold every id, so that they sort and readseq can seek them
+  var digits: usize = 1;
+  var n = cfg.num -| 1;
+  while (n >= 10) : (n /= 10) digits += 1;
+  for (cfg.key_sizes) |k| {
+    if (k < digits or k > max_key) {
+      std.debug.print("key_size {d} must be from {d} to {d}\n", .{k, digits, max_key});
+      return error.BadArgument;
+    }
+  }
+  for (cfg.threads) |t| if (t == 0) return error.BadArgument;
+  if (cfg.num == 0 or cfg.num > std.math.maxInt(u32) or cfg.batch == 0) return error.BadArgument;
+}
+
+//#endregion ==================================================================
+//#region MARK: TEST
+//=============================================================================
+test " percentile" {
+  var lat: [1000]u64 = undefined;
+  for (&lat, 1..) |*l, i| l.* = i;
+  try std.testing.expectEqual(@as(u64, 1), percentile(&lat, 0));
+  try std.testing.expectEqual(@as(u64, 500), percentile(&lat, 50));
+  try std.testing.expectEqual(@as(u64, 990), percentile(&lat, 99));
+  try std.testing.expectEqual(@as(u64, 999), percentile(&lat, 99.9));
+  try std.testing.expectEqual(@as(u64, 1000), percentile(&lat, 100));
+  try std.testing.expectEqual(@as(u64, 0), percentile(lat[0..0], 50));
+}
+
+test " parseSize" {
+  try std.testing.expectEqual(@as(usize, 1000), try parseSize("1000"));
+  try std.testing.expectEqual(@as(usize, 64 << 20), try parseSize("64M"));
+  try std.testing.expectEqual(@as(usize, 1 << 30), try parseSize("1g"));
+  try std.testing.expectError(error.BadArgument, parseSize(""));
+}
+
+test " fillValue" {
+  var prng = std.Random.DefaultPrng.init(1);
+  var buf: [250]u8 = undefined;
+  cfg.compression_ratio = 0.25;
+  defer cfg.compression_ratio = 1;
+  fillValue(&buf, prng.random());
+  try std.testing.expectEqualSlices(u8, buf[0..25], buf[25..50]);
+  try std.testing.expectEqualSlices(u8, buf[100..125], buf[175..200]);
+  try std.testing.expectEqualSlices(u8, buf[200..225], buf[225..250]);
+}
+
+test " makeKey" {
+  var buf: [8]u8 = undefined;
+  makeKey(&buf, 1234);
+  try std.testing.expectEqualStrings("00001234", &buf);
+}
+
+//#endregion ==================================================================
+//=============================================================================
\ No newline at end of file
@@ -17,6 +17,7 @@ pub fn build(b: *std.Build) void {
 
   const projectname = "BaseLMDB";
   const mainfile = "main.zig";
+  const benchfile = "bench.zig";
 
   const exe = b.addExecutable(.{
     .name = projectname,
@@ -66,18 +67,59 @@ pub fn build(b: *std.Build) void {
   run_step.dependOn(&run_cmd.step);
 
 //#endregion ==================================================================
-//#region MARK: TEST
+//#region MARK: BENCH
 //=============================================================================
-  const unit_tests = b.addTest(.{
+  const bench = b.addExecutable(.{
+    .name = projectname ++ "Bench",
     .root_module = b.createModule(.{
-      .root_source_file = b.path(mainfile),
+      .root_source_file = b.path(benchfile),
       .target = target,
       .optimize = optimize,
+      .link_libc = true,
     }),
   });
-  const run_unit_tests = b.addRunArtifact(unit_tests);
+  bench.root_module.addIncludePath( b.path(".") );
+  bench.root_module.addIncludePath( b.path("lib/LMDB") );
+  inline for (c_srcs) |c_cpp| {
+    bench.root_module.addCSourceFile(.{
+      .file = b.path(c_cpp),
+      .flags = &.{ }
+    });
+  }
+  b.installArtifact(bench);
+
+  const bench_cmd = b.addRunArtifact(bench);
+  bench_cmd.step.dependOn(b.getInstallStep());
+  if (b.args) |args| {
+    bench_cmd.addArgs(args);
+  }
+  const bench_step = b.step("bench", "Run the benchmarks (zig build bench -- --help)");
+  bench_step.dependOn(&bench_cmd.step);
+
+//#endregion ==================================================================
+//#region MARK: TEST
+//=============================================================================
   const test_step = b.step("test", "Run unit tests");
-  test_step.dependOn(&run_unit_tests.step);
+  inline for (.{ mainfile, benchfile }) |rootfile| {
+    const unit_tests = b.addTest(.{
+      .root_module = b.createModule(.{
+        .root_source_file = b.path(rootfile),
+        .target = target,
+        .optimize = optimize,
+        .link_libc = true,
+      }),
+    });
+    unit_tests.root_module.addIncludePath( b.path(".") );
+    unit_tests.root_module.addIncludePath( b.path("lib/LMDB") );
+    inline for (c_srcs) |c_cpp| {
+      unit_tests.root_module.addCSourceFile(.{
+        .file = b.path(c_cpp),
+        .flags = &.{ }
+      });
+    }
+    const run_unit_tests = b.addRunArtifact(unit_tests);
+    test_step.dependOn(&run_unit_tests.step);
+  }
 }
 //#endregion ==================================================================
 //=============================================================================
\ No newline at end of file
@@ -272,6 +272,9 @@ typedef unsigned int	MDB_dbi;
 /** @brief Opaque structure for navigating through a database */
 typedef struct MDB_cursor MDB_cursor;
 
+/** @brief Opaque structure for a sorted bulk load, see #mdb_bulk_begin() */
+typedef struct MDB_bulk MDB_bulk;
+
 /** @brief Generic structure used for passing keys and data in and out
  * of the database.
  *
@@ -307,6 +310,18 @@ typedef int  (MDB_cmp_func)(const MDB_val *a, const MDB_val *b);
  */
 typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *relctx);
 
+/** @brief A callback function used to compress or expand values, see #mdb_set_codec().
+ *
+ * @param[in,out] dst On entry the buffer to write to and its size, on return
+ * the size written.
+ * @param[in] src The value to compress or expand.
+ * @param[in] ctx An application-provided context, set by #mdb_set_codec().
+ * @return 0 on success. A compressor returns non-zero when the result does
+ * not fit in \b dst, and the value is then stored as it is. A non-zero
+ * return from an expander is returned by the read.
+ */
+typedef int (MDB_codec_func)(MDB_val *dst, const MDB_val *src, void *ctx);
+
 /** @defgroup	mdb_env	Environment Flags
  *	@{
  */
@@ -353,6 +368,8 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_INTEGERDUP	0x20
 	/** with #MDB_DUPSORT, use reverse string dups */
 #define MDB_REVERSEDUP	0x40
+	/** store leaf keys front-coded against a per-page anchor */
+#define MDB_PREFIXKEYS	0x80
 	/** create DB if not already existing */
 #define MDB_CREATE		0x40000
 /** @} */
@@ -507,6 +524,16 @@ typedef struct MDB_envinfo {
 	unsigned int me_numreaders;		/**< max reader slots used in the environment */
 } MDB_envinfo;
 
+/** @brief Statistics of the key cache, see #mdb_env_set_keycache() */
+typedef struct MDB_kcstat {
+	unsigned int	ks_size;		/**< Number of cache slots, 0 if there is no cache */
+	mdb_size_t	ks_hits;			/**< Lookups answered from the cache */
+	mdb_size_t	ks_misses;			/**< Lookups that searched the B-tree */
+	mdb_size_t	ks_stale;			/**< Misses that found a hint for another state of the database */
+	mdb_size_t	ks_hit_ns;			/**< Mean time of a sampled hit, in nanoseconds */
+	mdb_size_t	ks_miss_ns;			/**< Mean time of a sampled miss, in nanoseconds */
+} MDB_kcstat;
+
 	/** @brief Return the LMDB library version information.
 	 *
 	 * @param[out] major if non-NULL, the library major version number is copied here
@@ -745,6 +772,68 @@ int  mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags);
 	 */
 int  mdb_env_copyfd2(MDB_env *env, mdb_filehandle_t fd, unsigned int flags);
 
+	/** @brief Progress of a compacting copy */
+typedef struct MDB_cpstat {
+	mdb_size_t	cs_written;	/**< Pages written so far */
+	mdb_size_t	cs_total;	/**< Pages in the copy, including meta pages */
+	mdb_size_t	cs_msec;	/**< Milliseconds since the copy started */
+	mdb_size_t	cs_rate;	/**< Bytes written per second so far */
+} MDB_cpstat;
+
+	/** @brief A progress callback for #mdb_env_copyfd3().
+	 *
+	 * @param[in] stat Progress of the copy.
+	 * @param[in] ctx The context passed to #mdb_env_copyfd3().
+	 * @return 0 to go on, or an error code to abort the copy with.
+	 */
+typedef int (MDB_copy_func)(const MDB_cpstat *stat, void *ctx);
+
+	/** @brief Copy an LMDB environment to the specified file descriptor,
+	 *	with options, threads and progress reports.
+	 *
+	 * Like #mdb_env_copyfd2(). For a compacting copy into a file, the
+	 * tree is split into subtrees that are copied by \b nthreads threads,
+	 * each writing its pages at the positions it reserved in the file.
+	 * The meta pages are written last. Other readers and writers keep
+	 * working meanwhile, see the note about long-lived transactions.
+	 * A pipe, or \b nthreads 1, gets a single-threaded copy as usual.
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] fd The filedescriptor to write the copy to. It must
+	 * have already been opened for Write access.
+	 * @param[in] flags Special options for this operation.
+	 * See #mdb_env_copy2() for options.
+	 * @param[in] nthreads Number of threads for a compacting copy, or 0
+	 * for the default.
+	 * @param[in] func Called about once a second during a compacting copy,
+	 * and once at the end, or NULL. It may run on any of the copy threads,
+	 * but not on two at once, and stalls the copy while it runs.
+	 * @param[in] ctx An arbitrary pointer passed to \b func.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copyfd3(MDB_env *env, mdb_filehandle_t fd, unsigned int flags,
+	unsigned int nthreads, MDB_copy_func *func, void *ctx);
+
+	/** @brief Copy an LMDB environment to the specified path,
+	 *	with options, threads and progress reports.
+	 *
+	 * See #mdb_env_copy2() and #mdb_env_copyfd3().
+	 * @param[in] env An environment handle returned by #mdb_env_create(). It
+	 * must have already been opened successfully.
+	 * @param[in] path The directory in which the copy will reside. This
+	 * directory must already exist and be writable but must otherwise be
+	 * empty.
+	 * @param[in] flags Special options for this operation.
+	 * See #mdb_env_copy2() for options.
+	 * @param[in] nthreads Number of threads for a compacting copy, or 0
+	 * for the default.
+	 * @param[in] func A progress callback, see #mdb_env_copyfd3(), or NULL.
+	 * @param[in] ctx An arbitrary pointer passed to \b func.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_copy3(MDB_env *env, const char *path, unsigned int flags,
+	unsigned int nthreads, MDB_copy_func *func, void *ctx);
+
 	/** @brief Return statistics about the LMDB environment.
 	 *
 	 * @param[in] env An environment handle returned by #mdb_env_create()
@@ -935,6 +1024,42 @@ int  mdb_env_get_maxreaders(MDB_env *env, unsigned int *readers);
 	 */
 int  mdb_env_set_maxdbs(MDB_env *env, MDB_dbi dbs);
 
+	/** @brief Set the size of the key cache for the environment.
+	 *
+	 * The key cache remembers where #mdb_get() found recently read keys:
+	 * the leaf page, the node on it, and the snapshot it was found in.
+	 * A later #mdb_get() in a read-only transaction uses such a hint
+	 * instead of searching the B-tree from the root, if the database is
+	 * still unchanged since that snapshot. Otherwise it searches as usual
+	 * and updates the hint. Changes made by other processes cause all
+	 * hints to be dropped. Lookups do not take locks.
+	 *
+	 * Databases with #MDB_DUPSORT and write transactions do not use the
+	 * cache. Each slot holds one key; keys that hash to the same slot
+	 * replace each other.
+	 * This function may only be called after #mdb_env_create() and before #mdb_env_open().
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] size The number of cache slots, rounded up to a power of 2,
+	 * or 0 for no cache. The default is 0.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or the environment is already open.
+	 * </ul>
+	 */
+int  mdb_env_set_keycache(MDB_env *env, unsigned int size);
+
+	/** @brief Return statistics about the key cache.
+	 *
+	 * Counters include the lookups of read-only transactions that have
+	 * ended. Lookup times are measured for one in 16 lookups.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[out] stat The address of an #MDB_kcstat structure
+	 * 	where the statistics will be copied
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_keycache_stat(MDB_env *env, MDB_kcstat *stat);
+
 	/** @brief Get the maximum size of keys and #MDB_DUPSORT data we can write.
 	 *
 	 * Depends on the compile-time constant #MDB_MAXKEYSIZE. Default 511.
@@ -1096,6 +1221,75 @@ void mdb_txn_reset(MDB_txn *txn);
 	 */
 int  mdb_txn_renew(MDB_txn *txn);
 
+	/** @brief A write batch for the commit queue.
+	 *
+	 * Called on the committer thread to apply one batch of writes.
+	 * It must only use \b txn, must not commit or abort it, and may be
+	 * called again in a later transaction if another batch fails.
+	 * @param[in] txn The write transaction to apply the batch in.
+	 * @param[in] arg The argument passed to #mdb_env_commitq_submit().
+	 * @return 0 to keep the writes, or an error to discard them.
+	 */
+typedef int (MDB_commit_func)(MDB_txn *txn, void *arg);
+
+	/** @brief Start a group commit queue for an environment.
+	 *
+	 * Write transactions are serialized, and each commit does its own
+	 * page flush and sync. With the queue running, threads can submit
+	 * write batches with #mdb_env_commitq_submit() instead. A committer
+	 * thread applies all pending batches in a single write transaction
+	 * and commits it with a single sync, so concurrent writers share
+	 * the cost of the sync instead of waiting for each other's.
+	 *
+	 * Each batch runs in its own nested transaction, so a failed batch
+	 * does not discard the others. With #MDB_WRITEMAP, which does not
+	 * support nested transactions, the group is aborted and retried
+	 * without the failed batch.
+	 *
+	 * The environment's sync flags apply to the group commits as usual.
+	 * Other threads may still use their own write transactions.
+	 * @param[in] env An environment handle returned by #mdb_env_create().
+	 * It must be opened read-write and must not have a running queue.
+	 * @param[in] max_batches Max number of batches per transaction, or 0
+	 * for the default.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  mdb_env_commitq_start(MDB_env *env, unsigned int max_batches);
+
+	/** @brief Stop the commit queue of an environment.
+	 *
+	 * Commits the batches already submitted and waits for the committer
+	 * thread to exit. No thread may submit batches during or after this
+	 * call. #mdb_env_close() calls this if the queue is still running.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_env_commitq_stop(MDB_env *env);
+
+	/** @brief Submit a write batch to the commit queue and wait for it.
+	 *
+	 * Returns when the transaction containing the batch has been committed,
+	 * or when the batch or its transaction has failed. The calling thread
+	 * must not have a write transaction open in this environment.
+	 * @param[in] env An environment handle with a running queue,
+	 * see #mdb_env_commitq_start().
+	 * @param[in] func The #MDB_commit_func to apply the batch with.
+	 * @param[in] arg An argument for \b func.
+	 * @return A non-zero error value on failure and 0 on success. This is
+	 * the error returned by \b func, or else the error from committing the
+	 * group, see #mdb_txn_commit(). Some possible errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or the queue
+	 *		is not running.
+	 * </ul>
+	 */
+int  mdb_env_commitq_submit(MDB_env *env, MDB_commit_func *func, void *arg);
+
 /** Compat with version <= 0.9.4, avoid clash with libmdb from MDB Tools project */
 #define mdb_open(txn,name,flags,dbi)	mdb_dbi_open(txn,name,flags,dbi)
 /** Compat with version <= 0.9.4, avoid clash with libmdb from MDB Tools project */
@@ -1157,6 +1351,15 @@ int  mdb_txn_renew(MDB_txn *txn);
 	 *	<li>#MDB_REVERSEDUP
 	 *		This option specifies that duplicate data items should be compared as
 	 *		strings in reverse order.
+	 *	<li>#MDB_PREFIXKEYS
+	 *		Store the keys of leaf pages front-coded: each page keeps an anchor
+	 *		key, and every key on the page only stores the part following its
+	 *		common prefix with the anchor. This packs more keys per page when
+	 *		they share long prefixes, such as hierarchical paths. The format is
+	 *		recorded per page, so pages written without this flag stay readable.
+	 *		Keys returned by a cursor on such a database are only valid until
+	 *		the next operation on that cursor. This option may not be combined
+	 *		with #MDB_DUPSORT or #MDB_INTEGERKEY.
 	 *	<li>#MDB_CREATE
 	 *		Create the named database if it doesn't exist. This option is not
 	 *		allowed in a read-only transaction or a read-only environment.
@@ -1168,6 +1371,7 @@ int  mdb_txn_renew(MDB_txn *txn);
 	 *	<li>#MDB_NOTFOUND - the specified database doesn't exist in the environment
 	 *		and #MDB_CREATE was not specified.
 	 *	<li>#MDB_DBS_FULL - too many databases have been opened. See #mdb_env_set_maxdbs().
+	 *	<li>EINVAL - #MDB_PREFIXKEYS was combined with #MDB_DUPSORT or #MDB_INTEGERKEY.
 	 * </ul>
 	 */
 int  mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *dbi);
@@ -1304,6 +1508,39 @@ int  mdb_set_relfunc(MDB_txn *txn, MDB_dbi dbi, MDB_rel_func *rel);
 	 */
 int  mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx);
 
+	/** @brief Set functions to compress the values of a database.
+	 *
+	 * Values of at least \b threshold bytes that #mdb_put() and #mdb_cursor_put()
+	 * write are passed to \b enc, and stored compressed if that makes them
+	 * smaller. Smaller values are stored as they are, and reads return them
+	 * from the map as usual. Reads of compressed values expand them with
+	 * \b dec into memory of the transaction, which stays valid until the
+	 * transaction ends; a transaction that reads many of them holds all of
+	 * that memory. Values written with #MDB_RESERVE are not compressed.
+	 *
+	 * Whether a value is compressed is recorded with it, so a database can
+	 * hold both kinds and the codec can be added to an existing database.
+	 * Every program reading a database with compressed values must set the
+	 * same \b dec, reads of such values fail with #MDB_INCOMPATIBLE otherwise.
+	 * Like #mdb_set_compare(), this function must be called before any data
+	 * access functions are used. The setting stays with the database handle.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] enc A #MDB_codec_func function to compress values, or NULL
+	 * to store new values as they are
+	 * @param[in] dec A #MDB_codec_func function to expand values, or NULL
+	 * @param[in] threshold The size of the smallest value to compress
+	 * @param[in] ctx An arbitrary pointer passed to \b enc and \b dec.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified, or the database
+	 *	has #MDB_DUPSORT.
+	 * </ul>
+	 */
+int  mdb_set_codec(MDB_txn *txn, MDB_dbi dbi, MDB_codec_func *enc,
+	MDB_codec_func *dec, size_t threshold, void *ctx);
+
 	/** @brief Get items from a database.
 	 *
 	 * This function retrieves key/data pairs from the database. The address
@@ -1406,6 +1643,81 @@ int  mdb_put(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data,
 	 */
 int  mdb_del(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data);
 
+	/** @brief Start a bulk load into a database.
+	 *
+	 * Items given to #mdb_bulk_put() are buffered in runs of about
+	 * \b run_size bytes. Each full run is sorted by a background thread
+	 * and written to a temporary file, while the caller fills the next
+	 * one. #mdb_bulk_end() merges the runs and stores the items in key
+	 * order. Keys may be given in any order.
+	 *
+	 * If the database is empty and does not use #MDB_DUPSORT, the merged
+	 * items are not stored with #mdb_put(): leaf pages are filled
+	 * completely one after another, and the branch pages above them are
+	 * built the same way, bottom-up. Inserting into such a database
+	 * later splits its full pages. Otherwise the items are stored with
+	 * #mdb_put() in key order.
+	 *
+	 * As with #mdb_put(), the last item put with a key replaces earlier
+	 * ones, unless the database supports duplicates.
+	 * The transaction must not be used for writes to \b dbi until
+	 * #mdb_bulk_end() or #mdb_bulk_abort(), and must still be committed
+	 * afterwards.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] run_size Bytes of items to sort in memory at a time,
+	 * or 0 for the default.
+	 * @param[in] nthreads Max number of runs sorted at once, or 0 for
+	 * the default.
+	 * @param[out] bulk Address where the new #MDB_bulk handle will be stored
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EACCES - an attempt was made to write in a read-only transaction.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  mdb_bulk_begin(MDB_txn *txn, MDB_dbi dbi, size_t run_size,
+	unsigned int nthreads, MDB_bulk **bulk);
+
+	/** @brief Add an item to a bulk load.
+	 *
+	 * The key and data are copied. The item is not visible in the
+	 * database before #mdb_bulk_end().
+	 * @param[in] bulk A bulk load handle returned by #mdb_bulk_begin()
+	 * @param[in] key The key to store in the database
+	 * @param[in] data The data to store
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#MDB_BAD_VALSIZE - the key or data is too large, see #mdb_put().
+	 *	<li>ENOMEM - out of memory.
+	 *	<li>EIO - a temporary file could not be written.
+	 * </ul>
+	 */
+int  mdb_bulk_put(MDB_bulk *bulk, MDB_val *key, MDB_val *data);
+
+	/** @brief Store the items of a bulk load and free its handle.
+	 *
+	 * The handle is freed even if an error is returned. After an
+	 * error the transaction may only be aborted.
+	 * @param[in] bulk A bulk load handle returned by #mdb_bulk_begin()
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#MDB_MAP_FULL - the database is full, see #mdb_env_set_mapsize().
+	 *	<li>ENOMEM - out of memory.
+	 *	<li>EIO - a temporary file could not be read or written.
+	 * </ul>
+	 */
+int  mdb_bulk_end(MDB_bulk *bulk);
+
+	/** @brief Discard the items of a bulk load and free its handle.
+	 * @param[in] bulk A bulk load handle returned by #mdb_bulk_begin()
+	 */
+void mdb_bulk_abort(MDB_bulk *bulk);
+
 	/** @brief Create a cursor handle.
 	 *
 	 * A cursor is associated with a specific transaction and database.
@@ -1589,6 +1901,48 @@ int  mdb_cursor_del(MDB_cursor *cursor, unsigned int flags);
 	 */
 int  mdb_cursor_count(MDB_cursor *cursor, mdb_size_t *countp);
 
+	/** @brief Prefetch leaf pages ahead of a cursor.
+	 *
+	 * While the cursor moves forward, the OS is advised that the next
+	 * \b npages leaf pages will be needed, so a scan does not take each
+	 * page fault in turn. If the cursor is positioned, the pages after
+	 * its current one are advised right away. This is only a hint, and
+	 * is ignored on Windows. The setting is cleared by #mdb_cursor_renew().
+	 * @param[in] cursor A cursor handle returned by #mdb_cursor_open()
+	 * @param[in] npages Number of leaf pages to prefetch, or 0 to stop.
+	 * @return A non-zero error value on failure and 0 on success.
+	 */
+int  mdb_cursor_readahead(MDB_cursor *cursor, unsigned int npages);
+
+	/** @brief Split the keys of a database into ranges of similar size.
+	 *
+	 * Reads the branch pages from the root down to the first level with
+	 * at least \b nparts pages, and returns keys that split that level
+	 * into \b nparts parts of similar page counts. The ranges are
+	 * [first key, keys[0]), [keys[0], keys[1]) ... [keys[*nkeys-1], last key].
+	 * Fewer keys are returned if the database is too small to split.
+	 *
+	 * Each range can then be scanned by its own cursor, e.g. positioned
+	 * with #MDB_SET_RANGE and stopped at the next key with #mdb_cmp().
+	 * In a read-only transaction, cursors on \b dbi opened after this
+	 * call may be used concurrently, one cursor per thread. This is not
+	 * supported when liblmdb is built with MDB_VL32.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] nparts The number of ranges wanted.
+	 * @param[out] keys An array of at least \b nparts - 1 items for the split
+	 * keys. They point into the database, see #mdb_get().
+	 * @param[out] nkeys Address where the number of keys will be stored.
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 *	<li>ENOMEM - out of memory.
+	 * </ul>
+	 */
+int  mdb_dbi_partition(MDB_txn *txn, MDB_dbi dbi, unsigned int nparts,
+	MDB_val *keys, unsigned int *nkeys);
+
 	/** @brief Compare two data items according to a particular database.
 	 *
 	 * This returns a comparison as if the two data items were keys in the
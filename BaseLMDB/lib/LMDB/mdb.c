@@ -682,6 +682,11 @@ static txnid_t mdb_debug_start;
 #define ENV_MAXKEY(env)	((env)->me_maxkey)
 #endif
 
+	/**	Size of a buffer for any key decoded from a #P_PREFIX page.
+	 *	#MDB_PREFIXKEYS needs a compile-time key size limit.
+	 */
+#define MDB_KEYBUF	((MDB_MAXKEYSIZE) > 0 ? (MDB_MAXKEYSIZE) : 1)
+
 	/**	@brief The maximum size of a data item.
 	 *
 	 *	We only store a 32 bit value for node sizes.
@@ -1008,6 +1013,7 @@ typedef struct MDB_page {
 #define	P_DIRTY		 0x10		/**< dirty page, also set for #P_SUBP pages */
 #define	P_LEAF2		 0x20		/**< for #MDB_DUPFIXED records */
 #define	P_SUBP		 0x40		/**< for #MDB_DUPSORT sub-pages */
+#define	P_PREFIX	 0x80		/**< leaf keys front-coded against an anchor */
 #define	P_LOOSE		 0x4000		/**< page was dirtied then freed, can be reused */
 #define	P_KEEP		 0x8000		/**< leave this page alone during spill */
 /** @} */
@@ -1075,6 +1081,8 @@ typedef struct MDB_page2 {
 #define IS_OVERFLOW(p)	 F_ISSET(MP_FLAGS(p), P_OVERFLOW)
 	/** Test if a page is a sub page */
 #define IS_SUBP(p)	 F_ISSET(MP_FLAGS(p), P_SUBP)
+	/** Test if a page is a front-coded leaf page */
+#define IS_PREFIX(p)	 F_ISSET(MP_FLAGS(p), P_PREFIX)
 
 	/** The number of overflow pages needed to store the given size. */
 #define OVPAGES(size, psize)	((PAGEHDRSZ-1 + (size)) / (psize) + 1)
@@ -1115,9 +1123,10 @@ typedef struct MDB_node {
 #define F_BIGDATA	 0x01			/**< data put on overflow page */
 #define F_SUBDATA	 0x02			/**< data is a sub-database */
 #define F_DUPDATA	 0x04			/**< data has duplicates */
+#define F_CODEC		 0x08			/**< data was compressed by the DB's codec */
 
 /** valid flags for #mdb_node_add() */
-#define	NODE_ADD_FLAGS	(F_DUPDATA|F_SUBDATA|MDB_RESERVE|MDB_APPEND)
+#define	NODE_ADD_FLAGS	(F_DUPDATA|F_SUBDATA|F_CODEC|MDB_RESERVE|MDB_APPEND)
 
 /** @} */
 	unsigned short	mn_flags;		/**< @ref mdb_node */
@@ -1199,12 +1208,40 @@ typedef struct MDB_node {
 	 */
 #define LEAF2KEY(p, i, ks)	((char *)(p) + PAGEHDRSZ + ((i)*(ks)))
 
-	/** Set the \b node's key into \b keyptr, if requested. */
-#define MDB_GET_KEY(node, keyptr)	{ if ((keyptr) != NULL) { \
-	(keyptr)->mv_size = NODEKSZ(node); (keyptr)->mv_data = NODEKEY(node); } }
+	/**	@brief Front-coded keys on #P_PREFIX pages.
+	 *
+	 *	A #P_PREFIX leaf keeps an anchor key at the top of the page,
+	 *	above all nodes: a length byte followed by the key bytes,
+	 *	padded to an even size. #MDB_page.%mp_pad holds its offset
+	 *	like an #MDB_page.%mp_ptrs entry, or 0 if there is no anchor.
+	 *	The key of each node starts with the length of its common
+	 *	prefix with the anchor, followed by the rest of the key. So
+	 *	every node is a restart point and a binary search never has
+	 *	to look at a neighbor to rebuild a key.
+	 */
+	/** Address of the anchor of a #P_PREFIX page */
+#define PAGEANCHOR(p)	 ((unsigned char *)(p) + MP_PAD(p) + PAGEBASE)
+	/** Size of the anchor region of a #P_PREFIX page */
+#define ANCHORSIZE(env, p)	 (MP_PAD(p) ? (env)->me_psize - PAGEBASE - MP_PAD(p) : 0)
+	/** Longest anchor, so its region fits in 256 bytes and the
+	 *	common prefix length fits in the first byte of a key.
+	 */
+#define MDB_ANCHORMAX	 254
+	/** Largest leaf node on page \b p before its data goes to an overflow
+	 *	page. Two nodes and an anchor must fit on a #P_PREFIX page, and
+	 *	their keys take an extra byte.
+	 */
+#define LEAF_NODEMAX(env, p)	 ((env)->me_nodemax - \
+	(IS_PREFIX(p) ? EVEN(MDB_ANCHORMAX + 1) / 2 + 2 : 0))
+
+	/** Set the \b node's key into \b keyptr, if requested. Keys of
+	 *	#P_PREFIX nodes are decoded into the cursor's key buffer.
+	 */
+#define MDB_GET_KEY(mc, node, keyptr)	{ if ((keyptr) != NULL) \
+	mdb_node_key((mc)->mc_pg[(mc)->mc_top], node, keyptr, (mc)->mc_kbuf); }
 
-	/** Set the \b node's key into \b key. */
-#define MDB_GET_KEY2(node, key)	{ key.mv_size = NODEKSZ(node); key.mv_data = NODEKEY(node); }
+	/** Set the \b node's key on page \b mp into \b key, decoding it into \b buf. */
+#define MDB_GET_KEY2(mp, node, key, buf)	mdb_node_key(mp, node, &(key), buf)
 
 	/** Information about a single database in the environment. */
 typedef struct MDB_db {
@@ -1220,9 +1257,11 @@ typedef struct MDB_db {
 
 #define MDB_VALID	0x8000		/**< DB handle is valid, for me_dbflags */
 #define PERSISTENT_FLAGS	(0xffff & ~(MDB_VALID))
+	/** #MDB_PREFIXKEYS is combined with flags it does not support */
+#define NO_PREFIXKEYS(f)	(((f) & MDB_PREFIXKEYS) && ((f) & (MDB_DUPSORT|MDB_INTEGERKEY)))
 	/** #mdb_dbi_open() flags */
 #define VALID_FLAGS	(MDB_REVERSEKEY|MDB_DUPSORT|MDB_INTEGERKEY|MDB_DUPFIXED|\
-	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_CREATE)
+	MDB_INTEGERDUP|MDB_REVERSEDUP|MDB_PREFIXKEYS|MDB_CREATE)
 
 	/** Handle for the DB used to track free pages. */
 #define	FREE_DBI	0
@@ -1289,11 +1328,28 @@ typedef struct MDB_dbx {
 	MDB_cmp_func	*md_dcmp;	/**< function for comparing data items */
 	MDB_rel_func	*md_rel;	/**< user relocate function */
 	void		*md_relctx;		/**< user-provided context for md_rel */
+	MDB_codec_func	*md_enc;	/**< value compressor, see #mdb_set_codec() */
+	MDB_codec_func	*md_dec;	/**< value expander */
+	void		*md_codecctx;	/**< user-provided context for md_enc and md_dec */
+	size_t		md_codecmin;	/**< smallest value to compress */
 } MDB_dbx;
 
 	/** A database transaction.
 	 *	Every operation requires a transaction handle.
 	 */
+	/** Key cache counters. A read txn counts its own lookups and
+	 *	adds them to the environment's when it ends.
+	 */
+typedef struct MDB_kccount {
+	uint64_t	kn_hits;		/**< lookups answered from a hint */
+	uint64_t	kn_misses;		/**< lookups that searched the tree */
+	uint64_t	kn_stale;		/**< misses with a hint from an older DB state */
+	uint64_t	kn_hit_ns;		/**< total time of the sampled hits */
+	uint64_t	kn_hit_samples;
+	uint64_t	kn_miss_ns;		/**< total time of the sampled misses */
+	uint64_t	kn_miss_samples;
+} MDB_kccount;
+
 struct MDB_txn {
 	MDB_txn		*mt_parent;		/**< parent of a nested txn */
 	/** Nested txn under this txn, set together with flag #MDB_TXN_HAS_CHILD */
@@ -1334,6 +1390,8 @@ struct MDB_txn {
 	MDB_db		*mt_dbs;
 	/** Array of sequence numbers for each DB handle */
 	unsigned int	*mt_dbiseqs;
+	/** Values expanded by a codec in this txn, see #mdb_scratch_alloc() */
+	struct MDB_scratch	*mt_scratch;
 /** @defgroup mt_dbflag	Transaction DB Flags
  *	@ingroup internal
  * @{
@@ -1394,6 +1452,7 @@ struct MDB_txn {
 	 *	dirty_list into mt_parent after freeing hidden mt_parent pages.
 	 */
 	unsigned int	mt_dirty_room;
+	MDB_kccount	mt_kc;		/**< key cache counters of a read txn */
 };
 
 /** Enough space for 2^32 nodes with minimum of 2 keys per node. I.e., plenty.
@@ -1449,8 +1508,10 @@ struct MDB_cursor {
 #define C_ORIG_RDONLY	MDB_TXN_RDONLY
 /** @} */
 	unsigned int	mc_flags;	/**< @ref mdb_cursor */
+	unsigned int	mc_rahead;	/**< leaf pages to prefetch, see #mdb_cursor_readahead() */
 	MDB_page	*mc_pg[CURSOR_STACK];	/**< stack of pushed pages */
 	indx_t		mc_ki[CURSOR_STACK];	/**< stack of page indices */
+	char		mc_kbuf[MDB_KEYBUF];	/**< last key decoded from a #P_PREFIX page */
 #ifdef MDB_VL32
 	MDB_page	*mc_ovpg;		/**< a referenced overflow page */
 #	define MC_OVPG(mc)			((mc)->mc_ovpg)
@@ -1533,6 +1594,8 @@ struct MDB_env {
 	MDB_txninfo	*me_txns;		/**< the memory map of the lock file or NULL */
 	MDB_meta	*me_metas[NUM_METAS];	/**< pointers to the two meta pages */
 	void		*me_pbuf;		/**< scratch area for DUPSORT put() */
+	void		*me_cbuf;		/**< scratch area for compressing in put() */
+	size_t		me_cbufsize;	/**< size of #me_cbuf */
 	MDB_txn		*me_txn;		/**< current write transaction */
 	MDB_txn		*me_txn0;		/**< prealloc'd write transaction */
 	mdb_size_t	me_mapsize;		/**< size of the data memory map */
@@ -1546,7 +1609,14 @@ struct MDB_env {
 	MDB_pgstate	me_pgstate;		/**< state of old pages from freeDB */
 #	define		me_pglast	me_pgstate.mf_pglast
 #	define		me_pghead	me_pgstate.mf_pghead
+	/** Run index of me_pghead, loaded by the first multi-page
+	 *	#mdb_page_alloc() of a write txn and kept in sync with it
+	 */
+	MDB_idrun	me_pgruns;
 	MDB_page	*me_dpages;		/**< list of malloc'd blocks for re-use */
+	struct MDB_commitq	*me_cq;	/**< group commit queue, if running */
+	struct MDB_keycache	*me_kc;	/**< key cache, if configured */
+	unsigned int	me_kcsize;	/**< slots of #me_kc, from #mdb_env_set_keycache() */
 	/** IDL of pages that became unused in a write txn */
 	MDB_IDL		me_free_pgs;
 	/** ID2L of pages written during a write txn. Length MDB_IDL_UM_SIZE. */
@@ -1627,6 +1697,11 @@ enum {
 #define MDB_END_SLOT MDB_NOTLS	/**< release any reader slot if #MDB_NOTLS */
 static void mdb_txn_end(MDB_txn *txn, unsigned mode);
 
+static int  mdb_kc_open(MDB_env *env);
+static void mdb_kc_close(MDB_env *env);
+static void mdb_kc_update(MDB_env *env, txnid_t id, MDB_txn *txn);
+static void mdb_kc_count(MDB_txn *txn);
+
 static int  mdb_page_get(MDB_cursor *mc, pgno_t pgno, MDB_page **mp, int *lvl);
 static int  mdb_page_search_root(MDB_cursor *mc,
 			    MDB_val *key, int modify);
@@ -1657,7 +1732,9 @@ static void mdb_node_del(MDB_cursor *mc, int ksize);
 static void mdb_node_shrink(MDB_page *mp, indx_t indx);
 static int	mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft);
 static int  mdb_node_read(MDB_cursor *mc, MDB_node *leaf, MDB_val *data);
-static size_t	mdb_leaf_size(MDB_env *env, MDB_val *key, MDB_val *data);
+static void	mdb_scratch_free(MDB_txn *txn, int keep);
+static void	mdb_node_key(MDB_page *mp, MDB_node *node, MDB_val *key, char *buf);
+static size_t	mdb_leaf_size(MDB_env *env, MDB_page *mp, MDB_val *key, MDB_val *data);
 static size_t	mdb_branch_size(MDB_env *env, MDB_val *key);
 
 static int	mdb_rebalance(MDB_cursor *mc);
@@ -1895,6 +1972,7 @@ mdb_page_list(MDB_page *mp)
 	MDB_node *node;
 	unsigned int i, nkeys, nsize, total = 0;
 	MDB_val key;
+	char nbuf[MDB_KEYBUF];
 	DKBUF;
 
 	switch (MP_FLAGS(mp) & (P_BRANCH|P_LEAF|P_LEAF2|P_META|P_OVERFLOW|P_SUBP)) {
@@ -1928,9 +2006,8 @@ mdb_page_list(MDB_page *mp)
 			continue;
 		}
 		node = NODEPTR(mp, i);
-		key.mv_size = node->mn_ksize;
-		key.mv_data = node->mn_data;
-		nsize = NODESIZE + key.mv_size;
+		mdb_node_key(mp, node, &key, nbuf);
+		nsize = NODESIZE + node->mn_ksize;
 		if (IS_BRANCH(mp)) {
 			fprintf(stderr, "key %d: page %"Yu", %s\n", i, NODEPGNO(node),
 				DKEY(&key));
@@ -2468,11 +2545,40 @@ mdb_page_dirty(MDB_txn *txn, MDB_page *mp)
 	txn->mt_dirty_room--;
 }
 
+/** Add pages just merged into me_pghead to its run index, if loaded.
+ * @param[in] env the environment handle.
+ * @param[in] idl the merged pages.
+ */
+static void
+mdb_pgruns_add(MDB_env *env, MDB_IDL idl)
+{
+	if (env->me_pgruns.ir_nleaf)
+		mdb_idrun_add(&env->me_pgruns, idl);
+}
+
+/** Merge pages only added to the run index so far into me_pghead,
+ * which must have room for them, and free their list.
+ * @param[in] env the environment handle.
+ * @param[in,out] pend the list of pages, or NULL.
+ */
+static void
+mdb_pgruns_flush(MDB_env *env, MDB_IDL *pend)
+{
+	if (*pend) {
+		mdb_midl_sort(*pend);
+		mdb_midl_xmerge(env->me_pghead, *pend);
+		mdb_midl_free(*pend);
+		*pend = NULL;
+	}
+}
+
 /** Allocate page numbers and memory for writing.  Maintain me_pglast,
  * me_pghead and mt_next_pgno.  Set #MDB_TXN_ERROR on failure.
  *
  * If there are free pages available from older transactions, they
  * are re-used first. Otherwise allocate a new page at mt_next_pgno.
+ * Ranges of several pages are found with the run index of me_pghead,
+ * loaded on the first such request of the txn.
  * Do not modify the freedB, just merge freeDB records into me_pghead[]
  * and move me_pglast to say which records were consumed.  Only this
  * function can create me_pghead and move me_pglast/mt_next_pgno.
@@ -2504,6 +2610,7 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 	MDB_env *env = txn->mt_env;
 	pgno_t pgno, *mop = env->me_pghead;
 	unsigned i, j, mop_len = mop ? mop[0] : 0, n2 = num-1;
+	MDB_IDL pend = NULL;	/* pages of records not merged into mop yet */
 	MDB_page *np;
 	txnid_t oldest = 0, last;
 	MDB_cursor_op op;
@@ -2538,11 +2645,22 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		 */
 		if (mop_len > n2) {
 			i = mop_len;
-			do {
+			if (n2) {
+				/* Find the lowest range in the run index */
+				if (!env->me_pgruns.ir_nleaf &&
+					(rc = mdb_idrun_load(&env->me_pgruns, mop)) != 0)
+					goto fail;
+				pgno = mdb_idrun_find(&env->me_pgruns, num);
+				i = 0;
+				if (pgno) {
+					mdb_pgruns_flush(env, &pend);
+					i = mdb_midl_search(mop, pgno);
+				}
+			}
+			if (i) {
 				pgno = mop[i];
-				if (mop[i-n2] == pgno+n2)
-					goto search_done;
-			} while (--i > n2);
+				goto search_done;
+			}
 			if (--retry < 0)
 				break;
 		}
@@ -2611,7 +2729,7 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 				goto fail;
 			}
 		} else {
-			if ((rc = mdb_midl_need(&env->me_pghead, i)) != 0)
+			if ((rc = mdb_midl_need(&env->me_pghead, i + (pend ? pend[0] : 0))) != 0)
 				goto fail;
 			mop = env->me_pghead;
 		}
@@ -2622,10 +2740,27 @@ mdb_page_alloc(MDB_cursor *mc, int num, MDB_page **mp)
 		for (j = i; j; j--)
 			DPRINTF(("IDL %"Yu, idl[j]));
 #endif
+		if (n2 && env->me_pgruns.ir_nleaf) {
+			/* Index the pages now, merge them into mop all at once
+			 * when a range is found or we stop looking
+			 */
+			if (!pend && !(pend = mdb_midl_alloc(i))) {
+				rc = ENOMEM;
+				goto fail;
+			}
+			if ((rc = mdb_midl_append_list(&pend, idl)) != 0)
+				goto fail;
+			mdb_idrun_add(&env->me_pgruns, idl);
+			mop_len += i;
+			continue;
+		}
+		mdb_pgruns_flush(env, &pend);
 		/* Merge in descending sorted order */
 		mdb_midl_xmerge(mop, idl);
+		mdb_pgruns_add(env, idl);
 		mop_len = mop[0];
 	}
+	mdb_pgruns_flush(env, &pend);
 
 	/* Use new pages from the map when nothing suitable in the freeDB */
 	i = 0;
@@ -2660,6 +2795,8 @@ search_done:
 		}
 	}
 	if (i) {
+		if (env->me_pgruns.ir_nleaf)
+			mdb_idrun_set(&env->me_pgruns, pgno, num, 0);
 		mop[0] = mop_len -= num;
 		/* Move any stragglers down */
 		for (j = i-num; j < mop_len; )
@@ -2674,6 +2811,7 @@ search_done:
 	return MDB_SUCCESS;
 
 fail:
+	mdb_midl_free(pend);
 	txn->mt_flags |= MDB_TXN_ERROR;
 	return rc;
 }
@@ -3396,6 +3534,8 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 				txn->mt_u.reader = NULL;
 			} /* else txn owns the slot until it does MDB_END_SLOT */
 		}
+		if (env->me_kc)
+			mdb_kc_count(txn);
 		txn->mt_numdbs = 0;		/* prevent further DBI activity */
 		txn->mt_flags |= MDB_TXN_FINISHED;
 
@@ -3434,6 +3574,7 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 		mdb_midl_free(txn->mt_spill_pgs);
 
 		mdb_midl_free(pghead);
+		mdb_idrun_reset(&env->me_pgruns);
 	}
 #ifdef MDB_VL32
 	if (!txn->mt_parent) {
@@ -3460,6 +3601,8 @@ mdb_txn_end(MDB_txn *txn, unsigned mode)
 			free(tl);
 	}
 #endif
+	if (txn->mt_scratch)
+		mdb_scratch_free(txn, !(mode & MDB_END_FREE));
 	if (mode & MDB_END_FREE)
 		free(txn);
 }
@@ -3687,6 +3830,7 @@ mdb_freelist_save(MDB_txn *txn)
 		loose[0] = count;
 		mdb_midl_sort(loose);
 		mdb_midl_xmerge(mop, loose);
+		mdb_pgruns_add(env, loose);
 		txn->mt_loose_pgs = NULL;
 		txn->mt_loose_count = 0;
 		mop_len = mop[0];
@@ -4120,6 +4264,7 @@ _mdb_txn_commit(MDB_txn *txn)
 
 		parent->mt_child = NULL;
 		mdb_midl_free(((MDB_ntxn *)txn)->mnt_pgstate.mf_pghead);
+		mdb_scratch_free(txn, 0);
 		free(txn);
 		return rc;
 	}
@@ -4179,8 +4324,14 @@ _mdb_txn_commit(MDB_txn *txn)
 	if (!F_ISSET(txn->mt_flags, MDB_TXN_NOSYNC) &&
 		(rc = mdb_env_sync0(env, 0, txn->mt_next_pgno)))
 		goto fail;
-	if ((rc = mdb_env_write_meta(txn)))
+	if (env->me_kc)
+		mdb_kc_update(env, txn->mt_txnid, txn);
+	if ((rc = mdb_env_write_meta(txn))) {
+		/* Another process may commit this txnid instead */
+		if (env->me_kc)
+			mdb_kc_update(env, txn->mt_txnid, NULL);
 		goto fail;
+	}
 	end_mode = MDB_END_COMMITTED|MDB_END_UPDATE;
 	if (env->me_flags & MDB_PREVSNAPSHOT) {
 		if (!(env->me_flags & MDB_NOLOCK)) {
@@ -4208,6 +4359,234 @@ mdb_txn_commit(MDB_txn *txn)
 	return _mdb_txn_commit(txn);
 }
 
+#ifndef MDB_COMMITQ_MAX
+#define MDB_COMMITQ_MAX	256	/**< default max batches per group commit */
+#endif
+
+	/** A batch submitted to the commit queue. It lives on the
+	 *	submitter's stack, and the committer must not touch it
+	 *	after setting #cr_done.
+	 */
+typedef struct MDB_cqreq {
+	struct MDB_cqreq *cr_next;
+	MDB_commit_func *cr_func;
+	void *cr_arg;
+	pthread_cond_t cr_cond;	/**< Condition variable for #cr_done */
+	int cr_rc;				/**< Result of the batch */
+	int cr_done;
+} MDB_cqreq;
+
+	/** State of a group commit queue. */
+typedef struct MDB_commitq {
+	MDB_env *cq_env;
+	pthread_t cq_thr;
+	pthread_mutex_t cq_mutex;	/**< Protects the queue and all #cr_done */
+	pthread_cond_t cq_cond;	/**< Condition variable for #cq_head and #cq_stop */
+	MDB_cqreq *cq_head;		/**< Oldest pending batch */
+	MDB_cqreq *cq_tail;		/**< Newest pending batch */
+	unsigned int cq_max;	/**< Max batches per transaction */
+	int cq_stop;
+} MDB_commitq;
+
+	/** Apply a group of batches in one write transaction and commit it.
+	 *	Batches that fail are skipped and keep their error in #cr_rc.
+	 * @param[in] env The environment.
+	 * @param[in] group The batches, linked by #cr_next.
+	 * @return 0 on success, non-zero if the group could not be committed.
+	 */
+static int
+mdb_env_cqgroup(MDB_env *env, MDB_cqreq *group)
+{
+	MDB_txn *txn, *child;
+	MDB_cqreq *req;
+	int rc;
+
+	/* Batches run in nested txns where possible, so a failed batch is
+	 * just aborted. WRITEMAP has no nested txns: abort the whole group
+	 * instead and rerun it without the batches that failed.
+	 */
+	for (;;) {
+		rc = mdb_txn_begin(env, NULL, 0, &txn);
+		if (rc)
+			return rc;
+		for (req = group; req; req = req->cr_next) {
+			if (req->cr_rc)
+				continue;
+			if (env->me_flags & MDB_WRITEMAP) {
+				if ((req->cr_rc = req->cr_func(txn, req->cr_arg)) != 0)
+					break;
+				continue;
+			}
+			if ((rc = mdb_txn_begin(env, txn, 0, &child)) != 0)
+				break;
+			if ((req->cr_rc = req->cr_func(child, req->cr_arg)) != 0)
+				mdb_txn_abort(child);
+			else if ((rc = mdb_txn_commit(child)) != 0)
+				break;
+		}
+		if (!req)
+			return mdb_txn_commit(txn);
+		mdb_txn_abort(txn);
+		if (rc)
+			return rc;
+	}
+}
+
+	/** Dedicated committer thread for the commit queue. */
+static THREAD_RET ESECT CALL_CONV
+mdb_env_cqthr(void *arg)
+{
+	MDB_commitq *cq = arg;
+	MDB_cqreq *group, *req, *next;
+	unsigned int n;
+	int rc;
+
+	pthread_mutex_lock(&cq->cq_mutex);
+	for (;;) {
+		while (!cq->cq_head && !cq->cq_stop)
+			pthread_cond_wait(&cq->cq_cond, &cq->cq_mutex);
+		if (!cq->cq_head)
+			break;
+		/* Everything that arrived during the last commit goes in this one */
+		group = req = cq->cq_head;
+		for (n = 1; n < cq->cq_max && req->cr_next; n++)
+			req = req->cr_next;
+		cq->cq_head = req->cr_next;
+		req->cr_next = NULL;
+		pthread_mutex_unlock(&cq->cq_mutex);
+
+		rc = mdb_env_cqgroup(cq->cq_env, group);
+
+		pthread_mutex_lock(&cq->cq_mutex);
+		for (req = group; req; req = next) {
+			next = req->cr_next;
+			if (!req->cr_rc)
+				req->cr_rc = rc;
+			req->cr_done = 1;
+			pthread_cond_signal(&req->cr_cond);
+		}
+	}
+	pthread_mutex_unlock(&cq->cq_mutex);
+	return (THREAD_RET)0;
+}
+
+int ESECT
+mdb_env_commitq_start(MDB_env *env, unsigned int max_batches)
+{
+	MDB_commitq *cq;
+	int rc;
+
+	if (env == NULL || env->me_cq ||
+		(env->me_flags & (MDB_ENV_ACTIVE|MDB_RDONLY)) != MDB_ENV_ACTIVE)
+		return EINVAL;
+
+	MDB_TRACE(("%p, %u", env, max_batches));
+	if ((cq = calloc(1, sizeof(MDB_commitq))) == NULL)
+		return ENOMEM;
+	cq->cq_env = env;
+	cq->cq_max = max_batches ? max_batches : MDB_COMMITQ_MAX;
+#ifdef _WIN32
+	if (!(cq->cq_mutex = CreateMutex(NULL, FALSE, NULL)) ||
+		!(cq->cq_cond = CreateEvent(NULL, FALSE, FALSE, NULL))) {
+		rc = ErrCode();
+		goto fail;
+	}
+#else
+	if ((rc = pthread_mutex_init(&cq->cq_mutex, NULL)) != 0)
+		goto fail2;
+	if ((rc = pthread_cond_init(&cq->cq_cond, NULL)) != 0)
+		goto fail1;
+#endif
+	if ((rc = THREAD_CREATE(cq->cq_thr, mdb_env_cqthr, cq)) != 0)
+		goto fail;
+	env->me_cq = cq;
+	return MDB_SUCCESS;
+
+fail:
+#ifdef _WIN32
+	if (cq->cq_cond)  CloseHandle(cq->cq_cond);
+	if (cq->cq_mutex) CloseHandle(cq->cq_mutex);
+#else
+	pthread_cond_destroy(&cq->cq_cond);
+fail1:
+	pthread_mutex_destroy(&cq->cq_mutex);
+fail2:
+#endif
+	free(cq);
+	return rc;
+}
+
+int ESECT
+mdb_env_commitq_stop(MDB_env *env)
+{
+	MDB_commitq *cq;
+	int rc;
+
+	if (env == NULL || (cq = env->me_cq) == NULL)
+		return EINVAL;
+
+	MDB_TRACE(("%p", env));
+	pthread_mutex_lock(&cq->cq_mutex);
+	cq->cq_stop = 1;
+	pthread_cond_signal(&cq->cq_cond);
+	pthread_mutex_unlock(&cq->cq_mutex);
+	rc = THREAD_FINISH(cq->cq_thr);
+	env->me_cq = NULL;
+#ifdef _WIN32
+	CloseHandle(cq->cq_thr);
+	CloseHandle(cq->cq_cond);
+	CloseHandle(cq->cq_mutex);
+#else
+	pthread_cond_destroy(&cq->cq_cond);
+	pthread_mutex_destroy(&cq->cq_mutex);
+#endif
+	free(cq);
+	return rc;
+}
+
+int
+mdb_env_commitq_submit(MDB_env *env, MDB_commit_func *func, void *arg)
+{
+	MDB_commitq *cq;
+	MDB_cqreq req;
+
+	if (env == NULL || func == NULL || (cq = env->me_cq) == NULL)
+		return EINVAL;
+
+	MDB_TRACE(("%p, %p, %p", env, func, arg));
+	req.cr_next = NULL;
+	req.cr_func = func;
+	req.cr_arg = arg;
+	req.cr_rc = 0;
+	req.cr_done = 0;
+#ifdef _WIN32
+	if (!(req.cr_cond = CreateEvent(NULL, FALSE, FALSE, NULL)))
+		return ErrCode();
+#else
+	{
+		int rc = pthread_cond_init(&req.cr_cond, NULL);
+		if (rc)
+			return rc;
+	}
+#endif
+	pthread_mutex_lock(&cq->cq_mutex);
+	if (cq->cq_head)
+		cq->cq_tail->cr_next = &req;
+	else
+		cq->cq_head = &req;
+	cq->cq_tail = &req;
+	pthread_cond_signal(&cq->cq_cond);
+	while (!req.cr_done)
+		pthread_cond_wait(&req.cr_cond, &cq->cq_mutex);
+	pthread_mutex_unlock(&cq->cq_mutex);
+#ifdef _WIN32
+	CloseHandle(req.cr_cond);
+#else
+	pthread_cond_destroy(&req.cr_cond);
+#endif
+	return req.cr_rc;
+}
+
 /** Read the environment parameters of a DB environment before
  * mapping it into memory.
  * @param[in] env the environment handle
@@ -4707,6 +5086,16 @@ mdb_env_get_maxreaders(MDB_env *env, unsigned int *readers)
 	return MDB_SUCCESS;
 }
 
+int ESECT
+mdb_env_set_keycache(MDB_env *env, unsigned int size)
+{
+	if (env->me_map || size > 1U << 30)
+		return EINVAL;
+	env->me_kcsize = size;
+	MDB_TRACE(("%p, %u", env, size));
+	return MDB_SUCCESS;
+}
+
 static int ESECT
 mdb_fsize(HANDLE fd, mdb_size_t *size)
 {
@@ -5681,6 +6070,8 @@ mdb_env_open(MDB_env *env, const char *path, unsigned int flags, mdb_mode_t mode
 		rc = ENOMEM;
 		goto leave;
 	}
+	if (env->me_kcsize && (rc = mdb_kc_open(env)) != 0)
+		goto leave;
 	env->me_dbxs[FREE_DBI].md_cmp = mdb_cmp_long; /* aligned MDB_INTEGERKEY */
 
 	/* For RDONLY, get lockfile after we know datafile exists */
@@ -5783,6 +6174,8 @@ mdb_env_close0(MDB_env *env, int excl)
 	}
 
 	free(env->me_pbuf);
+	free(env->me_cbuf);
+	mdb_kc_close(env);
 	free(env->me_dbiseqs);
 	free(env->me_dbflags);
 	free(env->me_path);
@@ -5798,8 +6191,11 @@ mdb_env_close0(MDB_env *env, int excl)
 		free(el);
 	}
 #endif
+	if (env->me_txn0)
+		mdb_scratch_free(env->me_txn0, 0);
 	free(env->me_txn0);
 	mdb_midl_free(env->me_free_pgs);
+	mdb_idrun_free(&env->me_pgruns);
 
 	if (env->me_flags & MDB_ENV_TXKEY) {
 		pthread_key_delete(env->me_txkey);
@@ -5915,6 +6311,8 @@ mdb_env_close(MDB_env *env)
 		return;
 
 	MDB_TRACE(("%p", env));
+	if (env->me_cq)
+		mdb_env_commitq_stop(env);
 	VGMEMP_DESTROY(env);
 	while ((dp = env->me_dpages) != NULL) {
 		VGMEMP_DEFINED(&dp->mp_next, sizeof(dp->mp_next));
@@ -6021,6 +6419,98 @@ mdb_cmp_memnr(const MDB_val *a, const MDB_val *b)
 	return len_diff<0 ? -1 : len_diff;
 }
 
+/** Length of the common prefix of two keys, at most #MDB_ANCHORMAX. */
+static unsigned int
+mdb_prefix_shared(const MDB_val *a, const MDB_val *b)
+{
+	const unsigned char *p1 = a->mv_data, *p2 = b->mv_data;
+	size_t i, len = a->mv_size < b->mv_size ? a->mv_size : b->mv_size;
+
+	if (len > MDB_ANCHORMAX)
+		len = MDB_ANCHORMAX;
+	for (i = 0; i < len && p1[i] == p2[i]; i++)
+		;
+	return i;
+}
+
+/** Get the anchor of a #P_PREFIX page, an empty key if it has none. */
+static void
+mdb_page_anchor(MDB_page *mp, MDB_val *anchor)
+{
+	if (MP_PAD(mp)) {
+		anchor->mv_size = *PAGEANCHOR(mp);
+		anchor->mv_data = PAGEANCHOR(mp) + 1;
+	} else {
+		anchor->mv_size = 0;
+		anchor->mv_data = NULL;
+	}
+}
+
+/** Store the anchor of an empty #P_PREFIX page.
+ * @param[in] env The environment handle.
+ * @param[in] mp The page. It must not have any nodes.
+ * @param[in] key The anchor, cut to #MDB_ANCHORMAX bytes.
+ * An empty key leaves the page without an anchor.
+ */
+static void
+mdb_page_set_anchor(MDB_env *env, MDB_page *mp, MDB_val *key)
+{
+	unsigned int len = key->mv_size < MDB_ANCHORMAX ? key->mv_size : MDB_ANCHORMAX;
+	unsigned char *ptr;
+
+	MP_UPPER(mp) = env->me_psize - PAGEBASE;
+	MP_PAD(mp) = 0;
+	if (len) {
+		MP_UPPER(mp) -= EVEN(len + 1);
+		MP_PAD(mp) = MP_UPPER(mp);
+		ptr = PAGEANCHOR(mp);
+		ptr[0] = len;
+		memcpy(ptr + 1, key->mv_data, len);
+	}
+}
+
+/** Size of a key when stored in a node on the given page. */
+static size_t
+mdb_prefix_ksize(MDB_page *mp, MDB_val *key)
+{
+	MDB_val anchor;
+
+	if (!IS_PREFIX(mp))
+		return key->mv_size;
+	mdb_page_anchor(mp, &anchor);
+	return 1 + key->mv_size - mdb_prefix_shared(&anchor, key);
+}
+
+/** Get the key of a node.
+ * Keys on #P_PREFIX pages are rebuilt from the page's anchor into
+ * \b buf, unless they share nothing with it.
+ * @param[in] mp The page holding the node.
+ * @param[in] node The node.
+ * @param[out] key The key of the node.
+ * @param[in] buf A buffer of at least #MDB_KEYBUF bytes.
+ */
+static void
+mdb_node_key(MDB_page *mp, MDB_node *node, MDB_val *key, char *buf)
+{
+	unsigned char *ptr = NODEKEY(node);
+	unsigned int shared;
+
+	if (!IS_PREFIX(mp)) {
+		key->mv_size = NODEKSZ(node);
+		key->mv_data = ptr;
+		return;
+	}
+	shared = ptr[0];
+	key->mv_size = shared + NODEKSZ(node) - 1;
+	if (!shared) {
+		key->mv_data = ptr + 1;
+		return;
+	}
+	memcpy(buf, PAGEANCHOR(mp) + 1, shared);
+	memcpy(buf + shared, ptr + 1, NODEKSZ(node) - 1);
+	key->mv_data = buf;
+}
+
 /** Search for key within a page, using binary search.
  * Returns the smallest entry larger or equal to the key.
  * If exactp is non-null, stores whether the found entry was an exact match
@@ -6076,6 +6566,52 @@ mdb_node_search(MDB_cursor *mc, MDB_val *key, int *exactp)
 			else
 				high = i - 1;
 		}
+	} else if (IS_PREFIX(mp)) {
+		MDB_val anchor, rest;
+		unsigned int lcp, shared;
+		unsigned char *ptr;
+		char nbuf[MDB_KEYBUF];
+		int memn = cmp == mdb_cmp_memn;
+
+		/* With the default comparator, match the key against the
+		 * anchor once. A node sharing no more than that with the
+		 * anchor is compared by its suffix alone, any other node
+		 * sorts as the anchor does. Other comparators see the
+		 * rebuilt key.
+		 */
+		mdb_page_anchor(mp, &anchor);
+		lcp = mdb_prefix_shared(&anchor, key);
+		while (low <= high) {
+			i = (low + high) >> 1;
+
+			node = NODEPTR(mp, i);
+			if (memn) {
+				ptr = NODEKEY(node);
+				shared = ptr[0];
+				if (shared <= lcp) {
+					rest.mv_size = key->mv_size - shared;
+					rest.mv_data = (char *)key->mv_data + shared;
+					nodekey.mv_size = NODEKSZ(node) - 1;
+					nodekey.mv_data = ptr + 1;
+					rc = mdb_cmp_memn(&rest, &nodekey);
+				} else if (key->mv_size == lcp) {
+					rc = -1;
+				} else {
+					rc = (int)((unsigned char *)key->mv_data)[lcp] -
+						(int)((unsigned char *)anchor.mv_data)[lcp];
+				}
+			} else {
+				mdb_node_key(mp, node, &nodekey, nbuf);
+				rc = cmp(key, &nodekey);
+			}
+			DPRINTF(("found prefix leaf index %u, rc = %i", i, rc));
+			if (rc == 0)
+				break;
+			if (rc > 0)
+				low = i + 1;
+			else
+				high = i - 1;
+		}
 	} else {
 		while (low <= high) {
 			i = (low + high) >> 1;
@@ -6803,6 +7339,8 @@ release:
 		while (j>i)
 			mop[j--] = pg++;
 		mop[0] += ovpages;
+		if (env->me_pgruns.ir_nleaf)
+			mdb_idrun_set(&env->me_pgruns, pg - ovpages, ovpages, 1);
 	} else {
 		rc = mdb_midl_append_range(&txn->mt_free_pgs, pg, ovpages);
 		if (rc)
@@ -6816,7 +7354,158 @@ release:
 	return 0;
 }
 
+	/** @defgroup codec	Value Codec
+	 *	@{
+	 *
+	 *	A value compressed by the codec of its DB is stored with the
+	 *	#F_CODEC node flag, as its original size followed by the output
+	 *	of #MDB_dbx.%md_enc. Reads expand it into the scratch arena of
+	 *	the txn, a list of chunks freed when the txn ends.
+	 */
+#ifndef MDB_SCRATCH_SIZE
+	/** Size of a scratch arena chunk */
+#define MDB_SCRATCH_SIZE	(128*1024)
+#endif
+	/** Size of the header of a compressed value */
+#define CODEC_HDR	sizeof(uint32_t)
+
+	/** A chunk of a scratch arena, its memory follows this header */
+typedef struct MDB_scratch {
+	struct MDB_scratch	*ms_next;
+	size_t		ms_size;		/**< bytes in the chunk */
+	size_t		ms_used;		/**< bytes handed out */
+} MDB_scratch;
+
+/** Allocate memory that lives until the txn ends.
+ * Allocations larger than a chunk get a chunk of their own, which
+ * goes behind the current one so that its free space stays in use.
+ * @param[in] txn the transaction
+ * @param[in] size the number of bytes
+ * @return the memory, or NULL on failure.
+ */
+static void *
+mdb_scratch_alloc(MDB_txn *txn, size_t size)
+{
+	MDB_scratch *ms = txn->mt_scratch, *nm;
+	size_t len;
+	char *ptr;
+
+	size = (size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+	if (ms && ms->ms_size - ms->ms_used >= size) {
+		ptr = (char *)(ms + 1) + ms->ms_used;
+		ms->ms_used += size;
+		return ptr;
+	}
+	len = size > MDB_SCRATCH_SIZE ? size : MDB_SCRATCH_SIZE;
+	if ((nm = malloc(sizeof(MDB_scratch) + len)) == NULL)
+		return NULL;
+	nm->ms_size = len;
+	nm->ms_used = size;
+	if (ms && len > MDB_SCRATCH_SIZE) {
+		nm->ms_next = ms->ms_next;
+		ms->ms_next = nm;
+	} else {
+		nm->ms_next = ms;
+		txn->mt_scratch = nm;
+	}
+	return nm + 1;
+}
+
+/** Free the scratch arena of a txn.
+ * @param[in] txn the transaction
+ * @param[in] keep non-zero to keep the current chunk for reuse
+ */
+static void
+mdb_scratch_free(MDB_txn *txn, int keep)
+{
+	MDB_scratch *ms = txn->mt_scratch, *next;
+
+	if (keep && ms && ms->ms_size == MDB_SCRATCH_SIZE) {
+		ms->ms_used = 0;
+		next = ms->ms_next;
+		ms->ms_next = NULL;
+	} else {
+		next = ms;
+		txn->mt_scratch = NULL;
+	}
+	for (ms = next; ms; ms = next) {
+		next = ms->ms_next;
+		free(ms);
+	}
+}
+
+/** Compress a value with the codec of the cursor's DB.
+ * The result is in #MDB_env.%me_cbuf, valid until the next put.
+ * @param[in] mc the cursor for this operation
+ * @param[in] data the value
+ * @param[out] cdata the compressed value
+ * @return 0 on success, #MDB_NOTFOUND to store the value as it is,
+ * or ENOMEM.
+ */
+static int
+mdb_codec_compress(MDB_cursor *mc, MDB_val *data, MDB_val *cdata)
+{
+	MDB_env *env = mc->mc_txn->mt_env;
+	MDB_dbx *dbx = mc->mc_dbx;
+	MDB_val dst;
+	uint32_t size;
+
+	if (data->mv_size <= CODEC_HDR + 1)
+		return MDB_NOTFOUND;
+	if (env->me_cbufsize < data->mv_size) {
+		void *ptr = realloc(env->me_cbuf, data->mv_size);
+		if (!ptr)
+			return ENOMEM;
+		env->me_cbuf = ptr;
+		env->me_cbufsize = data->mv_size;
+	}
+	/* the result must be smaller than the value */
+	dst.mv_size = data->mv_size - CODEC_HDR - 1;
+	dst.mv_data = (char *)env->me_cbuf + CODEC_HDR;
+	if (dbx->md_enc(&dst, data, dbx->md_codecctx) ||
+		dst.mv_size > data->mv_size - CODEC_HDR - 1)
+		return MDB_NOTFOUND;
+	size = data->mv_size;
+	memcpy(env->me_cbuf, &size, CODEC_HDR);
+	cdata->mv_size = CODEC_HDR + dst.mv_size;
+	cdata->mv_data = env->me_cbuf;
+	return MDB_SUCCESS;
+}
+
+/** Expand a compressed value into the scratch arena of the cursor's txn.
+ * @param[in] mc the cursor for this operation
+ * @param[in,out] data the stored value, replaced by the expanded one
+ * @return 0 on success, non-zero on failure.
+ */
+static int
+mdb_codec_expand(MDB_cursor *mc, MDB_val *data)
+{
+	MDB_dbx *dbx = mc->mc_dbx;
+	MDB_val src, dst;
+	uint32_t size;
+	int rc;
+
+	if (!dbx->md_dec)
+		return MDB_INCOMPATIBLE;
+	if (data->mv_size < CODEC_HDR)
+		return MDB_CORRUPTED;
+	memcpy(&size, data->mv_data, CODEC_HDR);
+	src.mv_size = data->mv_size - CODEC_HDR;
+	src.mv_data = (char *)data->mv_data + CODEC_HDR;
+	dst.mv_size = size;
+	if ((dst.mv_data = mdb_scratch_alloc(mc->mc_txn, size)) == NULL)
+		return ENOMEM;
+	if ((rc = dbx->md_dec(&dst, &src, dbx->md_codecctx)) != 0)
+		return rc;
+	if (dst.mv_size != size)
+		return MDB_CORRUPTED;
+	*data = dst;
+	return MDB_SUCCESS;
+}
+/** @} */
+
 /** Return the data associated with a given node.
+ * Compressed data is expanded, other data is returned in place.
  * @param[in] mc The cursor for this operation.
  * @param[in] leaf The node being read.
  * @param[out] data Updated to point to the node's data.
@@ -6836,6 +7525,8 @@ mdb_node_read(MDB_cursor *mc, MDB_node *leaf, MDB_val *data)
 	if (!F_ISSET(leaf->mn_flags, F_BIGDATA)) {
 		data->mv_size = NODEDSZ(leaf);
 		data->mv_data = NODEDATA(leaf);
+		if (leaf->mn_flags & F_CODEC)
+			return mdb_codec_expand(mc, data);
 		return MDB_SUCCESS;
 	}
 
@@ -6849,29 +7540,359 @@ mdb_node_read(MDB_cursor *mc, MDB_node *leaf, MDB_val *data)
 	}
 	data->mv_data = METADATA(omp);
 	MC_SET_OVPG(mc, omp);
+	if (leaf->mn_flags & F_CODEC)
+		return mdb_codec_expand(mc, data);
 
 	return MDB_SUCCESS;
 }
 
-int
-mdb_get(MDB_txn *txn, MDB_dbi dbi,
-    MDB_val *key, MDB_val *data)
+	/** @defgroup keycache	Key Cache
+	 *	@{
+	 *
+	 *	A hint in the key cache says where #mdb_get() found a key in some
+	 *	snapshot. It is good for any snapshot with the same state of the
+	 *	key's DB. The cache tracks the state of each DB by the commits it
+	 *	knows of: #kc_mod[dbi] is a snapshot from which on the DB is known
+	 *	unchanged up to #kc_last. Our own writers update both before their
+	 *	meta page is written. A reader that sees a snapshot after #kc_last
+	 *	missed a commit by another process, and marks all DBs changed.
+	 *	#kc_last and #kc_mod only grow, by compare-and-swap, and each
+	 *	update raises #kc_mod before #kc_last, so readers can do this
+	 *	without locks; our writers are already serialized by the write lock.
+	 *	Lookups read the slots without locks, each slot has a sequence
+	 *	number that is odd while a reader is writing it.
+	 */
+#ifndef MDB_KC_SAMPLE
+	/** Measure the time of one in this many lookups of a txn */
+#define MDB_KC_SAMPLE	16
+#endif
+
+#ifdef _WIN32
+#define KC_CAS(p, old, new) \
+	(InterlockedCompareExchange((LONG volatile *)(p), new, old) == (LONG)(old))
+#define KC_CASID(p, old, new) \
+	(InterlockedCompareExchangePointer((PVOID volatile *)(p), (PVOID)(new), (PVOID)(old)) == (PVOID)(old))
+#define KC_ADD(p, n)	InterlockedExchangeAdd64((LONG64 volatile *)(p), n)
+#define KC_BARRIER()	MemoryBarrier()
+#else
+#define KC_CAS(p, old, new)	__sync_bool_compare_and_swap(p, old, new)
+#define KC_CASID(p, old, new)	__sync_bool_compare_and_swap(p, old, new)
+#define KC_ADD(p, n)	__sync_fetch_and_add(p, n)
+#if defined(__i386__) || defined(__x86_64__)
+	/* Loads are not reordered with loads, nor stores with stores */
+#define KC_BARRIER()	__asm__ __volatile__("" ::: "memory")
+#else
+#define KC_BARRIER()	__sync_synchronize()
+#endif
+#endif
+
+	/** A slot of the key cache */
+typedef struct MDB_kcent {
+	volatile unsigned int	ke_seq;	/**< odd while the slot is being written */
+	unsigned int	ke_hash;	/**< hash of the key and DBI */
+	unsigned int	ke_dbiseq;	/**< #MDB_txn.%mt_dbiseqs of the DBI */
+	MDB_dbi		ke_dbi;
+	txnid_t		ke_txnid;	/**< snapshot the key was found in */
+	pgno_t		ke_pgno;	/**< its leaf page */
+	indx_t		ke_indx;	/**< its node on the page */
+} MDB_kcent;
+
+typedef struct MDB_keycache {
+	MDB_kcent	*kc_ents;
+	unsigned int	kc_mask;	/**< number of slots - 1 */
+	volatile txnid_t	kc_last;	/**< last commit #kc_mod knows of */
+	volatile txnid_t	*kc_mod;	/**< for each DBI, see @ref keycache */
+	MDB_kccount	kc_count;	/**< counters of finished read txns */
+} MDB_keycache;
+
+	/** Allocate the key cache of an environment being opened. */
+static int ESECT
+mdb_kc_open(MDB_env *env)
 {
-	MDB_cursor	mc;
-	MDB_xcursor	mx;
-	int exact = 0, rc;
-	DKBUF;
+	MDB_keycache *kc;
+	unsigned int size = 1;
 
-	DPRINTF(("===> get db %u key [%s]", dbi, DKEY(key)));
+	while (size < env->me_kcsize)
+		size <<= 1;
+	if ((kc = calloc(1, sizeof(MDB_keycache))) == NULL)
+		return ENOMEM;
+	kc->kc_ents = calloc(size, sizeof(MDB_kcent));
+	kc->kc_mod = calloc(env->me_maxdbs, sizeof(txnid_t));
+	if (!kc->kc_ents || !kc->kc_mod) {
+		free((void *)kc->kc_mod);
+		free(kc->kc_ents);
+		free(kc);
+		return ENOMEM;
+	}
+	kc->kc_mask = size - 1;
+	env->me_kc = kc;
+	return MDB_SUCCESS;
+}
 
-	if (!key || !data || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
-		return EINVAL;
+static void ESECT
+mdb_kc_close(MDB_env *env)
+{
+	MDB_keycache *kc = env->me_kc;
 
-	if (txn->mt_flags & MDB_TXN_BLOCKED)
+	if (!kc)
+		return;
+	free((void *)kc->kc_mod);
+	free(kc->kc_ents);
+	free(kc);
+	env->me_kc = NULL;
+}
+
+	/** Raise a txnid of the key cache to at least \b id. */
+static void
+mdb_kc_raise(volatile txnid_t *p, txnid_t id)
+{
+	txnid_t old;
+
+	while ((old = *p) < id && !KC_CASID(p, old, id))
+		;
+}
+
+	/** Record a commit in the key cache.
+	 * @param[in] env The environment.
+	 * @param[in] id The txnid of the commit.
+	 * @param[in] txn Our write txn making the commit, or NULL if it is
+	 * not known which DBs the commit changes. Then all hints older than
+	 * \b id are dropped.
+	 */
+static void
+mdb_kc_update(MDB_env *env, txnid_t id, MDB_txn *txn)
+{
+	MDB_keycache *kc = env->me_kc;
+	txnid_t known = id;
+	MDB_dbi i;
+
+	if (txn) {
+		known = id - 1;
+		for (i = CORE_DBS; i < txn->mt_numdbs; i++)
+			if (txn->mt_dbflags[i] & DB_DIRTY)
+				mdb_kc_raise(&kc->kc_mod[i], id);
+		/* The main DB is not flagged, but changing it gives it a new root */
+		if (txn->mt_dbs[MAIN_DBI].md_root !=
+			mdb_env_pick_meta(env)->mm_dbs[MAIN_DBI].md_root)
+			mdb_kc_raise(&kc->kc_mod[MAIN_DBI], id);
+	}
+	if (kc->kc_last < known || !txn) {
+		/* Commits we missed could have changed any DB */
+		for (i = 0; i < env->me_maxdbs; i++)
+			mdb_kc_raise(&kc->kc_mod[i], known);
+	}
+	KC_BARRIER();
+	mdb_kc_raise(&kc->kc_last, id);
+}
+
+	/** Drop the hints for a DBI slot that is being reused. */
+static void
+mdb_kc_forget(MDB_env *env, MDB_dbi dbi)
+{
+	/* Until now the DB may have been changed through another slot */
+	mdb_kc_raise(&env->me_kc->kc_mod[dbi], mdb_env_pick_meta(env)->mm_txnid);
+}
+
+	/** Get the first snapshot whose state of a DB is the same as in
+	 *	the txn's snapshot, or -1 if the cache does not know it.
+	 */
+static txnid_t
+mdb_kc_since(MDB_txn *txn, MDB_dbi dbi)
+{
+	MDB_keycache *kc = txn->mt_env->me_kc;
+	txnid_t mod;
+
+	if (txn->mt_txnid > kc->kc_last)
+		mdb_kc_update(txn->mt_env, txn->mt_txnid, NULL);
+	KC_BARRIER();
+	mod = kc->kc_mod[dbi];
+	return txn->mt_txnid < mod ? (txnid_t)-1 : mod;
+}
+
+	/** Add a finished read txn's counters to the environment's. */
+static void
+mdb_kc_count(MDB_txn *txn)
+{
+	MDB_kccount *kn = &txn->mt_kc, *sum = &txn->mt_env->me_kc->kc_count;
+
+	if (!(kn->kn_hits | kn->kn_misses))
+		return;
+	KC_ADD(&sum->kn_hits, kn->kn_hits);
+	KC_ADD(&sum->kn_misses, kn->kn_misses);
+	KC_ADD(&sum->kn_stale, kn->kn_stale);
+	KC_ADD(&sum->kn_hit_ns, kn->kn_hit_ns);
+	KC_ADD(&sum->kn_hit_samples, kn->kn_hit_samples);
+	KC_ADD(&sum->kn_miss_ns, kn->kn_miss_ns);
+	KC_ADD(&sum->kn_miss_samples, kn->kn_miss_samples);
+	memset(kn, 0, sizeof(*kn));
+}
+
+	/** Monotonic time in nanoseconds, for lookup latencies */
+static uint64_t
+mdb_kc_clock(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)(now.QuadPart / freq.QuadPart * 1000000000 +
+		now.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+	/** FNV-1a hash of a key and its DBI */
+static unsigned int
+mdb_kc_hash(MDB_val *key, MDB_dbi dbi)
+{
+	const unsigned char *p = key->mv_data, *end = p + key->mv_size;
+	unsigned int h = 2166136261U ^ dbi;
+
+	while (p < end)
+		h = (h ^ *p++) * 16777619U;
+	return h;
+}
+
+	/** Look up a key for #mdb_get(), using and updating its hint.
+	 * @param[in] mc A cursor initialized for a read txn and a DB
+	 * without #MDB_DUPSORT.
+	 * @param[in] key The key to look up.
+	 * @param[out] data The data of the key.
+	 * @return As #mdb_get().
+	 */
+static int
+mdb_kc_get(MDB_cursor *mc, MDB_val *key, MDB_val *data)
+{
+	MDB_txn *txn = mc->mc_txn;
+	MDB_kccount *kn = &txn->mt_kc;
+	MDB_dbi dbi = mc->mc_dbi;
+	MDB_kcent *ke, hint;
+	MDB_page *mp;
+	MDB_node *leaf;
+	MDB_val nodekey;
+	char nbuf[MDB_KEYBUF];
+	uint64_t start = 0;
+	txnid_t since;
+	unsigned int hash, seq;
+	int exact = 0, rc;
+
+	if (!((kn->kn_hits + kn->kn_misses) & (MDB_KC_SAMPLE-1)))
+		start = mdb_kc_clock();
+	hash = mdb_kc_hash(key, dbi);
+	ke = &txn->mt_env->me_kc->kc_ents[hash & txn->mt_env->me_kc->kc_mask];
+	since = mdb_kc_since(txn, dbi);
+
+	seq = ke->ke_seq;
+	KC_BARRIER();
+	hint = *ke;
+	KC_BARRIER();
+	if (!(seq & 1) && seq == ke->ke_seq && hint.ke_hash == hash &&
+		hint.ke_dbi == dbi && hint.ke_dbiseq == txn->mt_dbiseqs[dbi]) {
+		/* A hint from a later snapshot than ours can name a page
+		 * that is still free or holds other data in ours.
+		 */
+		if (hint.ke_txnid < since || hint.ke_txnid > txn->mt_txnid) {
+			kn->kn_stale++;
+		} else if (hint.ke_pgno < txn->mt_next_pgno &&
+			mdb_page_get(mc, hint.ke_pgno, &mp, NULL) == MDB_SUCCESS) {
+			mc->mc_pg[0] = mp;
+			mc->mc_ki[0] = hint.ke_indx;
+			mc->mc_snum = 1;
+			mc->mc_top = 0;
+			mc->mc_flags |= C_INITIALIZED;
+			if (IS_LEAF(mp) && !IS_LEAF2(mp) && hint.ke_indx < NUMKEYS(mp)) {
+				leaf = NODEPTR(mp, hint.ke_indx);
+				MDB_GET_KEY2(mp, leaf, nodekey, nbuf);
+				if (!mc->mc_dbx->md_cmp(key, &nodekey)) {
+					rc = mdb_node_read(mc, leaf, data);
+					kn->kn_hits++;
+					if (start) {
+						kn->kn_hit_ns += mdb_kc_clock() - start;
+						kn->kn_hit_samples++;
+					}
+					return rc;
+				}
+			}
+			/* Another key with the same hash */
+			MDB_CURSOR_UNREF(mc, 1);
+			mc->mc_snum = 0;
+			mc->mc_flags &= ~C_INITIALIZED;
+		}
+	}
+
+	kn->kn_misses++;
+	rc = mdb_cursor_set(mc, key, data, MDB_SET, &exact);
+	if (rc == MDB_SUCCESS && since != (txnid_t)-1) {
+		seq = ke->ke_seq;
+		if (!(seq & 1) && KC_CAS(&ke->ke_seq, seq, seq + 1)) {
+			ke->ke_hash = hash;
+			ke->ke_dbiseq = txn->mt_dbiseqs[dbi];
+			ke->ke_dbi = dbi;
+			ke->ke_txnid = txn->mt_txnid;
+			ke->ke_pgno = mc->mc_pg[mc->mc_top]->mp_pgno;
+			ke->ke_indx = mc->mc_ki[mc->mc_top];
+			KC_BARRIER();
+			ke->ke_seq = seq + 2;
+		}
+	}
+	if (start) {
+		kn->kn_miss_ns += mdb_kc_clock() - start;
+		kn->kn_miss_samples++;
+	}
+	return rc;
+}
+
+int ESECT
+mdb_env_keycache_stat(MDB_env *env, MDB_kcstat *arg)
+{
+	MDB_keycache *kc;
+	MDB_kccount kn;
+
+	if (env == NULL || arg == NULL)
+		return EINVAL;
+
+	memset(arg, 0, sizeof(*arg));
+	if ((kc = env->me_kc) == NULL)
+		return MDB_SUCCESS;
+	kn = kc->kc_count;
+	arg->ks_size = kc->kc_mask + 1;
+	arg->ks_hits = kn.kn_hits;
+	arg->ks_misses = kn.kn_misses;
+	arg->ks_stale = kn.kn_stale;
+	if (kn.kn_hit_samples)
+		arg->ks_hit_ns = kn.kn_hit_ns / kn.kn_hit_samples;
+	if (kn.kn_miss_samples)
+		arg->ks_miss_ns = kn.kn_miss_ns / kn.kn_miss_samples;
+	return MDB_SUCCESS;
+}
+/** @} */
+
+int
+mdb_get(MDB_txn *txn, MDB_dbi dbi,
+    MDB_val *key, MDB_val *data)
+{
+	MDB_cursor	mc;
+	MDB_xcursor	mx;
+	int exact = 0, rc;
+	DKBUF;
+
+	DPRINTF(("===> get db %u key [%s]", dbi, DKEY(key)));
+
+	if (!key || !data || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
 		return MDB_BAD_TXN;
 
 	mdb_cursor_init(&mc, txn, dbi, &mx);
-	rc = mdb_cursor_set(&mc, key, data, MDB_SET, &exact);
+	if (txn->mt_env->me_kc && F_ISSET(txn->mt_flags, MDB_TXN_RDONLY) &&
+		!(mc.mc_db->md_flags & MDB_DUPSORT) && key->mv_size)
+		rc = mdb_kc_get(&mc, key, data);
+	else
+		rc = mdb_cursor_set(&mc, key, data, MDB_SET, &exact);
 	/* unref all the pages when MDB_VL32 - caller must copy the data
 	 * before doing anything else
 	 */
@@ -6879,6 +7900,50 @@ mdb_get(MDB_txn *txn, MDB_dbi dbi,
 	return rc;
 }
 
+/** Advise the OS that a cursor will soon read the leaf pages to
+ * the right of the current one, as found in their parent page.
+ * Contiguous pages are advised together.
+ * @param[in] mc The cursor.
+ * @param[in] top The index of the parent page in the cursor's stack.
+ */
+static void
+mdb_cursor_willneed(MDB_cursor *mc, unsigned int top)
+{
+#if !defined(_WIN32) && !defined(MDB_VL32) && \
+	(defined(MADV_WILLNEED) || defined(POSIX_MADV_WILLNEED))
+	MDB_env *env = mc->mc_txn->mt_env;
+	MDB_page *mp = mc->mc_pg[top];
+	unsigned int i, end;
+	pgno_t pg, lo = 0, n = 0;
+
+	end = mc->mc_ki[top] + 1 + mc->mc_rahead;
+	if (end > NUMKEYS(mp))
+		end = NUMKEYS(mp);
+	for (i = mc->mc_ki[top] + 1; ; i++) {
+		if (i < end) {
+			pg = NODEPGNO(NODEPTR(mp, i));
+			if (n && pg == lo + n) {
+				n++;
+				continue;
+			}
+		}
+		if (n) {
+			char *addr = env->me_map + lo * env->me_psize;
+			size_t off = (size_t)addr & (env->me_os_psize - 1);
+#ifdef MADV_WILLNEED
+			madvise(addr - off, n * env->me_psize + off, MADV_WILLNEED);
+#else
+			posix_madvise(addr - off, n * env->me_psize + off, POSIX_MADV_WILLNEED);
+#endif
+		}
+		if (i >= end)
+			break;
+		lo = pg;
+		n = 1;
+	}
+#endif
+}
+
 /** Find a sibling for a page.
  * Replaces the page at the top of the cursor's stack with the
  * specified sibling, if one exists.
@@ -6928,6 +7993,11 @@ mdb_cursor_sibling(MDB_cursor *mc, int move_right)
 	}
 	mdb_cassert(mc, IS_BRANCH(mc->mc_pg[mc->mc_top]));
 
+	/* Stay a window ahead when moving right through the leaves */
+	if (mc->mc_rahead && move_right && mc->mc_snum + 1 == mc->mc_db->md_depth &&
+		!(mc->mc_ki[mc->mc_top] % mc->mc_rahead))
+		mdb_cursor_willneed(mc, mc->mc_top);
+
 	MDB_PAGE_UNREF(mc->mc_txn, op);
 
 	indx = NODEPTR(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top]);
@@ -6973,7 +8043,7 @@ mdb_cursor_next(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 				rc = mdb_cursor_next(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_NEXT);
 				if (op != MDB_NEXT || rc != MDB_NOTFOUND) {
 					if (rc == MDB_SUCCESS)
-						MDB_GET_KEY(leaf, key);
+						MDB_GET_KEY(mc, leaf, key);
 					return rc;
 				}
 			}
@@ -7028,7 +8098,7 @@ skip:
 			return rc;
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -7057,7 +8127,7 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 				rc = mdb_cursor_prev(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_PREV);
 				if (op != MDB_PREV || rc != MDB_NOTFOUND) {
 					if (rc == MDB_SUCCESS) {
-						MDB_GET_KEY(leaf, key);
+						MDB_GET_KEY(mc, leaf, key);
 						mc->mc_flags &= ~C_EOF;
 					}
 					return rc;
@@ -7113,7 +8183,7 @@ mdb_cursor_prev(MDB_cursor *mc, MDB_val *key, MDB_val *data, MDB_cursor_op op)
 			return rc;
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -7138,6 +8208,7 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	/* See if we're already on the right page */
 	if (mc->mc_flags & C_INITIALIZED) {
 		MDB_val nodekey;
+		char nbuf[MDB_KEYBUF];
 
 		mp = mc->mc_pg[mc->mc_top];
 		if (!NUMKEYS(mp)) {
@@ -7149,7 +8220,7 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 			nodekey.mv_data = LEAF2KEY(mp, 0, nodekey.mv_size);
 		} else {
 			leaf = NODEPTR(mp, 0);
-			MDB_GET_KEY2(leaf, nodekey);
+			MDB_GET_KEY2(mp, leaf, nodekey, nbuf);
 		}
 		rc = mc->mc_dbx->md_cmp(key, &nodekey);
 		if (rc == 0) {
@@ -7170,7 +8241,7 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 						 nkeys-1, nodekey.mv_size);
 				} else {
 					leaf = NODEPTR(mp, nkeys-1);
-					MDB_GET_KEY2(leaf, nodekey);
+					MDB_GET_KEY2(mp, leaf, nodekey, nbuf);
 				}
 				rc = mc->mc_dbx->md_cmp(key, &nodekey);
 				if (rc == 0) {
@@ -7188,7 +8259,7 @@ mdb_cursor_set(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 								 mc->mc_ki[mc->mc_top], nodekey.mv_size);
 						} else {
 							leaf = NODEPTR(mp, mc->mc_ki[mc->mc_top]);
-							MDB_GET_KEY2(leaf, nodekey);
+							MDB_GET_KEY2(mp, leaf, nodekey, nbuf);
 						}
 						rc = mc->mc_dbx->md_cmp(key, &nodekey);
 						if (rc == 0) {
@@ -7309,7 +8380,7 @@ set1:
 
 	/* The key already matches in all other cases */
 	if (op == MDB_SET_RANGE || op == MDB_SET_KEY)
-		MDB_GET_KEY(leaf, key);
+		MDB_GET_KEY(mc, leaf, key);
 	DPRINTF(("==> cursor placed on key [%s]", DKEY(key)));
 
 	return rc;
@@ -7358,7 +8429,7 @@ mdb_cursor_first(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 			return rc;
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -7403,7 +8474,7 @@ mdb_cursor_last(MDB_cursor *mc, MDB_val *key, MDB_val *data)
 			return rc;
 	}
 
-	MDB_GET_KEY(leaf, key);
+	MDB_GET_KEY(mc, leaf, key);
 	return MDB_SUCCESS;
 }
 
@@ -7439,7 +8510,7 @@ mdb_cursor_get(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				key->mv_data = LEAF2KEY(mp, mc->mc_ki[mc->mc_top], key->mv_size);
 			} else {
 				MDB_node *leaf = NODEPTR(mp, mc->mc_ki[mc->mc_top]);
-				MDB_GET_KEY(leaf, key);
+				MDB_GET_KEY(mc, leaf, key);
 				if (data) {
 					if (F_ISSET(leaf->mn_flags, F_DUPDATA)) {
 						rc = mdb_cursor_get(&mc->mc_xcursor->mx_cursor, data, NULL, MDB_GET_CURRENT);
@@ -7566,7 +8637,7 @@ fetchm:
 		{
 			MDB_node *leaf = NODEPTR(mc->mc_pg[mc->mc_top], mc->mc_ki[mc->mc_top]);
 			if (!F_ISSET(leaf->mn_flags, F_DUPDATA)) {
-				MDB_GET_KEY(leaf, key);
+				MDB_GET_KEY(mc, leaf, key);
 				rc = mdb_node_read(mc, leaf, data);
 				break;
 			}
@@ -7637,7 +8708,7 @@ _mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	MDB_node	*leaf = NULL;
 	MDB_page	*fp, *mp, *sub_root = NULL;
 	uint16_t	fp_flags;
-	MDB_val		xdata, *rdata, dkey, olddata;
+	MDB_val		xdata, *rdata, dkey, olddata, cdata;
 	MDB_db dummy;
 	int do_sub = 0, insert_key, insert_data;
 	unsigned int mcount = 0, dcount = 0, nospill;
@@ -7695,10 +8766,13 @@ _mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 		rc = MDB_NO_ROOT;
 	} else {
 		int exact = 0;
-		MDB_val d2;
+		MDB_val d2, *dp = &d2;
+		/* don't expand the old value unless it is returned */
+		if (mc->mc_dbx->md_dec && !(flags & MDB_NOOVERWRITE))
+			dp = NULL;
 		if (flags & MDB_APPEND) {
 			MDB_val k2;
-			rc = mdb_cursor_last(mc, &k2, &d2);
+			rc = mdb_cursor_last(mc, &k2, dp);
 			if (rc == 0) {
 				rc = mc->mc_dbx->md_cmp(key, &k2);
 				if (rc > 0) {
@@ -7710,7 +8784,7 @@ _mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 				}
 			}
 		} else {
-			rc = mdb_cursor_set(mc, key, &d2, MDB_SET, &exact);
+			rc = mdb_cursor_set(mc, key, dp, MDB_SET, &exact);
 		}
 		if ((flags & MDB_NOOVERWRITE) && rc == 0) {
 			DPRINTF(("duplicate key [%s]", DKEY(key)));
@@ -7724,6 +8798,17 @@ _mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 	if (mc->mc_flags & C_DEL)
 		mc->mc_flags ^= C_DEL;
 
+	if (mc->mc_dbx->md_enc && data->mv_size >= mc->mc_dbx->md_codecmin &&
+		!(flags & (MDB_RESERVE|F_SUBDATA)) && !(mc->mc_flags & C_SUB)) {
+		rc2 = mdb_codec_compress(mc, data, &cdata);
+		if (rc2 == MDB_SUCCESS) {
+			data = &cdata;
+			flags |= F_CODEC;
+		} else if (rc2 != MDB_NOTFOUND) {
+			return rc2;
+		}
+	}
+
 	/* Cursor is positioned, check for room in the dirty list */
 	if (!nospill) {
 		if (flags & MDB_MULTIPLE) {
@@ -7750,6 +8835,11 @@ _mdb_cursor_put(MDB_cursor *mc, MDB_val *key, MDB_val *data,
 		if ((mc->mc_db->md_flags & (MDB_DUPSORT|MDB_DUPFIXED))
 			== MDB_DUPFIXED)
 			MP_FLAGS(np) |= P_LEAF2;
+		else if (mc->mc_db->md_flags & MDB_PREFIXKEYS) {
+			/* splits inherit the format and pick their own anchors */
+			MP_FLAGS(np) |= P_PREFIX;
+			mdb_page_set_anchor(env, np, key);
+		}
 		mc->mc_flags |= C_INITIALIZED;
 	} else {
 		/* make sure all cursor pages are writable */
@@ -8001,6 +9091,7 @@ current:
 					omp = np;
 				}
 				SETDSZ(leaf, data->mv_size);
+				leaf->mn_flags = (leaf->mn_flags & ~F_CODEC) | (flags & F_CODEC);
 				if (F_ISSET(flags, MDB_RESERVE))
 					data->mv_data = METADATA(omp);
 				else
@@ -8010,7 +9101,8 @@ current:
 			}
 			if ((rc2 = mdb_ovpage_free(mc, omp)) != MDB_SUCCESS)
 				return rc2;
-		} else if (data->mv_size == olddata.mv_size) {
+		} else if (data->mv_size == olddata.mv_size &&
+			!((leaf->mn_flags ^ flags) & F_CODEC)) {
 			/* same size, just replace it. Note that we could
 			 * also reuse this node if the new data is smaller,
 			 * but instead we opt to shrink the node in that case.
@@ -8035,7 +9127,8 @@ new_ksize:
 
 new_sub:
 	nflags = flags & NODE_ADD_FLAGS;
-	nsize = IS_LEAF2(mc->mc_pg[mc->mc_top]) ? key->mv_size : mdb_leaf_size(env, key, rdata);
+	nsize = IS_LEAF2(mc->mc_pg[mc->mc_top]) ? key->mv_size :
+		mdb_leaf_size(env, mc->mc_pg[mc->mc_top], key, rdata);
 	if (SIZELEFT(mc->mc_pg[mc->mc_top]) < nsize) {
 		if (( flags & (F_DUPDATA|F_SUBDATA)) == F_DUPDATA )
 			nflags &= ~MDB_APPEND; /* sub-page may need room to grow */
@@ -8326,20 +9419,23 @@ mdb_page_new(MDB_cursor *mc, uint32_t flags, int num, MDB_page **mp)
  * rounded up to an even number of bytes, to guarantee 2-byte alignment
  * of the #MDB_node headers.
  * @param[in] env The environment handle.
+ * @param[in] mp The page the node will go to, for the size of its key.
  * @param[in] key The key for the node.
  * @param[in] data The data for the node.
  * @return The number of bytes needed to store the node.
  */
 static size_t
-mdb_leaf_size(MDB_env *env, MDB_val *key, MDB_val *data)
+mdb_leaf_size(MDB_env *env, MDB_page *mp, MDB_val *key, MDB_val *data)
 {
 	size_t		 sz;
 
 	sz = LEAFSIZE(key, data);
-	if (sz > env->me_nodemax) {
+	if (sz > LEAF_NODEMAX(env, mp)) {
 		/* put on overflow page */
 		sz -= data->mv_size - sizeof(pgno_t);
 	}
+	if (IS_PREFIX(mp))
+		sz = sz - key->mv_size + mdb_prefix_ksize(mp, key);
 
 	return EVEN(sz + sizeof(indx_t));
 }
@@ -8397,6 +9493,8 @@ mdb_node_add(MDB_cursor *mc, indx_t indx,
 	MDB_page	*mp = mc->mc_pg[mc->mc_top];
 	MDB_page	*ofp = NULL;		/* overflow page */
 	void		*ndata;
+	size_t		 ksize = 0;
+	unsigned int	 shared = 0;
 	DKBUF;
 
 	mdb_cassert(mc, MP_UPPER(mp) >= MP_LOWER(mp));
@@ -8424,14 +9522,22 @@ mdb_node_add(MDB_cursor *mc, indx_t indx,
 	}
 
 	room = (ssize_t)SIZELEFT(mp) - (ssize_t)sizeof(indx_t);
-	if (key != NULL)
-		node_size += key->mv_size;
+	if (key != NULL) {
+		ksize = key->mv_size;
+		if (IS_PREFIX(mp)) {
+			MDB_val anchor;
+			mdb_page_anchor(mp, &anchor);
+			shared = mdb_prefix_shared(&anchor, key);
+			ksize = ksize + 1 - shared;
+		}
+		node_size += ksize;
+	}
 	if (IS_LEAF(mp)) {
 		mdb_cassert(mc, key && data);
 		if (F_ISSET(flags, F_BIGDATA)) {
 			/* Data already on overflow page. */
 			node_size += sizeof(pgno_t);
-		} else if (node_size + data->mv_size > mc->mc_txn->mt_env->me_nodemax) {
+		} else if (LEAFSIZE(key, data) > LEAF_NODEMAX(mc->mc_txn->mt_env, mp)) {
 			int ovpages = OVPAGES(data->mv_size, mc->mc_txn->mt_env->me_psize);
 			int rc;
 			/* Put data on overflow page. */
@@ -8467,14 +9573,17 @@ update:
 
 	/* Write the node data. */
 	node = NODEPTR(mp, indx);
-	node->mn_ksize = (key == NULL) ? 0 : key->mv_size;
+	node->mn_ksize = ksize;
 	node->mn_flags = flags;
 	if (IS_LEAF(mp))
 		SETDSZ(node,data->mv_size);
 	else
 		SETPGNO(node,pgno);
 
-	if (key)
+	if (IS_PREFIX(mp)) {
+		*(unsigned char *)NODEKEY(node) = shared;
+		memcpy((char *)NODEKEY(node) + 1, (char *)key->mv_data + shared, ksize - 1);
+	} else if (key)
 		memcpy(NODEKEY(node), key->mv_data, key->mv_size);
 
 	if (IS_LEAF(mp)) {
@@ -8633,11 +9742,14 @@ mdb_xcursor_init0(MDB_cursor *mc)
 	mx->mx_cursor.mc_top = 0;
 	MC_SET_OVPG(&mx->mx_cursor, NULL);
 	mx->mx_cursor.mc_flags = C_SUB | (mc->mc_flags & (C_ORIG_RDONLY|C_WRITEMAP));
+	mx->mx_cursor.mc_rahead = 0;
 	mx->mx_dbx.md_name.mv_size = 0;
 	mx->mx_dbx.md_name.mv_data = NULL;
 	mx->mx_dbx.md_cmp = mc->mc_dbx->md_dcmp;
 	mx->mx_dbx.md_dcmp = NULL;
 	mx->mx_dbx.md_rel = mc->mc_dbx->md_rel;
+	mx->mx_dbx.md_enc = NULL;
+	mx->mx_dbx.md_dec = NULL;
 }
 
 /** Final setup of a sorted-dups cursor.
@@ -8735,6 +9847,7 @@ mdb_cursor_init(MDB_cursor *mc, MDB_txn *txn, MDB_dbi dbi, MDB_xcursor *mx)
 	mc->mc_ki[0] = 0;
 	MC_SET_OVPG(mc, NULL);
 	mc->mc_flags = txn->mt_flags & (C_ORIG_RDONLY|C_WRITEMAP);
+	mc->mc_rahead = 0;
 	if (txn->mt_dbs[dbi].md_flags & MDB_DUPSORT) {
 		mdb_tassert(txn, mx != NULL);
 		mc->mc_xcursor = mx;
@@ -8872,6 +9985,119 @@ mdb_cursor_dbi(MDB_cursor *mc)
 	return mc->mc_dbi;
 }
 
+int
+mdb_cursor_readahead(MDB_cursor *mc, unsigned int npages)
+{
+	if (mc == NULL)
+		return EINVAL;
+
+	mc->mc_rahead = npages;
+	if (npages && (mc->mc_flags & C_INITIALIZED) && mc->mc_snum >= 2 &&
+		mc->mc_snum == mc->mc_db->md_depth)
+		mdb_cursor_willneed(mc, mc->mc_top - 1);
+	return MDB_SUCCESS;
+}
+
+	/** A page in one level of the tree, for #mdb_dbi_partition(). */
+typedef struct MDB_part {
+	pgno_t	pt_pgno;
+	MDB_val	pt_low;		/**< lowest key under the page, unset for the first */
+} MDB_part;
+
+int
+mdb_dbi_partition(MDB_txn *txn, MDB_dbi dbi, unsigned int nparts,
+	MDB_val *keys, unsigned int *nkeys)
+{
+	MDB_cursor	mc;
+	MDB_xcursor	mx;
+	MDB_page	*mp;
+	MDB_node	*node;
+	MDB_part	*level, *next, *tmp;
+	size_t		npg, nkid, g, t, s;
+	unsigned int	i, j;
+	int rc = MDB_SUCCESS;
+
+	if (!keys || !nkeys || !nparts || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED)
+		return MDB_BAD_TXN;
+
+	*nkeys = 0;
+	mdb_cursor_init(&mc, txn, dbi, &mx);
+	if (nparts < 2 || mc.mc_db->md_root == P_INVALID)
+		return MDB_SUCCESS;
+	if ((level = malloc(2 * nparts * sizeof(MDB_part))) == NULL)
+		return ENOMEM;
+	next = level + nparts;
+
+	/* Go down a level at a time while it has fewer than nparts pages.
+	 * Split keys are the low keys of evenly spaced pages in the level
+	 * below that, ideally in a level of branch pages: each page covers
+	 * a subtree of about the same size.
+	 */
+	level[0].pt_pgno = mc.mc_db->md_root;
+	npg = 1;
+	for (;;) {
+		for (i = 0, nkid = 0; i < npg; i++) {
+			if ((rc = mdb_page_get(&mc, level[i].pt_pgno, &mp, NULL)) != 0)
+				goto done;
+			if (IS_LEAF(mp))
+				break;
+			nkid += NUMKEYS(mp);
+		}
+		if (i < npg) {
+			/* Leaves: split between the pages we have */
+			for (s = 1, g = 0; s < nparts; s++) {
+				t = s * npg / nparts;
+				if (t > g)
+					keys[(*nkeys)++] = level[g = t].pt_low;
+			}
+			break;
+		}
+		if (nkid >= nparts) {
+			for (i = 0, g = 0, s = 1, t = nkid / nparts; i < npg && s < nparts; i++) {
+				if ((rc = mdb_page_get(&mc, level[i].pt_pgno, &mp, NULL)) != 0)
+					goto done;
+				for (j = 0; j < NUMKEYS(mp) && s < nparts; j++, g++) {
+					if (g != t)
+						continue;
+					node = NODEPTR(mp, j);
+					if (j) {
+						keys[*nkeys].mv_size = NODEKSZ(node);
+						keys[*nkeys].mv_data = NODEKEY(node);
+					} else {
+						keys[*nkeys] = level[i].pt_low;
+					}
+					(*nkeys)++;
+					t = ++s * nkid / nparts;
+				}
+			}
+			break;
+		}
+		for (i = 0, g = 0; i < npg; i++) {
+			if ((rc = mdb_page_get(&mc, level[i].pt_pgno, &mp, NULL)) != 0)
+				goto done;
+			for (j = 0; j < NUMKEYS(mp); j++, g++) {
+				node = NODEPTR(mp, j);
+				next[g].pt_pgno = NODEPGNO(node);
+				if (j) {
+					next[g].pt_low.mv_size = NODEKSZ(node);
+					next[g].pt_low.mv_data = NODEKEY(node);
+				} else {
+					next[g].pt_low = level[i].pt_low;
+				}
+			}
+		}
+		tmp = level; level = next; next = tmp;
+		npg = nkid;
+	}
+
+done:
+	free(level < next ? level : next);
+	return rc;
+}
+
 /** Replace the key for a branch node with a new key.
  * Set #MDB_TXN_ERROR on failure.
  * @param[in] mc Cursor pointing to the node to operate on.
@@ -8977,6 +10203,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 	MDB_cursor mn;
 	int			 rc;
 	unsigned short flags;
+	char		 nbuf[MDB_KEYBUF], bbuf[MDB_KEYBUF];
 
 	DKBUF;
 
@@ -9009,14 +10236,12 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(csrc->mc_pg[csrc->mc_top], 0, key.mv_size);
 			} else {
 				s2 = NODEPTR(csrc->mc_pg[csrc->mc_top], 0);
-				key.mv_size = NODEKSZ(s2);
-				key.mv_data = NODEKEY(s2);
+				mdb_node_key(csrc->mc_pg[csrc->mc_top], s2, &key, nbuf);
 			}
 			csrc->mc_snum = snum--;
 			csrc->mc_top = snum;
 		} else {
-			key.mv_size = NODEKSZ(srcnode);
-			key.mv_data = NODEKEY(srcnode);
+			mdb_node_key(csrc->mc_pg[csrc->mc_top], srcnode, &key, nbuf);
 		}
 		data.mv_size = NODEDSZ(srcnode);
 		data.mv_data = NODEDATA(srcnode);
@@ -9036,8 +10261,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 			bkey.mv_data = LEAF2KEY(mn.mc_pg[mn.mc_top], 0, bkey.mv_size);
 		} else {
 			s2 = NODEPTR(mn.mc_pg[mn.mc_top], 0);
-			bkey.mv_size = NODEKSZ(s2);
-			bkey.mv_data = NODEKEY(s2);
+			mdb_node_key(mn.mc_pg[mn.mc_top], s2, &bkey, bbuf);
 		}
 		mn.mc_snum = snum--;
 		mn.mc_top = snum;
@@ -9130,8 +10354,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(csrc->mc_pg[csrc->mc_top], 0, key.mv_size);
 			} else {
 				srcnode = NODEPTR(csrc->mc_pg[csrc->mc_top], 0);
-				key.mv_size = NODEKSZ(srcnode);
-				key.mv_data = NODEKEY(srcnode);
+				mdb_node_key(csrc->mc_pg[csrc->mc_top], srcnode, &key, nbuf);
 			}
 			DPRINTF(("update separator for source page %"Yu" to [%s]",
 				csrc->mc_pg[csrc->mc_top]->mp_pgno, DKEY(&key)));
@@ -9161,8 +10384,7 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 				key.mv_data = LEAF2KEY(cdst->mc_pg[cdst->mc_top], 0, key.mv_size);
 			} else {
 				srcnode = NODEPTR(cdst->mc_pg[cdst->mc_top], 0);
-				key.mv_size = NODEKSZ(srcnode);
-				key.mv_data = NODEKEY(srcnode);
+				mdb_node_key(cdst->mc_pg[cdst->mc_top], srcnode, &key, nbuf);
 			}
 			DPRINTF(("update separator for destination page %"Yu" to [%s]",
 				cdst->mc_pg[cdst->mc_top]->mp_pgno, DKEY(&key)));
@@ -9189,6 +10411,36 @@ mdb_node_move(MDB_cursor *csrc, MDB_cursor *cdst, int fromleft)
 	return MDB_SUCCESS;
 }
 
+/** Check if the nodes of a #P_PREFIX leaf fit on another one.
+ * Keys are front-coded against the anchor of their page, so they
+ * can grow when they move to a page with a different anchor.
+ * @param[in] psrc The page whose nodes would move.
+ * @param[in] pdst The page they would move to.
+ * @return 1 if they fit, 0 otherwise.
+ */
+static int
+mdb_prefix_fits(MDB_page *psrc, MDB_page *pdst)
+{
+	MDB_node	*node;
+	MDB_val		 anchor, key;
+	size_t		 sz = 0;
+	unsigned	 i, nkeys = NUMKEYS(psrc);
+	char		 nbuf[MDB_KEYBUF];
+
+	/* An empty destination takes the source's anchor */
+	if (!nkeys || !NUMKEYS(pdst))
+		return 1;
+	mdb_page_anchor(pdst, &anchor);
+	for (i = 0; i < nkeys; i++) {
+		node = NODEPTR(psrc, i);
+		mdb_node_key(psrc, node, &key, nbuf);
+		sz += EVEN(NODESIZE + 1 + key.mv_size - mdb_prefix_shared(&anchor, &key) +
+			(F_ISSET(node->mn_flags, F_BIGDATA) ? sizeof(pgno_t) : NODEDSZ(node))) +
+			sizeof(indx_t);
+	}
+	return sz <= SIZELEFT(pdst);
+}
+
 /** Merge one page into another.
  *  The nodes from the page pointed to by \b csrc will
  *	be copied to the page pointed to by \b cdst and then
@@ -9206,6 +10458,7 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 	unsigned	 nkeys;
 	int			 rc;
 	indx_t		 i, j;
+	char		 nbuf[MDB_KEYBUF];
 
 	psrc = csrc->mc_pg[csrc->mc_top];
 	pdst = cdst->mc_pg[cdst->mc_top];
@@ -9222,6 +10475,12 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 	/* get dst page again now that we've touched it. */
 	pdst = cdst->mc_pg[cdst->mc_top];
 
+	/* An empty front-coded page takes the anchor of the nodes it gets */
+	if (IS_PREFIX(pdst) && IS_PREFIX(psrc) && !NUMKEYS(pdst)) {
+		mdb_page_anchor(psrc, &key);
+		mdb_page_set_anchor(cdst->mc_txn->mt_env, pdst, &key);
+	}
+
 	/* Move all nodes from src to dst.
 	 */
 	j = nkeys = NUMKEYS(pdst);
@@ -9251,12 +10510,10 @@ mdb_page_merge(MDB_cursor *csrc, MDB_cursor *cdst)
 					key.mv_data = LEAF2KEY(mn.mc_pg[mn.mc_top], 0, key.mv_size);
 				} else {
 					s2 = NODEPTR(mn.mc_pg[mn.mc_top], 0);
-					key.mv_size = NODEKSZ(s2);
-					key.mv_data = NODEKEY(s2);
+					mdb_node_key(mn.mc_pg[mn.mc_top], s2, &key, nbuf);
 				}
 			} else {
-				key.mv_size = srcnode->mn_ksize;
-				key.mv_data = NODEKEY(srcnode);
+				mdb_node_key(psrc, srcnode, &key, nbuf);
 			}
 
 			data.mv_size = NODEDSZ(srcnode);
@@ -9351,6 +10608,7 @@ mdb_cursor_copy(const MDB_cursor *csrc, MDB_cursor *cdst)
 	cdst->mc_snum = csrc->mc_snum;
 	cdst->mc_top = csrc->mc_top;
 	cdst->mc_flags = csrc->mc_flags;
+	cdst->mc_rahead = csrc->mc_rahead;
 	MC_SET_OVPG(cdst, MC_OVPG(csrc));
 
 	for (i=0; i<csrc->mc_snum; i++) {
@@ -9531,6 +10789,16 @@ mdb_rebalance(MDB_cursor *mc)
 			oldki++;
 		}
 	} else {
+		if (IS_PREFIX(mc->mc_pg[mc->mc_top]) && !(fromleft ?
+			mdb_prefix_fits(mc->mc_pg[mc->mc_top], mn.mc_pg[mn.mc_top]) :
+			mdb_prefix_fits(mn.mc_pg[mn.mc_top], mc->mc_pg[mc->mc_top])))
+		{
+			/* The keys would not fit once front-coded against the
+			 * other page's anchor, leave this page underfilled.
+			 */
+			mc->mc_ki[mc->mc_top] = oldki;
+			return MDB_SUCCESS;
+		}
 		if (!fromleft) {
 			rc = mdb_page_merge(&mn, mc);
 		} else {
@@ -9718,6 +10986,78 @@ mdb_del0(MDB_txn *txn, MDB_dbi dbi,
 	return rc;
 }
 
+/** Pick the anchor for one half of a #P_PREFIX page being split.
+ * The candidates are the common prefix of the first and last key
+ * of the half, and its first key. One is only taken if it makes the
+ * half smaller than the anchor of the page being split does, so the
+ * half still fits wherever the split point put it.
+ * @param[in] env The environment handle.
+ * @param[in] mp The page being split.
+ * @param[in] copy The node offsets of \b mp, with a hole at \b newindx.
+ * @param[in] lo The first index of the half.
+ * @param[in] hi The last index of the half.
+ * @param[in] newindx The index of the new node.
+ * @param[in] newkey The key for the new node.
+ * @param[in] newdata The data for the new node.
+ * @param[out] dst The empty page for the half.
+ */
+static void
+mdb_prefix_split(MDB_env *env, MDB_page *mp, MDB_page *copy, int lo, int hi,
+	int newindx, MDB_val *newkey, MDB_val *newdata, MDB_page *dst)
+{
+	MDB_val	 cand[3], key;
+	MDB_node	*node;
+	char	 first[MDB_KEYBUF], nbuf[MDB_KEYBUF];
+	size_t	 sz[3], dsz;
+	int	 c, i, pick = 0;
+
+	mdb_page_anchor(mp, &cand[0]);
+	if (lo > hi) {
+		mdb_page_set_anchor(env, dst, &cand[0]);
+		return;
+	}
+	/* Get the first key, then the last one */
+	for (c = 0, i = lo; c < 2; c++, i = hi) {
+		if (i == newindx) {
+			key = *newkey;
+		} else {
+			node = (MDB_node *)((char *)mp + copy->mp_ptrs[i] + PAGEBASE);
+			mdb_node_key(mp, node, &key, nbuf);
+		}
+		if (!c) {
+			memcpy(first, key.mv_data, key.mv_size);
+			cand[2].mv_size = key.mv_size;
+			cand[2].mv_data = first;
+		}
+	}
+	cand[1].mv_size = mdb_prefix_shared(&cand[2], &key);
+	cand[1].mv_data = first;
+	if (cand[2].mv_size > MDB_ANCHORMAX)
+		cand[2].mv_size = MDB_ANCHORMAX;
+
+	for (c = 0; c < 3; c++)
+		sz[c] = cand[c].mv_size ? EVEN(cand[c].mv_size + 1) : 0;
+	for (i = lo; i <= hi; i++) {
+		if (i == newindx) {
+			key = *newkey;
+			dsz = LEAFSIZE(newkey, newdata) > LEAF_NODEMAX(env, mp) ?
+				sizeof(pgno_t) : newdata->mv_size;
+		} else {
+			node = (MDB_node *)((char *)mp + copy->mp_ptrs[i] + PAGEBASE);
+			mdb_node_key(mp, node, &key, nbuf);
+			dsz = F_ISSET(node->mn_flags, F_BIGDATA) ?
+				sizeof(pgno_t) : NODEDSZ(node);
+		}
+		for (c = 0; c < 3; c++)
+			sz[c] += EVEN(NODESIZE + 1 + key.mv_size -
+				mdb_prefix_shared(&cand[c], &key) + dsz) + sizeof(indx_t);
+	}
+	for (c = 1; c < 3; c++)
+		if (sz[c] < sz[pick])
+			pick = c;
+	mdb_page_set_anchor(env, dst, &cand[pick]);
+}
+
 /** Split a page and insert a new node.
  * Set #MDB_TXN_ERROR on failure.
  * @param[in,out] mc Cursor pointing to the page and desired insertion index.
@@ -9745,6 +11085,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 	MDB_page	*mp, *rp, *pp;
 	int ptop;
 	MDB_cursor	mn;
+	char	 nbuf[MDB_KEYBUF];
 	DKBUF;
 
 	mp = mc->mc_pg[mc->mc_top];
@@ -9852,13 +11193,17 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 		} else {
 			int psize, nsize, k, keythresh;
 
-			/* Maximum free space in an empty page */
+			/* Maximum free space in an empty page. Both halves
+			 * start out with the current anchor, if any.
+			 */
 			pmax = env->me_psize - PAGEHDRSZ;
+			if (IS_PREFIX(mp))
+				pmax -= ANCHORSIZE(env, mp);
 			/* Threshold number of keys considered "small" */
 			keythresh = env->me_psize >> 7;
 
 			if (IS_LEAF(mp))
-				nsize = mdb_leaf_size(env, newkey, newdata);
+				nsize = mdb_leaf_size(env, mp, newkey, newdata);
 			else
 				nsize = mdb_branch_size(env, newkey);
 			nsize = EVEN(nsize);
@@ -9933,8 +11278,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 				sepkey.mv_data = newkey->mv_data;
 			} else {
 				node = (MDB_node *)((char *)mp + copy->mp_ptrs[split_indx] + PAGEBASE);
-				sepkey.mv_size = node->mn_ksize;
-				sepkey.mv_data = NODEKEY(node);
+				mdb_node_key(mp, node, &sepkey, nbuf);
 			}
 		}
 	}
@@ -9989,12 +11333,20 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 	if (nflags & MDB_APPEND) {
 		mc->mc_pg[mc->mc_top] = rp;
 		mc->mc_ki[mc->mc_top] = 0;
+		if (IS_PREFIX(rp))
+			mdb_page_set_anchor(env, rp, newkey);
 		rc = mdb_node_add(mc, 0, newkey, newdata, newpgno, nflags);
 		if (rc)
 			goto done;
 		for (i=0; i<mc->mc_top; i++)
 			mc->mc_ki[i] = mn.mc_ki[i];
 	} else if (!IS_LEAF2(mp)) {
+		if (IS_PREFIX(mp)) {
+			mdb_prefix_split(env, mp, copy, split_indx, nkeys,
+				newindx, newkey, newdata, rp);
+			mdb_prefix_split(env, mp, copy, 0, split_indx - 1,
+				newindx, newkey, newdata, copy);
+		}
 		/* Move nodes */
 		mc->mc_pg[mc->mc_top] = rp;
 		i = split_indx;
@@ -10012,8 +11364,7 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 				mc->mc_ki[mc->mc_top] = j;
 			} else {
 				node = (MDB_node *)((char *)mp + copy->mp_ptrs[i] + PAGEBASE);
-				rkey.mv_data = NODEKEY(node);
-				rkey.mv_size = node->mn_ksize;
+				mdb_node_key(mp, node, &rkey, nbuf);
 				if (IS_LEAF(mp)) {
 					xdata.mv_data = NODEDATA(node);
 					xdata.mv_size = NODEDSZ(node);
@@ -10048,6 +11399,8 @@ mdb_page_split(MDB_cursor *mc, MDB_val *newkey, MDB_val *newdata, pgno_t newpgno
 		mp->mp_upper = copy->mp_upper;
 		memcpy(NODEPTR(mp, nkeys-1), NODEPTR(copy, nkeys-1),
 			env->me_psize - copy->mp_upper - PAGEBASE);
+		if (IS_PREFIX(mp))
+			MP_PAD(mp) = MP_PAD(copy);
 
 		/* reset back to original page */
 		if (newindx < split_indx) {
@@ -10178,54 +11531,717 @@ mdb_put(MDB_txn *txn, MDB_dbi dbi,
 	return rc;
 }
 
-#ifndef MDB_WBUF
-#define MDB_WBUF	(1024*1024)
+#ifndef MDB_BULK_RUNSIZE
+#define MDB_BULK_RUNSIZE	(64*1024*1024)	/**< default bytes per bulk load run */
 #endif
-#define MDB_EOF		0x10	/**< #mdb_env_copyfd1() is done reading */
+#ifndef MDB_BULK_THREADS
+#define MDB_BULK_THREADS	2	/**< default max runs sorted at once */
+#endif
+#define MDB_BULK_IOBUF	(256*1024)	/**< stdio buffer of a run's temporary file */
 
-	/** State needed for a double-buffering compacting copy. */
-typedef struct mdb_copy {
-	MDB_env *mc_env;
-	MDB_txn *mc_txn;
-	pthread_mutex_t mc_mutex;
-	pthread_cond_t mc_cond;	/**< Condition variable for #mc_new */
-	char *mc_wbuf[2];
-	char *mc_over[2];
-	int mc_wlen[2];
-	int mc_olen[2];
-	pgno_t mc_next_pgno;
-	HANDLE mc_fd;
-	int mc_toggle;			/**< Buffer number in provider */
-	int mc_new;				/**< (0-2 buffers to write) | (#MDB_EOF at end) */
-	/** Error code.  Never cleared if set.  Both threads can set nonzero
-	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
+	/** An item of a bulk load run, for sorting. With #mdb_cmp_memn keys
+	 *	the first 8 key bytes are kept here, so most comparisons do not
+	 *	have to look up the items.
 	 */
-	volatile int mc_error;
-} mdb_copy;
+typedef struct MDB_bkent {
+	uint64_t	 be_pfx;	/**< key prefix, big-endian, or 0 */
+	size_t		 be_off;	/**< offset of the item in #MDB_bkrun.br_buf */
+} MDB_bkent;
+
+	/** A run of a bulk load. Each item is [size_t ksize][size_t dsize]
+	 *	[key][data] in #br_buf, padded to a size_t boundary. Once sorted,
+	 *	the run is written to a temporary file without the padding, and
+	 *	#br_buf is reused to read it back one item at a time.
+	 */
+typedef struct MDB_bkrun {
+	MDB_bulk	*br_bulk;
+	char		*br_buf;	/**< the items, or the item being read */
+	size_t		 br_used;	/**< bytes used in #br_buf */
+	size_t		 br_size;	/**< bytes allocated in #br_buf */
+	MDB_bkent	*br_recs;	/**< the items in #br_buf */
+	size_t		 br_nrecs;	/**< number of items */
+	size_t		 br_maxrecs;	/**< number of #br_recs allocated */
+	size_t		 br_pos;	/**< next item to read when merging */
+	FILE		*br_fp;		/**< the sorted run, or NULL if kept in memory */
+	pthread_t	 br_thr;	/**< thread sorting the run */
+	int			 br_rc;		/**< result of the sort */
+	unsigned int	 br_idx;	/**< run number, later runs win ties */
+	MDB_val		 br_key;	/**< current item when merging */
+	MDB_val		 br_data;
+} MDB_bkrun;
+
+struct MDB_bulk {
+	MDB_txn		*bk_txn;
+	MDB_dbi		 bk_dbi;
+	MDB_cmp_func	*bk_cmp;
+	int			 bk_dedup;	/**< keep only the last item of a key */
+	int			 bk_pfx;	/**< keys compare like #MDB_bkent.be_pfx */
+	size_t		 bk_runsize;
+	unsigned int	 bk_nthreads;
+	MDB_bkrun	**bk_runs;	/**< the last one is being filled */
+	unsigned int	 bk_nruns;
+	unsigned int	 bk_maxruns;
+	unsigned int	 bk_joined;	/**< runs before this are sorted and joined */
+};
 
-	/** Dedicated writer thread for compacting copy. */
-static THREAD_RET ESECT CALL_CONV
-mdb_env_copythr(void *arg)
+	/** State of a bottom-up build of a database, see #mdb_bulk_leaf().
+	 *	The cursor holds the page being filled at each level, leaves at 0,
+	 *	so #mdb_page_spill() keeps them.
+	 */
+typedef struct MDB_bkbuild {
+	MDB_cursor	 bb_mc;
+	MDB_val		 bb_first[CURSOR_STACK];	/**< first key under each page */
+	char		*bb_kbuf;	/**< memory for #bb_first */
+} MDB_bkbuild;
+
+	/** Header of an item of a bulk load run */
+#define BKREC(br, off)	((size_t *)((br)->br_buf + (off)))
+
+	/** Get the key and data of an item in memory. */
+static void
+mdb_bulk_rec(MDB_bkrun *br, size_t off, MDB_val *key, MDB_val *data)
 {
-	mdb_copy *my = arg;
-	char *ptr;
-	int toggle = 0, wsize, rc;
-#ifdef _WIN32
-	DWORD len;
-#define DO_WRITE(rc, fd, ptr, w2, len)	rc = WriteFile(fd, ptr, w2, &len, NULL)
-#else
-	int len;
-#define DO_WRITE(rc, fd, ptr, w2, len)	len = write(fd, ptr, w2); rc = (len >= 0)
-#ifdef SIGPIPE
-	sigset_t set;
-	sigemptyset(&set);
-	sigaddset(&set, SIGPIPE);
-	if ((rc = pthread_sigmask(SIG_BLOCK, &set, NULL)) != 0)
-		my->mc_error = rc;
-#endif
-#endif
+	size_t *hdr = BKREC(br, off);
+	key->mv_size = hdr[0];
+	key->mv_data = hdr + 2;
+	if (data) {
+		data->mv_size = hdr[1];
+		data->mv_data = (char *)(hdr + 2) + hdr[0];
+	}
+}
 
-	pthread_mutex_lock(&my->mc_mutex);
+	/** Stable merge sort of a run by key. Equal keys then keep only
+	 *	the last item unless the database supports duplicates.
+	 */
+static int
+mdb_bulk_sort(MDB_bkrun *br)
+{
+	MDB_cmp_func *cmp = br->br_bulk->bk_cmp;
+	size_t n = br->br_nrecs, w, i, j, k, m, r;
+	MDB_bkent *src = br->br_recs, *dst, *tmp;
+	MDB_val a, b;
+	int c;
+
+	if ((tmp = malloc(n * sizeof(MDB_bkent) + 1)) == NULL)
+		return ENOMEM;
+	dst = tmp;
+	for (w = 1; w < n; w <<= 1) {
+		for (k = 0; k < n; ) {
+			m = n - k > w ? k + w : n;
+			r = n - m > w ? m + w : n;
+			for (i = k, j = m; i < m && j < r; ) {
+				if (src[i].be_pfx != src[j].be_pfx) {
+					c = src[j].be_pfx < src[i].be_pfx;
+				} else {
+					mdb_bulk_rec(br, src[i].be_off, &a, NULL);
+					mdb_bulk_rec(br, src[j].be_off, &b, NULL);
+					c = cmp(&b, &a) < 0;
+				}
+				dst[k++] = c ? src[j++] : src[i++];
+			}
+			while (i < m)
+				dst[k++] = src[i++];
+			while (j < r)
+				dst[k++] = src[j++];
+		}
+		dst = src;
+		src = src == br->br_recs ? tmp : br->br_recs;
+	}
+	if (src != br->br_recs)
+		memcpy(br->br_recs, src, n * sizeof(MDB_bkent));
+	free(tmp);
+
+	if (br->br_bulk->bk_dedup && n) {
+		for (i = 0, j = 1; j < n; j++) {
+			mdb_bulk_rec(br, br->br_recs[i].be_off, &a, NULL);
+			mdb_bulk_rec(br, br->br_recs[j].be_off, &b, NULL);
+			if (br->br_recs[i].be_pfx != br->br_recs[j].be_pfx || cmp(&a, &b))
+				i++;
+			br->br_recs[i] = br->br_recs[j];
+		}
+		br->br_nrecs = i + 1;
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Sort a full run and write it to a temporary file. */
+static int
+mdb_bulk_spill(MDB_bkrun *br)
+{
+	FILE *fp;
+	size_t i, *hdr, len;
+	int rc;
+
+	if ((rc = mdb_bulk_sort(br)) != MDB_SUCCESS)
+		return rc;
+	if ((fp = tmpfile()) == NULL)
+		return errno ? errno : EIO;
+	br->br_fp = fp;
+	setvbuf(fp, NULL, _IOFBF, MDB_BULK_IOBUF);
+	for (i = 0; i < br->br_nrecs; i++) {
+		hdr = BKREC(br, br->br_recs[i].be_off);
+		len = 2 * sizeof(size_t) + hdr[0] + hdr[1];
+		if (fwrite(hdr, 1, len, fp) != len)
+			return EIO;
+	}
+	if (fflush(fp) || fseek(fp, 0, SEEK_SET))
+		return EIO;
+	free(br->br_recs);
+	br->br_recs = NULL;
+	br->br_maxrecs = 0;
+	free(br->br_buf);
+	br->br_buf = NULL;
+	br->br_size = 0;
+	return MDB_SUCCESS;
+}
+
+static THREAD_RET ESECT CALL_CONV
+mdb_bulk_thr(void *arg)
+{
+	MDB_bkrun *br = arg;
+	br->br_rc = mdb_bulk_spill(br);
+	return (THREAD_RET)0;
+}
+
+	/** Wait for the oldest run being sorted. */
+static int
+mdb_bulk_join(MDB_bulk *bk)
+{
+	MDB_bkrun *br = bk->bk_runs[bk->bk_joined++];
+	int rc = THREAD_FINISH(br->br_thr);
+#ifdef _WIN32
+	CloseHandle(br->br_thr);
+#endif
+	return rc ? rc : br->br_rc;
+}
+
+	/** Start a new run, handing the current one to a sorter thread. */
+static int
+mdb_bulk_next_run(MDB_bulk *bk)
+{
+	MDB_bkrun *br, *prev;
+	int rc;
+
+	if (bk->bk_nruns == bk->bk_maxruns) {
+		unsigned int n = bk->bk_maxruns ? bk->bk_maxruns * 2 : 8;
+		MDB_bkrun **runs = realloc(bk->bk_runs, n * sizeof(MDB_bkrun *));
+		if (!runs)
+			return ENOMEM;
+		bk->bk_runs = runs;
+		bk->bk_maxruns = n;
+	}
+	if ((br = calloc(1, sizeof(MDB_bkrun))) == NULL)
+		return ENOMEM;
+	if (bk->bk_nruns) {
+		/* Runs before the last one have a thread, until joined */
+		rc = MDB_SUCCESS;
+		if (bk->bk_nruns - 1 - bk->bk_joined >= bk->bk_nthreads)
+			rc = mdb_bulk_join(bk);
+		prev = bk->bk_runs[bk->bk_nruns - 1];
+		if (rc || (rc = THREAD_CREATE(prev->br_thr, mdb_bulk_thr, prev)) != 0) {
+			free(br);
+			return rc;
+		}
+	}
+	br->br_bulk = bk;
+	br->br_idx = bk->bk_nruns;
+	bk->bk_runs[bk->bk_nruns++] = br;
+	return MDB_SUCCESS;
+}
+
+int
+mdb_bulk_begin(MDB_txn *txn, MDB_dbi dbi, size_t run_size,
+	unsigned int nthreads, MDB_bulk **ret)
+{
+	MDB_bulk *bk;
+	int rc;
+
+	if (!ret || !TXN_DBI_EXIST(txn, dbi, DB_USRVALID))
+		return EINVAL;
+
+	if (txn->mt_flags & (MDB_TXN_RDONLY|MDB_TXN_BLOCKED))
+		return (txn->mt_flags & MDB_TXN_RDONLY) ? EACCES : MDB_BAD_TXN;
+
+	MDB_TRACE(("%p, %u, %"Z"u, %u", txn, dbi, run_size, nthreads));
+	if ((bk = calloc(1, sizeof(MDB_bulk))) == NULL)
+		return ENOMEM;
+	bk->bk_txn = txn;
+	bk->bk_dbi = dbi;
+	bk->bk_cmp = txn->mt_dbxs[dbi].md_cmp;
+	bk->bk_dedup = !(txn->mt_dbs[dbi].md_flags & MDB_DUPSORT);
+	bk->bk_pfx = bk->bk_cmp == mdb_cmp_memn;
+	bk->bk_runsize = run_size ? run_size : MDB_BULK_RUNSIZE;
+	bk->bk_nthreads = nthreads ? nthreads : MDB_BULK_THREADS;
+	if ((rc = mdb_bulk_next_run(bk)) != MDB_SUCCESS) {
+		free(bk);
+		return rc;
+	}
+	*ret = bk;
+	return MDB_SUCCESS;
+}
+
+int
+mdb_bulk_put(MDB_bulk *bk, MDB_val *key, MDB_val *data)
+{
+	MDB_bkrun *br;
+	MDB_bkent *ent;
+	size_t len, *hdr;
+	int rc;
+
+	if (!bk || !key || !data)
+		return EINVAL;
+	if (key->mv_size-1 >= ENV_MAXKEY(bk->bk_txn->mt_env))
+		return MDB_BAD_VALSIZE;
+	if (data->mv_size > (bk->bk_dedup ? MAXDATASIZE : ENV_MAXKEY(bk->bk_txn->mt_env)))
+		return MDB_BAD_VALSIZE;
+
+	len = 2 * sizeof(size_t) + key->mv_size + data->mv_size;
+	len = (len + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+	br = bk->bk_runs[bk->bk_nruns - 1];
+	if (br->br_used && br->br_used + len + (br->br_nrecs + 1) * sizeof(MDB_bkent) > bk->bk_runsize) {
+		if ((rc = mdb_bulk_next_run(bk)) != MDB_SUCCESS)
+			return rc;
+		br = bk->bk_runs[bk->bk_nruns - 1];
+	}
+	if (br->br_used + len > br->br_size) {
+		size_t n = br->br_size ? br->br_size * 2 : bk->bk_runsize / 16 + len;
+		char *buf;
+		while (n < br->br_used + len)
+			n *= 2;
+		if (n > bk->bk_runsize && bk->bk_runsize >= br->br_used + len)
+			n = bk->bk_runsize;
+		if ((buf = realloc(br->br_buf, n)) == NULL)
+			return ENOMEM;
+		br->br_buf = buf;
+		br->br_size = n;
+	}
+	if (br->br_nrecs == br->br_maxrecs) {
+		size_t n = br->br_maxrecs ? br->br_maxrecs * 2 : 1024;
+		MDB_bkent *recs = realloc(br->br_recs, n * sizeof(MDB_bkent));
+		if (!recs)
+			return ENOMEM;
+		br->br_recs = recs;
+		br->br_maxrecs = n;
+	}
+	hdr = BKREC(br, br->br_used);
+	hdr[0] = key->mv_size;
+	hdr[1] = data->mv_size;
+	memcpy(hdr + 2, key->mv_data, key->mv_size);
+	memcpy((char *)(hdr + 2) + key->mv_size, data->mv_data, data->mv_size);
+	ent = &br->br_recs[br->br_nrecs];
+	ent->be_off = br->br_used;
+	ent->be_pfx = 0;
+	if (bk->bk_pfx) {
+		unsigned char *ptr = key->mv_data;
+		unsigned int i;
+		for (i = 0; i < 8; i++)
+			ent->be_pfx = ent->be_pfx << 8 | (i < key->mv_size ? ptr[i] : 0);
+	}
+	br->br_nrecs++;
+	br->br_used += len;
+	return MDB_SUCCESS;
+}
+
+	/** Read the next item of a run for merging.
+	 * @return 0 on success, #MDB_NOTFOUND at the end of the run.
+	 */
+static int
+mdb_bulk_read(MDB_bkrun *br)
+{
+	size_t hdr[2], len;
+
+	if (br->br_pos == br->br_nrecs)
+		return MDB_NOTFOUND;
+	if (!br->br_fp) {
+		mdb_bulk_rec(br, br->br_recs[br->br_pos++].be_off, &br->br_key, &br->br_data);
+		return MDB_SUCCESS;
+	}
+	br->br_pos++;
+	if (fread(hdr, sizeof(hdr), 1, br->br_fp) != 1)
+		return EIO;
+	len = hdr[0] + hdr[1];
+	if (len > br->br_size) {
+		char *buf = realloc(br->br_buf, len);
+		if (!buf)
+			return ENOMEM;
+		br->br_buf = buf;
+		br->br_size = len;
+	}
+	if (fread(br->br_buf, 1, len, br->br_fp) != len)
+		return EIO;
+	br->br_key.mv_size = hdr[0];
+	br->br_key.mv_data = br->br_buf;
+	br->br_data.mv_size = hdr[1];
+	br->br_data.mv_data = br->br_buf + hdr[0];
+	return MDB_SUCCESS;
+}
+
+	/** Merge order of runs: by key, then the later run first. */
+static int
+mdb_bulk_before(MDB_bulk *bk, MDB_bkrun *a, MDB_bkrun *b)
+{
+	int c = bk->bk_cmp(&a->br_key, &b->br_key);
+	return c ? c < 0 : a->br_idx > b->br_idx;
+}
+
+static void
+mdb_bulk_sift(MDB_bulk *bk, MDB_bkrun **heap, unsigned int n, unsigned int i)
+{
+	MDB_bkrun *br = heap[i];
+	unsigned int c;
+
+	while ((c = 2 * i + 1) < n) {
+		if (c + 1 < n && mdb_bulk_before(bk, heap[c + 1], heap[c]))
+			c++;
+		if (!mdb_bulk_before(bk, heap[c], br))
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = br;
+}
+
+	/** Remember the first key under the page being filled at a level. */
+static void
+mdb_bulk_first(MDB_bkbuild *bb, unsigned int lvl, MDB_val *key)
+{
+	char *ptr = bb->bb_kbuf + lvl * ENV_MAXKEY(bb->bb_mc.mc_txn->mt_env);
+	memcpy(ptr, key->mv_data, key->mv_size);
+	bb->bb_first[lvl].mv_size = key->mv_size;
+	bb->bb_first[lvl].mv_data = ptr;
+}
+
+	/** Add a finished page to the branch level above it.
+	 * @param[in] bb The build state.
+	 * @param[in] lvl The branch level, 1 for the parents of leaves.
+	 * @param[in] key The first key under the page.
+	 * @param[in] pgno The page.
+	 * @return 0 on success, non-zero on failure.
+	 */
+static int
+mdb_bulk_branch(MDB_bkbuild *bb, unsigned int lvl, MDB_val *key, pgno_t pgno)
+{
+	MDB_cursor *mc = &bb->bb_mc;
+	MDB_page *mp;
+	MDB_node *node;
+	MDB_val mkey;
+	pgno_t moved = P_INVALID;
+	int rc;
+
+	if (lvl == mc->mc_snum ||
+		mdb_branch_size(mc->mc_txn->mt_env, key) > SIZELEFT(mc->mc_pg[lvl])) {
+		if (lvl == CURSOR_STACK)
+			return MDB_CURSOR_FULL;
+		if (lvl < mc->mc_snum) {
+			mp = mc->mc_pg[lvl];
+			rc = mdb_bulk_branch(bb, lvl + 1, &bb->bb_first[lvl], mp->mp_pgno);
+			if (rc)
+				return rc;
+			/* Branch pages need two children: the new page takes
+			 * the last child of the full one.
+			 */
+			node = NODEPTR(mp, NUMKEYS(mp) - 1);
+			moved = NODEPGNO(node);
+			mkey.mv_size = NODEKSZ(node);
+			mkey.mv_data = NODEKEY(node);
+			mdb_bulk_first(bb, lvl, &mkey);
+			mc->mc_top = lvl;
+			mc->mc_ki[lvl] = NUMKEYS(mp) - 1;
+			mdb_node_del(mc, 0);
+		}
+		if ((rc = mdb_page_new(mc, P_BRANCH, 1, &mp)))
+			return rc;
+		if (lvl == mc->mc_snum)
+			mc->mc_db->md_depth = ++mc->mc_snum;
+		mc->mc_pg[lvl] = mp;
+		mc->mc_top = lvl;
+		if (moved == P_INVALID) {
+			mdb_bulk_first(bb, lvl, key);
+			key = NULL;		/* the first key of a branch page is not stored */
+		} else if ((rc = mdb_node_add(mc, 0, NULL, NULL, moved, 0))) {
+			return rc;
+		}
+	}
+	mc->mc_top = lvl;
+	return mdb_node_add(mc, NUMKEYS(mc->mc_pg[lvl]), key, NULL, pgno, 0);
+}
+
+	/** Append an item to the leaf being filled, starting a new leaf
+	 *	when it is full.
+	 */
+static int
+mdb_bulk_leaf(MDB_bkbuild *bb, MDB_val *key, MDB_val *data)
+{
+	MDB_cursor *mc = &bb->bb_mc;
+	MDB_env *env = mc->mc_txn->mt_env;
+	MDB_page *mp = mc->mc_snum ? mc->mc_pg[0] : NULL;
+	int rc;
+
+	if ((rc = mdb_page_spill(mc, key, data)))
+		return rc;
+	if (!mp || mdb_leaf_size(env, mp, key, data) > SIZELEFT(mp)) {
+		if (mp && (rc = mdb_bulk_branch(bb, 1, &bb->bb_first[0], mp->mp_pgno)))
+			return rc;
+		if ((rc = mdb_page_new(mc, P_LEAF, 1, &mp)))
+			return rc;
+		if (mc->mc_db->md_flags & MDB_PREFIXKEYS) {
+			/* the rest of the page shares at least their common prefix with its first key */
+			MP_FLAGS(mp) |= P_PREFIX;
+			mdb_page_set_anchor(env, mp, key);
+		}
+		if (!mc->mc_snum)
+			mc->mc_db->md_depth = mc->mc_snum = 1;
+		mc->mc_pg[0] = mp;
+		mdb_bulk_first(bb, 0, key);
+	}
+	mc->mc_top = 0;
+	if ((rc = mdb_node_add(mc, NUMKEYS(mp), key, data, 0, 0)))
+		return rc;
+	mc->mc_db->md_entries++;
+	return MDB_SUCCESS;
+}
+
+	/** Add the last page of each level to its parent and set the root. */
+static int
+mdb_bulk_finish(MDB_bkbuild *bb)
+{
+	MDB_cursor *mc = &bb->bb_mc;
+	unsigned int i;
+	int rc;
+
+	if (!mc->mc_snum)
+		return MDB_SUCCESS;
+	for (i = 0; i + 1 < mc->mc_snum; i++) {
+		rc = mdb_bulk_branch(bb, i + 1, &bb->bb_first[i], mc->mc_pg[i]->mp_pgno);
+		if (rc)
+			return rc;
+	}
+	mc->mc_db->md_root = mc->mc_pg[mc->mc_snum - 1]->mp_pgno;
+	mc->mc_db->md_depth = mc->mc_snum;
+	*mc->mc_dbflag |= DB_DIRTY;
+	return MDB_SUCCESS;
+}
+
+	/** Free a bulk load, joining any sorter threads still running. */
+static int
+mdb_bulk_free(MDB_bulk *bk)
+{
+	MDB_bkrun *br;
+	unsigned int i;
+	int rc = MDB_SUCCESS, rc2;
+
+	while (bk->bk_joined + 1 < bk->bk_nruns)
+		if ((rc2 = mdb_bulk_join(bk)) && !rc)
+			rc = rc2;
+	for (i = 0; i < bk->bk_nruns; i++) {
+		br = bk->bk_runs[i];
+		if (br->br_fp)
+			fclose(br->br_fp);
+		free(br->br_recs);
+		free(br->br_buf);
+		free(br);
+	}
+	free(bk->bk_runs);
+	free(bk);
+	return rc;
+}
+
+int
+mdb_bulk_end(MDB_bulk *bk)
+{
+	MDB_txn *txn;
+	MDB_bkrun *br, **heap = NULL;
+	MDB_bkbuild bb;
+	MDB_val last;
+	char *lastbuf = NULL;
+	unsigned int i, n = 0;
+	int rc, rc2, build = 0;
+
+	if (!bk)
+		return EINVAL;
+	txn = bk->bk_txn;
+	MDB_TRACE(("%p", bk));
+	bb.bb_kbuf = NULL;
+
+	/* The last run stays in memory. Wait for the others. */
+	br = bk->bk_runs[bk->bk_nruns - 1];
+	if ((rc = mdb_bulk_sort(br)) != MDB_SUCCESS)
+		goto done;
+	while (bk->bk_joined + 1 < bk->bk_nruns)
+		if ((rc = mdb_bulk_join(bk)) != MDB_SUCCESS)
+			goto done;
+
+	if (txn->mt_flags & MDB_TXN_BLOCKED) {
+		rc = MDB_BAD_TXN;
+		goto done;
+	}
+	if (bk->bk_dedup) {
+		size_t maxkey = ENV_MAXKEY(txn->mt_env);
+		mdb_cursor_init(&bb.bb_mc, txn, bk->bk_dbi, NULL);
+		if (bb.bb_mc.mc_db->md_root == P_INVALID) {
+			/* Empty: build it bottom-up */
+			if ((bb.bb_kbuf = malloc(CURSOR_STACK * maxkey + maxkey)) == NULL) {
+				rc = ENOMEM;
+				goto done;
+			}
+			lastbuf = bb.bb_kbuf + CURSOR_STACK * maxkey;
+			bb.bb_mc.mc_flags |= C_INITIALIZED;
+			build = 1;
+		} else if ((lastbuf = malloc(maxkey)) == NULL) {
+			rc = ENOMEM;
+			goto done;
+		}
+	}
+
+	if ((heap = malloc(bk->bk_nruns * sizeof(MDB_bkrun *))) == NULL) {
+		rc = ENOMEM;
+		goto done;
+	}
+	for (i = 0; i < bk->bk_nruns; i++) {
+		br = bk->bk_runs[i];
+		if ((rc = mdb_bulk_read(br)) == MDB_SUCCESS)
+			heap[n++] = br;
+		else if (rc != MDB_NOTFOUND)
+			goto done;
+	}
+	for (i = n / 2; i-- > 0; )
+		mdb_bulk_sift(bk, heap, n, i);
+
+	rc = MDB_SUCCESS;
+	last.mv_data = NULL;
+	while (n) {
+		br = heap[0];
+		/* Equal keys come newest first, skip the older ones */
+		if (!last.mv_data || bk->bk_cmp(&br->br_key, &last)) {
+			if (build)
+				rc = mdb_bulk_leaf(&bb, &br->br_key, &br->br_data);
+			else
+				rc = mdb_put(txn, bk->bk_dbi, &br->br_key, &br->br_data, 0);
+			if (rc)
+				break;
+			if (lastbuf) {
+				memcpy(lastbuf, br->br_key.mv_data, br->br_key.mv_size);
+				last.mv_size = br->br_key.mv_size;
+				last.mv_data = lastbuf;
+			}
+		}
+		if ((rc = mdb_bulk_read(br)) == MDB_NOTFOUND)
+			heap[0] = heap[--n];
+		else if (rc)
+			break;
+		if (n)
+			mdb_bulk_sift(bk, heap, n, 0);
+		rc = MDB_SUCCESS;
+	}
+	if (!rc && build)
+		rc = mdb_bulk_finish(&bb);
+	if (rc)
+		txn->mt_flags |= MDB_TXN_ERROR;
+
+done:
+	free(heap);
+	free(bb.bb_kbuf);
+	if (!build)
+		free(lastbuf);
+	rc2 = mdb_bulk_free(bk);
+	return rc ? rc : rc2;
+}
+
+void
+mdb_bulk_abort(MDB_bulk *bk)
+{
+	if (bk) {
+		MDB_TRACE(("%p", bk));
+		mdb_bulk_free(bk);
+	}
+}
+
+#ifndef MDB_WBUF
+#define MDB_WBUF	(1024*1024)
+#endif
+#define MDB_EOF		0x10	/**< #mdb_env_copyfd1() is done reading */
+#ifndef MDB_CP_REPORT
+#define MDB_CP_REPORT	1000	/**< milliseconds between copy progress reports */
+#endif
+
+	/** Progress reports of a compacting copy. */
+typedef struct MDB_cprep {
+	MDB_copy_func *cr_func;
+	void *cr_ctx;
+	MDB_cpstat cr_stat;
+	unsigned int cr_psize;
+	uint64_t cr_start;	/**< when the copy started, see #mdb_kc_clock() */
+	uint64_t cr_next;	/**< when the next report is due */
+} MDB_cprep;
+
+	/** Report the progress of a compacting copy, if a report is due.
+	 * @param[in] cr the reports.
+	 * @param[in] written pages written so far.
+	 * @param[in] last nonzero for the final report, which is always made.
+	 * @return 0, or the error the callback returned.
+	 */
+static int ESECT
+mdb_env_cpreport(MDB_cprep *cr, mdb_size_t written, int last)
+{
+	uint64_t now;
+
+	cr->cr_stat.cs_written = written;
+	if (!cr->cr_func)
+		return MDB_SUCCESS;
+	now = mdb_kc_clock();
+	if (now < cr->cr_next && !last)
+		return MDB_SUCCESS;
+	cr->cr_next = now + (uint64_t)MDB_CP_REPORT * 1000000;
+	cr->cr_stat.cs_msec = (now - cr->cr_start) / 1000000;
+	cr->cr_stat.cs_rate = cr->cr_stat.cs_msec ?
+		written * cr->cr_psize * 1000 / cr->cr_stat.cs_msec : 0;
+	return cr->cr_func(&cr->cr_stat, cr->cr_ctx);
+}
+
+	/** State needed for a double-buffering compacting copy. */
+typedef struct mdb_copy {
+	MDB_env *mc_env;
+	MDB_txn *mc_txn;
+	pthread_mutex_t mc_mutex;
+	pthread_cond_t mc_cond;	/**< Condition variable for #mc_new */
+	char *mc_wbuf[2];
+	char *mc_over[2];
+	int mc_wlen[2];
+	int mc_olen[2];
+	pgno_t mc_next_pgno;
+	HANDLE mc_fd;
+	int mc_toggle;			/**< Buffer number in provider */
+	int mc_new;				/**< (0-2 buffers to write) | (#MDB_EOF at end) */
+	MDB_cprep *mc_rep;
+	/** Error code.  Never cleared if set.  Both threads can set nonzero
+	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
+	 */
+	volatile int mc_error;
+} mdb_copy;
+
+	/** Dedicated writer thread for compacting copy. */
+static THREAD_RET ESECT CALL_CONV
+mdb_env_copythr(void *arg)
+{
+	mdb_copy *my = arg;
+	char *ptr;
+	int toggle = 0, wsize, rc;
+#ifdef _WIN32
+	DWORD len;
+#define DO_WRITE(rc, fd, ptr, w2, len)	rc = WriteFile(fd, ptr, w2, &len, NULL)
+#else
+	int len;
+#define DO_WRITE(rc, fd, ptr, w2, len)	len = write(fd, ptr, w2); rc = (len >= 0)
+#ifdef SIGPIPE
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPIPE);
+	if ((rc = pthread_sigmask(SIG_BLOCK, &set, NULL)) != 0)
+		my->mc_error = rc;
+#endif
+#endif
+
+	pthread_mutex_lock(&my->mc_mutex);
 	for(;;) {
 		while (!my->mc_new)
 			pthread_cond_wait(&my->mc_cond, &my->mc_mutex);
@@ -10234,180 +12250,741 @@ mdb_env_copythr(void *arg)
 		wsize = my->mc_wlen[toggle];
 		ptr = my->mc_wbuf[toggle];
 again:
-		rc = MDB_SUCCESS;
-		while (wsize > 0 && !my->mc_error) {
-			DO_WRITE(rc, my->mc_fd, ptr, wsize, len);
-			if (!rc) {
-				rc = ErrCode();
-#if defined(SIGPIPE) && !defined(_WIN32)
-				if (rc == EPIPE) {
-					/* Collect the pending SIGPIPE, otherwise at least OS X
-					 * gives it to the process on thread-exit (ITS#8504).
+		rc = MDB_SUCCESS;
+		while (wsize > 0 && !my->mc_error) {
+			DO_WRITE(rc, my->mc_fd, ptr, wsize, len);
+			if (!rc) {
+				rc = ErrCode();
+#if defined(SIGPIPE) && !defined(_WIN32)
+				if (rc == EPIPE) {
+					/* Collect the pending SIGPIPE, otherwise at least OS X
+					 * gives it to the process on thread-exit (ITS#8504).
+					 */
+					int tmp;
+					sigwait(&set, &tmp);
+				}
+#endif
+				break;
+			} else if (len > 0) {
+				rc = MDB_SUCCESS;
+				ptr += len;
+				wsize -= len;
+				continue;
+			} else {
+				rc = EIO;
+				break;
+			}
+		}
+		if (rc) {
+			my->mc_error = rc;
+		}
+		/* If there's an overflow page tail, write it too */
+		if (my->mc_olen[toggle]) {
+			wsize = my->mc_olen[toggle];
+			ptr = my->mc_over[toggle];
+			my->mc_olen[toggle] = 0;
+			goto again;
+		}
+		my->mc_wlen[toggle] = 0;
+		toggle ^= 1;
+		/* Return the empty buffer to provider */
+		my->mc_new--;
+		pthread_cond_signal(&my->mc_cond);
+	}
+	pthread_mutex_unlock(&my->mc_mutex);
+	return (THREAD_RET)0;
+#undef DO_WRITE
+}
+
+	/** Give buffer and/or #MDB_EOF to writer thread, await unused buffer.
+	 *
+	 * @param[in] my control structure.
+	 * @param[in] adjust (1 to hand off 1 buffer) | (MDB_EOF when ending).
+	 */
+static int ESECT
+mdb_env_cthr_toggle(mdb_copy *my, int adjust)
+{
+	pthread_mutex_lock(&my->mc_mutex);
+	my->mc_new += adjust;
+	pthread_cond_signal(&my->mc_cond);
+	while (my->mc_new & 2)		/* both buffers in use */
+		pthread_cond_wait(&my->mc_cond, &my->mc_mutex);
+	pthread_mutex_unlock(&my->mc_mutex);
+
+	my->mc_toggle ^= (adjust & 1);
+	/* Both threads reset mc_wlen, to be safe from threading errors */
+	my->mc_wlen[my->mc_toggle] = 0;
+	if (!my->mc_error && !(adjust & MDB_EOF)) {
+		int rc = mdb_env_cpreport(my->mc_rep, my->mc_next_pgno, 0);
+		if (rc)
+			my->mc_error = rc;
+	}
+	return my->mc_error;
+}
+
+	/** Depth-first tree traversal for compacting copy.
+	 * @param[in] my control structure.
+	 * @param[in,out] pg database root.
+	 * @param[in] flags includes #F_DUPDATA if it is a sorted-duplicate sub-DB.
+	 */
+static int ESECT
+mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
+{
+	MDB_cursor mc = {0};
+	MDB_node *ni;
+	MDB_page *mo, *mp, *leaf;
+	char *buf, *ptr;
+	int rc, toggle;
+	unsigned int i;
+
+	/* Empty DB, nothing to do */
+	if (*pg == P_INVALID)
+		return MDB_SUCCESS;
+
+	mc.mc_snum = 1;
+	mc.mc_txn = my->mc_txn;
+	mc.mc_flags = my->mc_txn->mt_flags & (C_ORIG_RDONLY|C_WRITEMAP);
+
+	rc = mdb_page_get(&mc, *pg, &mc.mc_pg[0], NULL);
+	if (rc)
+		return rc;
+	rc = mdb_page_search_root(&mc, NULL, MDB_PS_FIRST);
+	if (rc)
+		return rc;
+
+	/* Make cursor pages writable */
+	buf = ptr = malloc(my->mc_env->me_psize * mc.mc_snum);
+	if (buf == NULL)
+		return ENOMEM;
+
+	for (i=0; i<mc.mc_top; i++) {
+		mdb_page_copy((MDB_page *)ptr, mc.mc_pg[i], my->mc_env->me_psize);
+		mc.mc_pg[i] = (MDB_page *)ptr;
+		ptr += my->mc_env->me_psize;
+	}
+
+	/* This is writable space for a leaf page. Usually not needed. */
+	leaf = (MDB_page *)ptr;
+
+	toggle = my->mc_toggle;
+	while (mc.mc_snum > 0) {
+		unsigned n;
+		mp = mc.mc_pg[mc.mc_top];
+		n = NUMKEYS(mp);
+
+		if (IS_LEAF(mp)) {
+			if (!IS_LEAF2(mp) && !(flags & F_DUPDATA)) {
+				for (i=0; i<n; i++) {
+					ni = NODEPTR(mp, i);
+					if (ni->mn_flags & F_BIGDATA) {
+						MDB_page *omp;
+						pgno_t pg;
+
+						/* Need writable leaf */
+						if (mp != leaf) {
+							mc.mc_pg[mc.mc_top] = leaf;
+							mdb_page_copy(leaf, mp, my->mc_env->me_psize);
+							mp = leaf;
+							ni = NODEPTR(mp, i);
+						}
+
+						memcpy(&pg, NODEDATA(ni), sizeof(pg));
+						memcpy(NODEDATA(ni), &my->mc_next_pgno, sizeof(pgno_t));
+						rc = mdb_page_get(&mc, pg, &omp, NULL);
+						if (rc)
+							goto done;
+						if (my->mc_wlen[toggle] >= MDB_WBUF) {
+							rc = mdb_env_cthr_toggle(my, 1);
+							if (rc)
+								goto done;
+							toggle = my->mc_toggle;
+						}
+						mo = (MDB_page *)(my->mc_wbuf[toggle] + my->mc_wlen[toggle]);
+						memcpy(mo, omp, my->mc_env->me_psize);
+						mo->mp_pgno = my->mc_next_pgno;
+						my->mc_next_pgno += omp->mp_pages;
+						my->mc_wlen[toggle] += my->mc_env->me_psize;
+						if (omp->mp_pages > 1) {
+							my->mc_olen[toggle] = my->mc_env->me_psize * (omp->mp_pages - 1);
+							my->mc_over[toggle] = (char *)omp + my->mc_env->me_psize;
+							rc = mdb_env_cthr_toggle(my, 1);
+							if (rc)
+								goto done;
+							toggle = my->mc_toggle;
+						}
+					} else if (ni->mn_flags & F_SUBDATA) {
+						MDB_db db;
+
+						/* Need writable leaf */
+						if (mp != leaf) {
+							mc.mc_pg[mc.mc_top] = leaf;
+							mdb_page_copy(leaf, mp, my->mc_env->me_psize);
+							mp = leaf;
+							ni = NODEPTR(mp, i);
+						}
+
+						memcpy(&db, NODEDATA(ni), sizeof(db));
+						my->mc_toggle = toggle;
+						rc = mdb_env_cwalk(my, &db.md_root, ni->mn_flags & F_DUPDATA);
+						if (rc)
+							goto done;
+						toggle = my->mc_toggle;
+						memcpy(NODEDATA(ni), &db, sizeof(db));
+					}
+				}
+			}
+		} else {
+			mc.mc_ki[mc.mc_top]++;
+			if (mc.mc_ki[mc.mc_top] < n) {
+				pgno_t pg;
+again:
+				ni = NODEPTR(mp, mc.mc_ki[mc.mc_top]);
+				pg = NODEPGNO(ni);
+				rc = mdb_page_get(&mc, pg, &mp, NULL);
+				if (rc)
+					goto done;
+				mc.mc_top++;
+				mc.mc_snum++;
+				mc.mc_ki[mc.mc_top] = 0;
+				if (IS_BRANCH(mp)) {
+					/* Whenever we advance to a sibling branch page,
+					 * we must proceed all the way down to its first leaf.
 					 */
-					int tmp;
-					sigwait(&set, &tmp);
-				}
+					mdb_page_copy(mc.mc_pg[mc.mc_top], mp, my->mc_env->me_psize);
+					goto again;
+				} else
+					mc.mc_pg[mc.mc_top] = mp;
+				continue;
+			}
+		}
+		if (my->mc_wlen[toggle] >= MDB_WBUF) {
+			rc = mdb_env_cthr_toggle(my, 1);
+			if (rc)
+				goto done;
+			toggle = my->mc_toggle;
+		}
+		mo = (MDB_page *)(my->mc_wbuf[toggle] + my->mc_wlen[toggle]);
+		mdb_page_copy(mo, mp, my->mc_env->me_psize);
+		mo->mp_pgno = my->mc_next_pgno++;
+		my->mc_wlen[toggle] += my->mc_env->me_psize;
+		if (mc.mc_top) {
+			/* Update parent if there is one */
+			ni = NODEPTR(mc.mc_pg[mc.mc_top-1], mc.mc_ki[mc.mc_top-1]);
+			SETPGNO(ni, mo->mp_pgno);
+			mdb_cursor_pop(&mc);
+		} else {
+			/* Otherwise we're done */
+			*pg = mo->mp_pgno;
+			break;
+		}
+	}
+done:
+	free(buf);
+	return rc;
+}
+
+	/** Set up the meta pages of a compacting copy.
+	 * @param[in] txn the read-only transaction to copy.
+	 * @param[out] buf space for #NUM_METAS pages.
+	 * @param[out] root the root of the main DB.
+	 * @param[out] new_root the root of the main DB in the copy.
+	 * @param[in,out] cr the progress reports, to set the page count.
+	 */
+static int ESECT
+mdb_env_cpmeta(MDB_txn *txn, char *buf, pgno_t *root, pgno_t *new_root,
+	MDB_cprep *cr)
+{
+	MDB_env *env = txn->mt_env;
+	MDB_meta *mm;
+	MDB_page *mp;
+	int rc = MDB_SUCCESS;
+
+	mp = (MDB_page *)buf;
+	memset(mp, 0, NUM_METAS * env->me_psize);
+	mp->mp_pgno = 0;
+	mp->mp_flags = P_META;
+	mm = (MDB_meta *)METADATA(mp);
+	mdb_env_init_meta0(env, mm);
+	mm->mm_address = env->me_metas[0]->mm_address;
+
+	mp = (MDB_page *)(buf + env->me_psize);
+	mp->mp_pgno = 1;
+	mp->mp_flags = P_META;
+	*(MDB_meta *)METADATA(mp) = *mm;
+	mm = (MDB_meta *)METADATA(mp);
+
+	/* Set metapage 1 with current main DB */
+	*root = *new_root = txn->mt_dbs[MAIN_DBI].md_root;
+	if (*root != P_INVALID) {
+		/* Count free pages + freeDB pages.  Subtract from last_pg
+		 * to find the new last_pg, which also becomes the new root.
+		 */
+		MDB_ID freecount = 0;
+		MDB_cursor mc;
+		MDB_val key, data;
+		mdb_cursor_init(&mc, txn, FREE_DBI, NULL);
+		while ((rc = mdb_cursor_get(&mc, &key, &data, MDB_NEXT)) == 0)
+			freecount += *(MDB_ID *)data.mv_data;
+		if (rc != MDB_NOTFOUND)
+			return rc;
+		rc = MDB_SUCCESS;
+		freecount += txn->mt_dbs[FREE_DBI].md_branch_pages +
+			txn->mt_dbs[FREE_DBI].md_leaf_pages +
+			txn->mt_dbs[FREE_DBI].md_overflow_pages;
+
+		*new_root = txn->mt_next_pgno - 1 - freecount;
+		mm->mm_last_pg = *new_root;
+		mm->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
+		mm->mm_dbs[MAIN_DBI].md_root = *new_root;
+	} else {
+		/* When the DB is empty, handle it specially to
+		 * fix any breakage like page leaks from ITS#8174.
+		 */
+		mm->mm_dbs[MAIN_DBI].md_flags = txn->mt_dbs[MAIN_DBI].md_flags;
+	}
+	if (*root != P_INVALID || mm->mm_dbs[MAIN_DBI].md_flags) {
+		mm->mm_txnid = 1;		/* use metapage 1 */
+	}
+	cr->cr_stat.cs_total = mm->mm_last_pg + 1;
+	return rc;
+}
+
+	/** Copy environment with compaction. */
+static int ESECT
+mdb_env_copyfd1(MDB_env *env, HANDLE fd, MDB_cprep *cr)
+{
+	mdb_copy my = {0};
+	MDB_txn *txn = NULL;
+	pthread_t thr;
+	pgno_t root, new_root;
+	int rc = MDB_SUCCESS;
+
+#ifdef _WIN32
+	if (!(my.mc_mutex = CreateMutex(NULL, FALSE, NULL)) ||
+		!(my.mc_cond = CreateEvent(NULL, FALSE, FALSE, NULL))) {
+		rc = ErrCode();
+		goto done;
+	}
+	my.mc_wbuf[0] = _aligned_malloc(MDB_WBUF*2, env->me_os_psize);
+	if (my.mc_wbuf[0] == NULL) {
+		/* _aligned_malloc() sets errno, but we use Windows error codes */
+		rc = ERROR_NOT_ENOUGH_MEMORY;
+		goto done;
+	}
+#else
+	if ((rc = pthread_mutex_init(&my.mc_mutex, NULL)) != 0)
+		return rc;
+	if ((rc = pthread_cond_init(&my.mc_cond, NULL)) != 0)
+		goto done2;
+#ifdef HAVE_MEMALIGN
+	my.mc_wbuf[0] = memalign(env->me_os_psize, MDB_WBUF*2);
+	if (my.mc_wbuf[0] == NULL) {
+		rc = errno;
+		goto done;
+	}
+#else
+	{
+		void *p;
+		if ((rc = posix_memalign(&p, env->me_os_psize, MDB_WBUF*2)) != 0)
+			goto done;
+		my.mc_wbuf[0] = p;
+	}
 #endif
-				break;
-			} else if (len > 0) {
-				rc = MDB_SUCCESS;
-				ptr += len;
-				wsize -= len;
+#endif
+	memset(my.mc_wbuf[0], 0, MDB_WBUF*2);
+	my.mc_wbuf[1] = my.mc_wbuf[0] + MDB_WBUF;
+	my.mc_next_pgno = NUM_METAS;
+	my.mc_env = env;
+	my.mc_fd = fd;
+	my.mc_rep = cr;
+	rc = THREAD_CREATE(thr, mdb_env_copythr, &my);
+	if (rc)
+		goto done;
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+	if (rc)
+		goto finish;
+
+	rc = mdb_env_cpmeta(txn, my.mc_wbuf[0], &root, &new_root, cr);
+	if (rc)
+		goto finish;
+
+	my.mc_wlen[0] = env->me_psize * NUM_METAS;
+	my.mc_txn = txn;
+	rc = mdb_env_cwalk(&my, &root, 0);
+	if (rc == MDB_SUCCESS && root != new_root) {
+		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+	}
+
+finish:
+	if (rc)
+		my.mc_error = rc;
+	mdb_env_cthr_toggle(&my, 1 | MDB_EOF);
+	rc = THREAD_FINISH(thr);
+	_mdb_txn_abort(txn);
+	if (!rc && !my.mc_error)
+		rc = mdb_env_cpreport(cr, cr->cr_stat.cs_total, 1);
+
+done:
+#ifdef _WIN32
+	if (my.mc_wbuf[0]) _aligned_free(my.mc_wbuf[0]);
+	if (my.mc_cond)  CloseHandle(my.mc_cond);
+	if (my.mc_mutex) CloseHandle(my.mc_mutex);
+#else
+	free(my.mc_wbuf[0]);
+	pthread_cond_destroy(&my.mc_cond);
+done2:
+	pthread_mutex_destroy(&my.mc_mutex);
+#endif
+	return rc ? rc : my.mc_error;
+}
+
+#ifndef MDB_VL32
+#ifndef MDB_CP_THREADS
+#define MDB_CP_THREADS	4	/**< default number of threads for #mdb_env_copyfd3() */
+#endif
+#define MDB_CP_SPLIT	16	/**< subtrees per thread in a parallel copy */
+	/** A spooled page's number, until its thread reserves a range of page
+	 *	numbers. Branch nodes keep 48 bits of a page number.
+	 */
+#define MDB_CP_TEMP	((pgno_t)1 << (sizeof(pgno_t) > 4 ? 47 : 31))
+
+	/** A subtree copied by one thread of a parallel copy. */
+typedef struct MDB_cpunit {
+	pgno_t	cu_pgno;	/**< its root page */
+	pgno_t	cu_new;		/**< its root page in the copy */
+	int		cu_flags;	/**< #F_DUPDATA if it is in a sorted-duplicate sub-DB */
+	struct MDB_cpunit *cu_next;	/**< next unit waiting for page numbers */
+} MDB_cpunit;
+
+	/** State shared by the threads of a parallel compacting copy.
+	 *
+	 *	The top of the tree is split into subtrees. Each thread takes a
+	 *	subtree, copies it depth-first like #mdb_env_cwalk() into its
+	 *	spool with temporary page numbers, and when the spool is full
+	 *	reserves the next range of page numbers for it, renumbers its
+	 *	pages and writes them at their place in the file. The pages
+	 *	above the subtrees are copied last, so the main DB root is the
+	 *	last page as usual.
+	 */
+typedef struct mdb_cpar {
+	MDB_env *cp_env;
+	MDB_txn *cp_txn;
+	HANDLE cp_fd;
+	mdb_size_t cp_off;	/**< offset of the copy in the file */
+	MDB_cpunit *cp_units;
+	unsigned int cp_nunits;
+	MDB_ID2L cp_map;	/**< subtrees by root page, while copying the top */
+	pthread_mutex_t cp_mutex;	/**< protects the fields below */
+	unsigned int cp_next;	/**< next unit to copy */
+	pgno_t cp_next_pgno;
+	mdb_size_t cp_written;
+	MDB_cprep *cp_rep;
+	/** Error code.  Never cleared if set.  Any thread can set nonzero
+	 *	to fail the copy.  Not mutex-protected, LMDB expects atomic int.
+	 */
+	volatile int cp_error;
+} mdb_cpar;
+
+	/** A tree traversal in progress: copies of its cursor stack pages. */
+typedef struct MDB_cpframe {
+	struct MDB_cpframe *cf_up;
+	char *cf_buf;
+	unsigned int cf_npages;
+} MDB_cpframe;
+
+	/** One thread of a parallel compacting copy. */
+typedef struct mdb_cpthr {
+	mdb_cpar *ct_par;
+	char *ct_buf;			/**< spool of pages to write */
+	unsigned int ct_npages;	/**< pages in the spool */
+	char *ct_tail;			/**< rest of an overflow page, written from the map */
+	pgno_t ct_ntail;
+	MDB_cpframe *ct_frames;	/**< traversals in progress, innermost first */
+	MDB_cpunit *ct_pending;	/**< units with a temporary root page number */
+	pthread_t ct_thr;
+} mdb_cpthr;
+
+	/** Write pages of a parallel copy at their place in the file. */
+static int ESECT
+mdb_cpar_write(mdb_cpar *cp, char *ptr, mdb_size_t size, pgno_t pgno)
+{
+	mdb_size_t pos = cp->cp_off + (mdb_size_t)pgno * cp->cp_env->me_psize;
+	size_t w2;
+#ifdef _WIN32
+	DWORD len;
+	OVERLAPPED ov;
+#else
+	ssize_t len;
+#endif
+
+	while (size > 0) {
+		w2 = size > MAX_WRITE ? MAX_WRITE : size;
+#ifdef _WIN32
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = pos & 0xffffffff;
+		ov.OffsetHigh = pos >> 16 >> 16;
+		if (!WriteFile(cp->cp_fd, ptr, w2, &len, &ov))
+			return ErrCode();
+#else
+		len = pwrite(cp->cp_fd, ptr, w2, pos);
+		if (len < 0) {
+			int rc = ErrCode();
+			if (rc == EINTR)
 				continue;
-			} else {
-				rc = EIO;
-				break;
-			}
+			return rc;
 		}
-		if (rc) {
-			my->mc_error = rc;
+#endif
+		if (len == 0)
+			return EIO;
+		ptr += len;
+		pos += len;
+		size -= len;
+	}
+	return MDB_SUCCESS;
+}
+
+	/** Give the temporary page numbers in a page their final value. */
+static void ESECT
+mdb_cpar_fix(MDB_page *mp, pgno_t base)
+{
+	MDB_node *ni;
+	MDB_db db;
+	pgno_t pg;
+	unsigned int i, n;
+
+	if (IS_BRANCH(mp)) {
+		n = NUMKEYS(mp);
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			pg = NODEPGNO(ni);
+			if (pg & MDB_CP_TEMP)
+				SETPGNO(ni, pg - MDB_CP_TEMP + base);
 		}
-		/* If there's an overflow page tail, write it too */
-		if (my->mc_olen[toggle]) {
-			wsize = my->mc_olen[toggle];
-			ptr = my->mc_over[toggle];
-			my->mc_olen[toggle] = 0;
-			goto again;
+	} else if (IS_LEAF(mp) && !IS_LEAF2(mp)) {
+		n = NUMKEYS(mp);
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			if (ni->mn_flags & F_BIGDATA) {
+				memcpy(&pg, NODEDATA(ni), sizeof(pg));
+				if (pg & MDB_CP_TEMP) {
+					pg += base - MDB_CP_TEMP;
+					memcpy(NODEDATA(ni), &pg, sizeof(pg));
+				}
+			} else if (ni->mn_flags & F_SUBDATA) {
+				memcpy(&db, NODEDATA(ni), sizeof(db));
+				if (db.md_root != P_INVALID && (db.md_root & MDB_CP_TEMP)) {
+					db.md_root += base - MDB_CP_TEMP;
+					memcpy(NODEDATA(ni), &db, sizeof(db));
+				}
+			}
 		}
-		my->mc_wlen[toggle] = 0;
-		toggle ^= 1;
-		/* Return the empty buffer to provider */
-		my->mc_new--;
-		pthread_cond_signal(&my->mc_cond);
 	}
-	pthread_mutex_unlock(&my->mc_mutex);
-	return (THREAD_RET)0;
-#undef DO_WRITE
 }
 
-	/** Give buffer and/or #MDB_EOF to writer thread, await unused buffer.
+	/** Reserve page numbers for the spool of a copy thread and write it.
 	 *
-	 * @param[in] my control structure.
-	 * @param[in] adjust (1 to hand off 1 buffer) | (MDB_EOF when ending).
+	 *	Temporary page numbers can only be in the spool, in the pages
+	 *	on the cursor stacks of the traversals in progress, and in the
+	 *	units finished since the last flush.
 	 */
 static int ESECT
-mdb_env_cthr_toggle(mdb_copy *my, int adjust)
+mdb_cpar_flush(mdb_cpthr *ct)
 {
-	pthread_mutex_lock(&my->mc_mutex);
-	my->mc_new += adjust;
-	pthread_cond_signal(&my->mc_cond);
-	while (my->mc_new & 2)		/* both buffers in use */
-		pthread_cond_wait(&my->mc_cond, &my->mc_mutex);
-	pthread_mutex_unlock(&my->mc_mutex);
+	mdb_cpar *cp = ct->ct_par;
+	unsigned int i, psize = cp->cp_env->me_psize;
+	pgno_t base, n = ct->ct_npages + ct->ct_ntail;
+	MDB_cpframe *cf;
+	MDB_cpunit *cu;
+	MDB_page *mp;
+	int rc;
 
-	my->mc_toggle ^= (adjust & 1);
-	/* Both threads reset mc_wlen, to be safe from threading errors */
-	my->mc_wlen[my->mc_toggle] = 0;
-	return my->mc_error;
+	if (!n)
+		return cp->cp_error;
+	pthread_mutex_lock(&cp->cp_mutex);
+	base = cp->cp_next_pgno;
+	cp->cp_next_pgno += n;
+	pthread_mutex_unlock(&cp->cp_mutex);
+
+	for (i=0; i<ct->ct_npages; i++) {
+		mp = (MDB_page *)(ct->ct_buf + i * psize);
+		mp->mp_pgno = base + i;
+		mdb_cpar_fix(mp, base);
+	}
+	for (cf = ct->ct_frames; cf; cf = cf->cf_up) {
+		for (i=0; i<cf->cf_npages; i++)
+			mdb_cpar_fix((MDB_page *)(cf->cf_buf + i * psize), base);
+	}
+	for (cu = ct->ct_pending; cu; cu = cu->cu_next)
+		cu->cu_new += base - MDB_CP_TEMP;
+	ct->ct_pending = NULL;
+
+	rc = mdb_cpar_write(cp, ct->ct_buf, (mdb_size_t)ct->ct_npages * psize, base);
+	if (!rc && ct->ct_ntail)
+		rc = mdb_cpar_write(cp, ct->ct_tail, (mdb_size_t)ct->ct_ntail * psize,
+			base + ct->ct_npages);
+	ct->ct_npages = 0;
+	ct->ct_ntail = 0;
+	if (!rc) {
+		pthread_mutex_lock(&cp->cp_mutex);
+		cp->cp_written += n;
+		rc = mdb_env_cpreport(cp->cp_rep, cp->cp_written, 0);
+		pthread_mutex_unlock(&cp->cp_mutex);
+	}
+	if (rc)
+		cp->cp_error = rc;
+	return cp->cp_error;
 }
 
-	/** Depth-first tree traversal for compacting copy.
-	 * @param[in] my control structure.
+	/** Add a copy of a page to the spool of a copy thread.
+	 * @param[in] ct the copy thread.
+	 * @param[in] mp the page.
+	 * @param[out] ret its temporary page number.
+	 */
+static int ESECT
+mdb_cpar_page(mdb_cpthr *ct, MDB_page *mp, pgno_t *ret)
+{
+	unsigned int psize = ct->ct_par->cp_env->me_psize;
+	MDB_page *mo;
+	int rc;
+
+	if (ct->ct_npages == MDB_WBUF / psize && (rc = mdb_cpar_flush(ct)) != 0)
+		return rc;
+	mo = (MDB_page *)(ct->ct_buf + ct->ct_npages * psize);
+	if (IS_OVERFLOW(mp))
+		memcpy(mo, mp, psize);
+	else
+		mdb_page_copy(mo, mp, psize);
+	*ret = MDB_CP_TEMP + ct->ct_npages++;
+	return MDB_SUCCESS;
+}
+
+	/** While copying the top of the tree, replace a subtree root
+	 *	by its page number in the copy.
+	 * @return 1 if \b pg was the root of a subtree, otherwise 0.
+	 */
+static int
+mdb_cpar_sub(mdb_cpar *cp, pgno_t *pg)
+{
+	unsigned int x;
+
+	if (!cp->cp_map)
+		return 0;
+	x = mdb_mid2l_search(cp->cp_map, *pg);
+	if (x > cp->cp_map[0].mid || cp->cp_map[x].mid != *pg)
+		return 0;
+	*pg = ((MDB_cpunit *)cp->cp_map[x].mptr)->cu_new;
+	return 1;
+}
+
+	/** Depth-first tree traversal for parallel compacting copy.
+	 * Like #mdb_env_cwalk(), but the pages go to the spool of a copy
+	 * thread, and subtrees that are already copied are skipped.
+	 * @param[in] ct the copy thread.
 	 * @param[in,out] pg database root.
 	 * @param[in] flags includes #F_DUPDATA if it is a sorted-duplicate sub-DB.
 	 */
 static int ESECT
-mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
+mdb_cpar_walk(mdb_cpthr *ct, pgno_t *pg, int flags)
 {
+	mdb_cpar *cp = ct->ct_par;
+	unsigned int i, n, depth, psize = cp->cp_env->me_psize;
 	MDB_cursor mc = {0};
+	MDB_cpframe cf;
 	MDB_node *ni;
-	MDB_page *mo, *mp, *leaf;
-	char *buf, *ptr;
-	int rc, toggle;
-	unsigned int i;
+	MDB_page *mp, *leaf;
+	pgno_t child;
+	int rc;
 
-	/* Empty DB, nothing to do */
-	if (*pg == P_INVALID)
+	/* Empty DB, or a subtree copied already */
+	if (*pg == P_INVALID || mdb_cpar_sub(cp, pg))
 		return MDB_SUCCESS;
 
-	mc.mc_snum = 1;
-	mc.mc_txn = my->mc_txn;
-	mc.mc_flags = my->mc_txn->mt_flags & (C_ORIG_RDONLY|C_WRITEMAP);
-
-	rc = mdb_page_get(&mc, *pg, &mc.mc_pg[0], NULL);
-	if (rc)
-		return rc;
-	rc = mdb_page_search_root(&mc, NULL, MDB_PS_FIRST);
-	if (rc)
-		return rc;
+	mc.mc_txn = cp->cp_txn;
+	mc.mc_flags = cp->cp_txn->mt_flags & (C_ORIG_RDONLY|C_WRITEMAP);
 
-	/* Make cursor pages writable */
-	buf = ptr = malloc(my->mc_env->me_psize * mc.mc_snum);
-	if (buf == NULL)
+	/* Find the depth, to keep a writable copy of each level */
+	child = *pg;
+	for (depth = 1;; depth++) {
+		if ((rc = mdb_page_get(&mc, child, &mp, NULL)) != 0)
+			return rc;
+		if (!IS_BRANCH(mp))
+			break;
+		if (depth == CURSOR_STACK)
+			return MDB_CORRUPTED;
+		child = NODEPGNO(NODEPTR(mp, 0));
+	}
+	if ((cf.cf_buf = calloc(depth, psize)) == NULL)
 		return ENOMEM;
+	cf.cf_npages = depth;
+	cf.cf_up = ct->ct_frames;
+	ct->ct_frames = &cf;
 
-	for (i=0; i<mc.mc_top; i++) {
-		mdb_page_copy((MDB_page *)ptr, mc.mc_pg[i], my->mc_env->me_psize);
-		mc.mc_pg[i] = (MDB_page *)ptr;
-		ptr += my->mc_env->me_psize;
+	child = *pg;
+descend:
+	/* Go down to the first leaf, or to a subtree copied already */
+	for (;;) {
+		if ((rc = mdb_page_get(&mc, child, &mp, NULL)) != 0)
+			goto done;
+		mc.mc_top = mc.mc_snum++;
+		mc.mc_ki[mc.mc_top] = 0;
+		if (!IS_BRANCH(mp)) {
+			mc.mc_pg[mc.mc_top] = mp;
+			break;
+		}
+		mc.mc_pg[mc.mc_top] = (MDB_page *)(cf.cf_buf + mc.mc_top * psize);
+		mdb_page_copy(mc.mc_pg[mc.mc_top], mp, psize);
+		ni = NODEPTR(mc.mc_pg[mc.mc_top], 0);
+		child = NODEPGNO(ni);
+		if (mdb_cpar_sub(cp, &child)) {
+			SETPGNO(ni, child);
+			break;
+		}
 	}
 
-	/* This is writable space for a leaf page. Usually not needed. */
-	leaf = (MDB_page *)ptr;
-
-	toggle = my->mc_toggle;
 	while (mc.mc_snum > 0) {
-		unsigned n;
 		mp = mc.mc_pg[mc.mc_top];
 		n = NUMKEYS(mp);
 
 		if (IS_LEAF(mp)) {
 			if (!IS_LEAF2(mp) && !(flags & F_DUPDATA)) {
+				/* This is writable space for a leaf page. Usually not needed. */
+				leaf = (MDB_page *)(cf.cf_buf + mc.mc_top * psize);
 				for (i=0; i<n; i++) {
-					ni = NODEPTR(mp, i);
-					if (ni->mn_flags & F_BIGDATA) {
-						MDB_page *omp;
-						pgno_t pg;
-
-						/* Need writable leaf */
-						if (mp != leaf) {
-							mc.mc_pg[mc.mc_top] = leaf;
-							mdb_page_copy(leaf, mp, my->mc_env->me_psize);
-							mp = leaf;
-							ni = NODEPTR(mp, i);
-						}
-
-						memcpy(&pg, NODEDATA(ni), sizeof(pg));
-						memcpy(NODEDATA(ni), &my->mc_next_pgno, sizeof(pgno_t));
-						rc = mdb_page_get(&mc, pg, &omp, NULL);
-						if (rc)
-							goto done;
-						if (my->mc_wlen[toggle] >= MDB_WBUF) {
-							rc = mdb_env_cthr_toggle(my, 1);
-							if (rc)
-								goto done;
-							toggle = my->mc_toggle;
-						}
-						mo = (MDB_page *)(my->mc_wbuf[toggle] + my->mc_wlen[toggle]);
-						memcpy(mo, omp, my->mc_env->me_psize);
-						mo->mp_pgno = my->mc_next_pgno;
-						my->mc_next_pgno += omp->mp_pages;
-						my->mc_wlen[toggle] += my->mc_env->me_psize;
+					ni = NODEPTR(mp, i);
+					if (!(ni->mn_flags & (F_BIGDATA|F_SUBDATA)))
+						continue;
+
+					/* Need writable leaf */
+					if (mp != leaf) {
+						mc.mc_pg[mc.mc_top] = leaf;
+						mdb_page_copy(leaf, mp, psize);
+						mp = leaf;
+						ni = NODEPTR(mp, i);
+					}
+
+					if (ni->mn_flags & F_BIGDATA) {
+						MDB_page *omp;
+
+						memcpy(&child, NODEDATA(ni), sizeof(pgno_t));
+						rc = mdb_page_get(&mc, child, &omp, NULL);
+						if (rc || (rc = mdb_cpar_page(ct, omp, &child)) != 0)
+							goto done;
+						memcpy(NODEDATA(ni), &child, sizeof(pgno_t));
 						if (omp->mp_pages > 1) {
-							my->mc_olen[toggle] = my->mc_env->me_psize * (omp->mp_pages - 1);
-							my->mc_over[toggle] = (char *)omp + my->mc_env->me_psize;
-							rc = mdb_env_cthr_toggle(my, 1);
-							if (rc)
+							/* Write the rest straight from the map */
+							ct->ct_tail = (char *)omp + psize;
+							ct->ct_ntail = omp->mp_pages - 1;
+							if ((rc = mdb_cpar_flush(ct)) != 0)
 								goto done;
-							toggle = my->mc_toggle;
 						}
-					} else if (ni->mn_flags & F_SUBDATA) {
+					} else {
 						MDB_db db;
 
-						/* Need writable leaf */
-						if (mp != leaf) {
-							mc.mc_pg[mc.mc_top] = leaf;
-							mdb_page_copy(leaf, mp, my->mc_env->me_psize);
-							mp = leaf;
-							ni = NODEPTR(mp, i);
-						}
-
 						memcpy(&db, NODEDATA(ni), sizeof(db));
-						my->mc_toggle = toggle;
-						rc = mdb_env_cwalk(my, &db.md_root, ni->mn_flags & F_DUPDATA);
+						rc = mdb_cpar_walk(ct, &db.md_root, ni->mn_flags & F_DUPDATA);
 						if (rc)
 							goto done;
-						toggle = my->mc_toggle;
 						memcpy(NODEDATA(ni), &db, sizeof(db));
 					}
 				}
@@ -10415,183 +12992,304 @@ mdb_env_cwalk(mdb_copy *my, pgno_t *pg, int flags)
 		} else {
 			mc.mc_ki[mc.mc_top]++;
 			if (mc.mc_ki[mc.mc_top] < n) {
-				pgno_t pg;
-again:
 				ni = NODEPTR(mp, mc.mc_ki[mc.mc_top]);
-				pg = NODEPGNO(ni);
-				rc = mdb_page_get(&mc, pg, &mp, NULL);
-				if (rc)
-					goto done;
-				mc.mc_top++;
-				mc.mc_snum++;
-				mc.mc_ki[mc.mc_top] = 0;
-				if (IS_BRANCH(mp)) {
-					/* Whenever we advance to a sibling branch page,
-					 * we must proceed all the way down to its first leaf.
-					 */
-					mdb_page_copy(mc.mc_pg[mc.mc_top], mp, my->mc_env->me_psize);
-					goto again;
-				} else
-					mc.mc_pg[mc.mc_top] = mp;
-				continue;
+				child = NODEPGNO(ni);
+				if (mdb_cpar_sub(cp, &child)) {
+					SETPGNO(ni, child);
+					continue;
+				}
+				goto descend;
 			}
 		}
-		if (my->mc_wlen[toggle] >= MDB_WBUF) {
-			rc = mdb_env_cthr_toggle(my, 1);
-			if (rc)
-				goto done;
-			toggle = my->mc_toggle;
-		}
-		mo = (MDB_page *)(my->mc_wbuf[toggle] + my->mc_wlen[toggle]);
-		mdb_page_copy(mo, mp, my->mc_env->me_psize);
-		mo->mp_pgno = my->mc_next_pgno++;
-		my->mc_wlen[toggle] += my->mc_env->me_psize;
+		if ((rc = mdb_cpar_page(ct, mp, &child)) != 0)
+			goto done;
 		if (mc.mc_top) {
 			/* Update parent if there is one */
 			ni = NODEPTR(mc.mc_pg[mc.mc_top-1], mc.mc_ki[mc.mc_top-1]);
-			SETPGNO(ni, mo->mp_pgno);
+			SETPGNO(ni, child);
 			mdb_cursor_pop(&mc);
 		} else {
 			/* Otherwise we're done */
-			*pg = mo->mp_pgno;
+			*pg = child;
 			break;
 		}
 	}
 done:
-	free(buf);
+	ct->ct_frames = cf.cf_up;
+	free(cf.cf_buf);
 	return rc;
 }
 
-	/** Copy environment with compaction. */
+	/** A thread of a parallel compacting copy: copy subtrees until
+	 *	there are none left.
+	 */
+static THREAD_RET ESECT CALL_CONV
+mdb_cpar_thr(void *arg)
+{
+	mdb_cpthr *ct = arg;
+	mdb_cpar *cp = ct->ct_par;
+	MDB_cpunit *cu;
+	int rc = MDB_SUCCESS;
+
+	for (;;) {
+		pthread_mutex_lock(&cp->cp_mutex);
+		cu = NULL;
+		if (cp->cp_next < cp->cp_nunits && !cp->cp_error)
+			cu = &cp->cp_units[cp->cp_next++];
+		pthread_mutex_unlock(&cp->cp_mutex);
+		if (!cu)
+			break;
+		cu->cu_new = cu->cu_pgno;
+		if ((rc = mdb_cpar_walk(ct, &cu->cu_new, cu->cu_flags)) != 0)
+			break;
+		cu->cu_next = ct->ct_pending;
+		ct->ct_pending = cu;
+	}
+	if (!rc)
+		rc = mdb_cpar_flush(ct);
+	if (rc)
+		cp->cp_error = rc;
+	return (THREAD_RET)0;
+}
+
+	/** Append a subtree to a growing list. */
 static int ESECT
-mdb_env_copyfd1(MDB_env *env, HANDLE fd)
+mdb_cpar_push(MDB_cpunit **list, unsigned int *n, unsigned int *max,
+	pgno_t pgno, int flags)
 {
-	MDB_meta *mm;
+	if (*n == *max) {
+		unsigned int m = *max ? *max * 2 : 64;
+		MDB_cpunit *l = realloc(*list, m * sizeof(MDB_cpunit));
+		if (!l)
+			return ENOMEM;
+		*list = l;
+		*max = m;
+	}
+	(*list)[*n].cu_pgno = pgno;
+	(*list)[*n].cu_flags = flags;
+	(*n)++;
+	return MDB_SUCCESS;
+}
+
+	/** Split the tree into subtrees for the threads of a parallel copy.
+	 *
+	 *	Pages are expanded breadth-first until there are \b nunits
+	 *	subtrees. The branch pages, and the leaves with sub-DBs, that
+	 *	were expanded are the top of the tree. Larger subtrees come first
+	 *	in the list, so the threads finish at about the same time.
+	 */
+static int ESECT
+mdb_cpar_split(mdb_cpar *cp, pgno_t root, unsigned int nunits)
+{
+	MDB_cursor mc = {0};
+	MDB_cpunit *q = NULL, *leaves = NULL;
+	unsigned int i, m, n, head = 0, nq = 0, maxq = 0, nl = 0, maxl = 0;
+	MDB_node *ni;
 	MDB_page *mp;
-	mdb_copy my = {0};
+	MDB_db db;
+	pgno_t pg;
+	int rc, flags;
+
+	mc.mc_txn = cp->cp_txn;
+	mc.mc_flags = cp->cp_txn->mt_flags & (C_ORIG_RDONLY|C_WRITEMAP);
+
+	rc = mdb_cpar_push(&q, &nq, &maxq, root, 0);
+	while (!rc && head < nq && nq - head + nl < nunits) {
+		pg = q[head].cu_pgno;
+		flags = q[head].cu_flags;
+		head++;
+		if ((rc = mdb_page_get(&mc, pg, &mp, NULL)) != 0)
+			break;
+		n = NUMKEYS(mp);
+		if (IS_BRANCH(mp)) {
+			for (i=0; i<n && !rc; i++)
+				rc = mdb_cpar_push(&q, &nq, &maxq, NODEPGNO(NODEPTR(mp, i)), flags);
+			continue;
+		}
+		/* A leaf is only expanded into its sub-DBs */
+		m = nq;
+		if (!IS_LEAF2(mp) && !(flags & F_DUPDATA)) {
+			for (i=0; i<n && !rc; i++) {
+				ni = NODEPTR(mp, i);
+				if (!(ni->mn_flags & F_SUBDATA))
+					continue;
+				memcpy(&db, NODEDATA(ni), sizeof(db));
+				if (db.md_root != P_INVALID)
+					rc = mdb_cpar_push(&q, &nq, &maxq, db.md_root,
+						ni->mn_flags & F_DUPDATA);
+			}
+		}
+		if (!rc && m == nq)
+			rc = mdb_cpar_push(&leaves, &nl, &maxl, pg, flags);
+	}
+
+	if (!rc) {
+		n = nq - head;
+		if ((cp->cp_units = malloc((n + nl) * sizeof(MDB_cpunit))) == NULL) {
+			rc = ENOMEM;
+		} else {
+			memcpy(cp->cp_units, q + head, n * sizeof(MDB_cpunit));
+			if (nl)
+				memcpy(cp->cp_units + n, leaves, nl * sizeof(MDB_cpunit));
+			cp->cp_nunits = n + nl;
+		}
+	}
+	free(q);
+	free(leaves);
+	return rc;
+}
+
+	/** Copy environment with compaction, on several threads.
+	 * @param[in] env the environment.
+	 * @param[in] fd a regular file.
+	 * @param[in] off the offset of the copy in the file.
+	 * @param[in] nthreads number of threads, including the caller.
+	 * @param[in,out] cr the progress reports.
+	 */
+static int ESECT
+mdb_env_cpar(MDB_env *env, HANDLE fd, mdb_size_t off, unsigned int nthreads,
+	MDB_cprep *cr)
+{
+	mdb_cpar cp = {0};
+	mdb_cpthr *ct = NULL;
+	MDB_cpunit top;
+	MDB_ID2 id;
 	MDB_txn *txn = NULL;
-	pthread_t thr;
-	pgno_t root, new_root;
-	int rc = MDB_SUCCESS;
+	char *buf = NULL;
+	size_t size = (size_t)nthreads * MDB_WBUF + NUM_METAS * env->me_psize;
+	pgno_t new_root;
+	unsigned int i, started = 1;
+	int rc;
 
 #ifdef _WIN32
-	if (!(my.mc_mutex = CreateMutex(NULL, FALSE, NULL)) ||
-		!(my.mc_cond = CreateEvent(NULL, FALSE, FALSE, NULL))) {
-		rc = ErrCode();
-		goto done;
-	}
-	my.mc_wbuf[0] = _aligned_malloc(MDB_WBUF*2, env->me_os_psize);
-	if (my.mc_wbuf[0] == NULL) {
-		/* _aligned_malloc() sets errno, but we use Windows error codes */
+	if (!(cp.cp_mutex = CreateMutex(NULL, FALSE, NULL)))
+		return ErrCode();
+	if ((buf = _aligned_malloc(size, env->me_os_psize)) == NULL) {
 		rc = ERROR_NOT_ENOUGH_MEMORY;
 		goto done;
 	}
 #else
-	if ((rc = pthread_mutex_init(&my.mc_mutex, NULL)) != 0)
+	if ((rc = pthread_mutex_init(&cp.cp_mutex, NULL)) != 0)
 		return rc;
-	if ((rc = pthread_cond_init(&my.mc_cond, NULL)) != 0)
-		goto done2;
 #ifdef HAVE_MEMALIGN
-	my.mc_wbuf[0] = memalign(env->me_os_psize, MDB_WBUF*2);
-	if (my.mc_wbuf[0] == NULL) {
+	if ((buf = memalign(env->me_os_psize, size)) == NULL) {
 		rc = errno;
 		goto done;
 	}
 #else
 	{
 		void *p;
-		if ((rc = posix_memalign(&p, env->me_os_psize, MDB_WBUF*2)) != 0)
+		if ((rc = posix_memalign(&p, env->me_os_psize, size)) != 0)
 			goto done;
-		my.mc_wbuf[0] = p;
+		buf = p;
 	}
 #endif
 #endif
-	memset(my.mc_wbuf[0], 0, MDB_WBUF*2);
-	my.mc_wbuf[1] = my.mc_wbuf[0] + MDB_WBUF;
-	my.mc_next_pgno = NUM_METAS;
-	my.mc_env = env;
-	my.mc_fd = fd;
-	rc = THREAD_CREATE(thr, mdb_env_copythr, &my);
-	if (rc)
+	memset(buf, 0, size);
+	cp.cp_env = env;
+	cp.cp_fd = fd;
+	cp.cp_off = off;
+	cp.cp_rep = cr;
+	cp.cp_next_pgno = NUM_METAS;
+	if ((ct = calloc(nthreads, sizeof(mdb_cpthr))) == NULL) {
+		rc = ENOMEM;
 		goto done;
+	}
+	for (i=0; i<nthreads; i++) {
+		ct[i].ct_par = &cp;
+		ct[i].ct_buf = buf + NUM_METAS * env->me_psize + (size_t)i * MDB_WBUF;
+	}
 
 	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
 	if (rc)
-		goto finish;
-
-	mp = (MDB_page *)my.mc_wbuf[0];
-	memset(mp, 0, NUM_METAS * env->me_psize);
-	mp->mp_pgno = 0;
-	mp->mp_flags = P_META;
-	mm = (MDB_meta *)METADATA(mp);
-	mdb_env_init_meta0(env, mm);
-	mm->mm_address = env->me_metas[0]->mm_address;
-
-	mp = (MDB_page *)(my.mc_wbuf[0] + env->me_psize);
-	mp->mp_pgno = 1;
-	mp->mp_flags = P_META;
-	*(MDB_meta *)METADATA(mp) = *mm;
-	mm = (MDB_meta *)METADATA(mp);
-
-	/* Set metapage 1 with current main DB */
-	root = new_root = txn->mt_dbs[MAIN_DBI].md_root;
-	if (root != P_INVALID) {
-		/* Count free pages + freeDB pages.  Subtract from last_pg
-		 * to find the new last_pg, which also becomes the new root.
-		 */
-		MDB_ID freecount = 0;
-		MDB_cursor mc;
-		MDB_val key, data;
-		mdb_cursor_init(&mc, txn, FREE_DBI, NULL);
-		while ((rc = mdb_cursor_get(&mc, &key, &data, MDB_NEXT)) == 0)
-			freecount += *(MDB_ID *)data.mv_data;
-		if (rc != MDB_NOTFOUND)
-			goto finish;
-		freecount += txn->mt_dbs[FREE_DBI].md_branch_pages +
-			txn->mt_dbs[FREE_DBI].md_leaf_pages +
-			txn->mt_dbs[FREE_DBI].md_overflow_pages;
+		goto done;
+	cp.cp_txn = txn;
+	rc = mdb_env_cpmeta(txn, buf, &top.cu_pgno, &new_root, cr);
+	if (rc || top.cu_pgno == P_INVALID)
+		goto meta;
 
-		new_root = txn->mt_next_pgno - 1 - freecount;
-		mm->mm_last_pg = new_root;
-		mm->mm_dbs[MAIN_DBI] = txn->mt_dbs[MAIN_DBI];
-		mm->mm_dbs[MAIN_DBI].md_root = new_root;
-	} else {
-		/* When the DB is empty, handle it specially to
-		 * fix any breakage like page leaks from ITS#8174.
-		 */
-		mm->mm_dbs[MAIN_DBI].md_flags = txn->mt_dbs[MAIN_DBI].md_flags;
+	rc = mdb_cpar_split(&cp, top.cu_pgno, nthreads * MDB_CP_SPLIT);
+	if (rc)
+		goto done;
+	for (; started<nthreads; started++) {
+		if ((rc = THREAD_CREATE(ct[started].ct_thr, mdb_cpar_thr, &ct[started])) != 0) {
+			cp.cp_error = rc;
+			break;
+		}
 	}
-	if (root != P_INVALID || mm->mm_dbs[MAIN_DBI].md_flags) {
-		mm->mm_txnid = 1;		/* use metapage 1 */
+	mdb_cpar_thr(&ct[0]);
+	for (i=1; i<started; i++) {
+		THREAD_FINISH(ct[i].ct_thr);
+#ifdef _WIN32
+		CloseHandle(ct[i].ct_thr);
+#endif
 	}
+	if ((rc = cp.cp_error) != 0)
+		goto done;
 
-	my.mc_wlen[0] = env->me_psize * NUM_METAS;
-	my.mc_txn = txn;
-	rc = mdb_env_cwalk(&my, &root, 0);
-	if (rc == MDB_SUCCESS && root != new_root) {
+	/* Copy the top of the tree */
+	if ((cp.cp_map = malloc((cp.cp_nunits + 1) * sizeof(MDB_ID2))) == NULL) {
+		rc = ENOMEM;
+		goto done;
+	}
+	cp.cp_map[0].mid = 0;
+	for (i=0; i<cp.cp_nunits; i++) {
+		id.mid = cp.cp_units[i].cu_pgno;
+		id.mptr = &cp.cp_units[i];
+		if (mdb_mid2l_insert(cp.cp_map, &id)) {
+			rc = MDB_CORRUPTED;
+			goto done;
+		}
+	}
+	top.cu_new = top.cu_pgno;
+	rc = mdb_cpar_walk(&ct[0], &top.cu_new, 0);
+	if (rc)
+		goto done;
+	if (top.cu_new & MDB_CP_TEMP) {
+		top.cu_next = NULL;
+		ct[0].ct_pending = &top;
+	}
+	if ((rc = mdb_cpar_flush(&ct[0])) != 0)
+		goto done;
+	if (top.cu_new != new_root || cp.cp_next_pgno != new_root + 1) {
 		rc = MDB_INCOMPATIBLE;	/* page leak or corrupt DB */
+		goto done;
 	}
 
-finish:
-	if (rc)
-		my.mc_error = rc;
-	mdb_env_cthr_toggle(&my, 1 | MDB_EOF);
-	rc = THREAD_FINISH(thr);
-	_mdb_txn_abort(txn);
+meta:
+	if (!rc)
+		rc = mdb_cpar_write(&cp, buf, NUM_METAS * env->me_psize, 0);
+	if (!rc) {
+		/* Leave the file offset after the copy, like a plain write */
+		mdb_size_t end = off + cr->cr_stat.cs_total * env->me_psize;
+#ifdef _WIN32
+		LARGE_INTEGER pos;
+		pos.QuadPart = end;
+		if (!SetFilePointerEx(fd, pos, NULL, FILE_BEGIN))
+			rc = ErrCode();
+#else
+		if (lseek(fd, end, SEEK_SET) < 0)
+			rc = ErrCode();
+#endif
+	}
+	if (!rc)
+		rc = mdb_env_cpreport(cr, cr->cr_stat.cs_total, 1);
 
 done:
+	_mdb_txn_abort(txn);
+	free(cp.cp_map);
+	free(cp.cp_units);
+	free(ct);
 #ifdef _WIN32
-	if (my.mc_wbuf[0]) _aligned_free(my.mc_wbuf[0]);
-	if (my.mc_cond)  CloseHandle(my.mc_cond);
-	if (my.mc_mutex) CloseHandle(my.mc_mutex);
+	if (buf) _aligned_free(buf);
+	CloseHandle(cp.cp_mutex);
 #else
-	free(my.mc_wbuf[0]);
-	pthread_cond_destroy(&my.mc_cond);
-done2:
-	pthread_mutex_destroy(&my.mc_mutex);
+	free(buf);
+	pthread_mutex_destroy(&cp.cp_mutex);
 #endif
-	return rc ? rc : my.mc_error;
+	return rc;
 }
+#endif /* MDB_VL32 */
 
 	/** Copy environment as-is. */
 static int ESECT
@@ -10694,12 +13392,46 @@ leave:
 }
 
 int ESECT
-mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
+mdb_env_copyfd3(MDB_env *env, HANDLE fd, unsigned int flags,
+	unsigned int nthreads, MDB_copy_func *func, void *ctx)
 {
-	if (flags & MDB_CP_COMPACT)
-		return mdb_env_copyfd1(env, fd);
-	else
+	MDB_cprep cr = {0};
+
+	if (!(flags & MDB_CP_COMPACT))
 		return mdb_env_copyfd0(env, fd);
+
+	cr.cr_func = func;
+	cr.cr_ctx = ctx;
+	cr.cr_psize = env->me_psize;
+	cr.cr_start = mdb_kc_clock();
+	cr.cr_next = cr.cr_start + (uint64_t)MDB_CP_REPORT * 1000000;
+#ifndef MDB_VL32
+	/* Threads need positional writes, a pipe gets the copy in order */
+	if (!nthreads)
+		nthreads = MDB_CP_THREADS;
+	if (nthreads > 1) {
+#ifdef _WIN32
+		LARGE_INTEGER zero, pos;
+		zero.QuadPart = 0;
+		if (GetFileType(fd) == FILE_TYPE_DISK &&
+			SetFilePointerEx(fd, zero, &pos, FILE_CURRENT))
+			return mdb_env_cpar(env, fd, pos.QuadPart, nthreads, &cr);
+#else
+		struct stat st;
+		off_t pos;
+		if (!fstat(fd, &st) && S_ISREG(st.st_mode) &&
+			(pos = lseek(fd, 0, SEEK_CUR)) >= 0)
+			return mdb_env_cpar(env, fd, pos, nthreads, &cr);
+#endif
+	}
+#endif
+	return mdb_env_copyfd1(env, fd, &cr);
+}
+
+int ESECT
+mdb_env_copyfd2(MDB_env *env, HANDLE fd, unsigned int flags)
+{
+	return mdb_env_copyfd3(env, fd, flags, 1, NULL, NULL);
 }
 
 int ESECT
@@ -10709,7 +13441,8 @@ mdb_env_copyfd(MDB_env *env, HANDLE fd)
 }
 
 int ESECT
-mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
+mdb_env_copy3(MDB_env *env, const char *path, unsigned int flags,
+	unsigned int nthreads, MDB_copy_func *func, void *ctx)
 {
 	int rc;
 	MDB_name fname;
@@ -10721,13 +13454,19 @@ mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
 		mdb_fname_destroy(fname);
 	}
 	if (rc == MDB_SUCCESS) {
-		rc = mdb_env_copyfd2(env, newfd, flags);
+		rc = mdb_env_copyfd3(env, newfd, flags, nthreads, func, ctx);
 		if (close(newfd) < 0 && rc == MDB_SUCCESS)
 			rc = ErrCode();
 	}
 	return rc;
 }
 
+int ESECT
+mdb_env_copy2(MDB_env *env, const char *path, unsigned int flags)
+{
+	return mdb_env_copy3(env, path, flags, 1, NULL, NULL);
+}
+
 int ESECT
 mdb_env_copy(MDB_env *env, const char *path)
 {
@@ -10891,12 +13630,18 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 		return EINVAL;
 	if (txn->mt_flags & MDB_TXN_BLOCKED)
 		return MDB_BAD_TXN;
+#if !MDB_MAXKEYSIZE
+	if (flags & MDB_PREFIXKEYS)
+		return MDB_INCOMPATIBLE;
+#endif
 
 	/* main DB? */
 	if (!name) {
 		*dbi = MAIN_DBI;
 		if (flags & PERSISTENT_FLAGS) {
 			uint16_t f2 = flags & PERSISTENT_FLAGS;
+			if (NO_PREFIXKEYS(txn->mt_dbs[MAIN_DBI].md_flags | f2))
+				return EINVAL;
 			/* make sure flag changes get committed */
 			if ((txn->mt_dbs[MAIN_DBI].md_flags | f2) != txn->mt_dbs[MAIN_DBI].md_flags) {
 				txn->mt_dbs[MAIN_DBI].md_flags |= f2;
@@ -10935,6 +13680,9 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 	if (txn->mt_dbs[MAIN_DBI].md_flags & (MDB_DUPSORT|MDB_INTEGERKEY))
 		return (flags & MDB_CREATE) ? MDB_INCOMPATIBLE : MDB_NOTFOUND;
 
+	if (NO_PREFIXKEYS(flags))
+		return EINVAL;
+
 	/* Find the DB info */
 	dbflag = DB_NEW|DB_VALID|DB_USRVALID;
 	exact = 0;
@@ -10978,12 +13726,16 @@ int mdb_dbi_open(MDB_txn *txn, const char *name, unsigned int flags, MDB_dbi *db
 		txn->mt_dbxs[slot].md_name.mv_data = namedup;
 		txn->mt_dbxs[slot].md_name.mv_size = len;
 		txn->mt_dbxs[slot].md_rel = NULL;
+		txn->mt_dbxs[slot].md_enc = NULL;
+		txn->mt_dbxs[slot].md_dec = NULL;
 		txn->mt_dbflags[slot] = dbflag;
 		/* txn-> and env-> are the same in read txns, use
 		 * tmp variable to avoid undefined assignment
 		 */
 		seq = ++txn->mt_env->me_dbiseqs[slot];
 		txn->mt_dbiseqs[slot] = seq;
+		if (txn->mt_env->me_kc)
+			mdb_kc_forget(txn->mt_env, slot);
 
 		memcpy(&txn->mt_dbs[slot], data.mv_data, sizeof(MDB_db));
 		*dbi = slot;
@@ -11235,6 +13987,20 @@ int mdb_set_relctx(MDB_txn *txn, MDB_dbi dbi, void *ctx)
 	return MDB_SUCCESS;
 }
 
+int mdb_set_codec(MDB_txn *txn, MDB_dbi dbi, MDB_codec_func *enc,
+	MDB_codec_func *dec, size_t threshold, void *ctx)
+{
+	if (!TXN_DBI_EXIST(txn, dbi, DB_USRVALID) ||
+		(txn->mt_dbs[dbi].md_flags & MDB_DUPSORT))
+		return EINVAL;
+
+	txn->mt_dbxs[dbi].md_enc = enc;
+	txn->mt_dbxs[dbi].md_dec = dec;
+	txn->mt_dbxs[dbi].md_codecctx = ctx;
+	txn->mt_dbxs[dbi].md_codecmin = threshold;
+	return MDB_SUCCESS;
+}
+
 int ESECT
 mdb_env_get_maxkeysize(MDB_env *env)
 {
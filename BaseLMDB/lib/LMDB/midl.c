@@ -198,20 +198,114 @@ int mdb_midl_append_range( MDB_IDL *idp, MDB_ID id, unsigned n )
 	return 0;
 }
 
+	/* How mdb_midl_xmerge() picks its loop by the ratio of the list
+	 * sizes: lists within MERGE_MIX of each other interleave at random,
+	 * so a branch-free loop beats mispredicted compares. A merge list
+	 * MERGE_GALLOP times smaller than the target is merged by galloping
+	 * over the runs of old IDs and moving each run as one block. The
+	 * plain loop is best in between, where its branches are predictable.
+	 */
+#define MERGE_MIX	8
+#define MERGE_GALLOP	256
+
 void mdb_midl_xmerge( MDB_IDL idl, MDB_IDL merge )
 {
 	MDB_ID old_id, merge_id, i = merge[0], j = idl[0], k = i+j, total = k;
+	MDB_ID lo, hi, mid, lt;
 	idl[0] = (MDB_ID)-1;		/* delimiter for idl scan below */
-	old_id = idl[j];
-	while (i) {
-		merge_id = merge[i--];
-		for (; old_id < merge_id; old_id = idl[--j])
-			idl[k--] = old_id;
-		idl[k--] = merge_id;
+	if (i * MERGE_MIX >= j && j * MERGE_MIX >= i) {
+		while (i && j) {
+			old_id = idl[j];
+			merge_id = merge[i];
+			lt = old_id < merge_id;
+			idl[k--] = lt ? old_id : merge_id;
+			j -= lt;
+			i -= lt ^ 1;
+		}
+		memcpy(idl+1, merge+1, i * sizeof(MDB_ID));
+	} else if (i * MERGE_GALLOP < j) {
+		while (i) {
+			merge_id = merge[i--];
+			/* idl[j] ... idl[j-lo+1] are below merge_id, idl[j-hi+1] is not */
+			for (lo = 0, hi = 1; idl[j-hi+1] < merge_id; ) {
+				lo = hi;
+				hi <<= 1;
+				if (hi > j+1)
+					hi = j+1;
+			}
+			while (hi - lo > 1) {
+				mid = (lo + hi) >> 1;
+				if (idl[j-mid+1] < merge_id)
+					lo = mid;
+				else
+					hi = mid;
+			}
+			memmove(idl+k-lo+1, idl+j-lo+1, lo * sizeof(MDB_ID));
+			j -= lo;
+			k -= lo;
+			idl[k--] = merge_id;
+		}
+	} else {
+		old_id = idl[j];
+		while (i) {
+			merge_id = merge[i--];
+			for (; old_id < merge_id; old_id = idl[--j])
+				idl[k--] = old_id;
+			idl[k--] = merge_id;
+		}
 	}
 	idl[0] = total;
 }
 
+	/* Smallest IDL sorted by radix instead of quicksort */
+#ifndef MDB_MIDL_RADIX
+#define MDB_MIDL_RADIX	128
+#endif
+#define RADIX_BITS	8
+#define RADIX_SIZE	(1<<RADIX_BITS)
+
+	/* LSD radix sort, a byte per pass. Bytes that are the same in
+	 * all IDs are skipped, so page numbers below 2^32 take at most
+	 * 4 passes. Returns ENOMEM if there is no scratch space.
+	 */
+static int
+mdb_midl_radix( MDB_IDL ids )
+{
+	MDB_ID cnt[RADIX_SIZE];
+	MDB_ID n = ids[0], i, sum, c, all = (MDB_ID)-1, any = 0;
+	MDB_ID *src = ids+1, *dst, *tmp, *buf;
+	unsigned shift;
+
+	for (i=0; i<n; i++) {
+		all &= src[i];
+		any |= src[i];
+	}
+	any &= ~all;	/* bits that differ between IDs */
+	if ((buf = malloc(n * sizeof(MDB_ID))) == NULL)
+		return ENOMEM;
+	dst = buf;
+	for (shift = 0; shift < sizeof(MDB_ID)*CHAR_BIT; shift += RADIX_BITS) {
+		if (!((any >> shift) & (RADIX_SIZE-1)))
+			continue;
+		memset(cnt, 0, sizeof(cnt));
+		for (i=0; i<n; i++)
+			cnt[(src[i] >> shift) & (RADIX_SIZE-1)]++;
+		/* Descending order: high digits go first */
+		for (sum = 0, c = RADIX_SIZE; c--; ) {
+			i = cnt[c];
+			cnt[c] = sum;
+			sum += i;
+		}
+		for (i=0; i<n; i++)
+			dst[cnt[(src[i] >> shift) & (RADIX_SIZE-1)]++] = src[i];
+		tmp = src; src = dst; dst = tmp;
+	}
+	if (src != ids+1)
+		memcpy(ids+1, src, n * sizeof(MDB_ID));
+	free(buf);
+	return 0;
+}
+
 /* Quicksort + Insertion sort for small arrays */
 
 #define SMALL	8
@@ -225,6 +319,8 @@ mdb_midl_sort( MDB_IDL ids )
 	int i,j,k,l,ir,jstack;
 	MDB_ID a, itmp;
 
+	if (ids[0] >= MDB_MIDL_RADIX && !mdb_midl_radix(ids))
+		return;
 	ir = (int)ids[0];
 	l = 1;
 	jstack = 0;
@@ -278,6 +374,187 @@ mdb_midl_sort( MDB_IDL ids )
 	}
 }
 
+	/* ID run index: run k covers IDs ir_lo[k] .. ir_lo[k]+ir_len[k]-1,
+	 * and runs are neither adjacent nor overlapping. Leaf k of the tree
+	 * holds the length of run k, each inner node the larger of its
+	 * children's; leaves past ir_nrun hold 0.
+	 */
+
+	/* Make room for n runs, keeping the current ones */
+static int mdb_idrun_grow( MDB_idrun *ir, unsigned n )
+{
+	unsigned size = ir->ir_size ? ir->ir_size : 16;
+	MDB_ID *p;
+	if (n <= ir->ir_size)
+		return 0;
+	while (size < n)
+		size <<= 1;
+	if (!(p = realloc(ir->ir_lo, size * sizeof(MDB_ID))))
+		return ENOMEM;
+	ir->ir_lo = p;
+	if (!(p = realloc(ir->ir_len, size * sizeof(MDB_ID))))
+		return ENOMEM;
+	ir->ir_len = p;
+	if (!(p = realloc(ir->ir_best, 2 * size * sizeof(MDB_ID))))
+		return ENOMEM;
+	ir->ir_best = p;
+	ir->ir_size = size;
+	return 0;
+}
+
+	/* Rebuild the tree over the runs */
+static void mdb_idrun_build( MDB_idrun *ir )
+{
+	MDB_ID *best = ir->ir_best;
+	unsigned nleaf = 1, k;
+	while (nleaf < ir->ir_nrun)
+		nleaf <<= 1;
+	ir->ir_nleaf = nleaf;
+	for (k = 0; k < nleaf; k++)
+		best[nleaf + k] = k < ir->ir_nrun ? ir->ir_len[k] : 0;
+	for (k = nleaf - 1; k; k--)
+		best[k] = best[2*k] > best[2*k+1] ? best[2*k] : best[2*k+1];
+}
+
+	/* Update the tree after the length of run k changed */
+static void mdb_idrun_fix( MDB_idrun *ir, unsigned k )
+{
+	MDB_ID *best = ir->ir_best;
+	k += ir->ir_nleaf;
+	best[k] = ir->ir_len[k - ir->ir_nleaf];
+	for (k >>= 1; k; k >>= 1)
+		best[k] = best[2*k] > best[2*k+1] ? best[2*k] : best[2*k+1];
+}
+
+	/* Merge the IDs of a descending IDL, or else the run id..id+n-1,
+	 * into the runs. Runs and new IDs are taken from the highest down
+	 * and written from the end of the arrays, then moved to the front.
+	 */
+static int mdb_idrun_merge( MDB_idrun *ir, MDB_IDL ids, MDB_ID id, unsigned n )
+{
+	unsigned m = ids ? (unsigned)ids[0] : 1, r = ir->ir_nrun, i = 1;
+	unsigned w = r + m, end = w;
+	MDB_ID lo = 0, hi = 0, clo = 0, chi = 0;
+	int cur = 0;
+	if (mdb_idrun_grow(ir, w ? w : 1))
+		return ENOMEM;
+	for (;;) {
+		/* next run of the IDs, or 0 when done */
+		MDB_ID ilo = 0, ihi = 0;
+		if (i <= m) {
+			ilo = ihi = ids ? ids[i] : id + n - 1;
+			if (!ids)
+				ilo = id;
+		}
+		while (r && !ir->ir_len[r-1])	/* skip used up runs */
+			r--;
+		if (r && (i > m || ir->ir_lo[r-1] > ilo)) {
+			lo = ir->ir_lo[r-1];
+			hi = lo + ir->ir_len[r-1] - 1;
+			r--;
+		} else if (i <= m) {
+			lo = ilo;
+			hi = ihi;
+			i++;
+		} else {
+			break;
+		}
+		if (cur && hi + 1 >= clo) {
+			if (lo < clo)
+				clo = lo;
+		} else {
+			if (cur) {
+				w--;
+				ir->ir_lo[w] = clo;
+				ir->ir_len[w] = chi - clo + 1;
+			}
+			clo = lo;
+			chi = hi;
+			cur = 1;
+		}
+	}
+	if (cur) {
+		w--;
+		ir->ir_lo[w] = clo;
+		ir->ir_len[w] = chi - clo + 1;
+	}
+	ir->ir_nrun = end - w;
+	memmove(ir->ir_lo, ir->ir_lo + w, ir->ir_nrun * sizeof(MDB_ID));
+	memmove(ir->ir_len, ir->ir_len + w, ir->ir_nrun * sizeof(MDB_ID));
+	mdb_idrun_build(ir);
+	return 0;
+}
+
+int mdb_idrun_load( MDB_idrun *ir, MDB_IDL ids )
+{
+	ir->ir_nrun = 0;
+	if (mdb_idrun_merge(ir, ids, 0, 0)) {
+		ir->ir_nleaf = 0;
+		return ENOMEM;
+	}
+	return 0;
+}
+
+void mdb_idrun_add( MDB_idrun *ir, MDB_IDL ids )
+{
+	if (ids[0] && mdb_idrun_merge(ir, ids, 0, 0))
+		ir->ir_nleaf = 0;
+}
+
+void mdb_idrun_set( MDB_idrun *ir, MDB_ID id, unsigned n, int on )
+{
+	unsigned base = 0, len = ir->ir_nrun;
+	MDB_ID lo;
+	if (on) {
+		if (mdb_idrun_merge(ir, NULL, id, n))
+			ir->ir_nleaf = 0;
+		return;
+	}
+	/* find the last run starting at or below id */
+	while (len > 1) {
+		unsigned half = len / 2;
+		if (ir->ir_lo[base + half] <= id)
+			base += half;
+		len -= half;
+	}
+	lo = ir->ir_lo[base];
+	if (!ir->ir_nrun || id < lo || id + n > lo + ir->ir_len[base]) {
+		ir->ir_nleaf = 0;	/* not indexed: reload when needed */
+		return;
+	}
+	if (id == lo) {
+		ir->ir_lo[base] += n;
+		ir->ir_len[base] -= n;
+	} else if (id + n == lo + ir->ir_len[base]) {
+		ir->ir_len[base] -= n;
+	} else {
+		ir->ir_nleaf = 0;	/* would split the run */
+		return;
+	}
+	mdb_idrun_fix(ir, base);
+}
+
+MDB_ID mdb_idrun_find( MDB_idrun *ir, unsigned n )
+{
+	MDB_ID *best = ir->ir_best;
+	unsigned k = 1;
+	if (best[1] < n)
+		return 0;
+	/* descend to the leftmost run long enough */
+	while (k < ir->ir_nleaf)
+		k = best[2*k] >= n ? 2*k : 2*k+1;
+	return ir->ir_lo[k - ir->ir_nleaf];
+}
+
+void mdb_idrun_free( MDB_idrun *ir )
+{
+	free(ir->ir_lo);
+	free(ir->ir_len);
+	free(ir->ir_best);
+	ir->ir_lo = ir->ir_len = ir->ir_best = NULL;
+	ir->ir_size = ir->ir_nrun = ir->ir_nleaf = 0;
+}
+
 unsigned mdb_mid2l_search( MDB_ID2L ids, MDB_ID id )
 {
 	/*
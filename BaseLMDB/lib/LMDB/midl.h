@@ -144,6 +144,56 @@ void mdb_midl_xmerge( MDB_IDL idl, MDB_IDL merge );
 	 */
 void mdb_midl_sort( MDB_IDL ids );
 
+	/** An ID run index: the runs of consecutive IDs of an IDL, lowest
+	 * first, with a tree of their lengths to find a run of a given
+	 * length in logarithmic time. Its size follows the number of runs,
+	 * not the range of the IDs. It mirrors an IDL; the owner keeps the
+	 * two in sync. A zeroed struct is an empty, unloaded index.
+	 */
+typedef struct MDB_idrun {
+	MDB_ID	*ir_lo;		/**< lowest ID of each run, ascending */
+	MDB_ID	*ir_len;	/**< length of each run (0 once used up) */
+	MDB_ID	*ir_best;	/**< longest run of each subtree, root at 1, leaves are runs */
+	unsigned	ir_nrun;	/**< runs in use */
+	unsigned	ir_nleaf;	/**< leaves of the tree (a power of 2), or 0 if not loaded */
+	unsigned	ir_size;	/**< runs allocated */
+} MDB_idrun;
+
+	/** Mark an ID run index as not loaded, keeping its memory. */
+#define mdb_idrun_reset(ir)	((ir)->ir_nleaf = 0)
+
+	/** (Re)load an ID run index from an IDL.
+	 * @param[in,out] ir	The index.
+	 * @param[in] ids	The IDL to index.
+	 * @return	0 on success, ENOMEM on failure.
+	 */
+int mdb_idrun_load( MDB_idrun *ir, MDB_IDL ids );
+
+	/** Add the IDs of an IDL, none of them in the index yet, to a
+	 * loaded ID run index. Without memory for the new runs, the index
+	 * is reset instead.
+	 */
+void mdb_idrun_add( MDB_idrun *ir, MDB_IDL ids );
+
+	/** Add or remove a run of IDs in a loaded ID run index.
+	 * A removal that would split a run resets the index instead.
+	 * @param[in,out] ir	The index.
+	 * @param[in] id	The lowest ID of the run.
+	 * @param[in] n		Number of IDs in the run.
+	 * @param[in] on	Nonzero to add the run, zero to remove it.
+	 */
+void mdb_idrun_set( MDB_idrun *ir, MDB_ID id, unsigned n, int on );
+
+	/** Find the lowest run of consecutive IDs in an ID run index.
+	 * @param[in] ir	The index.
+	 * @param[in] n		Length of the run, at least 1.
+	 * @return	The lowest ID of the run, or 0 if there is none.
+	 */
+MDB_ID mdb_idrun_find( MDB_idrun *ir, unsigned n );
+
+	/** Free the memory of an ID run index. */
+void mdb_idrun_free( MDB_idrun *ir );
+
 	/** An ID2 is an ID/pointer pair.
 	 */
 typedef struct MDB_ID2 {
@@ -0,0 +1,119 @@
+//!zig-autodoc-section: BaseLMDB\\lz.zig
+//! lz.zig :
+//!  A small LZ77 value codec for mdb_set_codec().
+// Build using Zig 0.16.0
+
+//=============================================================================
+//#region MARK: GLOBAL
+//=============================================================================
+const std = @import("std");
+
+/// LZ77 in LZ4 style sequences: a token with the literal and match lengths,
+/// the literals, then a 16-bit match offset. `c` is the `@cImport` of lmdb.h,
+/// e.g. `const lz = @import("lz.zig").Codec(lmdb);`, then
+/// `mdb_set_codec(txn, dbi, &lz.enc, &lz.dec, threshold, null)`.
+pub fn Codec(comptime c: type) type {
+  return struct {
+    pub fn enc(dst: [*c]c.MDB_val, src: [*c]const c.MDB_val, _: ?*anyopaque) callconv(.c) c_int {
+      const in = @as([*]const u8, @ptrCast(src.*.mv_data))[0..src.*.mv_size];
+      const out = @as([*]u8, @ptrCast(dst.*.mv_data))[0..dst.*.mv_size];
+      var tab = [_]u32{0} ** 4096;
+      var ip: usize = 0;
+      var anchor: usize = 0;
+      var op: usize = 0;
+      while (true) {
+        var len: usize = 0;
+        var m: usize = 0;
+        while (ip + 4 <= in.len) : (ip += 1) {
+          const seq = std.mem.readInt(u32, in[ip..][0..4], .little);
+          const h = (seq *% 2654435761) >> 20;
+          const prev = tab[h];
+          tab[h] = @intCast(ip + 1);
+          if (prev != 0 and ip - (prev - 1) <= 65535 and std.mem.eql(u8, in[prev - 1 ..][0..4], in[ip..][0..4])) {
+            m = prev - 1;
+            len = 4;
+            while (ip + len < in.len and in[m + len] == in[ip + len]) len += 1;
+            break;
+          }
+        }
+        if (len == 0) ip = in.len;
+        const lit = ip - anchor;
+        if (op + lit + lit / 255 + len / 255 + 6 > out.len) return 1;
+        out[op] = @as(u8, @intCast(@min(lit, 15))) << 4 | @as(u8, @intCast(if (len != 0) @min(len - 4, 15) else 0));
+        op += 1;
+        if (lit >= 15) op = putLen(out, op, lit - 15);
+        @memcpy(out[op..][0..lit], in[anchor..ip]);
+        op += lit;
+        if (len == 0) break;
+        out[op] = @truncate(ip - m);
+        out[op + 1] = @truncate((ip - m) >> 8);
+        op += 2;
+        if (len - 4 >= 15) op = putLen(out, op, len - 4 - 15);
+        ip += len;
+        anchor = ip;
+      }
+      dst.*.mv_size = op;
+      return 0;
+    }
+
+    pub fn dec(dst: [*c]c.MDB_val, src: [*c]const c.MDB_val, _: ?*anyopaque) callconv(.c) c_int {
+      const in = @as([*]const u8, @ptrCast(src.*.mv_data))[0..src.*.mv_size];
+      const out = @as([*]u8, @ptrCast(dst.*.mv_data))[0..dst.*.mv_size];
+      var ip: usize = 0;
+      var op: usize = 0;
+      while (ip < in.len) {
+        const t = in[ip];
+        ip += 1;
+        var lit: usize = t >> 4;
+        var len: usize = t & 15;
+        if (lit == 15) lit += getLen(in, &ip) orelse return c.MDB_CORRUPTED;
+        if (in.len - ip < lit or out.len - op < lit) return c.MDB_CORRUPTED;
+        @memcpy(out[op..][0..lit], in[ip..][0..lit]);
+        op += lit;
+        ip += lit;
+        if (ip == in.len) break;
+        if (in.len - ip < 2) return c.MDB_CORRUPTED;
+        const off = @as(usize, in[ip]) | @as(usize, in[ip + 1]) << 8;
+        ip += 2;
+        if (len == 15) len += getLen(in, &ip) orelse return c.MDB_CORRUPTED;
+        len += 4;
+        if (off == 0 or off > op or out.len - op < len) return c.MDB_CORRUPTED;
+        for (0..len) |_| {
+          out[op] = out[op - off];
+          op += 1;
+        }
+      }
+      dst.*.mv_size = op;
+      return 0;
+    }
+  };
+}
+
+//#endregion ==================================================================
+//#region MARK: UTIL
+//=============================================================================
+/// Append a length byte run: 255s and the rest.
+fn putLen(out: []u8, at: usize, n: usize) usize {
+  var op = at;
+  var r = n;
+  while (r >= 255) : (r -= 255) {
+    out[op] = 255;
+    op += 1;
+  }
+  out[op] = @intCast(r);
+  return op + 1;
+}
+
+fn getLen(in: []const u8, ip: *usize) ?usize {
+  var n: usize = 0;
+  while (ip.* < in.len) {
+    const b = in[ip.*];
+    ip.* += 1;
+    n += b;
+    if (b != 255) return n;
+  }
+  return null;
+}
+
+//#endregion ==================================================================
+//=============================================================================
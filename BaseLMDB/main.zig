@@ -14,6 +14,10 @@ const std = @import("std");
 const lmdb = @cImport({
   @cInclude("lib/LMDB/lmdb.h");
 });
+const midl = @cImport({
+  @cInclude("lib/LMDB/midl.h");
+});
+const lz = @import("lz.zig").Codec(lmdb);
 
 //#endregion ==================================================================
 //#region MARK: MAIN
@@ -152,5 +156,786 @@ test " empty" {
   try std.testing.expect(true);
 }
 
+extern "c" fn remove(path: [*:0]const u8) c_int;
+
+fn check(rc: c_int) !void {
+  if (rc != lmdb.MDB_SUCCESS) {
+    std.debug.print("LMDB error: {s}\n", .{lmdb.mdb_strerror(rc)});
+    return error.LMDBError;
+  }
+}
+
+fn removeDb(path: [:0]const u8) void {
+  var buf: [256]u8 = undefined;
+  _ = remove(path.ptr);
+  const lock = std.fmt.bufPrintZ(&buf, "{s}-lock", .{path}) catch return;
+  _ = remove(lock.ptr);
+}
+
+const EnvOptions = struct {
+  mapsize: usize = 1 << 30,
+  maxdbs: c_uint = 0,
+  keycache: c_uint = 0,
+};
+
+/// An environment opened on a new, empty file; close() also removes it.
+const TestEnv = struct {
+  env: ?*lmdb.MDB_env,
+  path: [:0]const u8,
+
+  fn close(db: TestEnv) void {
+    lmdb.mdb_env_close(db.env);
+    removeDb(db.path);
+  }
+};
+
+fn openTestEnv(path: [:0]const u8, flags: c_uint, opts: EnvOptions) !TestEnv {
+  removeDb(path);
+  var env: ?*lmdb.MDB_env = null;
+  try check(lmdb.mdb_env_create(&env));
+  const db = TestEnv{.env = env, .path = path};
+  errdefer db.close();
+  try check(lmdb.mdb_env_set_mapsize(env, opts.mapsize));
+  if (opts.maxdbs != 0) try check(lmdb.mdb_env_set_maxdbs(env, opts.maxdbs));
+  if (opts.keycache != 0) try check(lmdb.mdb_env_set_keycache(env, opts.keycache));
+  try check(lmdb.mdb_env_open(env, path.ptr, lmdb.MDB_NOSUBDIR | flags, 0o664));
+  return db;
+}
+
+fn fill(key: u32, size: u32) u8 {
+  return @truncate(key *% 7 +% size);
+}
+
+/// Put values of 1-64 KB under random keys, deleting a quarter of them.
+fn churn(txn: ?*lmdb.MDB_txn, dbi: lmdb.MDB_dbi, rand: std.Random, sizes: []u32, ops: usize) !void {
+  var buf: [64 * 1024]u8 = undefined;
+  for (0..ops) |_| {
+    var key = rand.uintLessThan(u32, @intCast(sizes.len));
+    var k = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &key};
+    if (rand.uintLessThan(u32, 4) == 0) {
+      const rc = lmdb.mdb_del(txn, dbi, &k, null);
+      if (rc != lmdb.MDB_NOTFOUND) try check(rc);
+      sizes[key] = 0;
+    } else {
+      const size = 1024 + rand.uintLessThan(u32, 63 * 1024);
+      @memset(buf[0..size], fill(key, size));
+      var v = lmdb.MDB_val{.mv_size = size, .mv_data = &buf};
+      try check(lmdb.mdb_put(txn, dbi, &k, &v, 0));
+      sizes[key] = size;
+    }
+  }
+}
+
+test " freePageRuns" {
+  const db = try openTestEnv("test-freepages.mdb", lmdb.MDB_NOSYNC, .{});
+  defer db.close();
+  const env = db.env;
+
+  var sizes: [2000]u32 = @splat(0);
+  var prng = std.Random.DefaultPrng.init(41);
+  var dbi: lmdb.MDB_dbi = undefined;
+  for (0..400) |round| {
+    var txn: ?*lmdb.MDB_txn = null;
+    try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+    if (round == 0) try check(lmdb.mdb_dbi_open(txn, null, 0, &dbi));
+    // multi-page values freed by earlier txns fragment the free pages
+    churn(txn, dbi, prng.random(), &sizes, if (round == 0) 4000 else 25) catch |err| {
+      lmdb.mdb_txn_abort(txn);
+      return err;
+    };
+    try check(lmdb.mdb_txn_commit(txn));
+  }
+
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+  defer lmdb.mdb_txn_abort(txn);
+  for (sizes, 0..) |size, i| {
+    var key: u32 = @intCast(i);
+    var k = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &key};
+    var v: lmdb.MDB_val = undefined;
+    const rc = lmdb.mdb_get(txn, dbi, &k, &v);
+    if (size == 0) {
+      try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc);
+      continue;
+    }
+    try check(rc);
+    const data = @as([*]const u8, @ptrCast(v.mv_data))[0..v.mv_size];
+    try std.testing.expectEqual(@as(usize, size), data.len);
+    for (data) |c| try std.testing.expectEqual(fill(key, size), c);
+  }
+  // freed runs are reused, so the file stays under twice the live pages
+  var st: lmdb.MDB_stat = undefined;
+  try check(lmdb.mdb_stat(txn, dbi, &st));
+  var info: lmdb.MDB_envinfo = undefined;
+  try check(lmdb.mdb_env_info(env, &info));
+  try std.testing.expect(info.me_last_pgno + 1 < 2 * (st.ms_branch_pages + st.ms_leaf_pages + st.ms_overflow_pages));
+}
+
+const Batch = struct {
+  dbi: lmdb.MDB_dbi,
+  key: u32,
+};
+
+fn putBatch(txn: ?*lmdb.MDB_txn, arg: ?*anyopaque) callconv(.c) c_int {
+  const batch: *Batch = @ptrCast(@alignCast(arg));
+  var k = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &batch.key};
+  var v = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &batch.key};
+  const rc = lmdb.mdb_put(txn, batch.dbi, &k, &v, 0);
+  // every 10th batch fails after writing, and must leave nothing behind
+  return if (rc == 0 and batch.key % 10 == 9) lmdb.MDB_KEYEXIST else rc;
+}
+
+fn submitBatches(env: ?*lmdb.MDB_env, dbi: lmdb.MDB_dbi, first: u32, count: u32, failed: *std.atomic.Value(u32)) void {
+  for (first..first + count) |key| {
+    var batch = Batch{.dbi = dbi, .key = @intCast(key)};
+    const rc = lmdb.mdb_env_commitq_submit(env, &putBatch, &batch);
+    if (rc != (if (key % 10 == 9) lmdb.MDB_KEYEXIST else 0)) _ = failed.fetchAdd(1, .monotonic);
+  }
+}
+
+test " groupCommit" {
+  const db = try openTestEnv("test-groupcommit.mdb", 0, .{});
+  defer db.close();
+  const env = db.env;
+
+  var dbi: lmdb.MDB_dbi = undefined;
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  try check(lmdb.mdb_dbi_open(txn, null, 0, &dbi));
+  try check(lmdb.mdb_txn_commit(txn));
+
+  const nthreads = 8;
+  const per_thread = 200;
+  var failed = std.atomic.Value(u32).init(0);
+  try check(lmdb.mdb_env_commitq_start(env, 0));
+  var threads: [nthreads]std.Thread = undefined;
+  for (&threads, 0..) |*t, i| {
+    t.* = try std.Thread.spawn(.{}, submitBatches, .{env, dbi, @as(u32, @intCast(i * per_thread)), per_thread, &failed});
+  }
+  for (threads) |t| t.join();
+  try check(lmdb.mdb_env_commitq_stop(env));
+  try std.testing.expectEqual(@as(u32, 0), failed.load(.monotonic));
+
+  try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+  defer lmdb.mdb_txn_abort(txn);
+  var stat: lmdb.MDB_stat = undefined;
+  try check(lmdb.mdb_stat(txn, dbi, &stat));
+  try std.testing.expectEqual(@as(usize, nthreads * per_thread / 10 * 9), stat.ms_entries);
+  for (0..nthreads * per_thread) |i| {
+    var key: u32 = @intCast(i);
+    var k = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &key};
+    var v: lmdb.MDB_val = undefined;
+    const rc = lmdb.mdb_get(txn, dbi, &k, &v);
+    try std.testing.expectEqual(if (key % 10 == 9) lmdb.MDB_NOTFOUND else 0, rc);
+  }
+}
+
+const Range = struct {
+  txn: ?*lmdb.MDB_txn,
+  dbi: lmdb.MDB_dbi,
+  lo: ?*lmdb.MDB_val,
+  hi: ?*lmdb.MDB_val,
+  count: usize = 0,
+  rc: c_int = 0,
+};
+
+fn scanRange(range: *Range) void {
+  var cursor: ?*lmdb.MDB_cursor = null;
+  range.rc = lmdb.mdb_cursor_open(range.txn, range.dbi, &cursor);
+  if (range.rc != 0) return;
+  defer lmdb.mdb_cursor_close(cursor);
+  var k: lmdb.MDB_val = undefined;
+  var v: lmdb.MDB_val = undefined;
+  var rc: c_int = undefined;
+  if (range.lo) |lo| {
+    k = lo.*;
+    rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_SET_RANGE);
+  } else {
+    rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_FIRST);
+  }
+  _ = lmdb.mdb_cursor_readahead(cursor, 16);
+  while (rc == 0) : (rc = lmdb.mdb_cursor_get(cursor, &k, &v, lmdb.MDB_NEXT)) {
+    if (range.hi) |hi| {
+      if (lmdb.mdb_cmp(range.txn, range.dbi, &k, hi) >= 0) break;
+    }
+    range.count += 1;
+  }
+  if (rc != lmdb.MDB_NOTFOUND) range.rc = rc;
+}
+
+test " parallelScan" {
+  const db = try openTestEnv("test-parallelscan.mdb", lmdb.MDB_NOSYNC, .{.mapsize = 1 << 28});
+  defer db.close();
+  const env = db.env;
+
+  const nkeys = 50000;
+  var dbi: lmdb.MDB_dbi = undefined;
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  try check(lmdb.mdb_dbi_open(txn, null, lmdb.MDB_INTEGERKEY, &dbi));
+  for (0..nkeys) |i| {
+    var key: u32 = @intCast(i * 7919 % nkeys);
+    var val: [64]u8 = @splat(@truncate(key));
+    var k = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &key};
+    var v = lmdb.MDB_val{.mv_size = val.len, .mv_data = &val};
+    try check(lmdb.mdb_put(txn, dbi, &k, &v, 0));
+  }
+  try check(lmdb.mdb_txn_commit(txn));
+
+  try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+  defer lmdb.mdb_txn_abort(txn);
+  const nparts = 4;
+  var keys: [nparts - 1]lmdb.MDB_val = undefined;
+  var nsplit: c_uint = 0;
+  try check(lmdb.mdb_dbi_partition(txn, dbi, nparts, &keys, &nsplit));
+  try std.testing.expectEqual(@as(c_uint, nparts - 1), nsplit);
+
+  var ranges: [nparts]Range = undefined;
+  var threads: [nparts]std.Thread = undefined;
+  for (&ranges, &threads, 0..) |*r, *t, i| {
+    r.* = .{.txn = txn, .dbi = dbi, .lo = if (i > 0) &keys[i - 1] else null, .hi = if (i < nsplit) &keys[i] else null};
+    t.* = try std.Thread.spawn(.{}, scanRange, .{r});
+  }
+  for (threads) |t| t.join();
+  var total: usize = 0;
+  for (ranges) |r| {
+    try check(r.rc);
+    // ranges split the branch pages evenly, so their sizes are close
+    try std.testing.expect(r.count > nkeys / nparts / 2 and r.count < nkeys / nparts * 2);
+    total += r.count;
+  }
+  try std.testing.expectEqual(@as(usize, nkeys), total);
+}
+
+fn pathKey(buf: []u8, i: usize) []u8 {
+  return std.fmt.bufPrint(buf, "/srv/tenants/t{d:0>2}/buckets/b{d:0>3}/objects/obj-{d:0>8}.json", .{i % 16, i / 16 % 200, i}) catch unreachable;
+}
+
+test " prefixKeys" {
+  const db = try openTestEnv("test-prefixkeys.mdb", lmdb.MDB_NOSYNC, .{.mapsize = 1 << 28, .maxdbs = 4});
+  defer db.close();
+  const env = db.env;
+
+  const nkeys = 20000;
+  var plain: lmdb.MDB_dbi = undefined;
+  var prefix: lmdb.MDB_dbi = undefined;
+  var buf: [128]u8 = undefined;
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  var bad: lmdb.MDB_dbi = undefined;
+  try std.testing.expectEqual(@as(c_int, @intFromEnum(std.posix.E.INVAL)),
+    lmdb.mdb_dbi_open(txn, "bad", lmdb.MDB_CREATE | lmdb.MDB_PREFIXKEYS | lmdb.MDB_DUPSORT, &bad));
+  try check(lmdb.mdb_dbi_open(txn, "plain", lmdb.MDB_CREATE, &plain));
+  try check(lmdb.mdb_dbi_open(txn, "prefix", lmdb.MDB_CREATE | lmdb.MDB_PREFIXKEYS, &prefix));
+  for (0..nkeys) |n| {
+    const i = n * 7919 % nkeys;
+    const key = pathKey(&buf, i);
+    var val: u32 = @intCast(i);
+    for ([_]lmdb.MDB_dbi{plain, prefix}) |dbi| {
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      var v = lmdb.MDB_val{.mv_size = @sizeOf(u32), .mv_data = &val};
+      try check(lmdb.mdb_put(txn, dbi, &k, &v, 0));
+    }
+  }
+  // deleting runs of keys rebalances and merges the front-coded pages
+  for (0..nkeys) |i| {
+    if (i % 5 == 0 or i % 1000 < 300) continue;
+    const key = pathKey(&buf, i);
+    for ([_]lmdb.MDB_dbi{plain, prefix}) |dbi| {
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      try check(lmdb.mdb_del(txn, dbi, &k, null));
+    }
+  }
+  try check(lmdb.mdb_txn_commit(txn));
+
+  try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+  defer lmdb.mdb_txn_abort(txn);
+  var c1: ?*lmdb.MDB_cursor = null;
+  var c2: ?*lmdb.MDB_cursor = null;
+  try check(lmdb.mdb_cursor_open(txn, plain, &c1));
+  defer lmdb.mdb_cursor_close(c1);
+  try check(lmdb.mdb_cursor_open(txn, prefix, &c2));
+  defer lmdb.mdb_cursor_close(c2);
+  var k1: lmdb.MDB_val = undefined;
+  var v1: lmdb.MDB_val = undefined;
+  var k2: lmdb.MDB_val = undefined;
+  var v2: lmdb.MDB_val = undefined;
+  var count: usize = 0;
+  var rc = lmdb.mdb_cursor_get(c1, &k1, &v1, lmdb.MDB_FIRST);
+  var rc2 = lmdb.mdb_cursor_get(c2, &k2, &v2, lmdb.MDB_FIRST);
+  while (rc == 0) : ({
+    rc = lmdb.mdb_cursor_get(c1, &k1, &v1, lmdb.MDB_NEXT);
+    rc2 = lmdb.mdb_cursor_get(c2, &k2, &v2, lmdb.MDB_NEXT);
+  }) {
+    try check(rc2);
+    const a = @as([*]const u8, @ptrCast(k1.mv_data))[0..k1.mv_size];
+    const b = @as([*]const u8, @ptrCast(k2.mv_data))[0..k2.mv_size];
+    try std.testing.expectEqualStrings(a, b);
+    try std.testing.expectEqual(@as(*align(1) const u32, @ptrCast(v1.mv_data)).*, @as(*align(1) const u32, @ptrCast(v2.mv_data)).*);
+    count += 1;
+  }
+  try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc);
+  try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc2);
+  try std.testing.expectEqual(@as(usize, nkeys / 1000 * 300 + (nkeys - nkeys / 1000 * 300) / 5), count);
+
+  var s1: lmdb.MDB_stat = undefined;
+  var s2: lmdb.MDB_stat = undefined;
+  try check(lmdb.mdb_stat(txn, plain, &s1));
+  try check(lmdb.mdb_stat(txn, prefix, &s2));
+  try std.testing.expect(s2.ms_leaf_pages < s1.ms_leaf_pages);
+}
+
+fn hexKey(buf: []u8, i: usize) []u8 {
+  return std.fmt.bufPrint(buf, "{x:0>16}", .{@as(u64, i) *% 0x9e3779b97f4a7c15}) catch unreachable;
+}
+
+test " bulkLoad" {
+  const db = try openTestEnv("test-bulkload.mdb", lmdb.MDB_NOSYNC, .{.maxdbs = 2});
+  defer db.close();
+  const env = db.env;
+
+  const nkeys = 200000;
+  var buf: [32]u8 = undefined;
+  var val: [100]u8 = undefined;
+  var putdb: lmdb.MDB_dbi = undefined;
+  var bulkdb: lmdb.MDB_dbi = undefined;
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  try check(lmdb.mdb_dbi_open(txn, "put", lmdb.MDB_CREATE, &putdb));
+  try check(lmdb.mdb_dbi_open(txn, "bulk", lmdb.MDB_CREATE, &bulkdb));
+
+  for (0..nkeys + 1) |n| {
+    // the last item replaces the first one
+    const i = n % nkeys;
+    const key = hexKey(&buf, i);
+    @memset(&val, if (n == nkeys) 0xff else @truncate(i));
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v = lmdb.MDB_val{.mv_size = val.len, .mv_data = &val};
+    try check(lmdb.mdb_put(txn, putdb, &k, &v, 0));
+  }
+
+  var bulk: ?*lmdb.MDB_bulk = null;
+  // small runs, so they are merged from temporary files
+  try check(lmdb.mdb_bulk_begin(txn, bulkdb, 1 << 20, 0, &bulk));
+  for (0..nkeys + 1) |n| {
+    const i = n % nkeys;
+    const key = hexKey(&buf, i);
+    @memset(&val, if (n == nkeys) 0xff else @truncate(i));
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v = lmdb.MDB_val{.mv_size = val.len, .mv_data = &val};
+    try check(lmdb.mdb_bulk_put(bulk, &k, &v));
+  }
+  try check(lmdb.mdb_bulk_end(bulk));
+  try check(lmdb.mdb_txn_commit(txn));
+
+  try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+  defer lmdb.mdb_txn_abort(txn);
+  var c1: ?*lmdb.MDB_cursor = null;
+  var c2: ?*lmdb.MDB_cursor = null;
+  try check(lmdb.mdb_cursor_open(txn, putdb, &c1));
+  defer lmdb.mdb_cursor_close(c1);
+  try check(lmdb.mdb_cursor_open(txn, bulkdb, &c2));
+  defer lmdb.mdb_cursor_close(c2);
+  var k1: lmdb.MDB_val = undefined;
+  var v1: lmdb.MDB_val = undefined;
+  var k2: lmdb.MDB_val = undefined;
+  var v2: lmdb.MDB_val = undefined;
+  var rc = lmdb.mdb_cursor_get(c1, &k1, &v1, lmdb.MDB_FIRST);
+  var rc2 = lmdb.mdb_cursor_get(c2, &k2, &v2, lmdb.MDB_FIRST);
+  while (rc == 0) : ({
+    rc = lmdb.mdb_cursor_get(c1, &k1, &v1, lmdb.MDB_NEXT);
+    rc2 = lmdb.mdb_cursor_get(c2, &k2, &v2, lmdb.MDB_NEXT);
+  }) {
+    try check(rc2);
+    try std.testing.expectEqualSlices(u8, @as([*]const u8, @ptrCast(k1.mv_data))[0..k1.mv_size],
+      @as([*]const u8, @ptrCast(k2.mv_data))[0..k2.mv_size]);
+    try std.testing.expectEqualSlices(u8, @as([*]const u8, @ptrCast(v1.mv_data))[0..v1.mv_size],
+      @as([*]const u8, @ptrCast(v2.mv_data))[0..v2.mv_size]);
+  }
+  try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc);
+  try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc2);
+
+  var s1: lmdb.MDB_stat = undefined;
+  var s2: lmdb.MDB_stat = undefined;
+  try check(lmdb.mdb_stat(txn, putdb, &s1));
+  try check(lmdb.mdb_stat(txn, bulkdb, &s2));
+  try std.testing.expectEqual(@as(usize, nkeys), s2.ms_entries);
+  try std.testing.expect(s2.ms_leaf_pages < s1.ms_leaf_pages);
+}
+
+fn sortedIds(ids: midl.MDB_IDL, n: usize, rand: std.Random, range: usize, odd: bool) void {
+  ids[0] = n;
+  for (1..n + 1) |i| ids[i] = 2 * (1 + rand.uintLessThan(midl.MDB_ID, range)) + @intFromBool(odd);
+  midl.mdb_midl_sort(ids);
+}
+
+test " midlSortMerge" {
+  var prng = std.Random.DefaultPrng.init(46);
+  const rand = prng.random();
+  const alloc = std.testing.allocator;
+  // edge cases, a freeDB record and a large txn's free list
+  const sizes = [_]usize{1, 2, 7, 100, 4000};
+  for (sizes) |n| {
+    const ids = midl.mdb_midl_alloc(@intCast(n + @max(n, 16)));
+    if (ids == null) return error.OutOfMemory;
+    defer midl.mdb_midl_free(ids);
+    const ref = try alloc.alloc(midl.MDB_ID, n + @max(n, 16));
+    defer alloc.free(ref);
+
+    for (0..20) |_| {
+      // page numbers of a DB four times the list size, with repeats
+      ids[0] = n;
+      for (1..n + 1) |i| ids[i] = 2 + rand.uintLessThan(midl.MDB_ID, 4 * n);
+      @memcpy(ref[0..n], ids[1..n + 1]);
+      midl.mdb_midl_sort(ids);
+      std.mem.sort(midl.MDB_ID, ref[0..n], {}, std.sort.desc(midl.MDB_ID));
+      try std.testing.expectEqualSlices(midl.MDB_ID, ref[0..n], ids[1..n + 1]);
+    }
+
+    // a few loose pages, then a list of the same size
+    for ([_]usize{1, 16, n}) |m| {
+      const merge = midl.mdb_midl_alloc(@intCast(m));
+      if (merge == null) return error.OutOfMemory;
+      defer midl.mdb_midl_free(merge);
+      for (0..20) |_| {
+        sortedIds(ids, n, rand, 4 * n, false);
+        sortedIds(merge, m, rand, 4 * n, true);
+        @memcpy(ref[0..n], ids[1..n + 1]);
+        @memcpy(ref[n..n + m], merge[1..m + 1]);
+        midl.mdb_midl_xmerge(ids, merge);
+        std.mem.sort(midl.MDB_ID, ref[0..n + m], {}, std.sort.desc(midl.MDB_ID));
+        try std.testing.expectEqualSlices(midl.MDB_ID, ref[0..n + m], ids[1..n + m + 1]);
+      }
+    }
+  }
+}
+
+/// Lowest run of n set entries of a page map, or 0.
+fn lowestRun(free: []const bool, n: usize) midl.MDB_ID {
+  var len: usize = 0;
+  for (free, 0..) |f, p| {
+    len = if (f) len + 1 else 0;
+    if (len == n) return @intCast(p + 1 - n);
+  }
+  return 0;
+}
+
+test " midlRunIndex" {
+  var prng = std.Random.DefaultPrng.init(41);
+  const rand = prng.random();
+  var ir = std.mem.zeroes(midl.MDB_idrun);
+  defer midl.mdb_idrun_free(&ir);
+
+  // the index follows the runs, not the page numbers
+  const far = midl.mdb_midl_alloc(8);
+  if (far == null) return error.OutOfMemory;
+  defer midl.mdb_midl_free(far);
+  far[0] = 3;
+  far[1] = 1 << 40;
+  far[2] = (1 << 40) - 1;
+  far[3] = 1 << 30;
+  try std.testing.expectEqual(@as(c_int, 0), midl.mdb_idrun_load(&ir, far));
+  try std.testing.expectEqual(@as(midl.MDB_ID, (1 << 40) - 1), midl.mdb_idrun_find(&ir, 2));
+  try std.testing.expect(ir.ir_size <= 16);
+
+  // finds match a page map while runs are taken, added and released
+  var free: [3000]bool = @splat(false);
+  const ids = midl.mdb_midl_alloc(free.len);
+  if (ids == null) return error.OutOfMemory;
+  defer midl.mdb_midl_free(ids);
+  for (0..2000) |op| {
+    if (op % 500 == 0 or ir.ir_nleaf == 0) {  // (re)load, as a new txn does
+      if (op % 500 == 0) {
+        for (&free, 0..) |*f, p| f.* = p >= 2 and rand.uintLessThan(u32, 3) != 0;
+      }
+      ids[0] = 0;
+      var p = free.len;
+      while (p > 0) : (p -= 1) {
+        if (free[p - 1]) {
+          ids[0] += 1;
+          ids[ids[0]] = p - 1;
+        }
+      }
+      try std.testing.expectEqual(@as(c_int, 0), midl.mdb_idrun_load(&ir, ids));
+    }
+    const n = 1 + rand.uintLessThan(usize, 6);
+    const at = 2 + rand.uintLessThan(usize, free.len - 10);
+    switch (rand.uintLessThan(u32, 3)) {
+      0 => {  // take the lowest run, as mdb_page_alloc does
+        const pg = midl.mdb_idrun_find(&ir, @intCast(n));
+        try std.testing.expectEqual(lowestRun(&free, n), pg);
+        if (pg != 0) {
+          midl.mdb_idrun_set(&ir, pg, @intCast(n), 0);
+          @memset(free[pg..][0..n], false);
+        }
+      },
+      1 => {  // a freeDB record of a few scattered pages
+        ids[0] = 0;
+        var p = free.len - 1;
+        while (p > at and ids[0] < 8) : (p -|= 1 + rand.uintLessThan(usize, 400)) {
+          if (!free[p]) {
+            ids[0] += 1;
+            ids[ids[0]] = p;
+            free[p] = true;
+          }
+        }
+        midl.mdb_idrun_add(&ir, ids);
+      },
+      else => {  // overflow pages released back
+        if (std.mem.indexOfScalar(bool, free[at..][0..n], true) == null) {
+          midl.mdb_idrun_set(&ir, at, @intCast(n), 1);
+          @memset(free[at..][0..n], true);
+        }
+      },
+    }
+  }
+}
+
+test " keyCache" {
+  const db = try openTestEnv("test-keycache.mdb", lmdb.MDB_NOSYNC | lmdb.MDB_NOTLS, .{.keycache = 4096});
+  defer db.close();
+  const env = db.env;
+
+  const nkeys = 100000;
+  var buf: [32]u8 = undefined;
+  var val: [100]u8 = undefined;
+  var dbi: lmdb.MDB_dbi = undefined;
+  var prng = std.Random.DefaultPrng.init(47);
+  const rand = prng.random();
+  // an old snapshot, kept open beside the others thanks to MDB_NOTLS
+  var old: ?*lmdb.MDB_txn = null;
+  defer if (old != null) lmdb.mdb_txn_abort(old);
+  for (0..4) |round| {
+    // rewrite some hot keys, so older hints go stale
+    var txn: ?*lmdb.MDB_txn = null;
+    if (round == 3) try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &old));
+    try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+    if (round == 0) try check(lmdb.mdb_dbi_open(txn, null, 0, &dbi));
+    for (0..if (round == 0) nkeys else 100) |n| {
+      const i = if (round == 0) n else rand.uintLessThan(usize, 1000);
+      const key = hexKey(&buf, i);
+      @memset(&val, @truncate(i + round));
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      var v = lmdb.MDB_val{.mv_size = val.len, .mv_data = &val};
+      try check(lmdb.mdb_put(txn, dbi, &k, &v, 0));
+    }
+    try check(lmdb.mdb_txn_commit(txn));
+
+    // 1000 hot keys get 90% of the lookups
+    for (0..20) |_| {
+      try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+      defer lmdb.mdb_txn_abort(txn);
+      var cursor: ?*lmdb.MDB_cursor = null;
+      try check(lmdb.mdb_cursor_open(txn, dbi, &cursor));
+      defer lmdb.mdb_cursor_close(cursor);
+      for (0..1000) |_| {
+        const i = if (rand.uintLessThan(u32, 10) != 0) rand.uintLessThan(usize, 1000) else rand.uintLessThan(usize, nkeys);
+        const key = hexKey(&buf, i);
+        var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+        var v: lmdb.MDB_val = undefined;
+        try check(lmdb.mdb_get(txn, dbi, &k, &v));
+        // a cursor search does not use the cache
+        var k2 = k;
+        var v2: lmdb.MDB_val = undefined;
+        try check(lmdb.mdb_cursor_get(cursor, &k2, &v2, lmdb.MDB_SET));
+        try std.testing.expectEqual(v2.mv_data, v.mv_data);
+      }
+    }
+  }
+
+  // a snapshot from before the last round must not use its hints
+  for (0..1000) |i| {
+    const key = hexKey(&buf, i);
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v: lmdb.MDB_val = undefined;
+    try check(lmdb.mdb_get(old, dbi, &k, &v));
+    var v2: lmdb.MDB_val = undefined;
+    var cursor: ?*lmdb.MDB_cursor = null;
+    try check(lmdb.mdb_cursor_open(old, dbi, &cursor));
+    defer lmdb.mdb_cursor_close(cursor);
+    try check(lmdb.mdb_cursor_get(cursor, &k, &v2, lmdb.MDB_SET));
+    try std.testing.expectEqual(v2.mv_data, v.mv_data);
+  }
+  lmdb.mdb_txn_abort(old);
+  old = null;
+
+  var ks: lmdb.MDB_kcstat = undefined;
+  try check(lmdb.mdb_env_keycache_stat(env, &ks));
+  try std.testing.expectEqual(@as(c_uint, 4096), ks.ks_size);
+  try std.testing.expectEqual(@as(usize, 81000), ks.ks_hits + ks.ks_misses);
+  try std.testing.expect(ks.ks_hits > ks.ks_misses);
+  try std.testing.expect(ks.ks_stale > 0);
+}
+
+fn copyProgress(stat: [*c]const lmdb.MDB_cpstat, ctx: ?*anyopaque) callconv(.c) c_int {
+  const last: *lmdb.MDB_cpstat = @ptrCast(@alignCast(ctx));
+  last.* = stat.*;
+  return 0;
+}
+
+test " parallelCopy" {
+  const copies = [_][:0]const u8{"test-parallelcopy-1.mdb", "test-parallelcopy-4.mdb"};
+  for (copies) |p| _ = remove(p.ptr);
+  defer {
+    for (copies) |p| _ = remove(p.ptr);
+  }
+  const db = try openTestEnv("test-parallelcopy.mdb", lmdb.MDB_NOSYNC, .{.maxdbs = 2});
+  defer db.close();
+  const env = db.env;
+
+  // overflow pages, sub-DBs and free pages
+  var buf: [32]u8 = undefined;
+  var val: [20000]u8 = undefined;
+  var big: lmdb.MDB_dbi = undefined;
+  var dup: lmdb.MDB_dbi = undefined;
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  try check(lmdb.mdb_dbi_open(txn, "big", lmdb.MDB_CREATE, &big));
+  try check(lmdb.mdb_dbi_open(txn, "dup", lmdb.MDB_CREATE | lmdb.MDB_DUPSORT, &dup));
+  for (0..20000) |i| {
+    const key = hexKey(&buf, i);
+    @memset(&val, @truncate(i));
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v = lmdb.MDB_val{.mv_size = if (i % 100 == 0) 3000 + i else 50, .mv_data = &val};
+    try check(lmdb.mdb_put(txn, big, &k, &v, 0));
+    for (0..if (i % 1000 == 0) 500 else 3) |j| {
+      var d = lmdb.MDB_val{.mv_size = @sizeOf(usize), .mv_data = @constCast(&j)};
+      try check(lmdb.mdb_put(txn, dup, &k, &d, 0));
+    }
+  }
+  try check(lmdb.mdb_txn_commit(txn));
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  for (0..20000) |i| {
+    if (i % 3 != 0) continue;
+    const key = hexKey(&buf, i);
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    try check(lmdb.mdb_del(txn, big, &k, null));
+  }
+  try check(lmdb.mdb_txn_commit(txn));
+
+  var pages: [copies.len]usize = undefined;
+  for (copies, [_]c_uint{1, 4}, 0..) |p, nthreads, n| {
+    var last: lmdb.MDB_cpstat = undefined;
+    try check(lmdb.mdb_env_copy3(env, p.ptr, lmdb.MDB_CP_COMPACT, nthreads, &copyProgress, &last));
+    try std.testing.expectEqual(last.cs_total, last.cs_written);
+
+    var copy: ?*lmdb.MDB_env = null;
+    try check(lmdb.mdb_env_create(&copy));
+    defer lmdb.mdb_env_close(copy);
+    try check(lmdb.mdb_env_set_maxdbs(copy, 2));
+    try check(lmdb.mdb_env_open(copy, p.ptr, lmdb.MDB_NOSUBDIR | lmdb.MDB_RDONLY | lmdb.MDB_NOLOCK, 0o664));
+    var info: lmdb.MDB_envinfo = undefined;
+    try check(lmdb.mdb_env_info(copy, &info));
+    try std.testing.expectEqual(last.cs_total, info.me_last_pgno + 1);
+    pages[n] = info.me_last_pgno + 1;
+
+    var t1: ?*lmdb.MDB_txn = null;
+    var t2: ?*lmdb.MDB_txn = null;
+    try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &t1));
+    defer lmdb.mdb_txn_abort(t1);
+    try check(lmdb.mdb_txn_begin(copy, null, lmdb.MDB_RDONLY, &t2));
+    defer lmdb.mdb_txn_abort(t2);
+    for ([_][:0]const u8{"big", "dup"}) |name| {
+      var d1: lmdb.MDB_dbi = undefined;
+      var d2: lmdb.MDB_dbi = undefined;
+      try check(lmdb.mdb_dbi_open(t1, name.ptr, 0, &d1));
+      try check(lmdb.mdb_dbi_open(t2, name.ptr, 0, &d2));
+      var c1: ?*lmdb.MDB_cursor = null;
+      var c2: ?*lmdb.MDB_cursor = null;
+      try check(lmdb.mdb_cursor_open(t1, d1, &c1));
+      defer lmdb.mdb_cursor_close(c1);
+      try check(lmdb.mdb_cursor_open(t2, d2, &c2));
+      defer lmdb.mdb_cursor_close(c2);
+      var k1: lmdb.MDB_val = undefined;
+      var v1: lmdb.MDB_val = undefined;
+      var k2: lmdb.MDB_val = undefined;
+      var v2: lmdb.MDB_val = undefined;
+      var rc = lmdb.mdb_cursor_get(c1, &k1, &v1, lmdb.MDB_FIRST);
+      var rc2 = lmdb.mdb_cursor_get(c2, &k2, &v2, lmdb.MDB_FIRST);
+      while (rc == 0) : ({
+        rc = lmdb.mdb_cursor_get(c1, &k1, &v1, lmdb.MDB_NEXT);
+        rc2 = lmdb.mdb_cursor_get(c2, &k2, &v2, lmdb.MDB_NEXT);
+      }) {
+        try check(rc2);
+        try std.testing.expectEqualSlices(u8, @as([*]const u8, @ptrCast(k1.mv_data))[0..k1.mv_size],
+          @as([*]const u8, @ptrCast(k2.mv_data))[0..k2.mv_size]);
+        try std.testing.expectEqualSlices(u8, @as([*]const u8, @ptrCast(v1.mv_data))[0..v1.mv_size],
+          @as([*]const u8, @ptrCast(v2.mv_data))[0..v2.mv_size]);
+      }
+      try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc);
+      try std.testing.expectEqual(lmdb.MDB_NOTFOUND, rc2);
+    }
+  }
+  try std.testing.expectEqual(pages[0], pages[1]);
+}
+
+/// 2-20 KB of JSON-like records, or 100 bytes for every 7th value.
+fn jsonValue(buf: []u8, i: usize) []u8 {
+  const size: usize = if (i % 7 == 0) 100 else 2000 + i * 7919 % 18000;
+  var s: u32 = @truncate(i *% 2654435761 +% 1);
+  var n: usize = 0;
+  while (n < size) {
+    s = s *% 1103515245 +% 12345;
+    n += (std.fmt.bufPrint(buf[n..], "{{\"id\":{d},\"name\":\"user{d}\",\"active\":{s},\"tags\":[\"alpha\",\"beta\"],\"score\":{d}}},", .{
+      s >> 8, (s >> 4) % 100000, if ((s & 1) != 0) "true" else "false", s % 97}) catch unreachable).len;
+  }
+  return buf[0..size];
+}
+
+test " codec" {
+  const db = try openTestEnv("test-codec.mdb", lmdb.MDB_NOSYNC, .{.maxdbs = 2});
+  defer db.close();
+  const env = db.env;
+
+  const n = 3000;
+  var kbuf: [32]u8 = undefined;
+  var vbuf: [24000]u8 = undefined;
+  var dbis: [2]lmdb.MDB_dbi = undefined;
+  var txn: ?*lmdb.MDB_txn = null;
+  try check(lmdb.mdb_txn_begin(env, null, 0, &txn));
+  try check(lmdb.mdb_dbi_open(txn, "plain", lmdb.MDB_CREATE, &dbis[0]));
+  try check(lmdb.mdb_dbi_open(txn, "lz", lmdb.MDB_CREATE, &dbis[1]));
+  try check(lmdb.mdb_set_codec(txn, dbis[1], &lz.enc, &lz.dec, 1024, null));
+  for (0..n) |i| {
+    const key = hexKey(&kbuf, i);
+    const val = jsonValue(&vbuf, i);
+    for (dbis) |dbi| {
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      var v = lmdb.MDB_val{.mv_size = val.len, .mv_data = val.ptr};
+      try check(lmdb.mdb_put(txn, dbi, &k, &v, 0));
+    }
+  }
+  try check(lmdb.mdb_txn_commit(txn));
+
+  try check(lmdb.mdb_txn_begin(env, null, lmdb.MDB_RDONLY, &txn));
+  defer lmdb.mdb_txn_abort(txn);
+  var pages: [2]usize = undefined;
+  for (dbis, 0..) |dbi, d| {
+    var st: lmdb.MDB_stat = undefined;
+    try check(lmdb.mdb_stat(txn, dbi, &st));
+    pages[d] = st.ms_branch_pages + st.ms_leaf_pages + st.ms_overflow_pages;
+    for (0..n) |j| {
+      const i = j * 1999 % n;
+      const key = hexKey(&kbuf, i);
+      var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+      var v: lmdb.MDB_val = undefined;
+      try check(lmdb.mdb_get(txn, dbi, &k, &v));
+      try std.testing.expectEqualSlices(u8, jsonValue(&vbuf, i), @as([*]const u8, @ptrCast(v.mv_data))[0..v.mv_size]);
+    }
+  }
+  try std.testing.expect(pages[1] * 2 < pages[0]);
+
+  // small values are read in place, compressed ones into new memory
+  for ([_]usize{7, 8}, [_]bool{true, false}) |i, same| {
+    const key = hexKey(&kbuf, i);
+    var k = lmdb.MDB_val{.mv_size = key.len, .mv_data = key.ptr};
+    var v1: lmdb.MDB_val = undefined;
+    var v2: lmdb.MDB_val = undefined;
+    try check(lmdb.mdb_get(txn, dbis[1], &k, &v1));
+    try check(lmdb.mdb_get(txn, dbis[1], &k, &v2));
+    try std.testing.expectEqual(same, v1.mv_data.? == v2.mv_data.?);
+  }
+}
+
 //#endregion ==================================================================
 //=============================================================================
\ No newline at end of file
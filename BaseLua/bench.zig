@@ -0,0 +1,785 @@
+//!zig-autodoc-section: BaseLua\\bench.zig
+//! bench.zig :
+//!  Benchmarks for the Lua template.
+//!  Runs every benchmark given and writes one JSON object per result line
+//!  to stdout:
+//!    zig build bench -Doptimize=ReleaseFast -- --benchmarks=startup,vm,statepool,bindings,alloc,profile,gcpause,strfind > results.jsonl
+// Build using Zig 0.16.0
+
+//=============================================================================
+//#region MARK: GLOBAL
+//=============================================================================
+const std = @import("std");
+const Io = std.Io;
+var appinit: std.process.Init = undefined;
+
+const lua = @cImport({
+  @cInclude("lib/lua/lua.h");
+  @cInclude("lib/lua/lualib.h");
+  @cInclude("lib/lua/lauxlib.h");
+  @cInclude("stdio.h");
+});
+const bind = @import("luabind.zig").Bind(lua);
+// Build options (see build.zig)
+const config = @import("config");
+const ctime = @cImport({
+  @cInclude("time.h");
+});
+const builtin = @import("builtin");
+const cres = if (builtin.os.tag == .windows) struct {} else @cImport({
+  @cInclude("sys/resource.h");
+});
+
+const Mode = enum { startup, vm, statepool, bindings, alloc, icache, profile, gcpause, strfind };
+const Allocator = enum { libc, pool, arena };
+
+const Config = struct {
+  benchmarks: []const Mode = &.{ .startup, .vm, .statepool, .bindings, .alloc, .icache, .profile, .gcpause, .strfind },
+  iters: usize = 200,
+  functions: usize = 2000,
+  threads: []const usize = &.{ 1, 2, 4, 8 },
+  jobs: usize = 20000,
+  calls: usize = 2000000,
+  cache: [:0]const u8 = "bench-cache",
+  allocators: []const Allocator = &.{ .libc, .pool, .arena },
+  objects: usize = 50000,
+  arena: usize = 1 << 20,
+  hz: usize = 1000,
+  frames: usize = 5000,
+  haystacks: []const usize = &.{ 1 << 16, 1 << 20, 16 << 20 },
+  needles: []const usize = &.{ 2, 4, 16, 64 },
+};
+var cfg: Config = .{};
+
+const usage =
+  \\Usage: bench [--name=value ...]
+  \\  --benchmarks=LIST  startup,vm,statepool,bindings,alloc,icache,profile,gcpause,strfind
+  \\                     (default all); zig build bench-icache runs icache with and without inline caches
+  \\  --iters=N          runs timed for each result (default 200)
+  \\  --functions=N      functions in the script loaded by startup (default 2000)
+  \\  --threads=LIST     state pool sizes (default 1,2,4,8)
+  \\  --jobs=N           jobs run by each state pool (default 20000)
+  \\  --calls=N          calls timed by bindings (default 2000000)
+  \\  --cache=DIR        chunk cache directory, kept between runs (default bench-cache)
+  \\  --allocators=LIST  libc,pool,arena states timed by alloc (default all); max_rss_kb
+  \\                     is for the whole process, so run one allocator per process to compare it
+  \\  --objects=N        objects allocated by each alloc run (default 50000)
+  \\  --arena=BYTES      arena of the arena allocator (default 1048576)
+  \\  --hz=N             sampling rate timed by profile (default 1000)
+  \\  --frames=N         frames timed by gcpause (default 5000)
+  \\  --haystacks=LIST   haystack sizes in bytes searched by strfind (default 65536,1048576,16777216);
+  \\                     build with -Dvectorfind=false to time the search without SIMD
+  \\  --needles=LIST     needle sizes searched by strfind (default 2,4,16,64)
+  \\
+;
+
+const startup_src = "bench-startup.lua";
+const startup_bin = "bench-startup.luac";
+
+//#endregion ==================================================================
+//#region MARK: MAIN
+//=============================================================================
+pub fn main(init: std.process.Init) !void {
+  appinit = init;
+  const arena = init.arena.allocator();
+  const args = try init.minimal.args.toSlice(arena);
+  parseArgs(arena, args) catch |err| {
+    std.debug.print("{s}", .{usage});
+    if (err == error.Help) return;
+    return err;
+  };
+
+  const lat = try init.gpa.alloc(u64, cfg.iters);
+  defer init.gpa.free(lat);
+  for (cfg.benchmarks) |mode| {
+    switch (mode) {
+      .startup => try startup(lat),
+      .vm => try vm(init.gpa, lat),
+      .statepool => try statepool(),
+      .bindings => try bindings(),
+      .alloc => try alloc(lat),
+      .icache => try icache(lat),
+      .profile => try profile(init.gpa, lat),
+      .gcpause => try gcpause(init.gpa),
+      .strfind => try strfind(init.gpa, lat),
+    }
+  }
+}
+
+//#endregion ==================================================================
+//#region MARK: BENCH
+//=============================================================================
+const LoadKind = enum { source, bytecode, cached };
+
+/// Time loading the same script into a new state from its source, from
+/// precompiled bytecode and from the chunk cache (luaL_loadfilecached).
+fn startup(lat: []u64) !void {
+  try writeScript();
+  defer {
+    _ = lua.remove(startup_src);
+    _ = lua.remove(startup_bin);
+  }
+  // precompile it, and fill the cache so that every timed run hits it
+  {
+    const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+    defer lua.lua_close(L);
+    try check(L, lua.luaL_loadfilex(L, startup_src, null));
+    const f = lua.fopen(startup_bin, "wb");
+    if (f == null) return error.WriteFailed;
+    const rc = lua.lua_dump(L, writeChunk, f, 0);
+    if (lua.fclose(f) != 0 or rc != 0) return error.WriteFailed;
+    try check(L, lua.luaL_loadfilecached(L, startup_src, cfg.cache.ptr));
+  }
+
+  for ([_]LoadKind{ .source, .bytecode, .cached }) |kind| {
+    for (lat) |*l| {
+      const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+      defer lua.lua_close(L);
+      const t0 = nanos();
+      const status = switch (kind) {
+        .source => lua.luaL_loadfilex(L, startup_src, null),
+        .bytecode => lua.luaL_loadfilex(L, startup_bin, null),
+        .cached => lua.luaL_loadfilecached(L, startup_src, cfg.cache.ptr),
+      };
+      l.* = nanos() - t0;
+      try check(L, status);
+    }
+    try report("startup", @tagName(kind), cfg.functions, lat);
+  }
+}
+
+const Script = struct { name: []const u8, src: [:0]const u8 };
+
+/// Small loops: counted loops, field chains starting at globals (which
+/// luaP_fuse rewrites) and method calls.
+const vm_scripts = [_]Script{
+  .{ .name = "loops", .src =
+    \\local s, t = 0, 0
+    \\for r = 1, 10 do
+    \\  for i = 1, 100000 do s = s + i end
+    \\  for i = 1, 100000 do t = t + 1 end
+    \\end
+    \\return s + t
+  },
+  .{ .name = "chain", .src =
+    \\local ents = {}
+    \\for i = 1, 1000 do ents[i] = {pos = {x = i, y = -i}, vel = {x = 1, y = 2}} end
+    \\local acc = 0
+    \\for r = 1, 100 do
+    \\  for i = 1, #ents do
+    \\    local e = ents[i]
+    \\    acc = acc + e.pos.x * e.vel.x + e.pos.y * e.vel.y + math.floor(0.5) + math.pi
+    \\  end
+    \\end
+    \\return acc
+  },
+  .{ .name = "oop", .src =
+    \\local Point = {} Point.__index = Point
+    \\function Point.new(x, y) return setmetatable({x = x, y = y, vx = 1, vy = 2}, Point) end
+    \\function Point:move(dt) self.x = self.x + self.vx * dt; self.y = self.y + self.vy * dt end
+    \\function Point:len2() return self.x * self.x + self.y * self.y end
+    \\local pts = {} for i = 1, 1000 do pts[i] = Point.new(i, -i) end
+    \\local s = 0
+    \\for r = 1, 60 do
+    \\  for i = 1, #pts do local p = pts[i]; p:move(0.01); s = s + p:len2() + math.abs(p.vx) end
+    \\end
+    \\return s
+  },
+};
+
+/// Time running code used in place (mode "bF", as the chunk cache loads it)
+/// from a plain aligned dump and from one that keeps its superinstructions.
+fn vm(gpa: std.mem.Allocator, lat: []u64) !void {
+  for (vm_scripts) |script| {
+    var plain: std.ArrayList(u8) = .empty;
+    defer plain.deinit(gpa);
+    var fused: std.ArrayList(u8) = .empty;
+    defer fused.deinit(gpa);
+    {
+      const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+      defer lua.lua_close(L);
+      try check(L, lua.luaL_loadstring(L, script.src.ptr));
+      var out: Output = .{ .gpa = gpa, .buf = &plain };
+      if (lua.lua_dumpx(L, appendChunk, &out, 0, 1) != 0) return error.OutOfMemory;
+      out.buf = &fused;
+      if (lua.lua_dumpx(L, appendChunk, &out, 0, lua.LUA_DUMPFUSED) != 0) return error.OutOfMemory;
+    }
+
+    for ([_][]const u8{ "unfused", "fused" }, [_][]const u8{ plain.items, fused.items }) |variant, chunk| {
+      // code is used in place, so it must be aligned like an mmap'ed file
+      const code = try gpa.alignedAlloc(u8, .@"16", chunk.len);
+      defer gpa.free(code);
+      @memcpy(code, chunk);
+      for (lat) |*l| {
+        const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+        defer lua.lua_close(L);
+        lua.luaL_openlibs(L);
+        try check(L, lua.luaL_loadbufferx(L, code.ptr, code.len, "=vm", "bF"));
+        const t0 = nanos();
+        const status = lua.lua_pcallk(L, 0, 0, 0, 0, null);
+        l.* = nanos() - t0;
+        try check(L, status);
+      }
+      var buf: [64]u8 = undefined;
+      try report("vm", try std.fmt.bufPrint(&buf, "{s}/{s}", .{ script.name, variant }), script.src.len, lat);
+    }
+  }
+}
+
+/// Field reads and method calls, as in object oriented code: one class,
+/// several classes through the same call sites, and deep inheritance.
+const oop_scripts = [_]Script{
+  vm_scripts[2],
+  .{ .name = "shapes", .src =
+    \\local Circle = {} Circle.__index = Circle
+    \\function Circle:area() return 3.14159 * self.r * self.r end
+    \\local Rect = {} Rect.__index = Rect
+    \\function Rect:area() return self.w * self.h end
+    \\local Tri = {} Tri.__index = Tri
+    \\function Tri:area() return 0.5 * self.b * self.h end
+    \\local objs = {}
+    \\for i = 1, 999, 3 do
+    \\  objs[i] = setmetatable({r = i, name = "c"}, Circle)
+    \\  objs[i + 1] = setmetatable({w = i, h = 2, name = "r"}, Rect)
+    \\  objs[i + 2] = setmetatable({b = i, h = 3, name = "t"}, Tri)
+    \\end
+    \\local s = 0
+    \\for r = 1, 100 do
+    \\  for i = 1, #objs do local o = objs[i]; s = s + o:area() + #o.name end
+    \\end
+    \\return s
+  },
+  .{ .name = "inherit", .src =
+    \\local Base = {} Base.__index = Base
+    \\function Base:get() return self.v end
+    \\local Mid = setmetatable({}, Base) Mid.__index = Mid
+    \\function Mid:twice() return 2 * self:get() end
+    \\local Leaf = setmetatable({}, Mid) Leaf.__index = Leaf
+    \\local objs = {}
+    \\for i = 1, 1000 do objs[i] = setmetatable({v = i}, Leaf) end
+    \\local s = 0
+    \\for r = 1, 100 do
+    \\  for i = 1, #objs do s = s + objs[i]:twice() end
+    \\end
+    \\return s
+  },
+};
+
+/// Time the object oriented scripts compiled from source. The inline
+/// caches are on or off for the whole build; zig build bench-icache runs
+/// this in a build with them and in one without them (-Dicache=false).
+fn icache(lat: []u64) !void {
+  const state = if (config.icache) "on" else "off";
+  for (oop_scripts) |script| {
+    for (lat) |*l| {
+      const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+      defer lua.lua_close(L);
+      lua.luaL_openlibs(L);
+      try check(L, lua.luaL_loadstring(L, script.src.ptr));
+      const t0 = nanos();
+      const status = lua.lua_pcallk(L, 0, 0, 0, 0, null);
+      l.* = nanos() - t0;
+      try check(L, status);
+    }
+    var buf: [64]u8 = undefined;
+    try report("icache", try std.fmt.bufPrint(&buf, "{s}/{s}", .{ script.name, state }), script.src.len, lat);
+  }
+}
+
+/// Time the vm scripts without the profiler and sampling cfg.hz times per
+/// second of elapsed ("real") and of CPU time ("cpu"). Runs are interleaved
+/// so that drift hits all three alike; the overhead is the p50 ratio to the
+/// unprofiled run, which should stay under 3%.
+fn profile(gpa: std.mem.Allocator, lat: []u64) !void {
+  const runs = try gpa.alloc(u64, 2 * lat.len);
+  defer gpa.free(runs);
+  const real = runs[0..lat.len];
+  const cpu = runs[lat.len..];
+  for (vm_scripts) |script| {
+    for (lat, real, cpu) |*off, *r, *c| {
+      off.* = try profiledRun(script.src, null);
+      r.* = try profiledRun(script.src, 0);
+      c.* = try profiledRun(script.src, 1);
+    }
+    var buf: [64]u8 = undefined;
+    try report("profile", try std.fmt.bufPrint(&buf, "{s}/off", .{script.name}), script.src.len, lat);
+    const base: f64 = @floatFromInt(@max(percentile(lat, 50), 1));
+    for ([_][]const u8{ "real", "cpu" }, [_][]u64{ real, cpu }) |clock, times| {
+      try report("profile", try std.fmt.bufPrint(&buf, "{s}/{s}", .{ script.name, clock }), script.src.len, times);
+      const overhead_pct = (@as(f64, @floatFromInt(percentile(times, 50))) / base - 1) * 100;
+      var line: [256]u8 = undefined;
+      try Io.File.stdout().writeStreamingAll(appinit.io, try std.fmt.bufPrint(&line,
+        "{{\"benchmark\":\"profile_overhead\",\"script\":\"{s}\",\"clock\":\"{s}\",\"hz\":{d},\"overhead_pct\":{d:.2}}}\n",
+        .{ script.name, clock, cfg.hz, overhead_pct }));
+      std.debug.print("profile    {s:<24}: overhead {d:>6.2} % at {d} Hz\n", .{
+        try std.fmt.bufPrint(&buf, "{s}/{s}", .{ script.name, clock }), overhead_pct, cfg.hz});
+    }
+  }
+}
+
+/// One run of a script in a fresh state, profiled with the clock given
+/// (0 real, 1 cpu) or not at all. The profiler starts before the timed part.
+fn profiledRun(src: [:0]const u8, clock: ?c_int) !u64 {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+  try check(L, lua.luaL_loadstring(L, src.ptr));
+  if (clock) |cpu| {
+    if (lua.luaL_profstart(L, @intCast(cfg.hz), cpu) == 0) return error.ProfilerUnavailable;
+  }
+  const t0 = nanos();
+  const status = lua.lua_pcallk(L, 0, 0, 0, 0, null);
+  const t = nanos() - t0;
+  if (clock != null) _ = lua.luaL_profstop(L);
+  try check(L, status);
+  return t;
+}
+
+/// Frames of a program that keeps 50000 objects alive and replaces 2000 of
+/// them per frame, so the incremental collector steps inside frames. The
+/// time of a frame beyond its usual work is the collector pause. Timed
+/// with the objects freed by the sweeps ("sync") and by a helper thread
+/// (luaL_bgfree, "bgfree"), with a histogram of frame times: bucket i
+/// counts frames under 2^i us (the last one, all the longer ones).
+fn gcpause(gpa: std.mem.Allocator) !void {
+  const src =
+    \\local ring, n = {}, 0
+    \\function frame()
+    \\  for i = 1, 2000 do
+    \\    n = n + 1
+    \\    ring[n % 50000 + 1] = {n, "s" .. n}
+    \\  end
+    \\end
+  ;
+  const frames = try gpa.alloc(u64, cfg.frames);
+  defer gpa.free(frames);
+  for ([_][]const u8{ "sync", "bgfree" }) |variant| {
+    const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+    defer lua.lua_close(L);
+    lua.luaL_openlibs(L);
+    if (std.mem.eql(u8, variant, "bgfree") and lua.luaL_bgfree(L, 1) == 0) return error.NoHelperThread;
+    try check(L, lua.luaL_loadstring(L, src));
+    try check(L, lua.lua_pcallk(L, 0, 0, 0, 0, null));
+    for (frames) |*f| {
+      _ = lua.lua_getglobal(L, "frame");
+      const t0 = nanos();
+      const status = lua.lua_pcallk(L, 0, 0, 0, 0, null);
+      f.* = nanos() - t0;
+      try check(L, status);
+    }
+
+    var hist = [_]usize{0} ** 16;
+    for (frames) |f| {
+      const us = f / 1000;
+      const i: usize = if (us == 0) 0 else @as(usize, std.math.log2_int(u64, us)) + 1;
+      hist[@min(i, hist.len - 1)] += 1;
+    }
+    std.mem.sort(u64, frames, {}, std.sort.asc(u64));
+    const p50_us = @as(f64, @floatFromInt(percentile(frames, 50))) * 1e-3;
+    const p99_us = @as(f64, @floatFromInt(percentile(frames, 99))) * 1e-3;
+    const max_us = @as(f64, @floatFromInt(frames[frames.len - 1])) * 1e-3;
+    var buf: [1024]u8 = undefined;
+    var w: Io.Writer = .fixed(&buf);
+    try w.print("{{\"benchmark\":\"gcpause\",\"variant\":\"{s}\",\"frames\":{d}," ++
+      "\"p50_us\":{d:.3},\"p99_us\":{d:.3},\"max_us\":{d:.3},\"hist_log2_us\":[", .{
+      variant, frames.len, p50_us, p99_us, max_us,
+    });
+    for (hist, 0..) |h, i| try w.print("{s}{d}", .{ if (i == 0) "" else ",", h });
+    try w.writeAll("]}\n");
+    try Io.File.stdout().writeStreamingAll(appinit.io, w.buffered());
+    std.debug.print("gcpause    {s:<24}: p50 {d:>10.3} us, p99 {d:>10.3} us, max {d:>10.3} us\n", .{
+      variant, p50_us, p99_us, max_us});
+  }
+}
+
+/// Plain string.find over log-like text, for each haystack and needle size.
+/// The needle ends with a byte the text never has, so every search scans
+/// the whole haystack, stopping at each false start on the first byte.
+/// std.mem.indexOf on the same bytes is timed as a reference ("zig").
+fn strfind(gpa: std.mem.Allocator, lat: []u64) !void {
+  const impl = if (config.vectorfind) "simd" else "scalar";
+  const text = "abcdefghijklmnopqrstuvwxyz0123456789 =,:";
+  var largest: usize = 0;
+  for (cfg.haystacks) |n| largest = @max(largest, n);
+  const hay = try gpa.alloc(u8, largest);
+  defer gpa.free(hay);
+  var seed: u32 = 12345;
+  for (hay) |*c| {
+    seed = seed *% 1103515245 +% 12345;
+    c.* = text[(seed >> 16) % text.len];
+  }
+
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+  try check(L, lua.luaL_loadstring(L, "local h, n = ... return string.find(h, n, 1, true)"));
+  const find = lua.luaL_ref(L, lua.LUA_REGISTRYINDEX);
+  for (cfg.haystacks) |hsize| {
+    for (cfg.needles) |nsize| {
+      if (nsize == 0 or nsize > hsize) continue;
+      // the needle: the last bytes of the haystack, ending with the unseen byte
+      const h = hay[0..hsize];
+      const saved = h[hsize - 1];
+      h[hsize - 1] = '#';
+      defer h[hsize - 1] = saved;
+      const needle = h[hsize - nsize ..];
+      _ = lua.lua_pushlstring(L, h.ptr, h.len);
+      _ = lua.lua_pushlstring(L, needle.ptr, needle.len);
+      for ([_][]const u8{ impl, "zig" }) |variant| {
+        for (lat) |*l| {
+          var at: usize = 0;
+          const t0 = nanos();
+          if (std.mem.eql(u8, variant, "zig")) {
+            at = (std.mem.indexOf(u8, h, needle) orelse return error.NotFound) + 1;
+          } else {
+            _ = lua.lua_rawgeti(L, lua.LUA_REGISTRYINDEX, find);
+            lua.lua_pushvalue(L, -3);
+            lua.lua_pushvalue(L, -3);
+            try check(L, lua.lua_pcallk(L, 2, 1, 0, 0, null));
+            at = @intCast(lua.lua_tointegerx(L, -1, null));
+            lua.lua_settop(L, -2);
+          }
+          l.* = nanos() - t0;
+          if (at != hsize - nsize + 1) return error.NotFound;
+        }
+        var buf: [64]u8 = undefined;
+        const name = try std.fmt.bufPrint(&buf, "{d}/{d}/{s}", .{ hsize, nsize, variant });
+        try report("strfind", name, hsize, lat);
+        const gb_per_s = @as(f64, @floatFromInt(hsize)) / @as(f64, @floatFromInt(@max(percentile(lat, 50), 1)));
+        var line: [256]u8 = undefined;
+        try Io.File.stdout().writeStreamingAll(appinit.io, try std.fmt.bufPrint(&line,
+          "{{\"benchmark\":\"strfind_rate\",\"haystack\":{d},\"needle\":{d},\"impl\":\"{s}\",\"gb_per_s\":{d:.3}}}\n",
+          .{ hsize, nsize, variant, gb_per_s }));
+        std.debug.print("strfind    {s:<24}: {d:>10.3} GB/s\n", .{ name, gb_per_s });
+      }
+      lua.lua_settop(L, -3);
+    }
+  }
+}
+
+fn poolInit(L: ?*lua.lua_State, ud: ?*anyopaque) callconv(.c) c_int {
+  _ = ud;
+  if (lua.luaL_loadstring(L,
+    \\local n = ...
+    \\local t = {}
+    \\for i = 1, n do t[i] = tostring(i * i) end
+    \\return #table.concat(t, ",")
+  ) != lua.LUA_OK) return lua.LUA_ERRSYNTAX;
+  lua.lua_setfield(L, lua.LUA_REGISTRYINDEX, "handler");
+  return lua.LUA_OK;
+}
+
+/// A short request: call the preloaded handler, as a server would.
+fn poolJob(L: ?*lua.lua_State, arg: ?*anyopaque) callconv(.c) c_int {
+  _ = arg;
+  _ = lua.lua_getfield(L, lua.LUA_REGISTRYINDEX, "handler");
+  lua.lua_pushinteger(L, 50);
+  return lua.lua_pcallk(L, 1, 1, 0, 0, null);
+}
+
+/// Throughput and submit-to-finish latency of state pools of each size
+/// in cfg.threads running cfg.jobs short jobs, submitted in batches of
+/// four per thread so that latencies include only a short queue.
+fn statepool() !void {
+  for (cfg.threads) |n| {
+    const pool = lua.luaL_newstatepool(@intCast(n), poolInit, null) orelse return error.OutOfMemory;
+    defer lua.luaL_closestatepool(pool);
+    const t0 = nanos();
+    var left = cfg.jobs;
+    while (left > 0) {
+      const batch = @min(left, 4 * n);
+      for (0..batch) |_| {
+        if (lua.luaL_statepoolsubmit(pool, poolJob, null) == 0) return error.OutOfMemory;
+      }
+      lua.luaL_statepoolwait(pool);
+      left -= batch;
+    }
+    const secs = @as(f64, @floatFromInt(nanos() - t0)) * 1e-9;
+    var st: lua.luaL_StatePoolStats = undefined;
+    lua.luaL_statepoolstats(pool, &st);
+    if (st.failed != 0) return error.LuaError;
+
+    const jobs_per_s = @as(f64, @floatFromInt(cfg.jobs)) / secs;
+    var buf: [512]u8 = undefined;
+    const line = try std.fmt.bufPrint(&buf,
+      "{{\"benchmark\":\"statepool\",\"threads\":{d},\"jobs\":{d},\"jobs_per_s\":{d:.0}," ++
+      "\"p50_us\":{d:.3},\"p99_us\":{d:.3},\"max_us\":{d:.3}}}\n", .{
+      n, cfg.jobs, jobs_per_s, st.p50 * 1e6, st.p99 * 1e6, st.max * 1e6,
+    });
+    try Io.File.stdout().writeStreamingAll(appinit.io, line);
+    std.debug.print("statepool  {d:>3} threads: {d:>10.0} jobs/s, p50 {d:>10.3} us, p99 {d:>10.3} us\n", .{
+      n, jobs_per_s, st.p50 * 1e6, st.p99 * 1e6});
+  }
+}
+
+fn zigAdd(a: f64, b: f64) f64 {
+  return a + b;
+}
+
+// the same binding written by hand against the C API
+fn handAdd(L: ?*lua.lua_State) callconv(.c) c_int {
+  const a = lua.luaL_checknumber(L, 1);
+  const b = lua.luaL_checknumber(L, 2);
+  lua.lua_pushnumber(L, a + b);
+  return 1;
+}
+
+/// Cost of a call from Lua to a binding generated by luabind.zig and to
+/// the same function written by hand (best of five loops of cfg.calls).
+fn bindings() !void {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+  try check(L, lua.luaL_loadstring(L,
+    \\local f, n = ...
+    \\local x = 0
+    \\for i = 1, n do x = f(x, i) end
+    \\return x
+  ));
+  const loop = lua.luaL_ref(L, lua.LUA_REGISTRYINDEX);
+
+  for ([_][]const u8{ "hand", "generated" }, [_]lua.lua_CFunction{ handAdd, bind.wrap(zigAdd) }) |variant, f| {
+    var best: u64 = std.math.maxInt(u64);
+    for (0..5) |_| {
+      _ = lua.lua_rawgeti(L, lua.LUA_REGISTRYINDEX, loop);
+      lua.lua_pushcclosure(L, f, 0);
+      lua.lua_pushinteger(L, @intCast(cfg.calls));
+      const t0 = nanos();
+      const status = lua.lua_pcallk(L, 2, 1, 0, 0, null);
+      best = @min(best, nanos() - t0);
+      try check(L, status);
+      lua.lua_settop(L, 0);
+    }
+    const ns_per_call = @as(f64, @floatFromInt(best)) / @as(f64, @floatFromInt(@max(cfg.calls, 1)));
+    var buf: [256]u8 = undefined;
+    const line = try std.fmt.bufPrint(&buf,
+      "{{\"benchmark\":\"bindings\",\"variant\":\"{s}\",\"calls\":{d},\"ns_per_call\":{d:.2}}}\n", .{
+      variant, cfg.calls, ns_per_call,
+    });
+    try Io.File.stdout().writeStreamingAll(appinit.io, line);
+    std.debug.print("bindings   {s:<24}: {d:>10.2} ns/call\n", .{ variant, ns_per_call });
+  }
+}
+
+/// Short-lived states churning through small tables and strings, created
+/// with the C library allocator (luaL_newstate), a pool (luaL_newpoolstate)
+/// and a pool with an arena. Each run creates, runs and closes a state.
+fn alloc(lat: []u64) !void {
+  const src =
+    \\local n = ...
+    \\local ring = {}
+    \\for i = 1, n do
+    \\  ring[i % 4096 + 1] = {i, i + 1, name = "obj" .. i}
+    \\end
+    \\return #ring
+  ;
+  for (cfg.allocators) |kind| {
+    var heap_kb: usize = 0;
+    for (lat) |*l| {
+      const t0 = nanos();
+      const L = switch (kind) {
+        .libc => lua.luaL_newstate(),
+        .pool => lua.luaL_newpoolstate(0),
+        .arena => lua.luaL_newpoolstate(cfg.arena),
+      } orelse return error.OutOfMemory;
+      errdefer lua.lua_close(L);
+      try check(L, lua.luaL_loadstring(L, src));
+      lua.lua_pushinteger(L, @intCast(cfg.objects));
+      try check(L, lua.lua_pcallk(L, 1, 1, 0, 0, null));
+      heap_kb = @max(heap_kb, @as(usize, @intCast(lua.lua_gc(L, lua.LUA_GCCOUNT))));
+      lua.lua_close(L);  // timed too: a pool frees its slabs at once
+      l.* = nanos() - t0;
+    }
+    const rss_kb = maxRssKb();
+    std.mem.sort(u64, lat, {}, std.sort.asc(u64));
+    var sum: f64 = 0;
+    for (lat) |l| sum += @floatFromInt(l);
+    const objects_per_s = @as(f64, @floatFromInt(cfg.objects * lat.len)) / (sum * 1e-9);
+    const p50_us = @as(f64, @floatFromInt(percentile(lat, 50))) * 1e-3;
+    const p99_us = @as(f64, @floatFromInt(percentile(lat, 99))) * 1e-3;
+    var buf: [512]u8 = undefined;
+    const line = try std.fmt.bufPrint(&buf,
+      "{{\"benchmark\":\"alloc\",\"allocator\":\"{s}\",\"objects\":{d},\"iters\":{d}," ++
+      "\"objects_per_s\":{d:.0},\"p50_us\":{d:.3},\"p99_us\":{d:.3},\"heap_kb\":{d},\"max_rss_kb\":{d}}}\n", .{
+      @tagName(kind), cfg.objects, lat.len, objects_per_s, p50_us, p99_us, heap_kb, rss_kb,
+    });
+    try Io.File.stdout().writeStreamingAll(appinit.io, line);
+    std.debug.print("alloc      {s:<24}: {d:>10.0} objects/s, p50 {d:>10.3} us, max rss {d:>8} KB\n", .{
+      @tagName(kind), objects_per_s, p50_us, rss_kb});
+  }
+}
+
+/// Write a result as a JSON line to stdout and a summary to stderr.
+fn report(name: []const u8, variant: []const u8, size: usize, lat: []u64) !void {
+  std.mem.sort(u64, lat, {}, std.sort.asc(u64));
+  var sum: f64 = 0;
+  for (lat) |l| sum += @floatFromInt(l);
+  const avg_us = sum / @as(f64, @floatFromInt(@max(lat.len, 1))) * 1e-3;
+  const p50_us = @as(f64, @floatFromInt(percentile(lat, 50))) * 1e-3;
+  const p99_us = @as(f64, @floatFromInt(percentile(lat, 99))) * 1e-3;
+
+  var buf: [512]u8 = undefined;
+  const line = try std.fmt.bufPrint(&buf,
+    "{{\"benchmark\":\"{s}\",\"variant\":\"{s}\",\"size\":{d},\"iters\":{d}," ++
+    "\"avg_us\":{d:.3},\"p50_us\":{d:.3},\"p99_us\":{d:.3}}}\n", .{
+    name, variant, size, lat.len, avg_us, p50_us, p99_us,
+  });
+  try Io.File.stdout().writeStreamingAll(appinit.io, line);
+  std.debug.print("{s:<10} {s:<24}: avg {d:>10.3} us, p50 {d:>10.3} us, p99 {d:>10.3} us\n", .{
+    name, variant, avg_us, p50_us, p99_us});
+}
+
+//#endregion ==================================================================
+//#region MARK: UTIL
+//=============================================================================
+/// A module of cfg.functions small functions, like a large script.
+fn writeScript() !void {
+  const f = lua.fopen(startup_src, "wb");
+  if (f == null) return error.WriteFailed;
+  defer _ = lua.fclose(f);
+  var buf: [256]u8 = undefined;
+  try writeAll(f, "local M = {}\n");
+  for (0..cfg.functions) |i| {
+    try writeAll(f, try std.fmt.bufPrint(&buf,
+      "function M.f{d}(a, b) local t = {{}} for k = 1, a do t[k] = k * b + {d} end return #t, \"s{d}\" end\n",
+      .{ i, i, i }));
+  }
+  try writeAll(f, "return M\n");
+}
+
+fn writeAll(f: [*c]lua.FILE, s: []const u8) !void {
+  if (lua.fwrite(s.ptr, 1, s.len, f) != s.len) return error.WriteFailed;
+}
+
+fn writeChunk(L: ?*lua.lua_State, p: ?*const anyopaque, sz: usize, ud: ?*anyopaque) callconv(.c) c_int {
+  _ = L;
+  const f: [*c]lua.FILE = @ptrCast(@alignCast(ud));
+  return if (lua.fwrite(p, 1, sz, f) == sz) 0 else 1;
+}
+
+const Output = struct { gpa: std.mem.Allocator, buf: *std.ArrayList(u8) };
+
+fn appendChunk(L: ?*lua.lua_State, p: ?*const anyopaque, sz: usize, ud: ?*anyopaque) callconv(.c) c_int {
+  _ = L;
+  const out: *Output = @ptrCast(@alignCast(ud));
+  const bytes: [*]const u8 = @ptrCast(p orelse return 0);
+  out.buf.appendSlice(out.gpa, bytes[0..sz]) catch return 1;
+  return 0;
+}
+
+fn check(L: ?*lua.lua_State, status: c_int) !void {
+  if (status != lua.LUA_OK) {
+    std.debug.print("Lua error: {s}\n", .{lua.lua_tolstring(L, -1, null)});
+    return error.LuaError;
+  }
+}
+
+/// Peak resident set size of the process in KB (0 where unknown).
+fn maxRssKb() usize {
+  if (builtin.os.tag == .windows) {
+    return 0;
+  } else {
+    var ru: cres.struct_rusage = undefined;
+    if (cres.getrusage(cres.RUSAGE_SELF, &ru) != 0) return 0;
+    const kb: usize = @intCast(ru.ru_maxrss);
+    return if (builtin.os.tag.isDarwin()) kb / 1024 else kb; // bytes on macOS
+  }
+}
+
+fn nanos() u64 {
+  var ts: ctime.struct_timespec = undefined;
+  _ = ctime.timespec_get(&ts, ctime.TIME_UTC);
+  return @as(u64, @intCast(ts.tv_sec)) * 1000000000 + @as(u64, @intCast(ts.tv_nsec));
+}
+
+/// Nearest rank percentile of sorted samples.
+fn percentile(sorted: []const u64, p: f64) u64 {
+  if (sorted.len == 0) return 0;
+  const rank: usize = @intFromFloat(@ceil(p / 100 * @as(f64, @floatFromInt(sorted.len))));
+  return sorted[@min(@max(rank, 1), sorted.len) - 1];
+}
+
+fn parseArgs(arena: std.mem.Allocator, args: anytype) !void {
+  for (args[1..]) |arg| {
+    if (std.mem.eql(u8, arg, "--help") or std.mem.eql(u8, arg, "-h")) return error.Help;
+    const eq = std.mem.indexOfScalar(u8, arg, '=') orelse {
+      std.debug.print("Bad argument: {s}\n", .{arg});
+      return error.BadArgument;
+    };
+    const name = arg[0..eq];
+    const val = arg[eq + 1 ..];
+    if (std.mem.eql(u8, name, "--benchmarks")) {
+      const list = try arena.alloc(Mode, std.mem.count(u8, val, ",") + 1);
+      var it = std.mem.splitScalar(u8, val, ',');
+      for (list) |*m| {
+        const s = it.next().?;
+        m.* = std.meta.stringToEnum(Mode, s) orelse {
+          std.debug.print("Unknown benchmark: {s}\n", .{s});
+          return error.BadArgument;
+        };
+      }
+      cfg.benchmarks = list;
+    } else if (std.mem.eql(u8, name, "--iters")) {
+      cfg.iters = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--functions")) {
+      cfg.functions = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--threads")) {
+      const list = try arena.alloc(usize, std.mem.count(u8, val, ",") + 1);
+      var it = std.mem.splitScalar(u8, val, ',');
+      for (list) |*n| {
+        n.* = try std.fmt.parseInt(usize, it.next().?, 10);
+        if (n.* == 0) return error.BadArgument;
+      }
+      cfg.threads = list;
+    } else if (std.mem.eql(u8, name, "--jobs")) {
+      cfg.jobs = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--calls")) {
+      cfg.calls = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--cache")) {
+      cfg.cache = val;
+    } else if (std.mem.eql(u8, name, "--allocators")) {
+      const list = try arena.alloc(Allocator, std.mem.count(u8, val, ",") + 1);
+      var it = std.mem.splitScalar(u8, val, ',');
+      for (list) |*k| {
+        const s = it.next().?;
+        k.* = std.meta.stringToEnum(Allocator, s) orelse {
+          std.debug.print("Unknown allocator: {s}\n", .{s});
+          return error.BadArgument;
+        };
+      }
+      cfg.allocators = list;
+    } else if (std.mem.eql(u8, name, "--hz")) {
+      cfg.hz = try std.fmt.parseInt(usize, val, 10);
+      if (cfg.hz == 0 or cfg.hz > 100000) return error.BadArgument;
+    } else if (std.mem.eql(u8, name, "--frames")) {
+      cfg.frames = try std.fmt.parseInt(usize, val, 10);
+      if (cfg.frames == 0) return error.BadArgument;
+    } else if (std.mem.eql(u8, name, "--haystacks")) {
+      cfg.haystacks = try parseSizes(arena, val);
+    } else if (std.mem.eql(u8, name, "--needles")) {
+      cfg.needles = try parseSizes(arena, val);
+    } else if (std.mem.eql(u8, name, "--objects")) {
+      cfg.objects = try std.fmt.parseInt(usize, val, 10);
+    } else if (std.mem.eql(u8, name, "--arena")) {
+      cfg.arena = try std.fmt.parseInt(usize, val, 10);
+    } else {
+      std.debug.print("Unknown option: {s}\n", .{name});
+      return error.BadArgument;
+    }
+  }
+  if (cfg.iters == 0) return error.BadArgument;
+}
+
+/// A comma separated list of non-zero sizes.
+fn parseSizes(arena: std.mem.Allocator, val: []const u8) ![]const usize {
+  const list = try arena.alloc(usize, std.mem.count(u8, val, ",") + 1);
+  var it = std.mem.splitScalar(u8, val, ',');
+  for (list) |*n| {
+    n.* = try std.fmt.parseInt(usize, it.next().?, 10);
+    if (n.* == 0) return error.BadArgument;
+  }
+  return list;
+}
+
+//#endregion ==================================================================
+//=============================================================================
@@ -15,8 +15,26 @@ pub fn build(b: *std.Build) void {
   const target = b.standardTargetOptions(.{});
   const optimize = b.standardOptimizeOption(.{});
 
+  // off by default: lookups are slower (see LUAI_OPENHASH in luaconf.h)
+  const use_openhash = b.option(bool, "openhash", "Use open addressing for table hash parts (LUAI_OPENHASH)") orelse false;
+  const use_icache = b.option(bool, "icache", "Use inline caches for field accesses (see LUAI_NOICACHE in luaconf.h)") orelse true;
+  const use_vectorfind = b.option(bool, "vectorfind", "Use SIMD for plain string.find (see LUA_NOVECTORFIND in lstrlib.c)") orelse true;
+  var flags: std.ArrayList([]const u8) = .empty;
+  if (use_openhash) flags.append(b.allocator, "-DLUAI_OPENHASH") catch @panic("OOM");
+  if (!use_icache) flags.append(b.allocator, "-DLUAI_NOICACHE") catch @panic("OOM");
+  if (!use_vectorfind) flags.append(b.allocator, "-DLUA_NOVECTORFIND") catch @panic("OOM");
+  const c_flags = flags.items;
+
+  // off by default: the template would write a cache directory next to the script
+  const luacache = b.option([]const u8, "luacache", "Cache precompiled chunks of script.lua in this directory (luaL_loadfilecached)");
+  const config = b.addOptions();
+  config.addOption(?[:0]const u8, "luacache", if (luacache) |dir| b.allocator.dupeZ(u8, dir) catch @panic("OOM") else null);
+  config.addOption(bool, "icache", use_icache);
+  config.addOption(bool, "vectorfind", use_vectorfind);
+
   const projectname = "BaseLua";
   const mainfile = "main.zig";
+  const benchfile = "bench.zig";
 
   const exe = b.addExecutable(.{
     .name = projectname,
@@ -27,6 +45,7 @@ pub fn build(b: *std.Build) void {
       .link_libc = true,
     }),
   });
+  exe.root_module.addOptions("config", config);
   exe.root_module.addWin32ResourceFile(.{
     .file = b.path(projectname ++ ".rc"),
     .flags = &.{"/c65001"}, // UTF-8 codepage
@@ -38,9 +57,13 @@ pub fn build(b: *std.Build) void {
   b.installBinFile("script.lua", "script.lua");
 
   const imgui_srcs = .{
+    "lib/lua/lalloc.c",
     "lib/lua/lapi.c",
+    "lib/lua/larraylib.c",
     "lib/lua/lauxlib.c",
     "lib/lua/lbaselib.c",
+    "lib/lua/lbgfree.c",
+    "lib/lua/lcache.c",
     "lib/lua/lcode.c",
     "lib/lua/lctype.c",
     "lib/lua/ldebug.c",
@@ -59,7 +82,9 @@ pub fn build(b: *std.Build) void {
     "lib/lua/lopcodes.c",
     "lib/lua/loslib.c",
     "lib/lua/lparser.c",
+    "lib/lua/lproflib.c",
     "lib/lua/lstate.c",
+    "lib/lua/lstatepool.c",
     "lib/lua/lstring.c",
     "lib/lua/lstrlib.c",
     "lib/lua/ltable.c",
@@ -74,7 +99,7 @@ pub fn build(b: *std.Build) void {
   inline for (imgui_srcs) |c_cpp| {
     exe.root_module.addCSourceFile(.{
       .file = b.path(c_cpp),
-      .flags = &.{ }
+      .flags = c_flags
     });
   }
 
@@ -98,6 +123,73 @@ pub fn build(b: *std.Build) void {
   const run_step = b.step("run", "Run the app");
   run_step.dependOn(&run_cmd.step);
 
+//#endregion ==================================================================
+//#region MARK: BENCH
+//=============================================================================
+  const bench = b.addExecutable(.{
+    .name = projectname ++ "Bench",
+    .root_module = b.createModule(.{
+      .root_source_file = b.path(benchfile),
+      .target = target,
+      .optimize = optimize,
+      .link_libc = true,
+    }),
+  });
+  bench.root_module.addOptions("config", config);
+  bench.root_module.addIncludePath( b.path(".") );
+  bench.root_module.addIncludePath( b.path("lib/lua") );
+  inline for (imgui_srcs) |c_cpp| {
+    bench.root_module.addCSourceFile(.{
+      .file = b.path(c_cpp),
+      .flags = c_flags
+    });
+  }
+  b.installArtifact(bench);
+
+  // the same benchmarks without inline caches, to compare (zig build bench-icache)
+  const noic_config = b.addOptions();
+  noic_config.addOption(?[:0]const u8, "luacache", null);
+  noic_config.addOption(bool, "icache", false);
+  noic_config.addOption(bool, "vectorfind", use_vectorfind);
+  const noic_flags = std.mem.concat(b.allocator, []const u8, &.{ c_flags, &.{ "-DLUAI_NOICACHE" } }) catch @panic("OOM");
+  const bench_noic = b.addExecutable(.{
+    .name = projectname ++ "BenchNoIC",
+    .root_module = b.createModule(.{
+      .root_source_file = b.path(benchfile),
+      .target = target,
+      .optimize = optimize,
+      .link_libc = true,
+    }),
+  });
+  bench_noic.root_module.addOptions("config", noic_config);
+  bench_noic.root_module.addIncludePath( b.path(".") );
+  bench_noic.root_module.addIncludePath( b.path("lib/lua") );
+  inline for (imgui_srcs) |c_cpp| {
+    bench_noic.root_module.addCSourceFile(.{
+      .file = b.path(c_cpp),
+      .flags = noic_flags
+    });
+  }
+
+  const bench_cmd = b.addRunArtifact(bench);
+  bench_cmd.step.dependOn(b.getInstallStep());
+  if (b.args) |args| {
+    bench_cmd.addArgs(args);
+  }
+  const bench_step = b.step("bench", "Run the benchmarks (zig build bench -- --help)");
+  bench_step.dependOn(&bench_cmd.step);
+
+  const icache_step = b.step("bench-icache", "Run the icache benchmark with and without inline caches");
+  var prev: ?*std.Build.Step = null;
+  for ([_]*std.Build.Step.Compile{ bench, bench_noic }) |artifact| {
+    const cmd = b.addRunArtifact(artifact);
+    cmd.addArg("--benchmarks=icache");
+    if (b.args) |args| cmd.addArgs(args);
+    if (prev) |p| cmd.step.dependOn(p); // one at a time
+    prev = &cmd.step;
+    icache_step.dependOn(&cmd.step);
+  }
+
 //#endregion ==================================================================
 //#region MARK: TEST
 //=============================================================================
@@ -109,6 +201,15 @@ pub fn build(b: *std.Build) void {
       .link_libc = true,
     }),
   });
+  unit_tests.root_module.addOptions("config", config);
+  unit_tests.root_module.addIncludePath( b.path(".") );
+  unit_tests.root_module.addIncludePath( b.path("lib/lua") );
+  inline for (imgui_srcs) |c_cpp| {
+    unit_tests.root_module.addCSourceFile(.{
+      .file = b.path(c_cpp),
+      .flags = c_flags
+    });
+  }
   const run_unit_tests = b.addRunArtifact(unit_tests);
   const test_step = b.step("test", "Run unit tests");
   test_step.dependOn(&run_unit_tests.step);
@@ -0,0 +1,304 @@
+/*
+** $Id: lalloc.c $
+** Size-class pool allocator for Lua states
+** See Copyright Notice in lua.h
+*/
+
+#define lalloc_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+
+
+/*
+** Small blocks (up to POOL_MAXSMALL bytes) are rounded up to a
+** multiple of POOL_GRAIN and served from per-class free lists. Free
+** lists are refilled by carving new blocks from the current chunk: the
+** arena while it lasts, then slabs of POOL_SLABSIZE bytes. Lua always
+** passes the block size on frees and reallocations, so blocks need no
+** header. Small blocks are never returned to the C library before the
+** pool dies; larger blocks go to 'realloc'/'free' (or to the arena,
+** where freeing them is a no-op).
+*/
+#define POOL_GRAIN	16
+#define POOL_CLASSES	LUAL_POOLCLASSES
+#define POOL_MAXSMALL	(POOL_CLASSES * POOL_GRAIN)
+#define POOL_SLABSIZE	(16 * 1024)
+
+/* maximum number of free slabs each thread keeps between pools */
+#if !defined(POOL_SPARESLABS)
+#define POOL_SPARESLABS	64
+#endif
+
+
+#if !defined(l_threadlocal)
+#if defined(_MSC_VER)
+#define l_threadlocal	__declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define l_threadlocal	__thread
+#else  /* no thread-local storage: do not share slabs */
+#undef POOL_SPARESLABS
+#define POOL_SPARESLABS	0
+#define l_threadlocal	/* empty */
+#endif
+#endif
+
+
+typedef union Slab {
+  union Slab *next;  /* list of slabs of a pool or of a thread */
+  char pad[POOL_GRAIN];  /* keep blocks aligned */
+} Slab;
+
+
+typedef struct FreeBlock {
+  struct FreeBlock *next;
+} FreeBlock;
+
+
+struct luaL_Pool {
+  FreeBlock *freelist[POOL_CLASSES];
+  char *top, *limit;  /* unused part of the current chunk */
+  char *arena, *arenaend;  /* bump arena (or NULL) */
+  Slab *slabs;  /* slabs owned by this pool */
+  size_t nblocks;  /* number of live blocks */
+  int released;  /* owner gave up its reference */
+  luaL_PoolStats st;
+};
+
+
+/* free slabs of this thread, reused by the next pool that needs one
+   (until 'luaL_poolflush') */
+static l_threadlocal Slab *spareslabs = NULL;
+static l_threadlocal int nspareslabs = 0;
+
+
+#define issmall(s)	((s) <= POOL_MAXSMALL)
+#define sizeclass(s)	((int)(((s) - 1) / POOL_GRAIN))
+#define inarena(P,p)  \
+	((P)->arena != NULL && (char *)(p) >= (P)->arena && \
+	 (char *)(p) < (P)->arenaend)
+
+
+static int largebin (size_t size) {
+  int b = 0;
+  while (size > 1 && b < LUAL_POOLBINS - 1) {
+    size >>= 1;
+    b++;
+  }
+  return b;
+}
+
+
+static void addinuse (luaL_Pool *P, size_t size) {
+  P->st.inuse += size;
+  if (P->st.inuse > P->st.peak)
+    P->st.peak = P->st.inuse;
+}
+
+
+static int newslab (luaL_Pool *P) {
+  Slab *s = spareslabs;
+  if (s != NULL) {  /* reuse a slab left by a dead pool in this thread */
+    spareslabs = s->next;
+    nspareslabs--;
+  }
+  else if ((s = (Slab *)malloc(POOL_SLABSIZE)) == NULL)
+    return 0;
+  s->next = P->slabs;
+  P->slabs = s;
+  P->top = (char *)(s + 1);
+  P->limit = (char *)s + POOL_SLABSIZE;
+  P->st.reserved += POOL_SLABSIZE;
+  return 1;
+}
+
+
+static void *allocsmall (luaL_Pool *P, size_t size) {
+  int c = sizeclass(size);
+  FreeBlock *b = P->freelist[c];
+  if (b != NULL)
+    P->freelist[c] = b->next;
+  else {  /* carve a new block */
+    size_t bsize = (size_t)(c + 1) * POOL_GRAIN;
+    if ((size_t)(P->limit - P->top) < bsize && !newslab(P))
+      return NULL;
+    b = (FreeBlock *)P->top;
+    P->top += bsize;
+  }
+  P->st.small[c]++;
+  P->st.smalllive[c]++;
+  addinuse(P, size);
+  return b;
+}
+
+
+static void *alloclarge (luaL_Pool *P, size_t size) {
+  void *b;
+  size_t asize = (size + POOL_GRAIN - 1) & ~(size_t)(POOL_GRAIN - 1);
+  if (P->arena != NULL && (size_t)(P->arenaend - P->top) >= asize &&
+      P->limit == P->arenaend) {  /* still carving the arena? */
+    b = P->top;
+    P->top += asize;
+  }
+  else if ((b = malloc(size)) == NULL)
+    return NULL;
+  else
+    P->st.reserved += size;
+  P->st.large[largebin(size)]++;
+  addinuse(P, size);
+  return b;
+}
+
+
+static void freeblock (luaL_Pool *P, void *b, size_t size) {
+  P->st.inuse -= size;
+  if (issmall(size)) {
+    int c = sizeclass(size);
+    FreeBlock *f = (FreeBlock *)b;
+    f->next = P->freelist[c];
+    P->freelist[c] = f;
+    P->st.smalllive[c]--;
+  }
+  else if (!inarena(P, b)) {  /* arena memory goes away with the pool */
+    free(b);
+    P->st.reserved -= size;
+  }
+}
+
+
+static void destroypool (luaL_Pool *P) {
+  Slab *s = P->slabs;
+  while (s != NULL) {
+    Slab *next = s->next;
+    if (nspareslabs < POOL_SPARESLABS) {  /* keep it for this thread */
+      s->next = spareslabs;
+      spareslabs = s;
+      nspareslabs++;
+    }
+    else
+      free(s);
+    s = next;
+  }
+  free(P->arena);
+  free(P);
+}
+
+
+/*
+** The 'lua_Alloc' function for a pool. 'ud' must be the pool.
+*/
+LUALIB_API void *luaL_poolalloc (void *ud, void *ptr, size_t osize,
+                                                      size_t nsize) {
+  luaL_Pool *P = (luaL_Pool *)ud;
+  void *nb;
+  if (ptr == NULL)
+    osize = 0;  /* 'osize' is only a type tag */
+  if (nsize == 0) {
+    if (ptr != NULL) {
+      freeblock(P, ptr, osize);
+      if (--P->nblocks == 0 && P->released)
+        destroypool(P);  /* the state using it is gone */
+    }
+    return NULL;
+  }
+  if (ptr != NULL) {  /* reallocation? */
+    if (issmall(osize) && issmall(nsize) &&
+        sizeclass(osize) == sizeclass(nsize)) {  /* same block fits? */
+      P->st.inuse = P->st.inuse - osize;
+      addinuse(P, nsize);
+      return ptr;
+    }
+    if (!issmall(osize) && !issmall(nsize) && !inarena(P, ptr)) {
+      if ((nb = realloc(ptr, nsize)) == NULL)
+        return NULL;
+      P->st.reserved = P->st.reserved - osize + nsize;
+      P->st.inuse -= osize;
+      P->st.large[largebin(nsize)]++;
+      addinuse(P, nsize);
+      return nb;
+    }
+  }
+  nb = issmall(nsize) ? allocsmall(P, nsize) : alloclarge(P, nsize);
+  if (nb == NULL)
+    return NULL;
+  if (ptr != NULL) {  /* move old contents */
+    memcpy(nb, ptr, (osize < nsize) ? osize : nsize);
+    freeblock(P, ptr, osize);
+  }
+  else
+    P->nblocks++;
+  return nb;
+}
+
+
+/*
+** Free the slabs kept by the calling thread for its next pools. A
+** thread that created pools should call it before exiting, as they are
+** not freed otherwise.
+*/
+LUALIB_API void luaL_poolflush (void) {
+  while (spareslabs != NULL) {
+    Slab *next = spareslabs->next;
+    free(spareslabs);
+    spareslabs = next;
+  }
+  nspareslabs = 0;
+}
+
+
+/*
+** Create a pool. When 'arena' is not zero, the pool starts by carving
+** all its blocks (small and large) from a single region of that size,
+** which is released at once with the pool; this suits short-lived
+** states. The caller owns a reference to the pool until it calls
+** 'luaL_releasepool'; after that, the pool is destroyed when its last
+** block is freed (e.g., by 'lua_close').
+*/
+LUALIB_API luaL_Pool *luaL_newpool (size_t arena) {
+  luaL_Pool *P = (luaL_Pool *)malloc(sizeof(luaL_Pool));
+  if (P == NULL)
+    return NULL;
+  memset(P, 0, sizeof(luaL_Pool));
+  if (arena > 0) {
+    arena = (arena + POOL_GRAIN - 1) & ~(size_t)(POOL_GRAIN - 1);
+    P->arena = (char *)malloc(arena);
+    if (P->arena == NULL) {
+      free(P);
+      return NULL;
+    }
+    P->arenaend = P->arena + arena;
+    P->top = P->arena;
+    P->limit = P->arenaend;
+    P->st.reserved = arena;
+  }
+  return P;
+}
+
+
+LUALIB_API void luaL_releasepool (luaL_Pool *P) {
+  P->released = 1;
+  if (P->nblocks == 0)
+    destroypool(P);
+}
+
+
+/*
+** Copy the statistics of the pool used by state 'L' into 'st'.
+** Returns 0 if 'L' does not use a pool.
+*/
+LUALIB_API int luaL_poolstats (lua_State *L, luaL_PoolStats *st) {
+  void *ud;
+  if (lua_getallocf(L, &ud) != luaL_poolalloc)
+    return 0;
+  *st = ((luaL_Pool *)ud)->st;
+  return 1;
+}
+
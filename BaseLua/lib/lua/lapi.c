@@ -535,6 +535,59 @@ LUA_API const char *lua_pushlstring (lua_State *L, const char *s, size_t len) {
 }
 
 
+/*
+** Push the buffer 's' (of length 'len', with s[len] == '\0') as a
+** string without copying it. Short buffers are copied into an
+** ordinary string and released at once.
+*/
+typedef struct ExtStr {
+  const char *s;
+  size_t len;
+  lua_Alloc falloc;
+  void *ud;
+  TString *ts;
+} ExtStr;
+
+
+static void newextstr (lua_State *L, void *ud) {
+  ExtStr *e = cast(ExtStr *, ud);
+  if (e->len <= LUAI_MAXSHORTLEN)
+    e->ts = luaS_newlstr(L, e->s, e->len);
+  else
+    e->ts = luaS_newextlngstr(L, e->s, e->len, e->falloc, e->ud);
+}
+
+
+/*
+** Push the buffer 's' (with a '\0' at 's[len]') as a string. With a
+** non-NULL 'falloc', the buffer belongs to Lua from now on, even if
+** this function raises an error: it is released with
+** 'falloc(ud, s, len + 1, 0)' when the string dies, right away when the
+** string is short (and so copied), or before the error is propagated.
+*/
+LUA_API const char *lua_pushexternalstring (lua_State *L, const char *s,
+                                   size_t len, lua_Alloc falloc, void *ud) {
+  ExtStr e;
+  int status;
+  lua_lock(L);
+  api_check(L, s[len] == '\0', "string not ending with zero");
+  e.s = s; e.len = len; e.falloc = falloc; e.ud = ud;
+  status = luaD_rawrunprotected(L, newextstr, &e);
+  if (l_unlikely(status != LUA_OK)) {  /* could not create the string? */
+    if (falloc != NULL)
+      (*falloc)(ud, cast_voidp(s), len + 1, 0);
+    luaD_throw(L, status);
+  }
+  if (len <= LUAI_MAXSHORTLEN && falloc != NULL)  /* buffer was copied? */
+    (*falloc)(ud, cast_voidp(s), len + 1, 0);
+  setsvalue2s(L, L->top.p, e.ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getstr(e.ts);
+}
+
+
 LUA_API const char *lua_pushstring (lua_State *L, const char *s) {
   lua_lock(L);
   if (s == NULL)
@@ -1107,14 +1160,15 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
 }
 
 
-LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
+LUA_API int lua_dumpx (lua_State *L, lua_Writer writer, void *data,
+                       int strip, int aligned) {
   int status;
   TValue *o;
   lua_lock(L);
   api_checknelems(L, 1);
   o = s2v(L->top.p - 1);
   if (isLfunction(o))
-    status = luaU_dump(L, getproto(o), writer, data, strip);
+    status = luaU_dump(L, getproto(o), writer, data, strip, aligned);
   else
     status = 1;
   lua_unlock(L);
@@ -1122,6 +1176,11 @@ LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
 }
 
 
+LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data, int strip) {
+  return lua_dumpx(L, writer, data, strip, 0);
+}
+
+
 LUA_API int lua_status (lua_State *L) {
   return L->status;
 }
@@ -1324,6 +1383,20 @@ LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
 }
 
 
+/*
+** Set the function that frees the memory of objects the collector
+** finds dead while sweeping (NULL to use the state allocator). It is
+** called only to free blocks ('nsize' == 0); it may hand them over to
+** another thread.
+*/
+LUA_API void lua_setsweepf (lua_State *L, lua_Alloc f, void *ud) {
+  lua_lock(L);
+  G(L)->sweepud = ud;
+  G(L)->sweepf = f;
+  lua_unlock(L);
+}
+
+
 void lua_setwarnf (lua_State *L, lua_WarnFunction f, void *ud) {
   lua_lock(L);
   G(L)->ud_warn = ud;
@@ -0,0 +1,628 @@
+/*
+** $Id: larraylib.c $
+** Typed numeric arrays
+** See Copyright Notice in lua.h
+*/
+
+#define larraylib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** A typed array is a userdata with metatable LUAL_ARRAYHANDLE and
+** initial structure 'luaL_Array'. Arrays created by Lua keep their
+** elements in the same userdata, after the structure, aligned to
+** ARRAY_ALIGN bytes; arrays created over external memory (see
+** 'luaL_pusharray') call their release function when collected.
+*/
+#define ARRAY_ALIGN	64
+
+
+static const char *const typenames[] = {"f32", "f64", "i32", "u8", NULL};
+static const size_t typesizes[] = {
+  sizeof(float), sizeof(double), sizeof(int32_t), sizeof(uint8_t)
+};
+
+
+#define toarray(L,i)	((luaL_Array *)luaL_checkudata(L, i, LUAL_ARRAYHANDLE))
+
+
+static void pushmetatable (lua_State *L);
+
+
+LUALIB_API void *luaL_newarray (lua_State *L, int type, size_t n) {
+  luaL_Array *a;
+  size_t esize = typesizes[type];
+  if (n > (~(size_t)0 - sizeof(luaL_Array) - ARRAY_ALIGN) / esize)
+    luaL_error(L, "array too large");
+  a = (luaL_Array *)lua_newuserdatauv(L,
+                      sizeof(luaL_Array) + ARRAY_ALIGN + n * esize, 0);
+  a->data = (void *)(((uintptr_t)(a + 1) + ARRAY_ALIGN - 1)
+                     & ~(uintptr_t)(ARRAY_ALIGN - 1));
+  a->n = n;
+  a->type = type;
+  a->release = NULL;
+  a->ud = NULL;
+  memset(a->data, 0, n * esize);
+  pushmetatable(L);
+  lua_setmetatable(L, -2);
+  return a->data;
+}
+
+
+LUALIB_API void luaL_pusharray (lua_State *L, int type, void *data,
+                                size_t n, luaL_ArrayRelease release,
+                                void *ud) {
+  luaL_Array *a = (luaL_Array *)lua_newuserdatauv(L, sizeof(luaL_Array), 0);
+  a->data = data;
+  a->n = n;
+  a->type = type;
+  a->release = release;
+  a->ud = ud;
+  pushmetatable(L);
+  lua_setmetatable(L, -2);
+}
+
+
+LUALIB_API luaL_Array *luaL_toarray (lua_State *L, int idx) {
+  return (luaL_Array *)luaL_testudata(L, idx, LUAL_ARRAYHANDLE);
+}
+
+
+/*
+** {======================================================
+** Element access
+** =======================================================
+*/
+
+static lua_Number getnum (const luaL_Array *a, size_t i) {
+  switch (a->type) {
+    case LUAL_AF32: return (lua_Number)((const float *)a->data)[i];
+    case LUAL_AF64: return (lua_Number)((const double *)a->data)[i];
+    case LUAL_AI32: return (lua_Number)((const int32_t *)a->data)[i];
+    default: return (lua_Number)((const uint8_t *)a->data)[i];
+  }
+}
+
+
+/*
+** Store Lua value at 'idx' into element 'i'. Integer elements keep the
+** low bits of the (integral) value, as in C conversions to unsigned.
+*/
+static void setelem (lua_State *L, luaL_Array *a, size_t i, int idx) {
+  switch (a->type) {
+    case LUAL_AF32:
+      ((float *)a->data)[i] = (float)luaL_checknumber(L, idx);
+      break;
+    case LUAL_AF64:
+      ((double *)a->data)[i] = (double)luaL_checknumber(L, idx);
+      break;
+    case LUAL_AI32:
+      ((int32_t *)a->data)[i] = (int32_t)(uint32_t)luaL_checkinteger(L, idx);
+      break;
+    default:
+      ((uint8_t *)a->data)[i] = (uint8_t)luaL_checkinteger(L, idx);
+      break;
+  }
+}
+
+
+static void pushelem (lua_State *L, const luaL_Array *a, size_t i) {
+  switch (a->type) {
+    case LUAL_AI32:
+      lua_pushinteger(L, ((const int32_t *)a->data)[i]);
+      break;
+    case LUAL_AU8:
+      lua_pushinteger(L, ((const uint8_t *)a->data)[i]);
+      break;
+    default:
+      lua_pushnumber(L, getnum(a, i));
+      break;
+  }
+}
+
+
+/* convert 1-based index at 'arg' into a 0-based position in 'a' */
+static size_t checkpos (lua_State *L, const luaL_Array *a, int arg) {
+  lua_Integer i = luaL_checkinteger(L, arg);
+  luaL_argcheck(L, 1 <= i && (lua_Unsigned)i <= a->n, arg,
+                   "index out of range");
+  return (size_t)(i - 1);
+}
+
+
+static int arr_index (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  if (lua_type(L, 2) == LUA_TNUMBER)
+    pushelem(L, a, checkpos(L, a, 2));
+  else {  /* method */
+    lua_getmetatable(L, 1);
+    lua_getfield(L, -1, "__methods");
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+  }
+  return 1;
+}
+
+
+static int arr_newindex (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  setelem(L, a, checkpos(L, a, 2), 3);
+  return 0;
+}
+
+
+static int arr_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)toarray(L, 1)->n);
+  return 1;
+}
+
+
+static int arr_tostring (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  lua_pushfstring(L, "array<%s>(%I): %p", typenames[a->type],
+                     (LUAI_UACINT)a->n, a->data);
+  return 1;
+}
+
+
+static int arr_gc (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  if (a->release != NULL) {
+    a->release(a->ud, a->data, a->n);
+    a->release = NULL;
+    a->data = NULL;
+    a->n = 0;
+  }
+  return 0;
+}
+
+
+static int arr_type (lua_State *L) {
+  lua_pushstring(L, typenames[toarray(L, 1)->type]);
+  return 1;
+}
+
+
+static int arr_totable (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  size_t i;
+  luaL_argcheck(L, a->n <= INT_MAX, 1, "array too large");
+  lua_createtable(L, (int)a->n, 0);
+  for (i = 0; i < a->n; i++) {
+    pushelem(L, a, i);
+    lua_rawseti(L, -2, (lua_Integer)i + 1);
+  }
+  return 1;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Bulk kernels
+** =======================================================
+** The kernels are plain loops, which compilers turn into vector code.
+** (Element-wise operands may alias, as in 'a:add(a)'.) Floating-point
+** reductions use several independent accumulators, because compilers
+** may not reassociate them on their own.
+*/
+
+#if !defined(l_restrict)
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#define l_restrict	restrict
+#elif defined(__GNUC__) || defined(_MSC_VER)
+#define l_restrict	__restrict
+#else
+#define l_restrict	/* empty */
+#endif
+#endif
+
+
+/* element-wise operations (integers wrap around) */
+#define addf(x,y)	((x) + (y))
+#define mulf(x,y)	((x) * (y))
+#define addi32(x,y)	((int32_t)((uint32_t)(x) + (uint32_t)(y)))
+#define muli32(x,y)	((int32_t)((uint32_t)(x) * (uint32_t)(y)))
+#define addu8(x,y)	((uint8_t)((x) + (y)))
+#define mulu8(x,y)	((uint8_t)((x) * (y)))
+
+
+#define MAPKERNELS(name,T,op)  \
+static void name##v (T *a, const T *b, size_t n) {  \
+  size_t i;  \
+  for (i = 0; i < n; i++) a[i] = op(a[i], b[i]);  \
+}  \
+static void name##s (T *a, T s, size_t n) {  \
+  size_t i;  \
+  for (i = 0; i < n; i++) a[i] = op(a[i], s);  \
+}
+
+MAPKERNELS(add_f32, float, addf)
+MAPKERNELS(add_f64, double, addf)
+MAPKERNELS(add_i32, int32_t, addi32)
+MAPKERNELS(add_u8, uint8_t, addu8)
+MAPKERNELS(mul_f32, float, mulf)
+MAPKERNELS(mul_f64, double, mulf)
+MAPKERNELS(mul_i32, int32_t, muli32)
+MAPKERNELS(mul_u8, uint8_t, mulu8)
+
+
+/* sum and dot product of floats, with four accumulators */
+#define FLTREDUCE(name,T,term)  \
+static double name (const T *l_restrict a, const T *l_restrict b,  \
+                    size_t n) {  \
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;  \
+  size_t i = 0;  \
+  (void)b;  \
+  for (; i + 4 <= n; i += 4) {  \
+    s0 += term(i); s1 += term(i + 1);  \
+    s2 += term(i + 2); s3 += term(i + 3);  \
+  }  \
+  for (; i < n; i++) s0 += term(i);  \
+  return (s0 + s1) + (s2 + s3);  \
+}
+
+#define sumterm(i)	((double)a[i])
+#define dotterm(i)	((double)a[i] * (double)b[i])
+
+FLTREDUCE(sum_f32, float, sumterm)
+FLTREDUCE(sum_f64, double, sumterm)
+FLTREDUCE(dot_f32, float, dotterm)
+FLTREDUCE(dot_f64, double, dotterm)
+
+
+/* sum and dot product of integers (wrapping around, as Lua does) */
+#define INTREDUCE(name,T,term)  \
+static lua_Unsigned name (const T *l_restrict a, const T *l_restrict b,  \
+                          size_t n) {  \
+  lua_Unsigned s = 0;  \
+  size_t i;  \
+  (void)b;  \
+  for (i = 0; i < n; i++) s += term(i);  \
+  return s;  \
+}
+
+#define isumterm(i)	((lua_Unsigned)(lua_Integer)a[i])
+#define idotterm(i)  \
+	((lua_Unsigned)(lua_Integer)a[i] * (lua_Unsigned)(lua_Integer)b[i])
+
+INTREDUCE(sum_i32, int32_t, isumterm)
+INTREDUCE(sum_u8, uint8_t, isumterm)
+INTREDUCE(dot_i32, int32_t, idotterm)
+INTREDUCE(dot_u8, uint8_t, idotterm)
+
+
+/*
+** Index of the first minimum (or maximum) element; 'n' must be
+** positive. The first pass (which vectorizes) finds the value, the
+** second one its position. NaNs are skipped, unless 'a[0]' is one.
+*/
+#define EXTREME(name,T,cmp,isnan)  \
+static size_t name (const T *l_restrict a, size_t n) {  \
+  T m = a[0];  \
+  size_t i;  \
+  for (i = 1; i < n; i++) m = (a[i] cmp m) ? a[i] : m;  \
+  if (isnan(m)) return 0;  \
+  for (i = 0; a[i] != m; i++) ;  \
+  return i;  \
+}
+
+#define fltnan(x)	((x) != (x))
+#define intnan(x)	0
+
+EXTREME(min_f32, float, <, fltnan)
+EXTREME(min_f64, double, <, fltnan)
+EXTREME(min_i32, int32_t, <, intnan)
+EXTREME(min_u8, uint8_t, <, intnan)
+EXTREME(max_f32, float, >, fltnan)
+EXTREME(max_f64, double, >, fltnan)
+EXTREME(max_i32, int32_t, >, intnan)
+EXTREME(max_u8, uint8_t, >, intnan)
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Methods
+** =======================================================
+*/
+
+/* 2nd operand of an element-wise operation: array or number */
+static luaL_Array *checkoperand (lua_State *L, const luaL_Array *a,
+                                 int arg) {
+  luaL_Array *b = luaL_toarray(L, arg);
+  if (b != NULL) {
+    luaL_argcheck(L, b->type == a->type, arg, "array types differ");
+    luaL_argcheck(L, b->n == a->n, arg, "array sizes differ");
+  }
+  return b;
+}
+
+
+#define DISPATCHMAP(L,a,b,arg,name) \
+  switch (a->type) {  \
+    case LUAL_AF32:  \
+      if (b) name##_f32v((float *)a->data, (const float *)b->data, a->n);  \
+      else name##_f32s((float *)a->data,  \
+                       (float)luaL_checknumber(L, arg), a->n);  \
+      break;  \
+    case LUAL_AF64:  \
+      if (b) name##_f64v((double *)a->data, (const double *)b->data, a->n);  \
+      else name##_f64s((double *)a->data,  \
+                       (double)luaL_checknumber(L, arg), a->n);  \
+      break;  \
+    case LUAL_AI32:  \
+      if (b) name##_i32v((int32_t *)a->data,  \
+                         (const int32_t *)b->data, a->n);  \
+      else name##_i32s((int32_t *)a->data,  \
+                       (int32_t)(uint32_t)luaL_checkinteger(L, arg), a->n);  \
+      break;  \
+    default:  \
+      if (b) name##_u8v((uint8_t *)a->data,  \
+                        (const uint8_t *)b->data, a->n);  \
+      else name##_u8s((uint8_t *)a->data,  \
+                      (uint8_t)luaL_checkinteger(L, arg), a->n);  \
+      break;  \
+  }
+
+
+/* a:add(b) / a:mul(b): in place, with 'b' an array or a number */
+static int arr_add (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  luaL_Array *b = checkoperand(L, a, 2);
+  DISPATCHMAP(L, a, b, 2, add);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int arr_mul (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  luaL_Array *b = checkoperand(L, a, 2);
+  DISPATCHMAP(L, a, b, 2, mul);
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int arr_fill (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  size_t i;
+  if (a->n > 0) {
+    setelem(L, a, 0, 2);
+    switch (a->type) {
+      case LUAL_AF32: {
+        float *d = (float *)a->data;
+        for (i = 1; i < a->n; i++) d[i] = d[0];
+        break;
+      }
+      case LUAL_AF64: {
+        double *d = (double *)a->data;
+        for (i = 1; i < a->n; i++) d[i] = d[0];
+        break;
+      }
+      case LUAL_AI32: {
+        int32_t *d = (int32_t *)a->data;
+        for (i = 1; i < a->n; i++) d[i] = d[0];
+        break;
+      }
+      default:
+        memset(a->data, *(uint8_t *)a->data, a->n);
+        break;
+    }
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+/*
+** a:copy(src [, pos]): copy all of 'src' into 'a' starting at position
+** 'pos' (default 1), converting elements if types differ.
+*/
+static int arr_copy (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  luaL_Array *src = toarray(L, 2);
+  lua_Integer pos = luaL_optinteger(L, 3, 1);
+  size_t i, off;
+  luaL_argcheck(L, pos >= 1 && (lua_Unsigned)pos - 1 <= a->n &&
+                   src->n <= a->n - ((size_t)pos - 1), 3,
+                   "destination out of range");
+  off = (size_t)pos - 1;
+  if (src->type == a->type)
+    memmove((char *)a->data + off * typesizes[a->type], src->data,
+            src->n * typesizes[a->type]);
+  else {
+    for (i = 0; i < src->n; i++) {
+      pushelem(L, src, i);
+      setelem(L, a, off + i, -1);
+      lua_pop(L, 1);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;
+}
+
+
+static int arr_sum (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  switch (a->type) {
+    case LUAL_AF32:
+      lua_pushnumber(L, sum_f32((const float *)a->data, NULL, a->n));
+      break;
+    case LUAL_AF64:
+      lua_pushnumber(L, sum_f64((const double *)a->data, NULL, a->n));
+      break;
+    case LUAL_AI32:
+      lua_pushinteger(L, (lua_Integer)sum_i32((const int32_t *)a->data,
+                                               NULL, a->n));
+      break;
+    default:
+      lua_pushinteger(L, (lua_Integer)sum_u8((const uint8_t *)a->data,
+                                              NULL, a->n));
+      break;
+  }
+  return 1;
+}
+
+
+static int arr_dot (lua_State *L) {
+  luaL_Array *a = toarray(L, 1);
+  luaL_Array *b = checkoperand(L, a, 2);
+  if (b == NULL)
+    luaL_typeerror(L, 2, LUAL_ARRAYHANDLE);
+  switch (a->type) {
+    case LUAL_AF32:
+      lua_pushnumber(L, dot_f32((const float *)a->data,
+                                (const float *)b->data, a->n));
+      break;
+    case LUAL_AF64:
+      lua_pushnumber(L, dot_f64((const double *)a->data,
+                                (const double *)b->data, a->n));
+      break;
+    case LUAL_AI32:
+      lua_pushinteger(L, (lua_Integer)dot_i32((const int32_t *)a->data,
+                                 (const int32_t *)b->data, a->n));
+      break;
+    default:
+      lua_pushinteger(L, (lua_Integer)dot_u8((const uint8_t *)a->data,
+                                 (const uint8_t *)b->data, a->n));
+      break;
+  }
+  return 1;
+}
+
+
+/* a:min() / a:max(): value and index of an extreme element (or nil) */
+static int extreme (lua_State *L, int ismax) {
+  luaL_Array *a = toarray(L, 1);
+  size_t i;
+  if (a->n == 0) {
+    luaL_pushfail(L);
+    return 1;
+  }
+  switch (a->type) {
+    case LUAL_AF32:
+      i = ismax ? max_f32((const float *)a->data, a->n)
+                : min_f32((const float *)a->data, a->n);
+      break;
+    case LUAL_AF64:
+      i = ismax ? max_f64((const double *)a->data, a->n)
+                : min_f64((const double *)a->data, a->n);
+      break;
+    case LUAL_AI32:
+      i = ismax ? max_i32((const int32_t *)a->data, a->n)
+                : min_i32((const int32_t *)a->data, a->n);
+      break;
+    default:
+      i = ismax ? max_u8((const uint8_t *)a->data, a->n)
+                : min_u8((const uint8_t *)a->data, a->n);
+      break;
+  }
+  pushelem(L, a, i);
+  lua_pushinteger(L, (lua_Integer)i + 1);
+  return 2;
+}
+
+
+static int arr_min (lua_State *L) {
+  return extreme(L, 0);
+}
+
+
+static int arr_max (lua_State *L) {
+  return extreme(L, 1);
+}
+
+/* }====================================================== */
+
+
+/*
+** array.new(type, n | table)
+*/
+static int arr_new (lua_State *L) {
+  int type = luaL_checkoption(L, 1, NULL, typenames);
+  if (lua_istable(L, 2)) {
+    size_t i, n = (size_t)luaL_len(L, 2);
+    luaL_Array *a;
+    luaL_newarray(L, type, n);
+    a = (luaL_Array *)lua_touserdata(L, -1);
+    for (i = 0; i < n; i++) {
+      lua_geti(L, 2, (lua_Integer)i + 1);
+      setelem(L, a, i, -1);
+      lua_pop(L, 1);
+    }
+  }
+  else {
+    lua_Integer n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "invalid size");
+    luaL_newarray(L, type, (size_t)n);
+  }
+  return 1;
+}
+
+
+static const luaL_Reg meth[] = {
+  {"add", arr_add},
+  {"mul", arr_mul},
+  {"dot", arr_dot},
+  {"sum", arr_sum},
+  {"min", arr_min},
+  {"max", arr_max},
+  {"fill", arr_fill},
+  {"copy", arr_copy},
+  {"type", arr_type},
+  {"totable", arr_totable},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg metameth[] = {
+  {"__index", arr_index},
+  {"__newindex", arr_newindex},
+  {"__len", arr_len},
+  {"__tostring", arr_tostring},
+  {"__gc", arr_gc},
+  {"__methods", NULL},  /* place holder */
+  {NULL, NULL}
+};
+
+
+static void pushmetatable (lua_State *L) {
+  if (luaL_newmetatable(L, LUAL_ARRAYHANDLE)) {
+    luaL_setfuncs(L, metameth, 0);
+    luaL_newlibtable(L, meth);
+    luaL_setfuncs(L, meth, 0);
+    lua_setfield(L, -2, "__methods");
+  }
+}
+
+
+static const luaL_Reg arraylib[] = {
+  {"new", arr_new},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_array (lua_State *L) {
+  luaL_newlib(L, arraylib);
+  pushmetatable(L);
+  lua_pop(L, 1);
+  return 1;
+}
+
@@ -1115,6 +1115,26 @@ LUALIB_API lua_State *luaL_newstate (void) {
 }
 
 
+/*
+** Like 'luaL_newstate', but the state allocates from a size-class pool
+** (see lalloc.c), which goes away with the state. 'arena' is the size
+** of an optional bump arena carved before any slab.
+*/
+LUALIB_API lua_State *luaL_newpoolstate (size_t arena) {
+  lua_State *L;
+  luaL_Pool *P = luaL_newpool(arena);
+  if (l_unlikely(P == NULL))
+    return NULL;
+  L = lua_newstate(luaL_poolalloc, P);
+  luaL_releasepool(P);  /* now the state owns the pool (if it exists) */
+  if (l_likely(L)) {
+    lua_atpanic(L, &panic);
+    lua_setwarnf(L, warnfoff, L);  /* default is warnings off */
+  }
+  return L;
+}
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
   lua_Number v = lua_version(L);
   if (sz != LUAL_NUMSIZES)  /* check numeric types */
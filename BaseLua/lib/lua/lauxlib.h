@@ -94,11 +94,17 @@ LUALIB_API int (luaL_loadfilex) (lua_State *L, const char *filename,
 
 #define luaL_loadfile(L,f)	luaL_loadfilex(L,f,NULL)
 
+/* like 'luaL_loadfile', keeping precompiled chunks in directory 'dir';
+   from lcache.c */
+LUALIB_API int (luaL_loadfilecached) (lua_State *L, const char *filename,
+                                                    const char *dir);
+
 LUALIB_API int (luaL_loadbufferx) (lua_State *L, const char *buff, size_t sz,
                                    const char *name, const char *mode);
 LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
+LUALIB_API lua_State *(luaL_newpoolstate) (size_t arena);
 
 LUALIB_API lua_Integer (luaL_len) (lua_State *L, int idx);
 
@@ -227,6 +233,135 @@ LUALIB_API char *(luaL_buffinitsize) (lua_State *L, luaL_Buffer *B, size_t sz);
 
 
 
+/*
+** {======================================================
+** Size-class pool allocator (from lalloc.c)
+** =======================================================
+*/
+
+#define LUAL_POOLCLASSES	16	/* small blocks: 16, 32, ..., 256 bytes */
+#define LUAL_POOLBINS	32	/* larger blocks, by log2 of their size */
+
+typedef struct luaL_PoolStats {
+  size_t small[LUAL_POOLCLASSES];  /* allocations per size class */
+  size_t smalllive[LUAL_POOLCLASSES];  /* live blocks per size class */
+  size_t large[LUAL_POOLBINS];  /* larger allocations per log2 bin */
+  size_t inuse;  /* bytes requested by live blocks */
+  size_t peak;  /* maximum value of 'inuse' */
+  size_t reserved;  /* bytes taken from the C library */
+} luaL_PoolStats;
+
+typedef struct luaL_Pool luaL_Pool;
+
+LUALIB_API luaL_Pool *(luaL_newpool) (size_t arena);
+LUALIB_API void (luaL_releasepool) (luaL_Pool *P);
+LUALIB_API void *(luaL_poolalloc) (void *ud, void *ptr, size_t osize,
+                                                        size_t nsize);
+LUALIB_API int (luaL_poolstats) (lua_State *L, luaL_PoolStats *st);
+LUALIB_API void (luaL_poolflush) (void);
+
+/* free swept objects in a helper thread (from lbgfree.c) */
+LUALIB_API int (luaL_bgfree) (lua_State *L, int on);
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Typed arrays (from larraylib.c)
+** =======================================================
+*/
+
+/*
+** A typed array is a userdata with metatable 'LUAL_ARRAYHANDLE' and
+** initial structure 'luaL_Array'. Its elements are the 'n' values of
+** the given type at 'data', which C code can read and write in place.
+*/
+
+#define LUAL_ARRAYHANDLE	"ARRAY*"
+
+/* element types */
+#define LUAL_AF32	0	/* float */
+#define LUAL_AF64	1	/* double */
+#define LUAL_AI32	2	/* int32_t */
+#define LUAL_AU8	3	/* uint8_t */
+
+typedef void (*luaL_ArrayRelease) (void *ud, void *data, size_t n);
+
+typedef struct luaL_Array {
+  void *data;  /* elements */
+  size_t n;  /* number of elements */
+  int type;  /* LUAL_A* */
+  luaL_ArrayRelease release;  /* called when collected (for external data) */
+  void *ud;  /* argument to 'release' */
+} luaL_Array;
+
+/* push a new zero-filled array; returns its elements */
+LUALIB_API void *(luaL_newarray) (lua_State *L, int type, size_t n);
+/* push an array over external memory (which must outlive it) */
+LUALIB_API void (luaL_pusharray) (lua_State *L, int type, void *data,
+                                  size_t n, luaL_ArrayRelease release,
+                                  void *ud);
+/* array at 'idx', or NULL if it is not an array */
+LUALIB_API luaL_Array *(luaL_toarray) (lua_State *L, int idx);
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Sampling profiler (from lproflib.c)
+** =======================================================
+*/
+
+/* sample 'hz' times per second (0 for the default) of elapsed or CPU time */
+LUALIB_API int (luaL_profstart) (lua_State *L, int hz, int cpu);
+/* stop sampling; returns the number of samples */
+LUALIB_API size_t (luaL_profstop) (lua_State *L);
+/* write samples as folded stacks ("f1;f2;f3 count" per line) */
+LUALIB_API void (luaL_profdump) (lua_State *L, FILE *f);
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Pools of states run by worker threads (from lstatepool.c)
+** =======================================================
+*/
+
+/* number of jobs a state runs before being rebuilt */
+#if !defined(LUAL_STATEPOOLRECYCLE)
+#define LUAL_STATEPOOLRECYCLE	10000
+#endif
+
+typedef struct luaL_StatePool luaL_StatePool;
+
+/* both return LUA_OK or an error status */
+typedef int (*luaL_StateInit) (lua_State *L, void *ud);
+typedef int (*luaL_StateJob) (lua_State *L, void *arg);
+
+typedef struct luaL_StatePoolStats {
+  size_t done;  /* jobs finished with LUA_OK */
+  size_t failed;  /* jobs finished with an error */
+  size_t restarts;  /* states rebuilt */
+  double p50, p99, max;  /* latencies (seconds) from submit to finish */
+} luaL_StatePoolStats;
+
+LUALIB_API luaL_StatePool *(luaL_newstatepool) (int n, luaL_StateInit init,
+                                                void *ud);
+LUALIB_API int (luaL_statepoolsubmit) (luaL_StatePool *SP, luaL_StateJob job,
+                                       void *arg);
+LUALIB_API void (luaL_statepoolwait) (luaL_StatePool *SP);
+LUALIB_API void (luaL_statepoolstats) (luaL_StatePool *SP,
+                                       luaL_StatePoolStats *st);
+LUALIB_API void (luaL_closestatepool) (luaL_StatePool *SP);
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** File handles for IO library
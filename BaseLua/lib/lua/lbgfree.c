@@ -0,0 +1,219 @@
+/*
+** $Id: lbgfree.c $
+** Background freeing of objects swept by the collector
+** See Copyright Notice in lua.h
+*/
+
+#define lbgfree_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <stdlib.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lthreads.h"
+
+
+/*
+** The collector still marks, runs the atomic phase and walks the
+** lists during sweeps in the thread running the state; only the calls
+** that give the memory of dead objects back to the allocator move to
+** a helper thread. The sweep function (see 'lua_setsweepf') appends
+** each block to a batch; full batches go to the helper, which frees
+** them with the state allocator. Objects with finalizers are never
+** swept before their finalizers run, so no finalizer runs off the
+** state's thread. The allocator must accept frees from another thread
+** concurrent with its other calls (as 'malloc'-based allocators do).
+*/
+
+
+#define BATCHSIZE	1024
+
+#define BGFREE		"_BGFREE"
+
+
+typedef struct Batch {
+  struct Batch *next;
+  int n;
+  struct {
+    void *block;
+    size_t size;
+  } b[BATCHSIZE];
+} Batch;
+
+
+typedef struct BgFree {
+  lua_Alloc f;  /* the state allocator */
+  void *ud;
+  Batch *cur;  /* batch being filled by sweeps */
+  int running;
+  l_thread thread;
+  l_mutex lock;  /* protects the fields below */
+  l_cond hasbatch;
+  Batch *full;  /* batches waiting for the helper */
+  Batch *spare;  /* empty batches */
+  int closing;
+} BgFree;
+
+
+static void freebatch (BgFree *B, Batch *bt) {
+  int i;
+  for (i = 0; i < bt->n; i++)
+    B->f(B->ud, bt->b[i].block, bt->b[i].size, 0);
+  bt->n = 0;
+}
+
+
+THREADFUNC(helpermain) {
+  BgFree *B = (BgFree *)arg;
+  mutexlock(&B->lock);
+  for (;;) {
+    Batch *list, *last;
+    while (B->full == NULL && !B->closing)
+      condwait(&B->hasbatch, &B->lock);
+    if (B->full == NULL)  /* closing with nothing left? */
+      break;
+    list = B->full;
+    B->full = NULL;
+    mutexunlock(&B->lock);
+    for (last = list; ; last = last->next) {
+      freebatch(B, last);
+      if (last->next == NULL)
+        break;
+    }
+    mutexlock(&B->lock);
+    last->next = B->spare;
+    B->spare = list;
+  }
+  mutexunlock(&B->lock);
+  THREADRETURN;
+}
+
+
+/*
+** Hand batch 'bt' (if not NULL) to the helper and return an empty
+** batch, or NULL if there is no memory for one.
+*/
+static Batch *handoff (BgFree *B, Batch *bt) {
+  Batch *nb;
+  mutexlock(&B->lock);
+  if (bt != NULL) {
+    bt->next = B->full;
+    B->full = bt;
+    condsignal(&B->hasbatch);
+  }
+  nb = B->spare;
+  if (nb != NULL)
+    B->spare = nb->next;
+  mutexunlock(&B->lock);
+  if (nb == NULL && (nb = (Batch *)malloc(sizeof(Batch))) != NULL)
+    nb->n = 0;
+  return nb;
+}
+
+
+static void *sweepfree (void *ud, void *ptr, size_t osize, size_t nsize) {
+  BgFree *B = (BgFree *)ud;
+  Batch *bt = B->cur;
+  (void)nsize;  /* always 0 */
+  if (ptr == NULL)
+    return NULL;
+  if (bt == NULL || bt->n == BATCHSIZE) {
+    bt = B->cur = handoff(B, bt);
+    if (bt == NULL) {  /* no memory for a batch? */
+      B->f(B->ud, ptr, osize, 0);  /* free it here */
+      return NULL;
+    }
+  }
+  bt->b[bt->n].block = ptr;
+  bt->b[bt->n].size = osize;
+  bt->n++;
+  return NULL;
+}
+
+
+/*
+** Stop sweeping through the helper, wait for it to free everything
+** it got, and release its resources.
+*/
+static void stophelper (lua_State *L, BgFree *B) {
+  if (!B->running)
+    return;
+  lua_setsweepf(L, NULL, NULL);
+  if (B->cur != NULL) {
+    freebatch(B, B->cur);
+    free(B->cur);
+    B->cur = NULL;
+  }
+  mutexlock(&B->lock);
+  B->closing = 1;
+  condbroadcast(&B->hasbatch);
+  mutexunlock(&B->lock);
+  threadjoin(B->thread);
+  while (B->spare != NULL) {
+    Batch *next = B->spare->next;
+    free(B->spare);
+    B->spare = next;
+  }
+  condfree(&B->hasbatch);
+  mutexfree(&B->lock);
+  B->running = 0;
+}
+
+
+static int bgfree_gc (lua_State *L) {
+  stophelper(L, (BgFree *)lua_touserdata(L, 1));
+  return 0;
+}
+
+
+/*
+** Turn background freeing on or off for state 'L'. Returns 0 if it
+** cannot be turned on: the allocator is not thread safe (a pool from
+** 'luaL_newpool') or the helper thread cannot be created. The state
+** allocator must not change while this is on.
+*/
+LUALIB_API int luaL_bgfree (lua_State *L, int on) {
+  BgFree *B;
+  lua_getfield(L, LUA_REGISTRYINDEX, BGFREE);
+  B = (BgFree *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (!on) {
+    if (B != NULL) {
+      stophelper(L, B);
+      lua_pushnil(L);
+      lua_setfield(L, LUA_REGISTRYINDEX, BGFREE);
+    }
+    return 1;
+  }
+  if (B != NULL)  /* already on? */
+    return 1;
+  B = (BgFree *)lua_newuserdatauv(L, sizeof(BgFree), 0);
+  B->f = lua_getallocf(L, &B->ud);
+  B->cur = B->full = B->spare = NULL;
+  B->running = B->closing = 0;
+  if (B->f == luaL_poolalloc || !mutexinit(&B->lock)) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  (void)condinit(&B->hasbatch);
+  if (!threadstart(&B->thread, helpermain, B)) {
+    condfree(&B->hasbatch);
+    mutexfree(&B->lock);
+    lua_pop(L, 1);
+    return 0;
+  }
+  B->running = 1;
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, bgfree_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_setfield(L, LUA_REGISTRYINDEX, BGFREE);
+  lua_setsweepf(L, sweepfree, B);
+  return 1;
+}
+
@@ -0,0 +1,456 @@
+/*
+** $Id: lcache.c $
+** Cache of precompiled chunks, used in place from mapped files
+** See Copyright Notice in lua.h
+*/
+
+#define lcache_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+
+
+/*
+** {======================================================
+** File mapping
+** =======================================================
+*/
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <direct.h>
+
+#define l_mkdir(d)	_mkdir(d)
+#define CACHE_MAPWIN
+
+#elif defined(LUA_USE_POSIX) || defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define l_mkdir(d)	mkdir(d, 0777)
+#define CACHE_MAPPOSIX
+
+#else
+
+#define l_mkdir(d)	((void)(d), -1)
+
+#endif
+
+
+#define CACHE_MAPMT	"_CACHEMAP"
+
+/* how the bytes of a 'CacheMap' were obtained */
+#define MAP_NONE	0
+#define MAP_ALLOC	1  /* read with the state's allocator */
+#define MAP_VIEW	2  /* mapped from the file */
+
+typedef struct CacheMap {
+  const char *p;  /* contents of the cache file */
+  size_t size;
+  int kind;
+} CacheMap;
+
+
+static int map_gc (lua_State *L) {
+  CacheMap *m = (CacheMap *)luaL_checkudata(L, 1, CACHE_MAPMT);
+  if (m->kind == MAP_ALLOC) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    allocf(ud, (void *)m->p, m->size, 0);
+  }
+#if defined(CACHE_MAPWIN)
+  else if (m->kind == MAP_VIEW)
+    UnmapViewOfFile(m->p);
+#elif defined(CACHE_MAPPOSIX)
+  else if (m->kind == MAP_VIEW)
+    munmap((void *)m->p, m->size);
+#endif
+  m->kind = MAP_NONE;
+  return 0;
+}
+
+
+/*
+** Create a new (empty) 'CacheMap' userdata on the stack. It gets its
+** finalizer before any function is loaded from it, so that it is
+** finalized after them when the state closes.
+*/
+static CacheMap *newmap (lua_State *L) {
+  CacheMap *m = (CacheMap *)lua_newuserdatauv(L, sizeof(CacheMap), 0);
+  m->p = NULL;
+  m->size = 0;
+  m->kind = MAP_NONE;
+  if (luaL_newmetatable(L, CACHE_MAPMT)) {
+    lua_pushcfunction(L, map_gc);
+    lua_setfield(L, -2, "__gc");
+  }
+  lua_setmetatable(L, -2);
+  return m;
+}
+
+
+/*
+** Fill 'm' with the contents of file 'path'. Uses a read-only mapping
+** when the platform has one and falls back to reading the file.
+** Returns 0 if the file could not be read.
+*/
+static int mapfile (lua_State *L, CacheMap *m, const char *path) {
+  FILE *f;
+  long size = 0;
+#if defined(CACHE_MAPWIN)
+  HANDLE hf = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hf != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER fsize;
+    HANDLE hm = NULL;
+    if (GetFileSizeEx(hf, &fsize) && fsize.QuadPart > 0 &&
+        (unsigned long long)fsize.QuadPart <= (size_t)-1)
+      hm = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hm != NULL) {
+      m->p = (const char *)MapViewOfFile(hm, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(hm);  /* the view keeps the mapping alive */
+    }
+    CloseHandle(hf);
+    if (m->p != NULL) {
+      m->size = (size_t)fsize.QuadPart;
+      m->kind = MAP_VIEW;
+      return 1;
+    }
+  }
+#elif defined(CACHE_MAPPOSIX)
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+        (unsigned long long)st.st_size <= (size_t)-1)
+      p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  /* the mapping keeps the file alive */
+    if (p != MAP_FAILED) {
+      m->p = (const char *)p;
+      m->size = (size_t)st.st_size;
+      m->kind = MAP_VIEW;
+      return 1;
+    }
+  }
+#endif
+  f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+  if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 &&
+      fseek(f, 0, SEEK_SET) == 0) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    char *p = (char *)allocf(ud, NULL, 0, (size_t)size);
+    if (p != NULL) {
+      m->p = p;
+      m->size = (size_t)size;
+      m->kind = MAP_ALLOC;  /* from now on, 'map_gc' frees it */
+      if (fread(p, 1, (size_t)size, f) != (size_t)size)
+        size = 0;  /* short read */
+    }
+  }
+  fclose(f);
+  return (m->kind != MAP_NONE && size > 0);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Cache files
+** =======================================================
+*/
+
+/*
+** A cache file is a fixed-size header followed by an aligned dump that
+** keeps superinstructions (see 'lua_dumpx'), so that code used in place
+** runs fused, and has terminated long strings, which are used in place
+** as external strings. (Short strings are internalized, so they are
+** always copied.) All header fields are little endian:
+**   [0..7]    CACHE_MAGIC
+**   [8..11]   CACHE_VERSION
+**   [12..15]  reserved (zero)
+**   [16..23]  hash of the source text
+**   [24..31]  size of the dump
+**   [32..39]  size of the source file
+**   [40..47]  modification time of the source file
+** An entry is used only if all of them match, so that a hash collision
+** alone cannot run stale code. The header size keeps the dump aligned
+** for any 'Instruction' size.
+*/
+#define CACHE_MAGIC	"\x1bLcache\n"
+#define CACHE_VERSION	(LUA_VERSION_NUM * 16 + 5)
+#define CACHE_HEADERSIZE	48
+
+
+/* 64-bit FNV-1a; shifts are split so that they are valid for any
+   size of 'lua_Unsigned' */
+#define FNV_OFFSET	((((lua_Unsigned)0xcbf29ce4u << 16) << 16) | 0x84222325u)
+#define FNV_PRIME	((((lua_Unsigned)0x100u << 16) << 16) | 0x000001b3u)
+
+static lua_Unsigned hashbytes (lua_Unsigned h, const char *s, size_t l) {
+  size_t i;
+  for (i = 0; i < l; i++) {
+    h ^= (unsigned char)s[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+
+static void putfield (unsigned char *b, lua_Unsigned x) {
+  int i;
+  for (i = 0; i < 8; i++) {
+    b[i] = (unsigned char)(x & 0xff);
+    x = (x >> 4) >> 4;
+  }
+}
+
+
+/* what identifies the source of a cache entry */
+typedef struct SourceId {
+  lua_Unsigned hash;  /* hash of the source text */
+  lua_Unsigned size;  /* size of the source file */
+  lua_Unsigned mtime;  /* modification time of the source file */
+} SourceId;
+
+
+static void makeheader (unsigned char *h, const SourceId *id, size_t size) {
+  memset(h, 0, CACHE_HEADERSIZE);
+  memcpy(h, CACHE_MAGIC, 8);
+  putfield(h + 8, CACHE_VERSION);  /* overwrites the reserved field with 0 */
+  putfield(h + 16, id->hash);
+  putfield(h + 24, (lua_Unsigned)size);
+  putfield(h + 32, id->size);
+  putfield(h + 40, id->mtime);
+}
+
+
+/*
+** Check whether 'm' holds a valid cache entry for source 'id'.
+*/
+static int checkheader (const CacheMap *m, const SourceId *id) {
+  unsigned char h[CACHE_HEADERSIZE];
+  if (m->size <= CACHE_HEADERSIZE)
+    return 0;
+  makeheader(h, id, m->size - CACHE_HEADERSIZE);
+  return (memcmp(h, m->p, CACHE_HEADERSIZE) == 0);
+}
+
+
+/*
+** Modification time of file 'filename', or 0 if it is not known (in
+** which case entries are checked by the hash and size only).
+*/
+static lua_Unsigned filemtime (const char *filename) {
+#if defined(CACHE_MAPWIN)
+  WIN32_FILE_ATTRIBUTE_DATA fa;
+  if (GetFileAttributesExA(filename, GetFileExInfoStandard, &fa))
+    return ((lua_Unsigned)fa.ftLastWriteTime.dwHighDateTime << 16 << 16) |
+           fa.ftLastWriteTime.dwLowDateTime;
+#elif defined(CACHE_MAPPOSIX)
+  struct stat st;
+  if (stat(filename, &st) == 0)
+    return (lua_Unsigned)st.st_mtime;
+#else
+  (void)filename;  /* not used */
+#endif
+  return 0;
+}
+
+
+typedef struct LoadCache {
+  const char *p;
+  size_t size;
+} LoadCache;
+
+
+static const char *getC (lua_State *L, void *ud, size_t *size) {
+  LoadCache *lc = (LoadCache *)ud;
+  (void)L;  /* not used */
+  if (lc->size == 0) return NULL;
+  *size = lc->size;  /* whole dump in one block, as mode 'F' wants */
+  lc->size = 0;
+  return lc->p;
+}
+
+
+static int writer (lua_State *L, const void *b, size_t size, void *ud) {
+  (void)L;  /* not used */
+  return (fwrite(b, 1, size, (FILE *)ud) != size);
+}
+
+
+/*
+** Write the function on the top of the stack into cache file 'path'.
+** The file is written under a temporary name and then renamed, so that
+** concurrent readers never see a partial entry. Errors are ignored: the
+** cache is only an optimization.
+*/
+static void storecache (lua_State *L, const char *dir, const char *path,
+                        const SourceId *id) {
+  unsigned char h[CACHE_HEADERSIZE];
+  const char *tmp = lua_pushfstring(L, "%s.tmp", path);
+  FILE *f;
+  int ok;
+  l_mkdir(dir);  /* may already exist */
+  f = fopen(tmp, "wb");
+  if (f != NULL) {
+    lua_pushvalue(L, -2);  /* function to dump */
+    makeheader(h, id, 0);  /* size is not known yet */
+    ok = (fwrite(h, 1, CACHE_HEADERSIZE, f) == CACHE_HEADERSIZE &&
+          lua_dumpx(L, writer, f, 0, LUA_DUMPFUSED) == 0);
+    lua_pop(L, 1);  /* pop function copy */
+    if (ok) {  /* now fill in the size */
+      long size = ftell(f);
+      makeheader(h, id, (size_t)(size - CACHE_HEADERSIZE));
+      ok = (size > CACHE_HEADERSIZE && fseek(f, 0, SEEK_SET) == 0 &&
+            fwrite(h, 1, CACHE_HEADERSIZE, f) == CACHE_HEADERSIZE);
+    }
+    ok = (fclose(f) == 0) && ok;
+#if defined(_WIN32)
+    if (ok) remove(path);  /* Windows 'rename' does not replace files */
+#endif
+    if (!ok || rename(tmp, path) != 0)
+      remove(tmp);
+  }
+  lua_pop(L, 1);  /* pop 'tmp' */
+}
+
+
+/*
+** Table in the registry that keeps alive the mapped cache files of a
+** state: maps each cache path to its current map and each map ever
+** used to true. (Loaded code points into the maps, so a map cannot go
+** away before the state closes, even if its file is replaced.)
+*/
+#define CACHE_MAPS	"_CACHEMAPS"
+
+
+/*
+** Try to load the cached chunk in 'path'. On success, leaves the
+** function on the stack and returns 1; otherwise returns 0 with the
+** stack unchanged.
+*/
+static int loadcache (lua_State *L, const char *path, const char *chunkname,
+                      const SourceId *id) {
+  CacheMap *m;
+  LoadCache lc;
+  int top = lua_gettop(L);
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, CACHE_MAPS);
+  if (lua_getfield(L, -1, path) == LUA_TUSERDATA &&
+      checkheader((m = (CacheMap *)lua_touserdata(L, -1)), id))
+    lua_pop(L, 1);  /* reuse map already in this state */
+  else {  /* map the file */
+    lua_pop(L, 1);
+    m = newmap(L);
+    if (!mapfile(L, m, path) || !checkheader(m, id)) {
+      lua_settop(L, top);  /* map is collected */
+      return 0;
+    }
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, path);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);  /* maps[m] = true */
+  }
+  lc.p = m->p + CACHE_HEADERSIZE;
+  lc.size = m->size - CACHE_HEADERSIZE;
+  if (lua_load(L, getC, &lc, chunkname, "bF") != LUA_OK) {
+    lua_settop(L, top);  /* ignore damaged entries */
+    return 0;
+  }
+  lua_replace(L, top + 1);  /* function replaces the maps table */
+  return 1;
+}
+
+
+/*
+** Name of the cache file for chunk 'chunkname'. It depends only on the
+** name, so that editing a script replaces its entry.
+*/
+static const char *pushcachepath (lua_State *L, const char *dir,
+                                  const char *chunkname) {
+  static const char digits[] = "0123456789abcdef";
+  char name[17];
+  lua_Unsigned h = hashbytes(FNV_OFFSET, chunkname, strlen(chunkname));
+  int i;
+  for (i = 15; i >= 0; i--) {
+    name[i] = digits[h & 0xf];
+    h >>= 4;
+  }
+  name[16] = '\0';
+  return lua_pushfstring(L, "%s/%s.luac", dir, name);
+}
+
+
+LUALIB_API int luaL_loadfilecached (lua_State *L, const char *filename,
+                                                  const char *dir) {
+  FILE *f;
+  luaL_Buffer b;
+  size_t nr, len;
+  const char *src, *chunkname, *path;
+  SourceId id;
+  int status;
+  int base = lua_gettop(L);
+  if (dir == NULL || filename == NULL)
+    return luaL_loadfilex(L, filename, NULL);
+  f = fopen(filename, "rb");
+  if (f == NULL)  /* let the regular loader report the error */
+    return luaL_loadfilex(L, filename, NULL);
+  luaL_buffinit(L, &b);
+  do {  /* read the whole source */
+    char *p = luaL_prepbuffer(&b);
+    nr = fread(p, sizeof(char), LUAL_BUFFERSIZE, f);
+    luaL_addsize(&b, nr);
+  } while (nr == LUAL_BUFFERSIZE);
+  status = ferror(f);
+  fclose(f);
+  luaL_pushresult(&b);
+  src = lua_tolstring(L, -1, &len);
+  id.size = (lua_Unsigned)len;
+  id.mtime = filemtime(filename);
+  if (status || (len > 0 && src[0] == LUA_SIGNATURE[0])) {
+    lua_settop(L, base);  /* read error or precompiled file */
+    return luaL_loadfilex(L, filename, NULL);
+  }
+  if (len >= 3 && memcmp(src, "\xEF\xBB\xBF", 3) == 0) {  /* BOM? */
+    src += 3; len -= 3;
+  }
+  if (len > 0 && src[0] == '#') {  /* first-line comment? */
+    const char *nl = (const char *)memchr(src, '\n', len);
+    size_t skip = (nl != NULL) ? (size_t)(nl - src) : len;
+    src += skip; len -= skip;  /* keep newline to correct line numbers */
+  }
+  chunkname = lua_pushfstring(L, "@%s", filename);
+  path = pushcachepath(L, dir, chunkname);
+  id.hash = hashbytes(FNV_OFFSET, src, len);
+  if (!loadcache(L, path, chunkname, &id)) {  /* miss? */
+    status = luaL_loadbufferx(L, src, len, chunkname, "t");
+    if (status != LUA_OK) {
+      lua_replace(L, base + 1);  /* error message replaces source */
+      lua_settop(L, base + 1);
+      return status;
+    }
+    storecache(L, dir, path, &id);
+  }
+  lua_replace(L, base + 1);  /* function replaces source */
+  lua_settop(L, base + 1);
+  return LUA_OK;
+}
+
+/* }====================================================== */
+
@@ -1872,4 +1872,6 @@ void luaK_finish (FuncState *fs) {
       default: break;
     }
   }
+  if (luaP_fuse(p->code, fs->pc) > 0)
+    p->flag |= PF_FUSED;
 }
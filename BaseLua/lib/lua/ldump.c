@@ -16,6 +16,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -25,7 +26,10 @@ typedef struct {
   lua_Writer writer;
   void *data;
   int strip;
+  int aligned;  /* pad vectors to their element size */
+  int fused;  /* keep superinstructions in code */
   int status;
+  size_t offset;  /* current position in the dump */
 } DumpState;
 
 
@@ -44,6 +48,7 @@ static void dumpBlock (DumpState *D, const void *b, size_t size) {
     D->status = (*D->writer)(D->L, b, size, D->data);
     lua_lock(D->L);
   }
+  D->offset += size;
 }
 
 
@@ -62,6 +67,20 @@ static void dumpByte (DumpState *D, int y) {
 */
 #define DIBS    ((sizeof(size_t) * CHAR_BIT + 6) / 7)
 
+/*
+** In aligned dumps, pad the output so that the next vector, with
+** elements of size 'align', starts at a multiple of 'align'.
+*/
+static void dumpAlign (DumpState *D, size_t align) {
+  static const lu_byte zeros[16] = {0};
+  if (D->aligned) {
+    size_t pad = (align - D->offset % align) % align;
+    lua_assert(pad < sizeof(zeros));
+    dumpBlock(D, zeros, pad);
+  }
+}
+
+
 static void dumpSize (DumpState *D, size_t x) {
   lu_byte buff[DIBS];
   int n = 0;
@@ -97,13 +116,30 @@ static void dumpString (DumpState *D, const TString *s) {
     const char *str = getstr(s);
     dumpSize(D, size + 1);
     dumpVector(D, str, size);
+    if (D->aligned && size > LUAI_MAXSHORTLEN)
+      dumpByte(D, 0);  /* terminator, so it can be used in place */
   }
 }
 
 
 static void dumpCode (DumpState *D, const Proto *f) {
   dumpInt(D, f->sizecode);
-  dumpVector(D, f->code, f->sizecode);
+  dumpAlign(D, sizeof(Instruction));
+  if ((f->flag & PF_FUSED) && !D->fused) {  /* dump base opcodes? */
+    Instruction buff[64];
+    int pc = 0;
+    while (pc < f->sizecode) {
+      int n = 0;
+      for (; n < 64 && pc < f->sizecode; n++, pc++) {
+        Instruction i = f->code[pc];
+        SET_OPCODE(i, luaP_unfuse(GET_OPCODE(i)));
+        buff[n] = i;
+      }
+      dumpVector(D, buff, n);
+    }
+  }
+  else
+    dumpVector(D, f->code, f->sizecode);
 }
 
 
@@ -201,7 +237,8 @@ static void dumpFunction (DumpState *D, const Proto *f, TString *psource) {
 static void dumpHeader (DumpState *D) {
   dumpLiteral(D, LUA_SIGNATURE);
   dumpByte(D, LUAC_VERSION);
-  dumpByte(D, LUAC_FORMAT);
+  dumpByte(D, D->fused ? LUAC_FORMAT_FUSED
+            : D->aligned ? LUAC_FORMAT_ALIGNED : LUAC_FORMAT);
   dumpLiteral(D, LUAC_DATA);
   dumpByte(D, sizeof(Instruction));
   dumpByte(D, sizeof(lua_Integer));
@@ -215,13 +252,16 @@ static void dumpHeader (DumpState *D) {
 ** dump Lua function as precompiled chunk
 */
 int luaU_dump(lua_State *L, const Proto *f, lua_Writer w, void *data,
-              int strip) {
+              int strip, int aligned) {
   DumpState D;
   D.L = L;
   D.writer = w;
   D.data = data;
   D.strip = strip;
+  D.aligned = (aligned != 0);
+  D.fused = (aligned == LUA_DUMPFUSED);
   D.status = 0;
+  D.offset = 0;
   dumpHeader(&D);
   dumpByte(&D, f->sizeupvalues);
   dumpFunction(&D, f, NULL);
@@ -116,12 +116,6 @@ static void entersweep (lua_State *L);
 */
 
 
-/*
-** one after last element in a hash array
-*/
-#define gnodelast(h)	gnode(h, cast_sizet(sizenode(h)))
-
-
 static GCObject **getgclist (GCObject *o) {
   switch (o->tt) {
     case LUA_VTABLE: return &gco2t(o)->gclist;
@@ -444,18 +438,21 @@ static void genlink (global_State *g, GCObject *o) {
 ** put it in 'weak' list, to be cleared.
 */
 static void traverseweakvalue (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
+  int p;
   /* if there is array part, assume it may have white values (it is not
      worth traversing it now just to check) */
   int hasclears = (h->alimit > 0);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else {
-      lua_assert(!keyisnil(n));
-      markkey(g, n);
-      if (!hasclears && iscleared(g, gcvalueN(gval(n))))  /* a white value? */
-        hasclears = 1;  /* table will have to be cleared */
+  for (p = 0; p < hashparts(h); p++) {  /* traverse hash part */
+    Node *n, *limit = hashpart(h, p) + hashpartsize(h, p);
+    for (n = hashpart(h, p); n < limit; n++) {
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else {
+        lua_assert(!keyisnil(n));
+        markkey(g, n);
+        if (!hasclears && iscleared(g, gcvalueN(gval(n))))  /* a white value? */
+          hasclears = 1;  /* table will have to be cleared */
+      }
     }
   }
   if (g->gcstate == GCSatomic && hasclears)
@@ -483,7 +480,7 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
   int hasww = 0;  /* true if table has entry "white-key -> white-value" */
   unsigned int i;
   unsigned int asize = luaH_realasize(h);
-  unsigned int nsize = sizenode(h);
+  int p;
   /* traverse array part */
   for (i = 0; i < asize; i++) {
     if (valiswhite(&h->array[i])) {
@@ -493,18 +490,23 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
   }
   /* traverse hash part; if 'inv', traverse descending
      (see 'convergeephemerons') */
-  for (i = 0; i < nsize; i++) {
-    Node *n = inv ? gnode(h, nsize - 1 - i) : gnode(h, i);
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
-      hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
-        hasww = 1;  /* white-white entry */
-    }
-    else if (valiswhite(gval(n))) {  /* value not marked yet? */
-      marked = 1;
-      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+  for (p = 0; p < hashparts(h); p++) {
+    int part = inv ? hashparts(h) - 1 - p : p;
+    Node *node = hashpart(h, part);
+    unsigned int nsize = hashpartsize(h, part);
+    for (i = 0; i < nsize; i++) {
+      Node *n = inv ? node + (nsize - 1 - i) : node + i;
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
+        hasclears = 1;  /* table must be cleared */
+        if (valiswhite(gval(n)))  /* value not marked yet? */
+          hasww = 1;  /* white-white entry */
+      }
+      else if (valiswhite(gval(n))) {  /* value not marked yet? */
+        marked = 1;
+        reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+      }
     }
   }
   /* link table into proper list */
@@ -521,18 +523,21 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
 
 
 static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
   unsigned int i;
   unsigned int asize = luaH_realasize(h);
+  int p;
   for (i = 0; i < asize; i++)  /* traverse array part */
     markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    if (isempty(gval(n)))  /* entry is empty? */
-      clearkey(n);  /* clear its key */
-    else {
-      lua_assert(!keyisnil(n));
-      markkey(g, n);
-      markvalue(g, gval(n));
+  for (p = 0; p < hashparts(h); p++) {  /* traverse hash part */
+    Node *n, *limit = hashpart(h, p) + hashpartsize(h, p);
+    for (n = hashpart(h, p); n < limit; n++) {
+      if (isempty(gval(n)))  /* entry is empty? */
+        clearkey(n);  /* clear its key */
+      else {
+        lua_assert(!keyisnil(n));
+        markkey(g, n);
+        markvalue(g, gval(n));
+      }
     }
   }
   genlink(g, obj2gco(h));
@@ -725,13 +730,15 @@ static void convergeephemerons (global_State *g) {
 static void clearbykeys (global_State *g, GCObject *l) {
   for (; l; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *limit = gnodelast(h);
-    Node *n;
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (iscleared(g, gckeyN(n)))  /* unmarked key? */
-        setempty(gval(n));  /* remove entry */
-      if (isempty(gval(n)))  /* is entry empty? */
-        clearkey(n);  /* clear its key */
+    int p;
+    for (p = 0; p < hashparts(h); p++) {
+      Node *n, *limit = hashpart(h, p) + hashpartsize(h, p);
+      for (n = hashpart(h, p); n < limit; n++) {
+        if (iscleared(g, gckeyN(n)))  /* unmarked key? */
+          setempty(gval(n));  /* remove entry */
+        if (isempty(gval(n)))  /* is entry empty? */
+          clearkey(n);  /* clear its key */
+      }
     }
   }
 }
@@ -744,19 +751,22 @@ static void clearbykeys (global_State *g, GCObject *l) {
 static void clearbyvalues (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
     unsigned int i;
     unsigned int asize = luaH_realasize(h);
+    int p;
     for (i = 0; i < asize; i++) {
       TValue *o = &h->array[i];
       if (iscleared(g, gcvalueN(o)))  /* value was collected? */
         setempty(o);  /* remove entry */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
-        setempty(gval(n));  /* remove entry */
-      if (isempty(gval(n)))  /* is entry empty? */
-        clearkey(n);  /* clear its key */
+    for (p = 0; p < hashparts(h); p++) {
+      Node *n, *limit = hashpart(h, p) + hashpartsize(h, p);
+      for (n = hashpart(h, p); n < limit; n++) {
+        if (iscleared(g, gcvalueN(gval(n))))  /* unmarked value? */
+          setempty(gval(n));  /* remove entry */
+        if (isempty(gval(n)))  /* is entry empty? */
+          clearkey(n);  /* clear its key */
+      }
     }
   }
 }
@@ -801,12 +811,11 @@ static void freeobj (lua_State *L, GCObject *o) {
     case LUA_VSHRSTR: {
       TString *ts = gco2ts(o);
       luaS_remove(L, ts);  /* remove it from hash table */
-      luaM_freemem(L, ts, sizelstring(ts->shrlen));
+      luaM_freemem(L, ts, sizeshrstr(ts->shrlen));
       break;
     }
     case LUA_VLNGSTR: {
-      TString *ts = gco2ts(o);
-      luaM_freemem(L, ts, sizelstring(ts->u.lnglen));
+      luaS_freelngstr(L, gco2ts(o));
       break;
     }
     default: lua_assert(0);
@@ -814,6 +823,29 @@ static void freeobj (lua_State *L, GCObject *o) {
 }
 
 
+/*
+** Free an object found dead by a sweep. With a sweep function (see
+** 'lua_setsweepf'), the memory of the object goes through it instead
+** of the allocator; everything else 'freeobj' does (removing strings
+** from the string table, closing upvalues, releasing external strings)
+** still happens here. 'freeobj' never allocates, so the swap is safe.
+*/
+static void freedeadobj (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  if (g->sweepf == NULL)
+    freeobj(L, o);
+  else {
+    lua_Alloc f = g->frealloc;
+    void *ud = g->ud;
+    g->frealloc = g->sweepf;
+    g->ud = g->sweepud;
+    freeobj(L, o);
+    g->frealloc = f;
+    g->ud = ud;
+  }
+}
+
+
 /*
 ** sweep at most 'countin' elements from a list of GCObjects erasing dead
 ** objects, where a dead object is one marked with the old (non current)
@@ -832,7 +864,7 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, int countin,
     int marked = curr->marked;
     if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
       *p = curr->next;  /* remove 'curr' from list */
-      freeobj(L, curr);  /* erase 'curr' */
+      freedeadobj(L, curr);  /* erase 'curr' */
     }
     else {  /* change mark to 'white' */
       curr->marked = cast_byte((marked & ~maskgcbits) | white);
@@ -1083,7 +1115,7 @@ static void sweep2old (lua_State *L, GCObject **p) {
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
-      freeobj(L, curr);  /* erase 'curr' */
+      freedeadobj(L, curr);  /* erase 'curr' */
     }
     else {  /* all surviving objects become old */
       setage(curr, G_OLD);
@@ -1129,7 +1161,7 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(!isold(curr) && isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
-      freeobj(L, curr);  /* erase 'curr' */
+      freedeadobj(L, curr);  /* erase 'curr' */
     }
     else {  /* correct mark and age */
       if (getage(curr) == G_NEW) {  /* new objects go back to white */
@@ -381,7 +381,11 @@ typedef struct GCObject {
 
 
 /*
-** Header for a string value.
+** Header for a string value. The bytes of a short string start at
+** field 'contents' itself. A long string keeps its bytes wherever
+** 'contents' points: right after the field (regular strings, which do
+** not have fields 'falloc' and 'ud') or in a buffer owned by someone
+** else (external strings).
 */
 typedef struct TString {
   CommonHeader;
@@ -392,18 +396,27 @@ typedef struct TString {
     size_t lnglen;  /* length for long strings */
     struct TString *hnext;  /* linked list for hash table */
   } u;
-  char contents[1];
+  char *contents;  /* pointer to the bytes of a long string */
+  lua_Alloc falloc;  /* release function for external strings (or NULL) */
+  void *ud;  /* user data for 'falloc' */
 } TString;
 
 
+#define strisshr(ts)	((ts)->shrlen != 0xFF)
+
+/* true for long strings whose bytes live outside the object */
+#define strisext(ts)  \
+	(!strisshr(ts) && (ts)->contents != cast_charp(&(ts)->falloc))
+
 
 /*
 ** Get the actual string (array of bytes) from a 'TString'. (Generic
 ** version and specialized versions for long and short strings.)
 */
-#define getstr(ts)	((ts)->contents)
-#define getlngstr(ts)	check_exp((ts)->shrlen == 0xFF, (ts)->contents)
-#define getshrstr(ts)	check_exp((ts)->shrlen != 0xFF, (ts)->contents)
+#define rawgetshrstr(ts)	(cast_charp(&(ts)->contents))
+#define getshrstr(ts)	check_exp(strisshr(ts), rawgetshrstr(ts))
+#define getlngstr(ts)	check_exp(!strisshr(ts), (ts)->contents)
+#define getstr(ts)	(strisshr(ts) ? rawgetshrstr(ts) : (ts)->contents)
 
 
 /* get string length from 'TString *s' */
@@ -547,11 +560,18 @@ typedef struct AbsLineInfo {
 /*
 ** Function Prototypes
 */
+/* bits in 'flag' of a Proto */
+#define PF_FIXEDCODE	1  /* 'code' lives in an external (loaded) buffer */
+#define PF_FIXEDLINE	2  /* 'lineinfo' lives in an external (loaded) buffer */
+#define PF_FUSED	4  /* 'code' has superinstructions */
+
+
 typedef struct Proto {
   CommonHeader;
   lu_byte numparams;  /* number of fixed (named) parameters */
   lu_byte is_vararg;
   lu_byte maxstacksize;  /* number of registers needed by this function */
+  lu_byte flag;  /* PF_* bits */
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of 'k' */
   int sizecode;
@@ -563,6 +583,7 @@ typedef struct Proto {
   int lastlinedefined;  /* debug information  */
   TValue *k;  /* constants used by the function */
   Instruction *code;  /* opcodes */
+  unsigned int *icache;  /* per-instruction inline caches (node indices) */
   struct Proto **p;  /* functions defined inside the function */
   Upvaldesc *upvalues;  /* upvalue information */
   ls_byte *lineinfo;  /* information about source lines (debug information) */
@@ -738,10 +759,19 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of 'node' array */
+#if defined(LUAI_OPENHASH)
+  lu_byte lsizeold;  /* log2 of size of 'oldnode' array */
+#endif
   unsigned int alimit;  /* "limit" of 'array' array */
   TValue *array;  /* array part */
   Node *node;
+#if !defined(LUAI_OPENHASH)
   Node *lastfree;  /* any free position is before this position */
+#else
+  unsigned int hfree;  /* never-used nodes that can still take keys */
+  unsigned int hmoved;  /* nodes of 'oldnode' already moved to 'node' */
+  Node *oldnode;  /* hash part being moved into 'node' (or NULL) */
+#endif
   struct Table *metatable;
   GCObject *gclist;
 } Table;
@@ -100,5 +100,50 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_VARARG */
  ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
  ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABUPF */
 };
 
+
+LUAI_DDEF const lu_byte luaP_fusedbase[NUM_OPCODES - NUM_BASEOPCODES] = {
+  OP_GETTABUP		/* OP_GETTABUPF */
+};
+
+
+#if !defined(LUAI_NOFUSE)
+
+/*
+** Peephole pass over complete code: turn the first instruction of each
+** sequence that has a superinstruction into that superinstruction.
+** (Fusing only changes opcodes, so it can run on any valid code, as
+** long as nothing else rewrites it later.) Returns the number of
+** superinstructions created.
+*/
+int luaP_fuse (Instruction *code, int n) {
+  int pc;
+  int nfused = 0;
+  for (pc = 0; pc + 1 < n; pc++) {
+    OpCode next = luaP_unfuse(GET_OPCODE(code[pc + 1]));
+    OpCode fused;
+    switch (GET_OPCODE(code[pc])) {
+      case OP_GETTABUP:  /* global table, then a field: 'math.floor' */
+        fused = (next == OP_GETFIELD) ? OP_GETTABUPF : OP_GETTABUP;
+        break;
+      default: continue;
+    }
+    if (fused != GET_OPCODE(code[pc])) {
+      SET_OPCODE(code[pc], fused);
+      nfused++;
+    }
+  }
+  return nfused;
+}
+
+#else
+
+int luaP_fuse (Instruction *code, int n) {
+  UNUSED(code); UNUSED(n);
+  return 0;  /* superinstructions disabled */
+}
+
+#endif
+
@@ -306,11 +306,15 @@ OP_VARARG,/*	A C	R[A], R[A+1], ..., R[A+C-2] = vararg		*/
 
 OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* superinstructions (see 'luaP_fuse') */
+OP_GETTABUPF/*	A B C	OP_GETTABUP; then the next OP_GETFIELD		*/
 } OpCode;
 
 
-#define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES	((int)(OP_GETTABUPF) + 1)
+#define NUM_BASEOPCODES	((int)(OP_EXTRAARG) + 1)  /* without fused ones */
 
 
 
@@ -365,6 +369,12 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) A superinstruction replaces only the opcode of the first
+  instruction of a sequence; the other instructions stay in place.
+  It behaves like its base opcode and then, when nothing is being
+  traced, runs the rest of the sequence without dispatching it. So, jumps into the sequence, hooks, and debug information
+  see ordinary code. Dumps always use the base opcodes.
+
 ===========================================================================*/
 
 
@@ -379,6 +389,7 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 */
 
 LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
+LUAI_DDEC(const lu_byte luaP_fusedbase[NUM_OPCODES - NUM_BASEOPCODES];)
 
 #define getOpMode(m)	(cast(enum OpMode, luaP_opmodes[m] & 7))
 #define testAMode(m)	(luaP_opmodes[m] & (1 << 3))
@@ -402,4 +413,12 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 /* number of list items to accumulate before a SETLIST instruction */
 #define LFIELDS_PER_FLUSH	50
 
+/* base opcode of a (possibly fused) opcode */
+#define luaP_unfuse(o)  \
+	((o) < NUM_BASEOPCODES ? (o) \
+	 : cast(OpCode, luaP_fusedbase[(o) - NUM_BASEOPCODES]))
+
+LUAI_FUNC int luaP_fuse (Instruction *code, int n);
+
+
 #endif
@@ -96,6 +96,7 @@ static const char *const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+  "GETTABUPF",
   NULL
 };
 
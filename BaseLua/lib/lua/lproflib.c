@@ -0,0 +1,580 @@
+/*
+** $Id: lproflib.c $
+** Sampling profiler with folded-stack output
+** See Copyright Notice in lua.h
+*/
+
+#define lproflib_c
+#define LUA_LIB
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /* for 'syscall' */
+#endif
+
+#include "lprefix.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** A timer ticks at the sampling rate. Each tick only arms a count
+** hook (the same trick 'lua.c' uses to stop a script on a signal);
+** the hook then runs in the profiled thread at its next instruction,
+** disarms itself, walks the stack, and adds one sample to a hash table
+** keyed by the folded stack ("outer;...;inner"). Between samples the
+** interpreter runs with no hook at all. Only one state can be profiled
+** at a time. The profiler uses the state's hook, so it cannot be used
+** together with 'debug.sethook'; time spent in coroutines is charged
+** to the 'resume' that runs them.
+*/
+
+
+/* maximum number of frames kept in a sample (innermost ones) */
+#if !defined(PROF_MAXDEPTH)
+#define PROF_MAXDEPTH	64
+#endif
+
+/* maximum length of a folded stack */
+#define PROF_MAXLINE	2048
+
+#define PROF_DEFHZ	1000
+
+#define PROFILE	"_PROFILE"
+
+
+/*
+** {======================================================
+** Timers
+** =======================================================
+*/
+
+static void arm (void);
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+static HANDLE timer = NULL;
+
+static VOID CALLBACK ontick (PVOID param, BOOLEAN fired) {
+  (void)param; (void)fired;
+  arm();
+}
+
+/* there are no CPU-time timers: always sample by elapsed time */
+static int starttimer (int hz, int cpu) {
+  DWORD ms = (DWORD)(1000 / hz);
+  (void)cpu;
+  if (ms == 0) ms = 1;
+  return CreateTimerQueueTimer(&timer, NULL, ontick, NULL, ms, ms,
+                               WT_EXECUTEINTIMERTHREAD);
+}
+
+static void stoptimer (void) {
+  /* INVALID_HANDLE_VALUE: wait for a running callback to finish */
+  DeleteTimerQueueTimer(NULL, timer, INVALID_HANDLE_VALUE);
+  timer = NULL;
+}
+
+#elif defined(LUA_USE_POSIX) || defined(__unix__) || defined(__APPLE__)
+
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+#if defined(__linux__) && defined(SIGEV_THREAD_ID)
+#include <unistd.h>
+#include <sys/syscall.h>
+#define PROF_THREADTIMER
+#if !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id	_sigev_un._tid
+#endif
+#endif
+
+static void ontick (int sig) {
+  (void)sig;
+  arm();
+}
+
+static int profsig;  /* signal sent by the running timer */
+static struct sigaction oldact;  /* its handler before 'starttimer' */
+
+/*
+** On Linux the timer measures the CPU time (or the elapsed time) of
+** the thread that starts the profiler and signals only that thread, so
+** other threads of the process neither stop for ticks nor add to the
+** sampled time. Elsewhere it is a process timer (ITIMER_PROF or
+** ITIMER_REAL). CPU-time timers tick at most once per kernel tick,
+** which is often less than 1 kHz. The previous handler of the signal
+** (and, for process timers, the previous timer) is restored when the
+** profiler stops; stop it from the thread that started it.
+*/
+#if defined(PROF_THREADTIMER)
+
+static timer_t timer;
+
+static int starttimer (int hz, int cpu) {
+  struct sigaction sa;
+  struct sigevent sev;
+  struct itimerspec its;
+  profsig = SIGPROF;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = profsig;
+  sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+  sa.sa_handler = ontick;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(profsig, &sa, &oldact) != 0)
+    return 0;
+  if (timer_create(cpu ? CLOCK_THREAD_CPUTIME_ID : CLOCK_MONOTONIC,
+                   &sev, &timer) != 0) {
+    sigaction(profsig, &oldact, NULL);
+    return 0;
+  }
+  its.it_interval.tv_sec = 1 / hz;
+  its.it_interval.tv_nsec = (1000000000L / hz) % 1000000000L;
+  its.it_value = its.it_interval;
+  if (timer_settime(timer, 0, &its, NULL) != 0) {
+    timer_delete(timer);
+    sigaction(profsig, &oldact, NULL);
+    return 0;
+  }
+  return 1;
+}
+
+static void disarm (void) {
+  timer_delete(timer);
+}
+
+#else
+
+static int timerkind;
+static struct itimerval oldtimer;  /* timer before 'starttimer' */
+
+static int starttimer (int hz, int cpu) {
+  struct sigaction sa;
+  struct itimerval it;
+  profsig = cpu ? SIGPROF : SIGALRM;
+  timerkind = cpu ? ITIMER_PROF : ITIMER_REAL;
+  sa.sa_handler = ontick;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(profsig, &sa, &oldact) != 0)
+    return 0;
+  it.it_interval.tv_sec = 1 / hz;
+  it.it_interval.tv_usec = (1000000 / hz) % 1000000;
+  it.it_value = it.it_interval;
+  if (setitimer(timerkind, &it, &oldtimer) != 0) {
+    sigaction(profsig, &oldact, NULL);
+    return 0;
+  }
+  return 1;
+}
+
+static void disarm (void) {
+  struct itimerval it;
+  memset(&it, 0, sizeof(it));
+  setitimer(timerkind, &it, NULL);
+}
+
+#endif
+
+/*
+** A tick may still be pending after the timer is disarmed; it is
+** consumed here, so that it does not reach the previous handler (which
+** may be the default one, that terminates the process).
+*/
+static void stoptimer (void) {
+  sigset_t set, old, pending;
+  int sig;
+  disarm();
+  sigemptyset(&set);
+  sigaddset(&set, profsig);
+  sigprocmask(SIG_BLOCK, &set, &old);
+  while (sigpending(&pending) == 0 && sigismember(&pending, profsig))
+    sigwait(&set, &sig);
+  sigaction(profsig, &oldact, NULL);
+#if !defined(PROF_THREADTIMER)
+  setitimer(timerkind, &oldtimer, NULL);
+#endif
+  sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+#else  /* no timers: sample every PROF_COUNT instructions */
+
+#define PROF_COUNT	10000
+
+static int starttimer (int hz, int cpu) {
+  (void)hz; (void)cpu;
+  arm();
+  return 1;
+}
+
+static void stoptimer (void) { }
+
+#endif
+
+/* }====================================================== */
+
+
+
+typedef struct Stack {
+  struct Stack *next;  /* next entry in the same bucket */
+  size_t count;  /* number of samples with this stack */
+  unsigned int hash;
+  size_t len;
+  char line[1];  /* folded stack (variable length) */
+} Stack;
+
+
+typedef struct Profile {
+  lua_State *L;  /* profiled thread */
+  Stack **hash;  /* hash table of stacks */
+  int size;  /* size of 'hash' (0 or a power of 2) */
+  int nuse;  /* number of entries in 'hash' */
+  size_t nsamples;
+  size_t nlost;  /* samples dropped for lack of memory */
+  int running;
+  char line[PROF_MAXLINE];  /* folded stack being built */
+} Profile;
+
+
+/* profile being sampled; written only while its timer is stopped */
+static Profile *volatile active = NULL;
+
+
+static void sample (lua_State *L, lua_Debug *ar);
+
+
+static void arm (void) {
+  Profile *P = active;
+  if (P != NULL)
+#if defined(PROF_COUNT)
+    lua_sethook(P->L, sample, LUA_MASKCOUNT, PROF_COUNT);
+#else
+    lua_sethook(P->L, sample, LUA_MASKCOUNT, 1);
+#endif
+}
+
+
+static void *profalloc (lua_State *L, void *p, size_t osize, size_t nsize) {
+  void *ud;
+  lua_Alloc f = lua_getallocf(L, &ud);
+  return f(ud, p, osize, nsize);
+}
+
+
+static void freestacks (lua_State *L, Profile *P) {
+  int i;
+  for (i = 0; i < P->size; i++) {
+    Stack *s = P->hash[i];
+    while (s != NULL) {
+      Stack *next = s->next;
+      profalloc(L, s, offsetof(Stack, line) + s->len + 1, 0);
+      s = next;
+    }
+  }
+  profalloc(L, P->hash, P->size * sizeof(Stack *), 0);
+  P->hash = NULL;
+  P->size = P->nuse = 0;
+  P->nsamples = P->nlost = 0;
+}
+
+
+static int growhash (lua_State *L, Profile *P) {
+  int nsize = (P->size == 0) ? 64 : 2 * P->size;
+  int i;
+  Stack **nh = (Stack **)profalloc(L, NULL, 0, nsize * sizeof(Stack *));
+  if (nh == NULL)
+    return 0;
+  memset(nh, 0, nsize * sizeof(Stack *));
+  for (i = 0; i < P->size; i++) {
+    Stack *s = P->hash[i];
+    while (s != NULL) {
+      Stack *next = s->next;
+      Stack **b = &nh[s->hash & (nsize - 1)];
+      s->next = *b;
+      *b = s;
+      s = next;
+    }
+  }
+  profalloc(L, P->hash, P->size * sizeof(Stack *), 0);
+  P->hash = nh;
+  P->size = nsize;
+  return 1;
+}
+
+
+static void addstack (lua_State *L, Profile *P, size_t len) {
+  unsigned int h = 2166136261u;  /* FNV-1a */
+  size_t i;
+  Stack *s;
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char)P->line[i]) * 16777619u;
+  if (P->size > 0) {
+    for (s = P->hash[h & (P->size - 1)]; s != NULL; s = s->next) {
+      if (s->hash == h && s->len == len && memcmp(s->line, P->line, len) == 0) {
+        s->count++;
+        return;
+      }
+    }
+  }
+  if ((P->nuse >= P->size && !growhash(L, P)) ||
+      (s = (Stack *)profalloc(L, NULL, 0, offsetof(Stack, line) + len + 1))
+         == NULL) {
+    P->nlost++;
+    return;
+  }
+  s->count = 1;
+  s->hash = h;
+  s->len = len;
+  memcpy(s->line, P->line, len);
+  s->line[len] = '\0';
+  s->next = P->hash[h & (P->size - 1)];
+  P->hash[h & (P->size - 1)] = s;
+  P->nuse++;
+}
+
+
+/*
+** Append the name of the function in 'ar' to the folded stack, which
+** has 'n' bytes. Semicolons would split the frame, so they are
+** replaced.
+*/
+static size_t addframe (Profile *P, size_t n, lua_Debug *ar) {
+  size_t room = PROF_MAXLINE - n;
+  const char *name = (ar->name != NULL) ? ar->name : "?";
+  int l;
+  if (*ar->what == 'C')
+    l = snprintf(P->line + n, room, "%s [C]", name);
+  else if (*ar->what == 'm')
+    l = snprintf(P->line + n, room, "main chunk (%s)", ar->short_src);
+  else
+    l = snprintf(P->line + n, room, "%s (%s:%d)",
+                 name, ar->short_src, ar->linedefined);
+  if (l < 0)
+    return n;
+  l = ((size_t)l < room) ? l : (int)room - 1;
+  for (; l > 0; l--, n++) {
+    if (P->line[n] == ';' || P->line[n] == '\n')
+      P->line[n] = ':';
+  }
+  return n;
+}
+
+
+static void sample (lua_State *L, lua_Debug *ar) {
+  Profile *P = active;
+  size_t n = 0;
+  int depth = 0;
+  int level;
+  (void)ar;
+#if !defined(PROF_COUNT)
+  lua_sethook(L, NULL, 0, 0);  /* wait for next tick */
+#endif
+  if (P == NULL || P->L != L)
+    return;
+  while (depth < PROF_MAXDEPTH && lua_getstack(L, depth, ar))
+    depth++;
+  if (depth == PROF_MAXDEPTH && lua_getstack(L, depth, ar)) {
+    memcpy(P->line, "...;", 4);  /* stack was truncated */
+    n = 4;
+  }
+  for (level = depth - 1; level >= 0; level--) {
+    lua_getstack(L, level, ar);
+    lua_getinfo(L, "Sn", ar);
+    n = addframe(P, n, ar);
+    if (level > 0 && n < PROF_MAXLINE - 1)
+      P->line[n++] = ';';
+  }
+  P->nsamples++;
+  addstack(L, P, n);
+}
+
+
+static void stopprofile (Profile *P) {
+  if (P->running) {
+    stoptimer();
+    active = NULL;
+    lua_sethook(P->L, NULL, 0, 0);
+    P->running = 0;
+  }
+}
+
+
+static int profile_gc (lua_State *L) {
+  Profile *P = (Profile *)lua_touserdata(L, 1);
+  stopprofile(P);
+  freestacks(L, P);
+  return 0;
+}
+
+
+/*
+** Get the profile of state 'L' (creating it if 'create').
+*/
+static Profile *getprofile (lua_State *L, int create) {
+  Profile *P;
+  lua_getfield(L, LUA_REGISTRYINDEX, PROFILE);
+  P = (Profile *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (P == NULL && create) {
+    P = (Profile *)lua_newuserdatauv(L, sizeof(Profile), 0);
+    memset(P, 0, offsetof(Profile, line));
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, profile_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_setfield(L, LUA_REGISTRYINDEX, PROFILE);
+  }
+  return P;
+}
+
+
+/*
+** Start sampling the main thread of 'L' 'hz' times per second (of CPU
+** time if 'cpu' and the platform has such timers, of elapsed time
+** otherwise), discarding previous samples. Returns 0 if another state
+** is being profiled or the timer cannot be started.
+*/
+LUALIB_API int luaL_profstart (lua_State *L, int hz, int cpu) {
+  Profile *P = getprofile(L, 1);
+  if (active != NULL)
+    return (active == P);
+  freestacks(L, P);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  P->L = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  if (hz <= 0)
+    hz = PROF_DEFHZ;
+  active = P;
+  if (!starttimer(hz, cpu != 0)) {
+    active = NULL;
+    return 0;
+  }
+  P->running = 1;
+  return 1;
+}
+
+
+/*
+** Stop sampling; the samples are kept until the next start. Returns
+** the number of samples taken.
+*/
+LUALIB_API size_t luaL_profstop (lua_State *L) {
+  Profile *P = getprofile(L, 0);
+  if (P == NULL)
+    return 0;
+  stopprofile(P);
+  return P->nsamples;
+}
+
+
+/*
+** Write the samples to 'f' in folded-stack format, one stack per
+** line followed by its count, as read by flame-graph tools.
+*/
+LUALIB_API void luaL_profdump (lua_State *L, FILE *f) {
+  Profile *P = getprofile(L, 0);
+  int i;
+  if (P == NULL)
+    return;
+  for (i = 0; i < P->size; i++) {
+    Stack *s;
+    for (s = P->hash[i]; s != NULL; s = s->next)
+      fprintf(f, "%s %lu\n", s->line, (unsigned long)s->count);
+  }
+}
+
+
+
+/*
+** start([hz [, clock]]): 'clock' is "real" (elapsed time, default) or
+** "cpu" (CPU time). CPU-time timers tick at most once per kernel tick
+** (often 250 Hz), so with "cpu" a rate above that gives fewer samples
+** than asked for.
+*/
+static int prof_start (lua_State *L) {
+  static const char *const clocks[] = {"real", "cpu", NULL};
+  int hz = (int)luaL_optinteger(L, 1, PROF_DEFHZ);
+  int cpu = luaL_checkoption(L, 2, "real", clocks);
+  luaL_argcheck(L, 0 < hz && hz <= 100000, 1, "invalid frequency");
+  if (!luaL_profstart(L, hz, cpu))
+    return luaL_error(L, "cannot start profiler");
+  return 0;
+}
+
+
+static int prof_stop (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)luaL_profstop(L));
+  return 1;
+}
+
+
+/*
+** dump([filename]): write the folded stacks to a file or, without a
+** file name, return them as a string.
+*/
+static int prof_dump (lua_State *L) {
+  const char *fname = luaL_optstring(L, 1, NULL);
+  if (fname != NULL) {
+    FILE *f = fopen(fname, "w");
+    if (f == NULL)
+      return luaL_fileresult(L, 0, fname);
+    luaL_profdump(L, f);
+    return luaL_fileresult(L, fclose(f) == 0, fname);
+  }
+  else {
+    Profile *P = getprofile(L, 0);
+    luaL_Buffer b;
+    int i;
+    luaL_buffinit(L, &b);
+    for (i = 0; P != NULL && i < P->size; i++) {
+      Stack *s;
+      for (s = P->hash[i]; s != NULL; s = s->next) {
+        luaL_addlstring(&b, s->line, s->len);
+        lua_pushfstring(L, " %I\n", (LUAI_UACINT)s->count);
+        luaL_addvalue(&b);
+      }
+    }
+    luaL_pushresult(&b);
+    return 1;
+  }
+}
+
+
+/*
+** stats(): number of samples, number of distinct stacks, and number of
+** samples dropped for lack of memory.
+*/
+static int prof_stats (lua_State *L) {
+  Profile *P = getprofile(L, 0);
+  lua_pushinteger(L, P ? (lua_Integer)P->nsamples : 0);
+  lua_pushinteger(L, P ? P->nuse : 0);
+  lua_pushinteger(L, P ? (lua_Integer)P->nlost : 0);
+  return 3;
+}
+
+
+static const luaL_Reg prof_funcs[] = {
+  {"start", prof_start},
+  {"stop", prof_stop},
+  {"dump", prof_dump},
+  {"stats", prof_stats},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_profile (lua_State *L) {
+  luaL_newlib(L, prof_funcs);
+  return 1;
+}
+
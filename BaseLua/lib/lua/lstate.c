@@ -377,6 +377,8 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   incnny(L);  /* main thread is always non yieldable */
   g->frealloc = f;
   g->ud = ud;
+  g->sweepf = NULL;
+  g->sweepud = NULL;
   g->warnf = NULL;
   g->ud_warn = NULL;
   g->mainthread = L;
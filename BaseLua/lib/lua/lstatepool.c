@@ -0,0 +1,411 @@
+/*
+** $Id: lstatepool.c $
+** Pool of pre-initialized Lua states run by worker threads
+** See Copyright Notice in lua.h
+*/
+
+#define lstatepool_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lthreads.h"
+
+
+/*
+** Each worker thread owns one state for its whole life, so states are
+** never shared between threads. Workers take jobs from a single FIFO
+** queue; a worker waiting on the queue is an idle state. Between jobs
+** a state is only reset: its stack is emptied and its global table is
+** restored from a shallow snapshot taken after initialization (new
+** globals are removed, changed or removed ones get back their initial
+** values). Modules loaded by jobs stay loaded. The snapshot and the
+** reset run in protected mode. A state is rebuilt from scratch after a
+** memory error, when it cannot be reset, or every LUAL_STATEPOOLRECYCLE
+** jobs.
+*/
+
+
+#define GLOBALS		"_STATEPOOLGLOBALS"
+
+/* latency histogram: LAT_SUB bins per power of 2 of nanoseconds */
+#define LAT_SUB		4
+#define LAT_BINS	(64 * LAT_SUB)
+
+
+/*
+** {======================================================
+** Clocks
+** =======================================================
+*/
+
+#if defined(_WIN32)
+
+static double now (void) {
+  static LARGE_INTEGER freq = {0};
+  LARGE_INTEGER c;
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&c);
+  return (double)c.QuadPart / (double)freq.QuadPart;
+}
+
+#else
+
+#include <time.h>
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#endif
+
+/* }====================================================== */
+
+
+
+typedef struct Job {
+  struct Job *next;
+  luaL_StateJob f;
+  void *arg;
+  double submitted;  /* time when the job entered the queue */
+} Job;
+
+
+typedef struct Worker {
+  luaL_StatePool *SP;
+  lua_State *L;
+  l_thread thread;
+  unsigned long njobs;  /* jobs run by the current state */
+} Worker;
+
+
+struct luaL_StatePool {
+  l_mutex lock;  /* protects all fields below except 'workers' */
+  l_cond hasjob;  /* signaled when a job is queued or the pool closes */
+  l_cond alldone;  /* signaled when 'pending' drops to 0 */
+  Job *head, *tail;  /* queue of jobs not yet started */
+  Job *freejobs;  /* list of free Job blocks */
+  size_t pending;  /* jobs queued or running */
+  int closing;
+  int nworkers;
+  Worker *workers;
+  luaL_StateInit init;
+  void *ud;
+  size_t done, failed, restarts;
+  size_t lat[LAT_BINS];  /* histogram of submit-to-finish latencies */
+  double maxlat;
+};
+
+
+/* take the snapshot of the global table (called in protected mode) */
+static int snapshot (lua_State *L) {
+  lua_newtable(L);  /* 1 */
+  lua_pushglobaltable(L);  /* 2 */
+  lua_pushnil(L);
+  while (lua_next(L, 2)) {
+    lua_pushvalue(L, -2);
+    lua_insert(L, -2);
+    lua_rawset(L, 1);
+  }
+  lua_pop(L, 1);
+  lua_setfield(L, LUA_REGISTRYINDEX, GLOBALS);
+  return 0;
+}
+
+
+/*
+** Create and initialize a new state for the pool: libraries, then the
+** user's initialization, then the snapshot of its globals. Returns
+** NULL on errors.
+*/
+static lua_State *newstate (luaL_StatePool *SP) {
+  lua_State *L = luaL_newpoolstate(0);
+  if (L == NULL)
+    return NULL;
+  luaL_openlibs(L);
+  if (SP->init != NULL && SP->init(L, SP->ud) != LUA_OK) {
+    lua_close(L);
+    return NULL;
+  }
+  lua_settop(L, 0);
+  lua_pushcfunction(L, snapshot);
+  if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+    lua_close(L);
+    return NULL;
+  }
+  return L;
+}
+
+
+/*
+** Bring the globals back to their snapshot (called in protected mode).
+** Assigning to existing fields during a traversal is allowed, so the
+** first loop can reset changed entries (including setting new ones to
+** nil).
+*/
+static int doreset (lua_State *L) {
+  lua_pushglobaltable(L);  /* 1 */
+  lua_getfield(L, LUA_REGISTRYINDEX, GLOBALS);  /* 2 */
+  lua_pushnil(L);
+  while (lua_next(L, 1)) {  /* for each global (key at 3, value at 4) */
+    lua_pushvalue(L, 3);
+    lua_rawget(L, 2);  /* initial value (or nil) */
+    if (!lua_rawequal(L, 4, 5)) {
+      lua_pushvalue(L, 3);
+      lua_insert(L, 5);
+      lua_rawset(L, 1);  /* restore it */
+    }
+    lua_settop(L, 3);
+  }
+  lua_pushnil(L);
+  while (lua_next(L, 2)) {  /* for each initial global */
+    lua_pushvalue(L, 3);
+    if (lua_rawget(L, 1) == LUA_TNIL) {  /* removed by a job? */
+      lua_pushvalue(L, 3);
+      lua_pushvalue(L, 4);
+      lua_rawset(L, 1);
+    }
+    lua_settop(L, 3);
+  }
+  return 0;
+}
+
+
+/*
+** Empty the stack of 'L' and reset its globals. A failure (e.g., no
+** memory for a restored entry) leaves the globals half reset, so the
+** caller must drop the state.
+*/
+static int resetstate (lua_State *L) {
+  int status;
+  lua_settop(L, 0);
+  lua_pushcfunction(L, doreset);
+  status = lua_pcall(L, 0, 0, 0);
+  lua_settop(L, 0);
+  return status;
+}
+
+
+static int latbin (double t) {
+  int e;
+  double m = frexp(t * 1e9, &e);  /* t = m * 2^e ns, 0.5 <= m < 1 */
+  int b = (e - 1) * LAT_SUB + (int)((2 * m - 1) * LAT_SUB);
+  return (b < 0) ? 0 : (b >= LAT_BINS) ? LAT_BINS - 1 : b;
+}
+
+
+/* upper limit (in seconds) of the latencies in bin 'b' */
+static double binlimit (int b) {
+  return ldexp(1.0 + (double)(b % LAT_SUB + 1) / LAT_SUB, b / LAT_SUB) * 1e-9;
+}
+
+
+THREADFUNC(workermain) {
+  Worker *w = (Worker *)arg;
+  luaL_StatePool *SP = w->SP;
+  mutexlock(&SP->lock);
+  for (;;) {
+    Job *j;
+    int status, drop;
+    double lat;
+    while (SP->head == NULL && !SP->closing)
+      condwait(&SP->hasjob, &SP->lock);
+    if (SP->head == NULL)  /* closing and nothing left to do? */
+      break;
+    j = SP->head;
+    SP->head = j->next;
+    if (SP->head == NULL)
+      SP->tail = NULL;
+    mutexunlock(&SP->lock);
+    status = (w->L != NULL) ? j->f(w->L, j->arg) : LUA_ERRMEM;
+    drop = (status == LUA_ERRMEM || resetstate(w->L) != LUA_OK ||
+            ++w->njobs >= LUAL_STATEPOOLRECYCLE);
+    lat = now() - j->submitted;
+    if (drop) {
+      if (w->L != NULL)
+        lua_close(w->L);
+      w->L = newstate(SP);  /* may be NULL: jobs fail until it works */
+      w->njobs = 0;
+      mutexlock(&SP->lock);
+      SP->restarts++;
+    }
+    else
+      mutexlock(&SP->lock);
+    j->next = SP->freejobs;
+    SP->freejobs = j;
+    if (status == LUA_OK)
+      SP->done++;
+    else
+      SP->failed++;
+    SP->lat[latbin(lat)]++;
+    if (lat > SP->maxlat)
+      SP->maxlat = lat;
+    if (--SP->pending == 0)
+      condbroadcast(&SP->alldone);
+  }
+  mutexunlock(&SP->lock);
+  if (w->L != NULL) {  /* close it here, so that its slabs are freed */
+    lua_close(w->L);
+    w->L = NULL;
+  }
+  luaL_poolflush();  /* free the slabs this thread kept for later pools */
+  THREADRETURN;
+}
+
+
+static void freepool (luaL_StatePool *SP, int nstarted) {
+  int i;
+  mutexlock(&SP->lock);
+  SP->closing = 1;
+  condbroadcast(&SP->hasjob);
+  mutexunlock(&SP->lock);
+  for (i = 0; i < nstarted; i++)
+    threadjoin(SP->workers[i].thread);
+  for (i = 0; i < SP->nworkers; i++) {
+    if (SP->workers[i].L != NULL)
+      lua_close(SP->workers[i].L);
+  }
+  while (SP->freejobs != NULL) {
+    Job *next = SP->freejobs->next;
+    free(SP->freejobs);
+    SP->freejobs = next;
+  }
+  condfree(&SP->alldone);
+  condfree(&SP->hasjob);
+  mutexfree(&SP->lock);
+  free(SP->workers);
+  free(SP);
+}
+
+
+/*
+** Create a pool of 'n' states, each run by its own thread. Each state
+** gets the standard libraries and then 'init(L, ud)' (if not NULL),
+** which should preload whatever jobs need (e.g., handler functions in
+** the registry) and return LUA_OK. 'init' runs in the calling thread
+** now and in worker threads when a state is rebuilt. Returns NULL if
+** any state or thread cannot be created.
+*/
+LUALIB_API luaL_StatePool *luaL_newstatepool (int n, luaL_StateInit init,
+                                              void *ud) {
+  luaL_StatePool *SP;
+  int i;
+  if (n <= 0)
+    return NULL;
+  SP = (luaL_StatePool *)malloc(sizeof(luaL_StatePool));
+  if (SP == NULL)
+    return NULL;
+  memset(SP, 0, sizeof(luaL_StatePool));
+  SP->workers = (Worker *)calloc((size_t)n, sizeof(Worker));
+  if (SP->workers == NULL || !mutexinit(&SP->lock)) {
+    free(SP->workers);
+    free(SP);
+    return NULL;
+  }
+  (void)condinit(&SP->hasjob);
+  (void)condinit(&SP->alldone);
+  SP->nworkers = n;
+  SP->init = init;
+  SP->ud = ud;
+  for (i = 0; i < n; i++) {
+    Worker *w = &SP->workers[i];
+    w->SP = SP;
+    if ((w->L = newstate(SP)) == NULL) {
+      freepool(SP, 0);
+      return NULL;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    if (!threadstart(&SP->workers[i].thread, workermain, &SP->workers[i])) {
+      freepool(SP, i);
+      return NULL;
+    }
+  }
+  return SP;
+}
+
+
+/*
+** Queue 'job' to run as 'job(L, arg)' on some idle state. The job
+** must return LUA_OK or an error status, and must not keep references
+** to 'L'. Returns 0 if there is no memory for the job.
+*/
+LUALIB_API int luaL_statepoolsubmit (luaL_StatePool *SP, luaL_StateJob job,
+                                     void *arg) {
+  Job *j;
+  mutexlock(&SP->lock);
+  j = SP->freejobs;
+  if (j != NULL)
+    SP->freejobs = j->next;
+  else if ((j = (Job *)malloc(sizeof(Job))) == NULL) {
+    mutexunlock(&SP->lock);
+    return 0;
+  }
+  j->next = NULL;
+  j->f = job;
+  j->arg = arg;
+  j->submitted = now();
+  if (SP->tail != NULL)
+    SP->tail->next = j;
+  else
+    SP->head = j;
+  SP->tail = j;
+  SP->pending++;
+  condsignal(&SP->hasjob);
+  mutexunlock(&SP->lock);
+  return 1;
+}
+
+
+/* wait until all submitted jobs have finished */
+LUALIB_API void luaL_statepoolwait (luaL_StatePool *SP) {
+  mutexlock(&SP->lock);
+  while (SP->pending > 0)
+    condwait(&SP->alldone, &SP->lock);
+  mutexunlock(&SP->lock);
+}
+
+
+LUALIB_API void luaL_statepoolstats (luaL_StatePool *SP,
+                                     luaL_StatePoolStats *st) {
+  size_t total, acc = 0;
+  int b;
+  mutexlock(&SP->lock);
+  st->done = SP->done;
+  st->failed = SP->failed;
+  st->restarts = SP->restarts;
+  st->p50 = st->p99 = 0;
+  st->max = SP->maxlat;
+  total = SP->done + SP->failed;
+  for (b = 0; b < LAT_BINS && total > 0; b++) {
+    acc += SP->lat[b];
+    if (st->p50 == 0 && acc * 2 >= total)
+      st->p50 = binlimit(b);
+    if (acc * 100 >= total * 99) {
+      st->p99 = binlimit(b);
+      break;
+    }
+  }
+  if (st->p50 > st->max) st->p50 = st->max;  /* bins are coarser */
+  if (st->p99 > st->max) st->p99 = st->max;
+  mutexunlock(&SP->lock);
+}
+
+
+/* finish all submitted jobs, then stop the workers and close the states */
+LUALIB_API void luaL_closestatepool (luaL_StatePool *SP) {
+  freepool(SP, SP->nworkers);
+}
+
@@ -34,9 +34,15 @@
 int luaS_eqlngstr (TString *a, TString *b) {
   size_t len = a->u.lnglen;
   lua_assert(a->tt == LUA_VLNGSTR && b->tt == LUA_VLNGSTR);
-  return (a == b) ||  /* same instance or... */
-    ((len == b->u.lnglen) &&  /* equal length and ... */
-     (memcmp(getlngstr(a), getlngstr(b), len) == 0));  /* equal contents */
+  if (a == b)  /* same instance? */
+    return 1;
+  else if (len != b->u.lnglen)  /* different lengths? */
+    return 0;
+  else if (a->extra && b->extra && a->hash != b->hash)
+    return 0;  /* both already hashed, with different hashes */
+  else  /* equal contents? */
+    return (getlngstr(a) == getlngstr(b) ||
+            memcmp(getlngstr(a), getlngstr(b), len) == 0);
 }
 
 
@@ -140,28 +146,57 @@ void luaS_init (lua_State *L) {
 /*
 ** creates a new string object
 */
-static TString *createstrobj (lua_State *L, size_t l, int tag, unsigned int h) {
-  TString *ts;
-  GCObject *o;
-  size_t totalsize;  /* total size of TString object */
-  totalsize = sizelstring(l);
-  o = luaC_newobj(L, tag, totalsize);
-  ts = gco2ts(o);
+static TString *createstrobj (lua_State *L, size_t totalsize, int tag,
+                              unsigned int h) {
+  GCObject *o = luaC_newobj(L, tag, totalsize);
+  TString *ts = gco2ts(o);
   ts->hash = h;
   ts->extra = 0;
-  getstr(ts)[l] = '\0';  /* ending 0 */
   return ts;
 }
 
 
 TString *luaS_createlngstrobj (lua_State *L, size_t l) {
-  TString *ts = createstrobj(L, l, LUA_VLNGSTR, G(L)->seed);
+  TString *ts = createstrobj(L, sizelngstr(l), LUA_VLNGSTR, G(L)->seed);
   ts->u.lnglen = l;
   ts->shrlen = 0xFF;  /* signals that it is a long string */
+  ts->contents = cast_charp(ts) + offsetof(TString, falloc);
+  ts->contents[l] = '\0';  /* ending 0 */
+  return ts;
+}
+
+
+/*
+** Create a long string whose bytes stay in the buffer 's', which must
+** be immutable and end with a '\0' at 's[l]'. Nothing is copied and
+** the hash is computed only if the string is ever used as a table
+** key. When the string is collected, 'falloc' (if not NULL) is called
+** as 'falloc(ud, s, l + 1, 0)' to release the buffer.
+*/
+TString *luaS_newextlngstr (lua_State *L, const char *s, size_t l,
+                                          lua_Alloc falloc, void *ud) {
+  TString *ts = createstrobj(L, sizeextstr, LUA_VLNGSTR, G(L)->seed);
+  lua_assert(s[l] == '\0');
+  ts->u.lnglen = l;
+  ts->shrlen = 0xFF;
+  ts->contents = cast_charp(s);
+  ts->falloc = falloc;
+  ts->ud = ud;
   return ts;
 }
 
 
+void luaS_freelngstr (lua_State *L, TString *ts) {
+  if (!strisext(ts))
+    luaM_freemem(L, ts, sizelngstr(ts->u.lnglen));
+  else {
+    if (ts->falloc != NULL)  /* release the external buffer */
+      (*ts->falloc)(ts->ud, ts->contents, ts->u.lnglen + 1, 0);
+    luaM_freemem(L, ts, sizeextstr);
+  }
+}
+
+
 void luaS_remove (lua_State *L, TString *ts) {
   stringtable *tb = &G(L)->strt;
   TString **p = &tb->hash[lmod(ts->hash, tb->size)];
@@ -206,9 +241,10 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
     growstrtab(L, tb);
     list = &tb->hash[lmod(h, tb->size)];  /* rehash with new size */
   }
-  ts = createstrobj(L, l, LUA_VSHRSTR, h);
+  ts = createstrobj(L, sizeshrstr(l), LUA_VSHRSTR, h);
   ts->shrlen = cast_byte(l);
   memcpy(getshrstr(ts), str, l * sizeof(char));
+  getshrstr(ts)[l] = '\0';  /* ending 0 */
   ts->u.hnext = *list;
   *list = ts;
   tb->nuse++;
@@ -21,9 +21,12 @@
 
 /*
 ** Size of a TString: Size of the header plus space for the string
-** itself (including final '\0').
+** itself (including final '\0'). External long strings keep only the
+** header.
 */
-#define sizelstring(l)  (offsetof(TString, contents) + ((l) + 1) * sizeof(char))
+#define sizeshrstr(l)  (offsetof(TString, contents) + ((l) + 1) * sizeof(char))
+#define sizelngstr(l)  (offsetof(TString, falloc) + ((l) + 1) * sizeof(char))
+#define sizeextstr	sizeof(TString)
 
 #define luaS_newliteral(L, s)	(luaS_newlstr(L, "" s, \
                                  (sizeof(s)/sizeof(char))-1))
@@ -52,6 +55,9 @@ LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, int nuvalue);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
 LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
+LUAI_FUNC TString *luaS_newextlngstr (lua_State *L, const char *s, size_t l,
+                                      lua_Alloc falloc, void *ud);
+LUAI_FUNC void luaS_freelngstr (lua_State *L, TString *ts);
 
 
 #endif
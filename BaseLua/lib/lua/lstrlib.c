@@ -359,6 +359,7 @@ typedef struct MatchState {
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end ('\0') of source string */
   const char *p_end;  /* end ('\0') of pattern */
+  const char *first, *firstend;  /* item matching the 1st char (or NULL) */
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   unsigned char level;  /* total number of captures (finished or unfinished) */
@@ -503,11 +504,141 @@ static const char *matchbalance (MatchState *ms, const char *s,
 }
 
 
+/*
+** Length of the longest run of characters starting at 's' that match
+** the single-character class 'p'. Common classes get loops of their
+** own instead of a call to 'singlematch' per character: '.', plain
+** characters, one-letter classes and '[^c]' (which is a 'memchr').
+*/
+#define runwhile(cond)	{ while (q < e && (cond)) q++; return q - s; }
+
+static ptrdiff_t classrun (MatchState *ms, const char *s, const char *p,
+                                          const char *ep) {
+  const char *e = ms->src_end;
+  const char *q = s;
+  switch (*p) {
+    case '.': return e - s;
+    case L_ESC: {
+      switch (uchar(*(p + 1))) {
+        case 'a': runwhile(isalpha(uchar(*q)));
+        case 'A': runwhile(!isalpha(uchar(*q)));
+        case 'd': runwhile(isdigit(uchar(*q)));
+        case 'D': runwhile(!isdigit(uchar(*q)));
+        case 's': runwhile(isspace(uchar(*q)));
+        case 'S': runwhile(!isspace(uchar(*q)));
+        case 'w': runwhile(isalnum(uchar(*q)));
+        case 'W': runwhile(!isalnum(uchar(*q)));
+        case 'x': runwhile(isxdigit(uchar(*q)));
+        default: {
+          if (!isalnum(uchar(*(p + 1))))  /* escaped character? */
+            runwhile(*q == *(p + 1));
+          break;
+        }
+      }
+      break;
+    }
+    case '[': {
+      if (*(p + 1) == '^' && ep - p == 4 && *(p + 2) != L_ESC) {  /* [^c] */
+        q = (const char *)memchr(s, *(p + 2), e - s);
+        return (q != NULL) ? q - s : e - s;
+      }
+      break;
+    }
+    default: runwhile(*q == *p);
+  }
+  while (singlematch(ms, q, p, ep))  /* generic case */
+    q++;
+  return q - s;
+}
+
+
+/*
+** {======================================================
+** Skipping hopeless starts
+** If every match of pattern 'p' (not anchored) must start with a
+** character matched by a single-character item (possibly inside
+** captures), searches can skip positions whose character does not
+** match that item without calling 'match'. Malformed items are left
+** for 'match' to report.
+** =======================================================
+*/
+
+static void setfirst (MatchState *ms, const char *p) {
+  const char *ep;
+  while (p < ms->p_end && *p == '(' && *(p + 1) != ')')
+    p++;  /* the first item of a capture is the first item */
+  if (p >= ms->p_end)
+    return;
+  switch (*p) {
+    case L_ESC: {
+      if (p + 1 >= ms->p_end || *(p + 1) == 'b' || *(p + 1) == 'f' ||
+          isdigit(uchar(*(p + 1))))
+        return;  /* not a single-character item */
+      ep = p + 2;
+      break;
+    }
+    case '[': {
+      ep = p + 1;
+      if (ep < ms->p_end && *ep == '^') ep++;
+      do {  /* look for the ']' (as 'classend') */
+        if (ep >= ms->p_end)
+          return;
+        if (*(ep++) == L_ESC && ep < ms->p_end)
+          ep++;
+      } while (ep >= ms->p_end || *ep != ']');
+      ep++;
+      break;
+    }
+    case '.': return;  /* matches anything */
+    default: {
+      if (strchr(SPECIALS, *p) != NULL)  /* (also true for '\0') */
+        return;
+      ep = p + 1;
+      break;
+    }
+  }
+  if (ep < ms->p_end && (*ep == '*' || *ep == '?' || *ep == '-'))
+    return;  /* item may match the empty string */
+  ms->first = p;
+  ms->firstend = ep;
+}
+
+
+/*
+** First position from 's' whose character can start a match, or NULL.
+*/
+static const char *nextstart (MatchState *ms, const char *s) {
+  const char *p = ms->first;
+  const char *e = ms->src_end;
+  if (*p == L_ESC && !isalnum(uchar(*(p + 1))))  /* escaped character */
+    return (const char *)memchr(s, *(p + 1), e - s);
+  else if (*p == L_ESC && strchr("acdglpsuwx", tolower(uchar(*(p + 1))))) {
+    char inv[2];  /* the complement class, to skip a run of it */
+    inv[0] = L_ESC;
+    inv[1] = islower(uchar(*(p + 1))) ? toupper(uchar(*(p + 1)))
+                                     : tolower(uchar(*(p + 1)));
+    s += classrun(ms, s, inv, inv + 2);
+  }
+  else if (*p == '[' && *(p + 1) == '^' && ms->firstend - p == 4 &&
+           *(p + 2) != L_ESC) {  /* [^c] */
+    while (s < e && *s == *(p + 2))
+      s++;
+  }
+  else if (*p != L_ESC && *p != '[')  /* plain character */
+    return (const char *)memchr(s, *p, e - s);
+  else {
+    while (s < e && !singlematch(ms, s, p, ms->firstend))
+      s++;
+  }
+  return (s < e) ? s : NULL;
+}
+
+/* }====================================================== */
+
+
 static const char *max_expand (MatchState *ms, const char *s,
                                  const char *p, const char *ep) {
-  ptrdiff_t i = 0;  /* counts maximum expand for item */
-  while (singlematch(ms, s + i, p, ep))
-    i++;
+  ptrdiff_t i = classrun(ms, s, p, ep);  /* counts maximum expand for item */
   /* keeps trying to match with the maximum repetitions */
   while (i>=0) {
     const char *res = match(ms, (s+i), ep+1);
@@ -670,10 +801,87 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 
 
 
+/*
+** {======================================================
+** Vectorized search for patterns with two or more characters: compare
+** 16 candidate positions at a time against both the first and the last
+** character of 's2', and check the rest of 's2' only at positions where
+** both agree. This filters out most false starts that 'memchr' on the
+** first character alone would stop at.
+** =======================================================
+*/
+
+#if !defined(LUA_NOVECTORFIND) && defined(__GNUC__)
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define VECFIND
+typedef __m128i l_vec;
+#define vecsplat(c)	_mm_set1_epi8(c)
+#define vecload(p)	_mm_loadu_si128((const __m128i *)(p))
+/* bit 'i' of the mask is set when byte 'i' is equal in all four */
+#define vecmask2(a,b,c,d)  \
+	((unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, b), \
+	                                           _mm_cmpeq_epi8(c, d))))
+#define VECBITS		1  /* mask bits per byte */
+
+#elif defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+#define VECFIND
+typedef uint8x16_t l_vec;
+#define vecsplat(c)	vdupq_n_u8((uint8_t)(c))
+#define vecload(p)	vld1q_u8((const uint8_t *)(p))
+/* NEON has no 'movemask': narrow to a nibble per byte, keep one bit */
+#define vecmask2(a,b,c,d)  \
+	(vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8( \
+	  vandq_u8(vceqq_u8(a, b), vceqq_u8(c, d))), 4)), 0) & \
+	 0x8888888888888888ULL)
+#define VECBITS		4  /* mask bits per byte */
+
+#endif
+#endif
+
+
+#if defined(VECFIND)
+
+static const char *vecfind (const char *s1, size_t l1,
+                            const char *s2, size_t l2) {
+  const l_vec first = vecsplat(s2[0]);
+  const l_vec last = vecsplat(s2[l2 - 1]);
+  size_t i;
+  for (i = 0; i + 16 + l2 - 1 <= l1; i += 16) {
+    unsigned long long mask = vecmask2(vecload(s1 + i), first,
+                                       vecload(s1 + i + l2 - 1), last);
+    while (mask != 0) {
+      size_t pos = i + (size_t)__builtin_ctzll(mask) / VECBITS;
+      if (memcmp(s1 + pos + 1, s2 + 1, l2 - 2) == 0)
+        return s1 + pos;
+      mask &= mask - 1;
+    }
+  }
+  for (; i + l2 <= l1; i++) {  /* tail */
+    if (s1[i] == s2[0] && memcmp(s1 + i + 1, s2 + 1, l2 - 1) == 0)
+      return s1 + i;
+  }
+  return NULL;
+}
+
+#endif
+
+/* }====================================================== */
+
+
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
   if (l2 == 0) return s1;  /* empty strings are everywhere */
   else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
+#if defined(VECFIND)
+  else if (l2 >= 2)
+    return vecfind(s1, l1, s2, l2);
+#endif
   else {
     const char *init;  /* to search for a '*s2' inside 's1' */
     l2--;  /* 1st char will be checked by 'memchr' */
@@ -756,6 +964,7 @@ static int nospecials (const char *p, size_t l) {
 
 static void prepstate (MatchState *ms, lua_State *L,
                        const char *s, size_t ls, const char *p, size_t lp) {
+  ms->first = ms->firstend = NULL;
   ms->L = L;
   ms->matchdepth = MAXCCALLS;
   ms->src_init = s;
@@ -797,8 +1006,12 @@ static int str_find_aux (lua_State *L, int find) {
       p++; lp--;  /* skip anchor character */
     }
     prepstate(&ms, L, s, ls, p, lp);
+    if (!anchor)
+      setfirst(&ms, p);
     do {
       const char *res;
+      if (ms.first != NULL && (s1 = nextstart(&ms, s1)) == NULL)
+        break;  /* no more possible starts */
       reprepstate(&ms);
       if ((res=match(&ms, s1, p)) != NULL) {
         if (find) {
@@ -841,6 +1054,8 @@ static int gmatch_aux (lua_State *L) {
   gm->ms.L = L;
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if (gm->ms.first != NULL && (src = nextstart(&gm->ms, src)) == NULL)
+      break;  /* no more possible starts */
     reprepstate(&gm->ms);
     if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
@@ -863,6 +1078,7 @@ static int gmatch (lua_State *L) {
     init = ls + 1;  /* avoid overflows in 's + init' */
   prepstate(&gm->ms, L, s, ls, p, lp);
   gm->src = s + init; gm->p = p; gm->lastmatch = NULL;
+  setfirst(&gm->ms, p);
   lua_pushcclosure(L, gmatch_aux, 3);
   return 1;
 }
@@ -959,8 +1175,16 @@ static int str_gsub (lua_State *L) {
     p++; lp--;  /* skip anchor character */
   }
   prepstate(&ms, L, src, srcl, p, lp);
+  if (!anchor)
+    setfirst(&ms, p);
   while (n < max_s) {
     const char *e;
+    if (ms.first != NULL) {  /* copy up to the next possible start */
+      const char *q = nextstart(&ms, src);
+      if (q == NULL) break;  /* rest is copied below */
+      luaL_addlstring(&b, src, q - src);
+      src = q;
+    }
     reprepstate(&ms);  /* (re)prepare state for new match */
     if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
       n++;
@@ -21,10 +21,13 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** (With LUAI_OPENHASH, the hash part uses open addressing instead; see
+** section "Open addressing".)
 */
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -65,8 +68,15 @@
 ** between 2^MAXHBITS and the maximum size such that, measured in bytes,
 ** it fits in a 'size_t'.
 */
+#if !defined(LUAI_OPENHASH)
 #define MAXHSIZE	luaM_limitN(1u << MAXHBITS, Node)
+#else
+/* leave room for the control bytes */
+#define MAXHSIZE	(luaM_limitN(1u << MAXHBITS, Node) / 2)
+#endif
+
 
+#if !defined(LUAI_OPENHASH)
 
 /*
 ** When the original hash value is good, hashing by a power of 2
@@ -95,6 +105,8 @@ static const Node dummynode_ = {
    LUA_VNIL, 0, {NULL}}  /* key type, next, and key value */
 };
 
+#endif
+
 
 static const TValue absentkey = {ABSTKEYCONSTANT};
 
@@ -105,6 +117,7 @@ static const TValue absentkey = {ABSTKEYCONSTANT};
 ** remainder, which is faster. Otherwise, use an unsigned-integer
 ** remainder, which uses all bits and ensures a non-negative result.
 */
+#if !defined(LUAI_OPENHASH)
 static Node *hashint (const Table *t, lua_Integer i) {
   lua_Unsigned ui = l_castS2U(i);
   if (ui <= cast_uint(INT_MAX))
@@ -112,6 +125,7 @@ static Node *hashint (const Table *t, lua_Integer i) {
   else
     return hashmod(t, ui);
 }
+#endif
 
 
 /*
@@ -144,6 +158,8 @@ static int l_hashfloat (lua_Number n) {
 #endif
 
 
+#if !defined(LUAI_OPENHASH)
+
 /*
 ** returns the 'main' position of an element in a table (that is,
 ** the index of its hash value).
@@ -192,6 +208,8 @@ l_sinline Node *mainpositionfromnode (const Table *t, Node *nd) {
   return mainpositionTV(t, &key);
 }
 
+#endif
+
 
 /*
 ** Check whether key 'k1' is equal to the key in node 'n2'. This
@@ -236,6 +254,368 @@ static int equalkey (const TValue *k1, const Node *n2, int deadok) {
 }
 
 
+#if defined(LUAI_OPENHASH)	/* { */
+
+/*
+** {=============================================================
+** Open addressing
+** ==============================================================
+*/
+
+/*
+** The hash part is an open-addressing table in the style of
+** SwissTable. Its nodes are followed, in the same block, by one
+** control byte per node: CTRL_EMPTY for a node that never had a key,
+** or 7 bits of the hash of the node's key. (Nodes of small tables are
+** padded up to a full group with CTRL_GONE bytes.) Nodes are probed in
+** groups of GSIZE: one load gets the control bytes of a group, and
+** word-wide bit tricks find its nodes with a matching control byte
+** (the few false positives are harmless, as keys are compared anyway)
+** and its empty nodes. The probe sequence visits groups in triangular
+** order, which covers all groups (their number is a power of 2), and
+** stops at the first group with an empty node. Small hash parts (up
+** to one group) can be full; larger ones keep 1/8 of their nodes
+** empty.
+** As with chaining, removing a key only empties its value: the node
+** keeps its key and control byte until the next rehash, so that
+** 'next' can still find it. Only never-used nodes take new keys, so
+** when they run out the part is rebuilt, at the same size if most of
+** its keys were removed (see 'growhash').
+** Hash parts with 2^MOVEBITS nodes or more grow (or are rebuilt)
+** without a full rehash: a part twice as large (or as large) is
+** allocated, and the old one stays in 'oldnode' while each new key
+** moves its next MOVESTEP nodes (which get CTRL_GONE), so that
+** reinsertions are spread along the insertions that follow. Lookups search the new part and then the
+** old one. A key that may go to the array part still triggers a full
+** rehash, so that the array part can grow as usual.
+*/
+
+#define CTRL_EMPTY	0x80
+#define CTRL_GONE	0xFF
+
+#if !defined(MOVEBITS)
+#define MOVEBITS	10
+#endif
+
+#if !defined(MOVESTEP)
+#define MOVESTEP	4
+#endif
+
+
+typedef size_t Group;
+
+#define GSIZE		cast_uint(sizeof(Group))
+
+/* byte 'b' repeated in all bytes of a group */
+#define allbytes(b)	((~cast(Group, 0) / 0xFF) * (b))
+
+
+static Group loadgroup (const lu_byte *ctrl) {
+  Group g;
+  memcpy(&g, ctrl, sizeof(Group));
+  return g;
+}
+
+
+/*
+** Mask with the high bit of each byte in group 'g' equal to 'b'. A
+** byte just above a matching one may also be flagged.
+*/
+l_sinline Group matchbyte (Group g, int b) {
+  Group x = g ^ allbytes(b);
+  return (x - allbytes(0x01)) & ~x & allbytes(0x80);
+}
+
+
+/* mask with the high bit of each CTRL_EMPTY byte in group 'g' */
+#define matchempty(g)	((g) & ~((g) << 6) & allbytes(0x80))
+
+
+#if defined(__GNUC__)
+#define lowbyte(m)	cast_uint(__builtin_ctzll(cast(unsigned long long, m)) >> 3)
+#else
+static unsigned int lowbyte (Group m) {
+  unsigned int i = 0;
+  while ((m & 0xFF) == 0) {
+    m >>= 8;
+    i++;
+  }
+  return i;
+}
+#endif
+
+/* position in its group of the node of the lowest flag in mask 'm' */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define matchslot(m)	(GSIZE - 1 - lowbyte(m))
+#else
+#define matchslot(m)	lowbyte(m)
+#endif
+
+
+#define h2(h)		cast_int((h) & 0x7F)
+#define ngroups(lsize)	((cast_uint(twoto(lsize)) + GSIZE - 1) / GSIZE)
+#define hashctrl(node,lsize)	cast(lu_byte *, (node) + twoto(lsize))
+
+/* size of the block for a hash part with 'size' nodes */
+#define hashbytes(size)  \
+	(cast_sizet(size) * sizeof(Node) + \
+	 (cast_uint(size) < GSIZE ? GSIZE : cast_uint(size)))
+
+
+/* number of keys a hash part with 2^'lsize' nodes can take */
+static unsigned int maxload (int lsize) {
+  unsigned int size = cast_uint(twoto(lsize));
+  return (size <= GSIZE) ? size : size - size / 8;
+}
+
+
+/*
+** Dummy hash part: one node with no key, followed by control bytes
+** that neither match nor are empty.
+*/
+static const struct {
+  Node n;
+  lu_byte ctrl[8];
+} dummyhash = {
+  {{{NULL}, LUA_VEMPTY, LUA_VNIL, 0, {NULL}}},
+  {CTRL_GONE, CTRL_GONE, CTRL_GONE, CTRL_GONE,
+   CTRL_GONE, CTRL_GONE, CTRL_GONE, CTRL_GONE}
+};
+
+LUAI_DDEF Node *const luaH_dummynode = cast(Node *, &dummyhash.n);
+
+
+l_sinline unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+
+l_sinline unsigned int inthash (lua_Integer i) {
+  lua_Unsigned ui = l_castS2U(i);
+  return mixhash(cast_uint(ui ^ (ui >> (sizeof(ui) * CHAR_BIT / 2))));
+}
+
+
+/*
+** Hash of a key. Strings already have well-mixed hashes; everything
+** else is mixed, as probing uses both its low bits (the control byte)
+** and its high bits (the group).
+*/
+static unsigned int keyhash (const TValue *key) {
+  switch (ttypetag(key)) {
+    case LUA_VNUMINT:
+      return inthash(ivalue(key));
+    case LUA_VNUMFLT:
+      return mixhash(cast_uint(l_hashfloat(fltvalue(key))));
+    case LUA_VSHRSTR:
+      return tsvalue(key)->hash;
+    case LUA_VLNGSTR:
+      return luaS_hashlongstr(tsvalue(key));
+    case LUA_VFALSE:
+      return mixhash(0);
+    case LUA_VTRUE:
+      return mixhash(1);
+    case LUA_VLIGHTUSERDATA:
+      return mixhash(point2uint(pvalue(key)));
+    case LUA_VLCF:
+      return mixhash(point2uint(fvalue(key)));
+    default:
+      return mixhash(point2uint(gcvalue(key)));
+  }
+}
+
+
+/*
+** Search the hash part 'node', with 2^'lsize' nodes, for a node 'n'
+** with a key of hash 'h' satisfying 'eq'. 'res' gets the node, or
+** NULL if there is none.
+*/
+#define searchnodes(res,node,lsize,h,eq) {  \
+	const lu_byte *ctrl_ = hashctrl(node, lsize);  \
+	unsigned int gmask_ = ngroups(lsize) - 1;  \
+	unsigned int g_ = ((h) >> 7) & gmask_;  \
+	unsigned int step_ = 0;  \
+	res = NULL;  \
+	for (;;) {  \
+	  Group gr_ = loadgroup(ctrl_ + g_ * GSIZE);  \
+	  Group m_;  \
+	  for (m_ = matchbyte(gr_, h2(h)); m_ != 0; m_ &= m_ - 1) {  \
+	    Node *n = (node) + g_ * GSIZE + matchslot(m_);  \
+	    if (eq) { res = n; break; }  \
+	  }  \
+	  if (res != NULL || matchempty(gr_) != 0 || step_ == gmask_)  \
+	    break;  \
+	  g_ = (g_ + ++step_) & gmask_;  \
+	} }
+
+
+/* search both the hash part of 't' and the part being moved into it */
+#define searchkey(res,t,h,eq) {  \
+	searchnodes(res, (t)->node, (t)->lsizenode, h, eq);  \
+	if (res == NULL && (t)->oldnode != NULL)  \
+	  searchnodes(res, (t)->oldnode, (t)->lsizeold, h, eq);  }
+
+
+/*
+** Search the hash part 'node', with 2^'lsize' nodes, for the last node
+** in the probe sequence of 'key' holding it, dead or not. A key removed
+** and collected keeps its dead node; when inserted again it takes a
+** later node, so the last one is where the key is now.
+*/
+static Node *lastnode (Node *node, int lsize, unsigned int h,
+                       const TValue *key) {
+  Node *res;
+  Node *last = NULL;
+  const lu_byte *ctrl = hashctrl(node, lsize);
+  unsigned int gmask = ngroups(lsize) - 1;
+  unsigned int g = (h >> 7) & gmask;
+  unsigned int step = 0;
+  for (;;) {
+    Group gr = loadgroup(ctrl + g * GSIZE);
+    Group m;
+    for (m = matchbyte(gr, h2(h)); m != 0; m &= m - 1) {
+      res = node + g * GSIZE + matchslot(m);
+      if (equalkey(key, res, 1))
+        last = res;
+    }
+    if (matchempty(gr) != 0 || step == gmask)
+      return last;
+    g = (g + ++step) & gmask;
+  }
+}
+
+
+/*
+** Take a never-used node of the hash part of 't' for a key with hash
+** 'h'. There must be one ('t->hfree > 0').
+*/
+static Node *freenode (Table *t, unsigned int h) {
+  lu_byte *ctrl = hashctrl(t->node, t->lsizenode);
+  unsigned int gmask = ngroups(t->lsizenode) - 1;
+  unsigned int g = (h >> 7) & gmask;
+  unsigned int step = 0;
+  Group m;
+  lua_assert(t->hfree > 0);
+  while ((m = matchempty(loadgroup(ctrl + g * GSIZE))) == 0) {
+    lua_assert(step < gmask);
+    g = (g + ++step) & gmask;
+  }
+  g = g * GSIZE + matchslot(m);
+  ctrl[g] = cast_byte(h2(h));
+  t->hfree--;
+  return gnode(t, g);
+}
+
+
+/*
+** Give 't' a new empty hash part with 2^'lsize' nodes. (Does not
+** release the current one.)
+*/
+static void allochash (lua_State *L, Table *t, int lsize) {
+  unsigned int size = cast_uint(twoto(lsize));
+  Node *node = cast(Node *, luaM_malloc_(L, hashbytes(size), 0));
+  lu_byte *ctrl = hashctrl(node, lsize);
+  /* all-zero nodes have nil keys and nil (empty) values */
+  memset(node, 0, cast_sizet(size) * sizeof(Node));
+  memset(ctrl, CTRL_EMPTY, size);
+  if (size < GSIZE)
+    memset(ctrl + size, CTRL_GONE, GSIZE - size);
+  t->node = node;
+  t->lsizenode = cast_byte(lsize);
+  t->hfree = maxload(lsize);
+}
+
+
+/*
+** Move the next 'n' nodes of the old hash part of 't' into its current
+** one; release the old part when all its nodes have been moved.
+** Entries without values are dropped.
+*/
+static void movenodes (lua_State *L, Table *t, unsigned int n) {
+  unsigned int oldsize = cast_uint(twoto(t->lsizeold));
+  Node *old = t->oldnode;
+  lu_byte *ctrl = hashctrl(old, t->lsizeold);
+  unsigned int i = t->hmoved;
+  unsigned int lim = (n < oldsize - i) ? i + n : oldsize;
+  for (; i < lim; i++) {
+    Node *o = old + i;
+    if (ctrl[i] < CTRL_EMPTY && !isempty(gval(o))) {
+      TValue k;
+      getnodekey(L, &k, o);
+      *freenode(t, keyhash(&k)) = *o;
+      setempty(gval(o));
+    }
+    ctrl[i] = CTRL_GONE;
+  }
+  t->hmoved = i;
+  if (i == oldsize) {
+    luaM_freemem(L, old, hashbytes(oldsize));
+    t->oldnode = NULL;
+    t->hmoved = 0;
+  }
+}
+
+
+/* number of nodes of the hash part of 't' with values */
+static unsigned int numlive (const Table *t) {
+  unsigned int n = 0;
+  int i = sizenode(t);
+  while (i--) {
+    if (!isempty(gval(gnode(t, i))))
+      n++;
+  }
+  return n;
+}
+
+
+/*
+** Called when the hash part of 't' has no never-used nodes left.
+** Removed keys use up nodes too, so the part only doubles if more than
+** half its load are live keys. With fewer, it is rebuilt with the same
+** size, which frees the nodes of removed keys; with less than a
+** quarter, the caller shrinks it. Both the doubled and the rebuilt
+** parts get their keys incrementally, from 'oldnode'. Returns true if
+** 't' has never-used nodes again; otherwise the caller must do a full
+** rehash.
+*/
+static int growhash (lua_State *L, Table *t, const TValue *key) {
+  int lsize = t->lsizenode + 1;
+  int oldlsize = t->lsizenode;
+  Node *old = t->node;
+  unsigned int live;
+  if (t->oldnode != NULL)  /* still moving the previous part? */
+    movenodes(L, t, cast_uint(sizenode(t)));  /* finish it */
+  if (isdummy(t) || lsize <= MOVEBITS || lsize > MAXHBITS ||
+      (1u << lsize) > MAXHSIZE)
+    return 0;
+  if (ttisinteger(key)) {
+    lua_Unsigned k = l_castS2U(ivalue(key)) - 1u;
+    /* may it fit in an array part no more than half empty? */
+    if (k < MAXASIZE && k / 2 <= luaH_realasize(t) + sizenode(t))
+      return 0;
+  }
+  live = numlive(t);
+  if (live < maxload(t->lsizenode) / 4)  /* mostly removed keys? */
+    return 0;  /* shrink it */
+  if (live <= maxload(t->lsizenode) / 2)  /* many removed keys? */
+    lsize--;  /* same size */
+  allochash(L, t, lsize);
+  t->oldnode = old;
+  t->lsizeold = cast_byte(oldlsize);
+  t->hmoved = 0;
+  return 1;
+}
+
+/* }============================================================= */
+
+#endif				/* } */
+
+
 /*
 ** True if value of 'alimit' is equal to the real size of the array
 ** part of table 't'. (Otherwise, the array part must be larger than
@@ -297,6 +677,7 @@ static unsigned int setlimittosize (Table *t) {
 ** See explanation about 'deadok' in function 'equalkey'.
 */
 static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
+#if !defined(LUAI_OPENHASH)
   Node *n = mainpositionTV(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (equalkey(key, n, deadok))
@@ -308,6 +689,12 @@ static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
       n += nx;
     }
   }
+#else
+  Node *res;
+  unsigned int h = keyhash(key);
+  searchkey(res, t, h, equalkey(key, n, deadok));
+  return (res != NULL) ? gval(res) : &absentkey;
+#endif
 }
 
 
@@ -336,10 +723,25 @@ static unsigned int findindex (lua_State *L, Table *t, TValue *key,
   if (i - 1u < asize)  /* is 'key' inside array part? */
     return i;  /* yes; that's the index */
   else {
+#if !defined(LUAI_OPENHASH)
     const TValue *n = getgeneric(t, key, 1);
     if (l_unlikely(isabstkey(n)))
       luaG_runerror(L, "invalid key to 'next'");  /* key not found */
     i = cast_int(nodefromval(n) - gnode(t, 0));  /* key index in hash table */
+#else
+    /* nodes of the old part (if any) are numbered after the new ones */
+    unsigned int h = keyhash(key);
+    Node *res = lastnode(t->node, t->lsizenode, h, key);
+    if (res != NULL)
+      i = cast_uint(res - gnode(t, 0));
+    else {
+      if (t->oldnode != NULL)
+        res = lastnode(t->oldnode, t->lsizeold, h, key);
+      if (l_unlikely(res == NULL))
+        luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+      i = cast_uint(sizenode(t)) + cast_uint(res - t->oldnode);
+    }
+#endif
     /* hash elements are numbered after array ones */
     return (i + 1) + asize;
   }
@@ -349,6 +751,7 @@ static unsigned int findindex (lua_State *L, Table *t, TValue *key,
 int luaH_next (lua_State *L, Table *t, StkId key) {
   unsigned int asize = luaH_realasize(t);
   unsigned int i = findindex(L, t, s2v(key), asize);  /* find original key */
+  int p;
   for (; i < asize; i++) {  /* try first array part */
     if (!isempty(&t->array[i])) {  /* a non-empty entry? */
       setivalue(s2v(key), i + 1);
@@ -356,21 +759,34 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       return 1;
     }
   }
-  for (i -= asize; cast_int(i) < sizenode(t); i++) {  /* hash part */
-    if (!isempty(gval(gnode(t, i)))) {  /* a non-empty entry? */
-      Node *n = gnode(t, i);
-      getnodekey(L, s2v(key), n);
-      setobj2s(L, key + 1, gval(n));
-      return 1;
+  i -= asize;
+  for (p = 0; p < hashparts(t); p++) {  /* hash part */
+    Node *node = hashpart(t, p);
+    unsigned int nsize = hashpartsize(t, p);
+    for (; i < nsize; i++) {
+      if (!isempty(gval(node + i))) {  /* a non-empty entry? */
+        Node *n = node + i;
+        getnodekey(L, s2v(key), n);
+        setobj2s(L, key + 1, gval(n));
+        return 1;
+      }
     }
+    i -= nsize;
   }
   return 0;  /* no more elements */
 }
 
 
 static void freehash (lua_State *L, Table *t) {
+#if !defined(LUAI_OPENHASH)
   if (!isdummy(t))
     luaM_freearray(L, t->node, cast_sizet(sizenode(t)));
+#else
+  if (t->oldnode != NULL)
+    luaM_freemem(L, t->oldnode, hashbytes(twoto(t->lsizeold)));
+  if (!isdummy(t))
+    luaM_freemem(L, t->node, hashbytes(sizenode(t)));
+#endif
 }
 
 
@@ -477,6 +893,28 @@ static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
 ** comparison ensures that the shift in the second one does not
 ** overflow.
 */
+#if defined(LUAI_OPENHASH)
+
+static void setnodevector (lua_State *L, Table *t, unsigned int size) {
+  t->oldnode = NULL;
+  t->hmoved = 0;
+  if (size == 0) {  /* no elements to hash part? */
+    t->node = luaH_dummynode;  /* use common 'dummynode' */
+    t->lsizenode = 0;
+    t->hfree = 0;  /* any new key makes it grow */
+  }
+  else {
+    int lsize = luaO_ceillog2(size);
+    if (size > maxload(lsize))  /* keep some nodes empty */
+      lsize++;
+    if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
+      luaG_runerror(L, "table overflow");
+    allochash(L, t, lsize);
+  }
+}
+
+#else
+
 static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   if (size == 0) {  /* no elements to hash part? */
     t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
@@ -501,6 +939,8 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   }
 }
 
+#endif
+
 
 /*
 ** (Re)insert all elements from the hash part of 'ot' into table 't'.
@@ -527,13 +967,20 @@ static void reinsert (lua_State *L, Table *ot, Table *t) {
 static void exchangehashpart (Table *t1, Table *t2) {
   lu_byte lsizenode = t1->lsizenode;
   Node *node = t1->node;
+#if !defined(LUAI_OPENHASH)
   Node *lastfree = t1->lastfree;
+  t1->lastfree = t2->lastfree;
+  t2->lastfree = lastfree;
+#else
+  unsigned int hfree = t1->hfree;
+  lua_assert(t1->oldnode == NULL && t2->oldnode == NULL);
+  t1->hfree = t2->hfree;
+  t2->hfree = hfree;
+#endif
   t1->lsizenode = t2->lsizenode;
   t1->node = t2->node;
-  t1->lastfree = t2->lastfree;
   t2->lsizenode = lsizenode;
   t2->node = node;
-  t2->lastfree = lastfree;
 }
 
 
@@ -556,6 +1003,10 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
   Table newt;  /* to keep the new hash part */
   unsigned int oldasize = setlimittosize(t);
   TValue *newarray;
+#if defined(LUAI_OPENHASH)
+  if (t->oldnode != NULL)  /* moving the hash part? */
+    movenodes(L, t, cast_uint(sizenode(t)));  /* finish it first */
+#endif
   /* create new hash part with appropriate size into 'newt' */
   setnodevector(L, &newt, nhsize);
   if (newasize < oldasize) {  /* will array shrink? */
@@ -588,7 +1039,12 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
 
 
 void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize) {
+#if !defined(LUAI_OPENHASH)
   int nsize = allocsizenode(t);
+#else
+  /* as many keys as the current size can take (it keeps that size) */
+  unsigned int nsize = isdummy(t) ? 0 : maxload(t->lsizenode);
+#endif
   luaH_resize(L, t, nasize, nsize);
 }
 
@@ -642,6 +1098,8 @@ void luaH_free (lua_State *L, Table *t) {
 }
 
 
+#if !defined(LUAI_OPENHASH)
+
 static Node *getfreepos (Table *t) {
   if (!isdummy(t)) {
     while (t->lastfree > t->node) {
@@ -719,6 +1177,49 @@ static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
   setobj2t(L, gval(mp), value);
 }
 
+#else
+
+/*
+** inserts a new key into a hash table: moves a few nodes if it is
+** moving the hash part, grows the table if it has no never-used node
+** left, and puts the key into the first never-used node of its probe
+** sequence.
+*/
+static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
+                                                 TValue *value) {
+  Node *n;
+  TValue aux;
+  if (l_unlikely(ttisnil(key)))
+    luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    lua_Number f = fltvalue(key);
+    lua_Integer k;
+    if (luaV_flttointeger(f, &k, F2Ieq)) {  /* does key fit in an integer? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (l_unlikely(luai_numisnan(f)))
+      luaG_runerror(L, "table index is NaN");
+  }
+  if (ttisnil(value))
+    return;  /* do not insert nil values */
+  if (t->oldnode != NULL)
+    movenodes(L, t, MOVESTEP);
+  if (t->hfree == 0 && !growhash(L, t, key)) {
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    luaH_set(L, t, key, value);  /* insert key into grown table */
+    return;
+  }
+  n = freenode(t, keyhash(key));
+  setnodekey(L, n, key);
+  luaC_barrierback(L, obj2gco(t), key);
+  lua_assert(isempty(gval(n)));
+  setobj2t(L, gval(n), value);
+}
+
+#endif
+
 
 /*
 ** Search function for integers. If integer is inside 'alimit', get it
@@ -752,6 +1253,7 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
     return &t->array[key - 1];
   }
   else {  /* key is not in the array part; check the hash */
+#if !defined(LUAI_OPENHASH)
     Node *n = hashint(t, key);
     for (;;) {  /* check whether 'key' is somewhere in the chain */
       if (keyisinteger(n) && keyival(n) == key)
@@ -763,6 +1265,12 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
       }
     }
     return &absentkey;
+#else
+    Node *res;
+    unsigned int h = inthash(key);
+    searchkey(res, t, h, keyisinteger(n) && keyival(n) == key);
+    return (res != NULL) ? gval(res) : &absentkey;
+#endif
   }
 }
 
@@ -771,6 +1279,7 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
 ** search function for short strings
 */
 const TValue *luaH_getshortstr (Table *t, TString *key) {
+#if !defined(LUAI_OPENHASH)
   Node *n = hashstr(t, key);
   lua_assert(key->tt == LUA_VSHRSTR);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -783,6 +1292,63 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
       n += nx;
     }
   }
+#else
+  Node *res;
+  lua_assert(key->tt == LUA_VSHRSTR);
+  searchkey(res, t, key->hash, keyisshrstr(n) && eqshrstr(keystrval(n), key));
+  return (res != NULL) ? gval(res) : &absentkey;
+#endif
+}
+
+
+/*
+** Like 'luaH_getshortstr', with an inline cache: '*ic' is the index of
+** the node where 'key' was last found. The cache is only a hint, so a
+** rehash needs no explicit invalidation: the node at a stale index
+** holds some other key (or none), and the search falls back to the
+** chain and refreshes the hint.
+*/
+const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                      unsigned int *ic) {
+  Node *n;
+  lua_assert(key->tt == LUA_VSHRSTR);
+  if (l_likely(*ic < cast_uint(sizenode(t)))) {
+    n = gnode(t, *ic);
+    if (keyisshrstr(n) && eqshrstr(keystrval(n), key))
+      return gval(n);  /* cache hit */
+  }
+#if !defined(LUAI_OPENHASH)
+  n = hashstr(t, key);
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    if (keyisshrstr(n) && eqshrstr(keystrval(n), key)) {
+      *ic = cast_uint(n - gnode(t, 0));  /* remember it */
+      return gval(n);
+    }
+    else {
+      int nx = gnext(n);
+      if (nx == 0)
+        return &absentkey;  /* not found */
+      n += nx;
+    }
+  }
+#else
+  {
+    Node *res;
+    searchnodes(res, t->node, t->lsizenode, key->hash,
+                keyisshrstr(n) && eqshrstr(keystrval(n), key));
+    if (res != NULL) {
+      *ic = cast_uint(res - gnode(t, 0));  /* remember it */
+      return gval(res);
+    }
+    if (t->oldnode != NULL) {  /* may be in the part being moved */
+      searchnodes(res, t->oldnode, t->lsizeold, key->hash,
+                  keyisshrstr(n) && eqshrstr(keystrval(n), key));
+      if (res != NULL)
+        return gval(res);
+    }
+    return &absentkey;
+  }
+#endif
 }
 
 
@@ -989,7 +1555,12 @@ lua_Unsigned luaH_getn (Table *t) {
 /* export these functions for the test library */
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
+#if !defined(LUAI_OPENHASH)
   return mainpositionTV(t, key);
+#else
+  /* first node of the first group probed for 'key' */
+  return gnode(t, ((keyhash(key) >> 7) & (ngroups(t->lsizenode) - 1)) * GSIZE);
+#endif
 }
 
 #endif
@@ -23,9 +23,38 @@
 #define invalidateTMcache(t)	((t)->flags &= ~maskflags)
 
 
+#if !defined(LUAI_OPENHASH)
+
 /* true when 't' is using 'dummynode' as its hash part */
 #define isdummy(t)		((t)->lastfree == NULL)
 
+#else
+
+LUAI_DDEC(Node *const luaH_dummynode;)
+
+/* true when 't' is using 'dummynode' as its hash part */
+#define isdummy(t)		((t)->node == luaH_dummynode)
+
+#endif
+
+
+/*
+** The nodes of the hash part of a table are in 'hashparts(t)' vectors:
+** 't->node' and (with LUAI_OPENHASH) the previous hash part while it
+** is being moved into it. Vector 'p' starts at 'hashpart(t,p)' and has
+** 'hashpartsize(t,p)' nodes.
+*/
+#if !defined(LUAI_OPENHASH)
+#define hashparts(t)		1
+#define hashpart(t,p)		((void)(p), (t)->node)
+#define hashpartsize(t,p)	((void)(p), cast_uint(sizenode(t)))
+#else
+#define hashparts(t)		((t)->oldnode != NULL ? 2 : 1)
+#define hashpart(t,p)		((p) == 0 ? (t)->node : (t)->oldnode)
+#define hashpartsize(t,p)  \
+	cast_uint((p) == 0 ? sizenode(t) : twoto((t)->lsizeold))
+#endif
+
 
 /* allocated size for hash nodes */
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
@@ -39,6 +68,8 @@ LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
 LUAI_FUNC const TValue *luaH_getshortstr (Table *t, TString *key);
+LUAI_FUNC const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                                unsigned int *ic);
 LUAI_FUNC const TValue *luaH_getstr (Table *t, TString *key);
 LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
 LUAI_FUNC void luaH_set (lua_State *L, Table *t, const TValue *key,
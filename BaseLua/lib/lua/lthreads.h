@@ -0,0 +1,62 @@
+/*
+** $Id: lthreads.h $
+** Minimal OS threads for library modules (not used by the core)
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lthreads_h
+#define lthreads_h
+
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+typedef HANDLE l_thread;
+typedef SRWLOCK l_mutex;
+typedef CONDITION_VARIABLE l_cond;
+
+#define mutexinit(m)	(InitializeSRWLock(m), 1)
+#define mutexfree(m)	((void)(m))
+#define mutexlock(m)	AcquireSRWLockExclusive(m)
+#define mutexunlock(m)	ReleaseSRWLockExclusive(m)
+#define condinit(c)	(InitializeConditionVariable(c), 1)
+#define condfree(c)	((void)(c))
+#define condwait(c,m)	SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define condsignal(c)	WakeConditionVariable(c)
+#define condbroadcast(c)	WakeAllConditionVariable(c)
+
+#define THREADFUNC(f)	static DWORD WINAPI f (LPVOID arg)
+#define THREADRETURN	return 0
+
+#define threadstart(t,f,a)  \
+	((*(t) = CreateThread(NULL, 0, f, a, 0, NULL)) != NULL)
+#define threadjoin(t)	(WaitForSingleObject(t, INFINITE), CloseHandle(t))
+
+#else
+
+#include <pthread.h>
+
+typedef pthread_t l_thread;
+typedef pthread_mutex_t l_mutex;
+typedef pthread_cond_t l_cond;
+
+#define mutexinit(m)	(pthread_mutex_init(m, NULL) == 0)
+#define mutexfree(m)	pthread_mutex_destroy(m)
+#define mutexlock(m)	pthread_mutex_lock(m)
+#define mutexunlock(m)	pthread_mutex_unlock(m)
+#define condinit(c)	(pthread_cond_init(c, NULL) == 0)
+#define condfree(c)	pthread_cond_destroy(c)
+#define condwait(c,m)	pthread_cond_wait(c, m)
+#define condsignal(c)	pthread_cond_signal(c)
+#define condbroadcast(c)	pthread_cond_broadcast(c)
+
+#define THREADFUNC(f)	static void *f (void *arg)
+#define THREADRETURN	return NULL
+
+#define threadstart(t,f,a)	(pthread_create(t, NULL, f, a) == 0)
+#define threadjoin(t)	pthread_join(t, NULL)
+
+#endif
+
+#endif
@@ -246,6 +246,8 @@ LUA_API void        (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void        (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t len);
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
+LUA_API const char *(lua_pushexternalstring) (lua_State *L, const char *s,
+                                   size_t len, lua_Alloc falloc, void *ud);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
 LUA_API const char *(lua_pushfstring) (lua_State *L, const char *fmt, ...);
@@ -297,10 +299,18 @@ LUA_API int   (lua_pcallk) (lua_State *L, int nargs, int nresults, int errfunc,
                             lua_KContext ctx, lua_KFunction k);
 #define lua_pcall(L,n,r,f)	lua_pcallk(L, (n), (r), (f), 0, NULL)
 
+/* a binary chunk loaded with 'F' in 'mode' may use the reader's buffers
+   in place: they must stay valid while the loaded functions live */
 LUA_API int   (lua_load) (lua_State *L, lua_Reader reader, void *dt,
                           const char *chunkname, const char *mode);
 
 LUA_API int (lua_dump) (lua_State *L, lua_Writer writer, void *data, int strip);
+/* 'aligned' pads code and terminates long strings so that a chunk
+   loaded with mode "bF" can use them in place; LUA_DUMPFUSED also keeps superinstructions, so only this
+   same build of Lua can load the chunk */
+#define LUA_DUMPFUSED	2
+LUA_API int (lua_dumpx) (lua_State *L, lua_Writer writer, void *data,
+                         int strip, int aligned);
 
 
 /*
@@ -357,6 +367,7 @@ LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
+LUA_API void      (lua_setsweepf) (lua_State *L, lua_Alloc f, void *ud);
 
 LUA_API void (lua_toclose) (lua_State *L, int idx);
 LUA_API void (lua_closeslot) (lua_State *L, int idx);
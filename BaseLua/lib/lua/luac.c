@@ -185,7 +185,7 @@ static int pmain(lua_State* L)
   FILE* D= (output==NULL) ? stdout : fopen(output,"wb");
   if (D==NULL) cannot("open");
   lua_lock(L);
-  luaU_dump(L,f,writer,D,stripping);
+  luaU_dump(L,f,writer,D,stripping,0);
   lua_unlock(L);
   if (ferror(D)) cannot("write");
   if (fclose(D)) cannot("close");
@@ -352,7 +352,7 @@ static void PrintCode(const Proto* f)
   printf("\t%d\t",pc+1);
   if (line>0) printf("[%d]\t",line); else printf("[-]\t");
   printf("%-9s\t",opnames[o]);
-  switch (o)
+  switch (luaP_unfuse(o))
   {
    case OP_MOVE:
 	printf("%d %d",a,b);
@@ -650,6 +650,8 @@ static void PrintCode(const Proto* f)
    case OP_EXTRAARG:
 	printf("%d",ax);
 	break;
+   case OP_GETTABUPF:
+	break;		/* printed as its base opcode */
 #if 0
    default:
 	printf("%d %d %d",a,b,c);
@@ -727,6 +727,26 @@
 #define luai_apicheck(l,e)	assert(e)
 #endif
 
+
+/*
+@@ LUAI_OPENHASH makes the hash part of tables an open-addressing table
+** probed in groups of nodes through one metadata byte per node, which
+** grows incrementally when large (see ltable.c), instead of a chained
+** scatter table. It is off by default: lookups are slower with it
+** (by up to about 45% in our measurements), so define it only when
+** tables with many keys in their hash parts spend too much time
+** rehashing. (It changes the layout of tables, so it must be the same
+** in all of Lua's core.)
+*/
+/* #define LUAI_OPENHASH */
+
+
+/*
+@@ LUAI_NOICACHE turns off the inline caches of field accesses (see
+** 'luaH_getshortstrcached'), so that their effect can be measured.
+*/
+/* #define LUAI_NOICACHE */
+
 /* }================================================================== */
 
 
@@ -20,6 +20,7 @@
 #include "lfunc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstring.h"
 #include "lundump.h"
 #include "lzio.h"
@@ -34,6 +35,10 @@ typedef struct {
   lua_State *L;
   ZIO *Z;
   const char *name;
+  size_t offset;  /* current position in the chunk */
+  int aligned;  /* chunk uses format LUAC_FORMAT_ALIGNED or _FUSED */
+  int fused;  /* chunk uses format LUAC_FORMAT_FUSED */
+  int fixed;  /* chunk buffer outlives everything loaded from it */
 } LoadState;
 
 
@@ -52,6 +57,7 @@ static l_noret error (LoadState *S, const char *why) {
 static void loadBlock (LoadState *S, void *b, size_t size) {
   if (luaZ_read(S->Z, b, size) != 0)
     error(S, "truncated chunk");
+  S->offset += size;
 }
 
 
@@ -62,10 +68,44 @@ static lu_byte loadByte (LoadState *S) {
   int b = zgetc(S->Z);
   if (b == EOZ)
     error(S, "truncated chunk");
+  S->offset++;
   return cast_byte(b);
 }
 
 
+/*
+** Skip the padding that an aligned dump puts before a vector whose
+** elements have size 'align'.
+*/
+static void loadAlign (LoadState *S, size_t align) {
+  if (S->aligned) {
+    size_t pad = (align - S->offset % align) % align;
+    while (pad-- > 0)
+      loadByte(S);
+  }
+}
+
+
+/*
+** In fixed mode, return a pointer to the next 'size' bytes of the chunk
+** buffer itself, so that the caller can use them in place. Returns NULL
+** (and consumes nothing) when that is not possible: not in fixed mode,
+** the block is split across reader calls, or it is misaligned.
+*/
+static const void *loadFixed (LoadState *S, size_t size, size_t align) {
+  ZIO *Z = S->Z;
+  if (S->fixed && size > 0 && Z->n >= size &&
+      point2uint(Z->p) % align == 0) {
+    const void *b = Z->p;
+    Z->p += size;
+    Z->n -= size;
+    S->offset += size;
+    return b;
+  }
+  return NULL;
+}
+
+
 static size_t loadUnsigned (LoadState *S, size_t limit) {
   size_t x = 0;
   int b;
@@ -110,19 +150,32 @@ static lua_Integer loadInteger (LoadState *S) {
 static TString *loadStringN (LoadState *S, Proto *p) {
   lua_State *L = S->L;
   TString *ts;
+  const char *s;
   size_t size = loadSize(S);
   if (size == 0)  /* no string? */
     return NULL;
   else if (--size <= LUAI_MAXSHORTLEN) {  /* short string? */
     char buff[LUAI_MAXSHORTLEN];
-    loadVector(S, buff, size);  /* load string into buffer */
-    ts = luaS_newlstr(L, buff, size);  /* create string */
+    s = cast_charp(loadFixed(S, size, 1));
+    if (s == NULL) {
+      loadVector(S, buff, size);  /* load string into buffer */
+      s = buff;
+    }
+    ts = luaS_newlstr(L, s, size);  /* create (internalized) string */
+  }
+  else if (S->aligned &&  /* long string with a terminator in the buffer? */
+           (s = cast_charp(loadFixed(S, size + 1, 1))) != NULL) {
+    if (s[size] != '\0')
+      error(S, "unterminated string");
+    ts = luaS_newextlngstr(L, s, size, NULL, NULL);  /* use it in place */
   }
   else {  /* long string */
     ts = luaS_createlngstrobj(L, size);  /* create string */
     setsvalue2s(L, L->top.p, ts);  /* anchor it ('loadVector' can GC) */
     luaD_inctop(L);
     loadVector(S, getlngstr(ts), size);  /* load directly in final place */
+    if (S->aligned && loadByte(S) != '\0')
+      error(S, "unterminated string");
     L->top.p--;  /* pop string */
   }
   luaC_objbarrier(L, p, ts);
@@ -143,9 +196,25 @@ static TString *loadString (LoadState *S, Proto *p) {
 
 static void loadCode (LoadState *S, Proto *f) {
   int n = loadInt(S);
-  f->code = luaM_newvectorchecked(S->L, n, Instruction);
-  f->sizecode = n;
-  loadVector(S, f->code, n);
+  const void *fixed;
+  loadAlign(S, sizeof(Instruction));
+  fixed = loadFixed(S, cast_sizet(n) * sizeof(Instruction),
+                       sizeof(Instruction));
+  if (fixed != NULL) {  /* use code in place? */
+    f->code = cast(Instruction *, fixed);
+    f->sizecode = n;
+    f->flag |= PF_FIXEDCODE;  /* (read only, so fused only if dumped so) */
+  }
+  else {
+    f->code = luaM_newvectorchecked(S->L, n, Instruction);
+    f->sizecode = n;
+    loadVector(S, f->code, n);
+    if (!S->fused && luaP_fuse(f->code, n) > 0)
+      f->flag |= PF_FUSED;
+  }
+  if (S->fused)  /* code may have superinstructions */
+    f->flag |= PF_FUSED;
+  luaF_initcache(S->L, f);
 }
 
 
@@ -226,10 +295,19 @@ static void loadUpvalues (LoadState *S, Proto *f) {
 
 static void loadDebug (LoadState *S, Proto *f) {
   int i, n;
+  const void *fixed;
   n = loadInt(S);
-  f->lineinfo = luaM_newvectorchecked(S->L, n, ls_byte);
-  f->sizelineinfo = n;
-  loadVector(S, f->lineinfo, n);
+  fixed = loadFixed(S, cast_sizet(n), sizeof(ls_byte));
+  if (fixed != NULL) {  /* use line information in place? */
+    f->lineinfo = cast(ls_byte *, fixed);
+    f->sizelineinfo = n;
+    f->flag |= PF_FIXEDLINE;
+  }
+  else {
+    f->lineinfo = luaM_newvectorchecked(S->L, n, ls_byte);
+    f->sizelineinfo = n;
+    loadVector(S, f->lineinfo, n);
+  }
   n = loadInt(S);
   f->abslineinfo = luaM_newvectorchecked(S->L, n, AbsLineInfo);
   f->sizeabslineinfo = n;
@@ -294,8 +372,12 @@ static void checkHeader (LoadState *S) {
   checkliteral(S, &LUA_SIGNATURE[1], "not a binary chunk");
   if (loadByte(S) != LUAC_VERSION)
     error(S, "version mismatch");
-  if (loadByte(S) != LUAC_FORMAT)
-    error(S, "format mismatch");
+  switch (loadByte(S)) {
+    case LUAC_FORMAT: S->aligned = 0; break;
+    case LUAC_FORMAT_ALIGNED: S->aligned = 1; break;
+    case LUAC_FORMAT_FUSED: S->aligned = 1; S->fused = 1; break;
+    default: error(S, "format mismatch");
+  }
   checkliteral(S, LUAC_DATA, "corrupted chunk");
   checksize(S, Instruction);
   checksize(S, lua_Integer);
@@ -308,9 +390,13 @@ static void checkHeader (LoadState *S) {
 
 
 /*
-** Load precompiled chunk.
+** Load precompiled chunk. When 'fixed' is true, the caller guarantees
+** that the buffers returned by the reader stay valid and unchanged for
+** as long as the loaded functions live, so that code and line
+** information, and long strings of aligned dumps, can be used in place
+** instead of copied.
 */
-LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
+LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name, int fixed) {
   LoadState S;
   LClosure *cl;
   if (*name == '@' || *name == '=')
@@ -321,6 +407,10 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
     S.name = name;
   S.L = L;
   S.Z = Z;
+  S.offset = 1;  /* 1st char was already read */
+  S.aligned = 0;
+  S.fused = 0;
+  S.fixed = fixed;
   checkHeader(&S);
   cl = luaF_newLclosure(L, loadByte(&S));
   setclLvalue2s(L, L->top.p, cl);
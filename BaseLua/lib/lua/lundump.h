@@ -24,12 +24,18 @@
 #define LUAC_VERSION  (((LUA_VERSION_NUM / 100) * 16) + LUA_VERSION_NUM % 100)
 
 #define LUAC_FORMAT	0	/* this is the official format */
+#define LUAC_FORMAT_ALIGNED	1	/* official format plus padding that
+				   aligns vectors to their element size
+				   and a '\0' after each long string */
+#define LUAC_FORMAT_FUSED	2	/* aligned format whose code keeps its
+				   superinstructions (see 'luaP_fuse') */
 
 /* load one chunk; from lundump.c */
-LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name);
+LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name,
+                                 int fixed);
 
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w,
-                         void* data, int strip);
+                         void* data, int strip, int aligned);
 
 #endif
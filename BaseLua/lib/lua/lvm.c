@@ -818,7 +818,7 @@ void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->func.p + 1;
   Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
-  OpCode op = GET_OPCODE(inst);
+  OpCode op = luaP_unfuse(GET_OPCODE(inst));
   switch (op) {  /* finish its execution */
     case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
       setobjs2s(L, base + GETARG_A(*(ci->u.l.savedpc - 2)), --L->top.p);
@@ -1050,6 +1050,48 @@ void luaV_finishOp (lua_State *L) {
   }  \
   docondjump(); }
 
+
+/*
+** Bodies of the opcodes that superinstructions combine (shared by the
+** opcode itself and the superinstructions).
+*/
+#define op_gettabup(L) {  \
+  StkId ra = RA(i);  \
+  const TValue *slot;  \
+  TValue *upval = cl->upvals[GETARG_B(i)]->v.p;  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a short string */  \
+  if (luaV_fastgetcached(L, upval, key, slot, ICACHE(pc))) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(luaV_finishget(L, upval, rc, ra, slot)); }
+
+
+#define op_getfield(L) {  \
+  StkId ra = RA(i);  \
+  const TValue *slot;  \
+  TValue *rb = vRB(i);  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a short string */  \
+  if (luaV_fastgetcached(L, rb, key, slot, ICACHE(pc))) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(luaV_finishget(L, rb, rc, ra, slot)); }
+
+
+/*
+** Run the next instruction of a superinstruction sequence without
+** dispatching it, which requires that no hook is waiting for it.
+** (It also skips when 'trap' signals that 'base' may have changed.)
+*/
+#define fusednext(op,body) \
+  if (l_likely(!trap)) {  \
+    i = *(pc++);  \
+    lua_assert(luaP_unfuse(GET_OPCODE(i)) == op);  \
+    body; }
+
 /* }================================================================== */
 
 
@@ -1073,6 +1115,9 @@ void luaV_finishOp (lua_State *L) {
 #define KC(i)	(k+GETARG_C(i))
 #define RKC(i)	((TESTARG_k(i)) ? k + GETARG_C(i) : s2v(base + GETARG_C(i)))
 
+/* inline cache of the current instruction ('pc' already points past it) */
+#define ICACHE(pc)	(&cl->p->icache[(pc) - cl->p->code - 1])
+
 
 
 #define updatetrap(ci)  (trap = ci->u.l.trap)
@@ -1250,16 +1295,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_GETTABUP) {
-        StkId ra = RA(i);
-        const TValue *slot;
-        TValue *upval = cl->upvals[GETARG_B(i)]->v.p;
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a short string */
-        if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(luaV_finishget(L, upval, rc, ra, slot));
+        op_gettabup(L);
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
@@ -1293,16 +1329,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_GETFIELD) {
-        StkId ra = RA(i);
-        const TValue *slot;
-        TValue *rb = vRB(i);
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a short string */
-        if (luaV_fastget(L, rb, key, slot, luaH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(luaV_finishget(L, rb, rc, ra, slot));
+        op_getfield(L);
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1387,7 +1414,9 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobj2s(L, ra + 1, rb);
-        if (luaV_fastget(L, rb, key, slot, luaH_getstr)) {
+        if (key->tt == LUA_VSHRSTR
+              ? luaV_fastgetcached(L, rb, key, slot, ICACHE(pc))
+              : luaV_fastget(L, rb, key, slot, luaH_getstr)) {
           setobj2s(L, ra, slot);
         }
         else
@@ -1895,6 +1924,11 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_GETTABUPF) {
+        op_gettabup(L);
+        fusednext(OP_GETFIELD, op_getfield(L));
+        vmbreak;
+      }
     }
   }
 }
@@ -89,6 +89,22 @@ typedef enum {
       !isempty(slot)))  /* result not empty? */
 
 
+/*
+** Variant of 'luaV_fastget' for short-string keys with an inline cache
+** 'ic' (see 'luaH_getshortstrcached').
+*/
+#if defined(LUAI_NOICACHE)
+#define luaV_fastgetcached(L,t,k,slot,ic) \
+	luaV_fastget(L,t,k,slot,luaH_getshortstr)
+#else
+#define luaV_fastgetcached(L,t,k,slot,ic) \
+  (!ttistable(t)  \
+   ? (slot = NULL, 0)  /* not a table; 'slot' is NULL and result is 0 */  \
+   : (slot = luaH_getshortstrcached(hvalue(t), k, ic),  \
+      !isempty(slot)))  /* result not empty? */
+#endif
+
+
 /*
 ** Special case of 'luaV_fastget' for integers, inlining the fast case
 ** of 'luaH_getint'.
@@ -0,0 +1,317 @@
+//!zig-autodoc-section: BaseLua\\luabind.zig
+//! luabind.zig :
+//!  Lua bindings generated at comptime from Zig function signatures.
+// Build using Zig 0.16.0
+
+//=============================================================================
+//#region MARK: GLOBAL
+//=============================================================================
+const std = @import("std");
+
+/// Bindings over the Lua C API imported as `c` (the `@cImport` of lua.h,
+/// lauxlib.h and lualib.h), e.g. `const bind = @import("luabind.zig").Bind(lua);`.
+///
+/// Arguments are converted from the Lua stack in one pass, each with a
+/// single type check, and nothing is allocated:
+///  - integers, floats, bool;
+///  - enums, from the name of a tag;
+///  - `[]const u8` and `[:0]const u8`, borrowed from the Lua string for
+///    the duration of the call;
+///  - slices of f32, f64, i32 and u8, used in place from a typed array
+///    of the same element type (see 'array' library);
+///  - fixed size arrays, from a sequence;
+///  - structs, from a table by field name (absent fields take their
+///    default values) or from a userdata of the struct;
+///  - pointers to structs, to a userdata made with `Userdata`;
+///  - optionals, null for nil or absent arguments;
+///  - `*lua_State`, the calling state (takes no Lua argument).
+///
+/// Results: void, the value types above (slices are copied into a new
+/// typed array, structs into a new table), `Userdata(T)`, tuples (one
+/// result per field) and error unions (an error is raised with the name
+/// of the error).
+pub fn Bind(comptime c: type) type {
+  return struct {
+    const State = c.lua_State;
+
+    pub const Error = error{ Type, NotInteger, Range, Option };
+
+    /// Result type of a bound function that returns `value` as a new full
+    /// userdata with the metatable of `T` (see `newMetatable`).
+    pub fn Userdata(comptime T: type) type {
+      return struct {
+        value: T,
+        pub const luabind_userdata = T;
+      };
+    }
+
+//#endregion ==================================================================
+//#region MARK: REGISTER
+//=============================================================================
+
+    /// The `lua_CFunction` calling `f`.
+    pub fn wrap(comptime f: anytype) c.lua_CFunction {
+      return &Thunk(f).call;
+    }
+
+    /// Set each function of `fns` (e.g. `.{ .add = add }`) as a field of
+    /// the table on the top of the stack, like `luaL_setfuncs`.
+    pub fn setFuncs(L: ?*State, comptime fns: anytype) void {
+      inline for (std.meta.fields(@TypeOf(fns))) |field| {
+        c.lua_pushcclosure(L, wrap(@field(fns, field.name)), 0);
+        c.lua_setfield(L, -2, field.name.ptr);
+      }
+    }
+
+    /// Push the metatable of userdata of `T`, creating it with the
+    /// functions of `methods` as its methods when it does not exist yet.
+    /// It must exist before the first `Userdata(T)` is returned to get
+    /// the methods.
+    pub fn newMetatable(L: ?*State, comptime T: type, comptime methods: anytype) void {
+      if (c.luaL_newmetatable(L, tname(T)) != 0) {
+        c.lua_pushvalue(L, -1);
+        c.lua_setfield(L, -2, "__index");
+        setFuncs(L, methods);
+      }
+    }
+
+    fn tname(comptime T: type) [*:0]const u8 {
+      return @typeName(T);
+    }
+
+    fn Thunk(comptime f: anytype) type {
+      const F = @TypeOf(f);
+      const params = @typeInfo(F).@"fn".params;
+      return struct {
+        fn call(L: ?*State) callconv(.c) c_int {
+          var args: std.meta.ArgsTuple(F) = undefined;
+          comptime var idx: c_int = 0;
+          inline for (params, 0..) |p, i| {
+            const T = p.type orelse @compileError("luabind: generic parameter in " ++ @typeName(F));
+            if (T == *State or T == ?*State) {
+              args[i] = if (T == *State) L.? else L;
+            } else {
+              idx += 1;
+              args[i] = get(T, L, idx) catch |err| return argError(L, idx, T, err);
+            }
+          }
+          return pushResults(L, @call(.auto, f, args));
+        }
+      };
+    }
+
+    fn argError(L: ?*State, idx: c_int, comptime T: type, err: Error) c_int {
+      return switch (err) {
+        error.Type => c.luaL_typeerror(L, idx, expected(T)),
+        error.NotInteger => c.luaL_argerror(L, idx, "number has no integer representation"),
+        error.Range => c.luaL_argerror(L, idx, "value out of range"),
+        error.Option => c.luaL_argerror(L, idx, "invalid option"),
+      };
+    }
+
+    fn expected(comptime T: type) [*:0]const u8 {
+      return switch (@typeInfo(T)) {
+        .int => "integer",
+        .float => "number",
+        .@"enum" => "string",
+        .optional => |opt| expected(opt.child),
+        .pointer => |ptr|
+          if (ptr.size == .one) tname(ptr.child)
+          else if (T == []const u8 or T == [:0]const u8) "string"
+          else "array",
+        .array => "table",
+        else => tname(T),
+      };
+    }
+
+//#endregion ==================================================================
+//#region MARK: CONVERT
+//=============================================================================
+
+    /// Convert the value at `idx` to `T` (see `Bind`).
+    pub fn get(comptime T: type, L: ?*State, idx: c_int) Error!T {
+      switch (@typeInfo(T)) {
+        .int => {
+          var isnum: c_int = 0;
+          const v = c.lua_tointegerx(L, idx, &isnum);
+          if (isnum == 0)
+            return if (c.lua_isnumber(L, idx) != 0) error.NotInteger else error.Type;
+          return std.math.cast(T, v) orelse error.Range;
+        },
+        .float => {
+          var isnum: c_int = 0;
+          const v = c.lua_tonumberx(L, idx, &isnum);
+          if (isnum == 0)
+            return error.Type;
+          return @floatCast(v);
+        },
+        .bool => return c.lua_toboolean(L, idx) != 0,
+        .@"enum" => {
+          var len: usize = 0;
+          if (c.lua_type(L, idx) != c.LUA_TSTRING)
+            return error.Type;
+          const s = c.lua_tolstring(L, idx, &len);
+          return std.meta.stringToEnum(T, s[0..len]) orelse error.Option;
+        },
+        .optional => |opt| {
+          if (c.lua_type(L, idx) <= c.LUA_TNIL)  // nil or none?
+            return null;
+          return try get(opt.child, L, idx);
+        },
+        .pointer => |ptr| {
+          if (T == []const u8 or T == [:0]const u8) {
+            var len: usize = 0;
+            const s = c.lua_tolstring(L, idx, &len) orelse return error.Type;
+            return if (T == [:0]const u8) s[0..len :0] else s[0..len];
+          }
+          if (ptr.size == .slice and ptr.sentinel_ptr == null) {
+            const a = c.luaL_toarray(L, idx) orelse return error.Type;
+            if (a.*.type != arrayType(ptr.child))
+              return error.Type;
+            const data: [*]ptr.child = @ptrCast(@alignCast(a.*.data));
+            return data[0..a.*.n];
+          }
+          if (ptr.size == .one and @typeInfo(ptr.child) == .@"struct") {
+            const p = c.luaL_testudata(L, idx, tname(ptr.child)) orelse return error.Type;
+            return @ptrCast(@alignCast(p));
+          }
+          @compileError("luabind: unsupported argument type " ++ @typeName(T));
+        },
+        .array => |arr| {
+          const t = c.lua_absindex(L, idx);
+          if (c.lua_type(L, t) != c.LUA_TTABLE)
+            return error.Type;
+          var v: T = undefined;
+          for (&v, 1..) |*e, i| {
+            _ = c.lua_rawgeti(L, t, @intCast(i));
+            const r = get(arr.child, L, -1);
+            c.lua_settop(L, -2);
+            e.* = try r;
+          }
+          return v;
+        },
+        .@"struct" => |st| {
+          if (st.is_tuple)
+            @compileError("luabind: unsupported argument type " ++ @typeName(T));
+          const t = c.lua_absindex(L, idx);
+          switch (c.lua_type(L, t)) {
+            c.LUA_TTABLE => {},
+            c.LUA_TUSERDATA => {
+              const p = c.luaL_testudata(L, t, tname(T)) orelse return error.Type;
+              return @as(*T, @ptrCast(@alignCast(p))).*;
+            },
+            else => return error.Type,
+          }
+          var v: T = undefined;
+          inline for (st.fields) |field| {
+            const default = comptime field.defaultValue();
+            const ltype = c.lua_getfield(L, t, field.name.ptr);
+            const r: Error!field.type =
+              if (default != null and ltype == c.LUA_TNIL) default.? else get(field.type, L, -1);
+            c.lua_settop(L, -2);
+            @field(v, field.name) = try r;
+          }
+          return v;
+        },
+        else => @compileError("luabind: unsupported argument type " ++ @typeName(T)),
+      }
+    }
+
+    /// Push `value` onto the stack (see `Bind`).
+    pub fn push(L: ?*State, value: anytype) void {
+      const T = @TypeOf(value);
+      switch (@typeInfo(T)) {
+        .comptime_int => c.lua_pushinteger(L, value),
+        .int => {
+          if (std.math.cast(c.lua_Integer, value)) |i|
+            c.lua_pushinteger(L, i)
+          else
+            c.lua_pushnumber(L, @floatFromInt(value));
+        },
+        .float, .comptime_float => c.lua_pushnumber(L, value),
+        .bool => c.lua_pushboolean(L, @intFromBool(value)),
+        .@"enum" => {
+          const name = @tagName(value);
+          _ = c.lua_pushlstring(L, name.ptr, name.len);
+        },
+        .optional => {
+          if (value) |v| push(L, v) else c.lua_pushnil(L);
+        },
+        .pointer => |ptr| {
+          if (ptr.size == .one and @typeInfo(ptr.child) == .array)  // e.g. a string literal
+            return push(L, @as([]const std.meta.Elem(ptr.child), value));
+          if (ptr.size != .slice)
+            @compileError("luabind: unsupported result type " ++ @typeName(T));
+          if (ptr.child == u8 and ptr.is_const) {
+            _ = c.lua_pushlstring(L, value.ptr, value.len);
+          } else {
+            const data: [*]ptr.child = @ptrCast(@alignCast(c.luaL_newarray(L, arrayType(ptr.child), value.len).?));
+            @memcpy(data[0..value.len], value);
+          }
+        },
+        .array => {
+          c.lua_createtable(L, @intCast(value.len), 0);
+          for (value, 1..) |e, i| {
+            push(L, e);
+            c.lua_rawseti(L, -2, @intCast(i));
+          }
+        },
+        .@"struct" => |st| {
+          if (@hasDecl(T, "luabind_userdata")) {
+            const U = T.luabind_userdata;
+            if (@alignOf(U) > 8)  // LUAI_MAXALIGN
+              @compileError("luabind: userdata alignment too large for " ++ @typeName(U));
+            const p: *U = @ptrCast(@alignCast(c.lua_newuserdatauv(L, @sizeOf(U), 0).?));
+            p.* = value.value;
+            _ = c.luaL_newmetatable(L, tname(U));
+            c.lua_setmetatable(L, -2);
+            return;
+          }
+          if (st.is_tuple)
+            @compileError("luabind: tuples are only supported as results: " ++ @typeName(T));
+          c.lua_createtable(L, 0, st.fields.len);
+          inline for (st.fields) |field| {
+            push(L, @field(value, field.name));
+            c.lua_setfield(L, -2, field.name.ptr);
+          }
+        },
+        else => @compileError("luabind: unsupported result type " ++ @typeName(T)),
+      }
+    }
+
+    fn pushResults(L: ?*State, r: anytype) c_int {
+      const R = @TypeOf(r);
+      switch (@typeInfo(R)) {
+        .void => return 0,
+        .error_union => {
+          const v = r catch |err| return c.luaL_error(L, "%s", @errorName(err).ptr);
+          return pushResults(L, v);
+        },
+        .@"struct" => |st| {
+          if (st.is_tuple) {
+            c.luaL_checkstack(L, st.fields.len, "too many results");
+            inline for (st.fields) |field|
+              push(L, @field(r, field.name));
+            return st.fields.len;
+          }
+        },
+        else => {},
+      }
+      push(L, r);
+      return 1;
+    }
+
+    fn arrayType(comptime E: type) c_int {
+      return switch (E) {
+        f32 => c.LUAL_AF32,
+        f64 => c.LUAL_AF64,
+        i32 => c.LUAL_AI32,
+        u8 => c.LUAL_AU8,
+        else => @compileError("luabind: no typed array of " ++ @typeName(E)),
+      };
+    }
+  };
+}
+
+//#endregion ==================================================================
+//=============================================================================
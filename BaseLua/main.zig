@@ -17,6 +17,10 @@ const lua = @cImport({
   @cInclude("lib/lua/lauxlib.h");
   @cInclude("stdio.h");    
 });
+// Lua bindings generated from Zig function signatures
+const bind = @import("luabind.zig").Bind(lua);
+// Build options (see build.zig)
+const config = @import("config");
 
 //#endregion ==================================================================
 //#region MARK: MAIN
@@ -24,24 +28,24 @@ const lua = @cImport({
 pub fn main() u8 {
   //HideConsoleWindow();
   const stderr = std.log.err;
-  const lua_state = lua.luaL_newstate();
+  const lua_state = lua.luaL_newpoolstate(0) orelse {
+    stderr("Couldn't create Lua state: out of memory\n", .{});
+    return 3; // "Failed to create Lua state"
+  };
   defer lua.lua_close(lua_state);
 
   lua.luaL_openlibs(lua_state);
 
-  if (lua.luaL_loadfilex(lua_state, "script.lua", null) != 0) {
+  // With -Dluacache=DIR, precompiled chunks are kept in DIR and used in
+  // place on later runs; otherwise the script is compiled on every run
+  if (lua.luaL_loadfilecached(lua_state, "script.lua", if (config.luacache) |dir| dir.ptr else null) != 0) {
     stderr("Couldn't load file: {s}\n", .{lua.lua_tolstring(lua_state, -1, null)});
     return 1; // "Failed to load Lua script"
   }
 
-  lua.lua_newtable(lua_state);
-
-  var i: c_int = 1;
-  while (i <= 5) : (i += 1) {
-    lua.lua_pushnumber(lua_state, @floatFromInt(i));
-    lua.lua_pushnumber(lua_state, @floatFromInt(i * 2));
-    lua.lua_rawset(lua_state, -3);
-  }
+  var foo: [5]f64 = undefined;
+  for (&foo, 1..) |*v, i| v.* = @floatFromInt(i * 2);
+  bind.push(lua_state, foo);
 
   lua.lua_setglobal(lua_state, "foo");
 
@@ -51,7 +55,7 @@ pub fn main() u8 {
     return 2; // "Failed to run Lua script"
   }
 
-  const sum = lua.lua_tonumberx(lua_state, -1, null);
+  const sum = bind.get(f64, lua_state, -1) catch 0;
 
   _ = lua.printf("Script returned: %.0f\n", sum);
 
@@ -113,5 +117,586 @@ test " empty" {
   try std.testing.expect(true);
 }
 
+test " typedArrayShare" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  // Zig memory used by Lua in place
+  var samples = [_]f64{ 1.0, 2.0, 3.0, 4.0 };
+  lua.luaL_pusharray(L, lua.LUAL_AF64, &samples, samples.len, null, null);
+  lua.lua_setglobal(L, "samples");
+  try std.testing.expect(lua.luaL_loadstring(L, "samples:mul(2); samples[2] = samples:sum()") == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+  try std.testing.expectEqual(@as(f64, 2.0), samples[0]);
+  try std.testing.expectEqual(@as(f64, 20.0), samples[1]);
+
+  // Lua memory used by Zig in place
+  try std.testing.expect(lua.luaL_loadstring(L, "local a = array.new('i32', 3); a[2] = 7; return a") == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 1, 0, 0, null) == 0);
+  const arr = lua.luaL_toarray(L, -1) orelse return error.NotAnArray;
+  const elems: [*]i32 = @ptrCast(@alignCast(arr.*.data));
+  try std.testing.expectEqual(@as(i32, 7), elems[1]);
+  elems[2] = 9;
+  lua.lua_setglobal(L, "shared");
+  try std.testing.expect(lua.luaL_loadstring(L, "return shared:sum()") == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 1, 0, 0, null) == 0);
+  try std.testing.expectEqual(@as(lua.lua_Integer, 16), lua.lua_tointegerx(L, -1, null));
+}
+
+fn writeFile(path: [*:0]const u8, bytes: []const u8) !void {
+  const f = lua.fopen(path, "wb") orelse return error.FileNotFound;
+  defer _ = lua.fclose(f);
+  if (lua.fwrite(bytes.ptr, 1, bytes.len, f) != bytes.len) return error.WriteFailed;
+}
+
+fn readFile(path: [*:0]const u8, buf: []u8) ![]u8 {
+  const f = lua.fopen(path, "rb") orelse return error.FileNotFound;
+  defer _ = lua.fclose(f);
+  return buf[0..lua.fread(buf.ptr, 1, buf.len, f)];
+}
+
+/// Load 'path' through the cache in '.' in a new state and return what
+/// it returns, copied into 'out'.
+fn runCached(path: [*:0]const u8, out: []u8) ![]u8 {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  if (lua.luaL_loadfilecached(L, path, ".") != 0) return error.LoadFailed;
+  if (lua.lua_pcallk(L, 0, 1, 0, 0, null) != 0) return error.RunFailed;
+  var len: usize = 0;
+  const s = lua.lua_tolstring(L, -1, &len);
+  @memcpy(out[0..len], s[0..len]);
+  return out[0..len];
+}
+
+test " chunkCache" {
+  const src = "luacache_test.lua";
+  // entries are named by the FNV-1a hash of the chunk name
+  var name: [32]u8 = undefined;
+  const path = try std.fmt.bufPrintZ(&name, "./{x:0>16}.luac", .{std.hash.Fnv1a_64.hash("@" ++ src)});
+  defer _ = lua.remove(src);
+  defer _ = lua.remove(path);
+  const long = "a long string constant, used in place from the cache file";
+  var out: [128]u8 = undefined;
+  var buf: [4096]u8 = undefined;
+
+  // miss: compiled and stored
+  try writeFile(src, "return 'cached01' .. '" ++ long ++ "'");
+  try std.testing.expectEqualStrings("cached01" ++ long, try runCached(src, &out));
+  const entry = try readFile(path, &buf);
+  try std.testing.expect(entry.len > 48);
+
+  // hit: the stored chunk runs, not the source
+  const at = std.mem.indexOf(u8, entry, "cached01") orelse return error.NotCached;
+  entry[at + 7] = '2';
+  try writeFile(path, entry);
+  try std.testing.expectEqualStrings("cached02" ++ long, try runCached(src, &out));
+
+  // stale source: the entry is replaced
+  try writeFile(src, "return 'fresh'");
+  try std.testing.expectEqualStrings("fresh", try runCached(src, &out));
+  try std.testing.expectEqualStrings("fresh", try runCached(src, &out));
+
+  // corrupt file: a valid header over a damaged dump is ignored and replaced
+  const fresh = try readFile(path, &buf);
+  @memset(fresh[48..], 0xff);
+  try writeFile(path, fresh);
+  try std.testing.expectEqualStrings("fresh", try runCached(src, &out));
+  var again: [4096]u8 = undefined;
+  try std.testing.expect(!std.mem.eql(u8, fresh[48..], (try readFile(path, &again))[48..]));
+}
+
+var external_released: usize = 0;
+
+fn releaseExternal(ud: ?*anyopaque, ptr: ?*anyopaque, osize: usize, nsize: usize) callconv(.c) ?*anyopaque {
+  _ = ud;
+  _ = ptr;
+  _ = nsize;
+  external_released += osize;
+  return null;
+}
+
+test " externalString" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  // Zig buffer seen by Lua as a string, without a copy
+  var payload: [4096:0]u8 = undefined;
+  @memset(&payload, 'x');
+  payload[0] = 'y';
+  const s = lua.lua_pushexternalstring(L, &payload, payload.len, releaseExternal, null);
+  try std.testing.expect(s == @as([*c]const u8, &payload));
+  lua.lua_setglobal(L, "payload");
+  try std.testing.expect(lua.luaL_loadstring(L, "assert(#payload == 4096 and payload:find('^yx')); payload = nil") == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+  _ = lua.lua_gc(L, lua.LUA_GCCOLLECT);
+  try std.testing.expectEqual(@as(usize, payload.len + 1), external_released);
+}
+
+/// Frees blocks but refuses to allocate any.
+fn failingAlloc(ud: ?*anyopaque, ptr: ?*anyopaque, osize: usize, nsize: usize) callconv(.c) ?*anyopaque {
+  _ = ud;
+  _ = osize;
+  if (nsize == 0) std.c.free(ptr);
+  return null;
+}
+
+var oom_payload = [_:0]u8{'o'} ** 4096;
+var oom_len: usize = 0;
+
+fn pushExternalNoMemory(L: ?*lua.lua_State) callconv(.c) c_int {
+  lua.lua_setallocf(L, failingAlloc, null);
+  oom_payload[oom_len] = 0;
+  _ = lua.lua_pushexternalstring(L, &oom_payload, oom_len, releaseExternal, null);
+  return 1;
+}
+
+test " externalStringOutOfMemory" {
+  // the buffer is released even when the string cannot be created
+  for ([_]usize{ 10, 4000 }) |len| {
+    const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+    defer lua.lua_close(L);
+    var ud: ?*anyopaque = null;
+    const f = lua.lua_getallocf(L, &ud);
+    external_released = 0;
+    oom_len = len;
+    lua.lua_pushcclosure(L, pushExternalNoMemory, 0);
+    const status = lua.lua_pcallk(L, 0, 1, 0, 0, null);
+    lua.lua_setallocf(L, f, ud);
+    try std.testing.expectEqual(@as(c_int, lua.LUA_ERRMEM), status);
+    try std.testing.expectEqual(len + 1, external_released);
+  }
+}
+
+test " profileFolded" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  try std.testing.expect(lua.luaL_profstart(L, 1000, 0) == 1);
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\local function spin() local t = os.clock() while os.clock() - t < 0.05 do end end
+    \\spin()
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+  try std.testing.expect(lua.luaL_profstop(L) > 0);
+  try std.testing.expect(lua.luaL_loadstring(L, "return profile.dump()") == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 1, 0, 0, null) == 0);
+  const folded = std.mem.span(lua.lua_tolstring(L, -1, null));
+  try std.testing.expect(std.mem.indexOf(u8, folded, "spin (") != null);
+}
+
+fn poolInit(L: ?*lua.lua_State, ud: ?*anyopaque) callconv(.c) c_int {
+  _ = ud;
+  if (lua.luaL_loadstring(L, "local n = ...; counter = (counter or 0) + n; return counter") != 0)
+    return lua.LUA_ERRSYNTAX;
+  lua.lua_setfield(L, lua.LUA_REGISTRYINDEX, "handler");
+  return lua.LUA_OK;
+}
+
+fn poolJob(L: ?*lua.lua_State, arg: ?*anyopaque) callconv(.c) c_int {
+  _ = arg;
+  _ = lua.lua_getfield(L, lua.LUA_REGISTRYINDEX, "handler");
+  lua.lua_pushinteger(L, 5);
+  const status = lua.lua_pcallk(L, 1, 1, 0, 0, null);
+  // globals written by a job must not leak into the next one
+  if (status == lua.LUA_OK and lua.lua_tointegerx(L, -1, null) != 5) return lua.LUA_ERRRUN;
+  return status;
+}
+
+test " statePool" {
+  const pool = lua.luaL_newstatepool(2, poolInit, null) orelse return error.OutOfMemory;
+  defer lua.luaL_closestatepool(pool);
+
+  for (0..100) |_| try std.testing.expect(lua.luaL_statepoolsubmit(pool, poolJob, null) == 1);
+  lua.luaL_statepoolwait(pool);
+  var st: lua.luaL_StatePoolStats = undefined;
+  lua.luaL_statepoolstats(pool, &st);
+  try std.testing.expectEqual(@as(usize, 100), st.done);
+  try std.testing.expectEqual(@as(usize, 0), st.failed);
+}
+
+var pool_allocf: lua.lua_Alloc = null;
+var pool_allocud: ?*anyopaque = null;
+
+/// Frees and shrinks blocks, but fails every allocation or growth.
+fn noGrowAlloc(ud: ?*anyopaque, ptr: ?*anyopaque, osize: usize, nsize: usize) callconv(.c) ?*anyopaque {
+  _ = ud;
+  if (ptr == null and nsize > 0 or ptr != null and nsize > osize) return null;
+  return pool_allocf.?(pool_allocud, ptr, osize, nsize);
+}
+
+fn poolBreakReset(L: ?*lua.lua_State, arg: ?*anyopaque) callconv(.c) c_int {
+  _ = arg;
+  // an empty global table, refilled by the reset with no memory to grow it
+  lua.lua_createtable(L, 0, 0);
+  lua.lua_rawseti(L, lua.LUA_REGISTRYINDEX, lua.LUA_RIDX_GLOBALS);
+  pool_allocf = lua.lua_getallocf(L, &pool_allocud);
+  lua.lua_setallocf(L, noGrowAlloc, null);
+  return lua.LUA_OK;
+}
+
+test " statePoolResetFailure" {
+  const pool = lua.luaL_newstatepool(1, poolInit, null) orelse return error.OutOfMemory;
+  defer lua.luaL_closestatepool(pool);
+
+  // a state that cannot be reset is dropped, and the next job gets a new one
+  try std.testing.expect(lua.luaL_statepoolsubmit(pool, poolBreakReset, null) == 1);
+  try std.testing.expect(lua.luaL_statepoolsubmit(pool, poolJob, null) == 1);
+  lua.luaL_statepoolwait(pool);
+  var st: lua.luaL_StatePoolStats = undefined;
+  lua.luaL_statepoolstats(pool, &st);
+  try std.testing.expectEqual(@as(usize, 2), st.done);
+  try std.testing.expectEqual(@as(usize, 1), st.restarts);
+}
+
+/// Allocator that keeps the live byte count and the frees done by other
+/// threads than the one that created the state.
+const SweepCount = struct {
+  owner: std.Thread.Id,
+  live: std.atomic.Value(isize) = .init(0),
+  offthread: std.atomic.Value(usize) = .init(0),
+};
+
+fn sweepCountAlloc(ud: ?*anyopaque, ptr: ?*anyopaque, osize: usize, nsize: usize) callconv(.c) ?*anyopaque {
+  const sc: *SweepCount = @ptrCast(@alignCast(ud));
+  const old: isize = if (ptr == null) 0 else @intCast(osize);
+  if (nsize == 0) {
+    if (ptr != null) {
+      _ = sc.live.fetchSub(old, .monotonic);
+      if (std.Thread.getCurrentId() != sc.owner) _ = sc.offthread.fetchAdd(1, .monotonic);
+      std.c.free(ptr);
+    }
+    return null;
+  }
+  const nb = std.c.realloc(ptr, nsize) orelse return null;
+  _ = sc.live.fetchAdd(@as(isize, @intCast(nsize)) - old, .monotonic);
+  return nb;
+}
+
+test " backgroundFree" {
+  var sc: SweepCount = .{ .owner = std.Thread.getCurrentId() };
+  const L = lua.lua_newstate(sweepCountAlloc, &sc) orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  try std.testing.expect(lua.luaL_bgfree(L, 1) == 1);
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\for round = 1, 5 do
+    \\  local t = {}
+    \\  for i = 1, 20000 do t[i] = {i, "s" .. i} end
+    \\  collectgarbage()
+    \\end
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+  try std.testing.expect(lua.luaL_bgfree(L, 0) == 1);  // waits for the helper
+
+  // the swept tables were freed by the helper, and all of them were freed:
+  // the allocator holds exactly what the collector counts as in use
+  try std.testing.expect(sc.offthread.load(.monotonic) >= 5 * 20000);
+  const in_use = @as(isize, lua.lua_gc(L, lua.LUA_GCCOUNT)) * 1024 + lua.lua_gc(L, lua.LUA_GCCOUNTB);
+  try std.testing.expectEqual(in_use, sc.live.load(.monotonic));
+
+  // pool allocators are not thread safe
+  const P = lua.luaL_newpoolstate(0) orelse return error.OutOfMemory;
+  defer lua.lua_close(P);
+  try std.testing.expect(lua.luaL_bgfree(P, 1) == 0);
+}
+
+test " tableChurn" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  // a table with as many keys removed as added keeps its size (in both
+  // hash layouts, see -Dopenhash)
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\local live = 3000
+    \\local t = {}
+    \\for i = 1, live do t["k" .. i] = i end
+    \\collectgarbage()
+    \\local base = collectgarbage("count")
+    \\for i = live + 1, live + 200000 do
+    \\  t["k" .. i] = i
+    \\  t["k" .. (i - live)] = nil
+    \\  if i % 997 == 0 then  -- also while a rebuild is moving keys
+    \\    local n = 0
+    \\    for k, v in pairs(t) do assert(t[k] == v); n = n + 1 end
+    \\    assert(n == live and t["k" .. (i - live + 1)] == i - live + 1)
+    \\  end
+    \\end
+    \\local n = 0
+    \\for k, v in pairs(t) do assert(t[k] == v); n = n + 1 end
+    \\assert(n == live and t["k" .. (live + 200000)] and not t["k1"])
+    \\collectgarbage()
+    \\assert(collectgarbage("count") < 2 * base)
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+}
+
+test " inlineCacheShapes" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  // reads through cached sites (GETFIELD, SELF, GETTABUP) must agree with
+  // uncached rawget while the tables they see change shape
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\local function get(t) return t.key end          -- GETFIELD
+    \\local function call(o) return o:m() end         -- SELF
+    \\local function glob() return key end            -- GETTABUP
+    \\local tabs = {}
+    \\for n = 0, 40 do                                -- tables of many sizes
+    \\  local t = {}
+    \\  for i = 1, n do t["f" .. i] = i end
+    \\  t.key = n
+    \\  tabs[#tabs + 1] = t
+    \\end
+    \\for round = 1, 200 do
+    \\  for i, t in ipairs(tabs) do
+    \\    assert(get(t) == rawget(t, "key"))
+    \\    -- change the shape: grow (rehash), shrink, move 'key'
+    \\    if round % 3 == 0 then t["g" .. round] = round end
+    \\    if round % 5 == 0 then t["g" .. (round - 3)] = nil end
+    \\    if round % 7 == 0 then t.key = nil; collectgarbage("step"); t.key = round + i end
+    \\    if round % 11 == 0 then t.key = nil end
+    \\    assert(get(t) == rawget(t, "key"))
+    \\    if get(t) == nil then t.key = i end
+    \\  end
+    \\end
+    \\-- methods found through a chain of metatables that changes
+    \\local A = {m = function() return "A" end} A.__index = A
+    \\local B = setmetatable({}, A) B.__index = B
+    \\local o = setmetatable({}, B)
+    \\for round = 1, 100 do
+    \\  local expect = rawget(o, "m") and "o" or rawget(B, "m") and "B" or "A"
+    \\  assert(call(o) == expect)
+    \\  if round % 4 == 1 then B.m = function() return "B" end
+    \\  elseif round % 4 == 2 then o.m = function() return "o" end
+    \\  elseif round % 4 == 3 then o.m = nil
+    \\  else B.m = nil; for i = 1, round do B["x" .. i] = i end end
+    \\end
+    \\-- globals table reshaped under GETTABUP
+    \\for round = 1, 300 do
+    \\  assert(glob() == rawget(_ENV, "key"))
+    \\  _ENV["v" .. round] = round
+    \\  if round % 2 == 0 then _ENV["v" .. (round // 2)] = nil end
+    \\  key = (round % 3 ~= 0) and round or nil
+    \\  assert(glob() == rawget(_ENV, "key"))
+    \\end
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+}
+
+const fuse_cases =
+  \\local out = {}
+  \\local function try(f, ...)
+  \\  local ok, r = pcall(f, ...)
+  \\  out[#out + 1] = tostring(ok) .. ":" .. (type(r) == "function" and "function" or tostring(r))
+  \\end
+  \\local function cases()
+  \\  -- GETTABUP + GETFIELD
+  \\  try(function() return math.pi + math.maxinteger end)
+  \\  try(function() return nosuch.field end)
+  \\  try(function() return string.nosuch.x end)
+  \\  setmetatable(_G, {__index = function(t, k) if k == "virt" then return {x = 7} end end})
+  \\  try(function() return virt.x + virt.x end)
+  \\  try(function() return virt.y.z end)
+  \\  setmetatable(_G, nil)
+  \\  -- field chains and counted loops: never fused, they check the hooks line up
+  \\  local e = {pos = {x = 1, y = 2}, mt = setmetatable({}, {__index = function(t, k) return k .. "!" end})}
+  \\  try(function() return e.pos.x + e.pos.y end)
+  \\  try(function() return e.vel.x end)
+  \\  try(function() return e.mt.abc end)
+  \\  try(function() return e.mt.abc.len end)
+  \\  try(function() return e.pos.x.y end)
+  \\  try(function() local s = 0 for i = 1, 10 do s = s + i end return s end)
+  \\  try(function() local s = 0 for i = 1, 3, 0.5 do s = s + i end return s end)
+  \\  try(function() local s = 0 for i = 1, 10 do s = s + 1 end return s end)
+  \\  try(function() local s = 0.5 for i = 1, 10 do s = s + 1 end return s end)
+  \\  try(function() local s = math.maxinteger - 2 for i = 1, 5 do s = s + 1 end return s end)
+  \\  try(function() local s = "x" for i = 1, 2 do s = s + i end return s end)
+  \\  try(function() local s = {} for i = 1, 2 do s = s + 1 end return s end)
+  \\  try(function() local s = "10" for i = 1, 3 do s = s + 1 end return s end)
+  \\  try(function()
+  \\    local s = setmetatable({n = 0}, {__add = function(a, b) a.n = a.n + b; return a end})
+  \\    for i = 1, 4 do s = s + i end
+  \\    return s.n
+  \\  end)
+  \\end
+  \\cases()
+  \\debug.sethook(function() end, "", 1)  -- a count hook on every instruction
+  \\cases()
+  \\debug.sethook()
+  \\local lines = {}
+  \\debug.sethook(function(_, l) lines[#lines + 1] = l end, "l")
+  \\cases()
+  \\debug.sethook()
+  \\out[#out + 1] = table.concat(lines, ",")
+  \\return table.concat(out, "\n")
+;
+
+const Chunk = struct { gpa: std.mem.Allocator, buf: *std.ArrayList(u8) };
+
+fn appendChunk(L: ?*lua.lua_State, p: ?*const anyopaque, sz: usize, ud: ?*anyopaque) callconv(.c) c_int {
+  _ = L;
+  const out: *Chunk = @ptrCast(@alignCast(ud));
+  const bytes: [*]const u8 = @ptrCast(p orelse return 0);
+  out.buf.appendSlice(out.gpa, bytes[0..sz]) catch return 1;
+  return 0;
+}
+
+test " fusedMatchesUnfused" {
+  const gpa = std.testing.allocator;
+  // fused: compiled from source
+  const A = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(A);
+  lua.luaL_openlibs(A);
+  try std.testing.expect(lua.luaL_loadbufferx(A, fuse_cases, fuse_cases.len, "=fuse", "t") == 0);
+  try std.testing.expect(lua.lua_pcallk(A, 0, 1, 0, 0, null) == 0);
+
+  // unfused: code of an aligned dump used in place is never fused
+  const B = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(B);
+  lua.luaL_openlibs(B);
+  var dump: std.ArrayList(u8) = .empty;
+  defer dump.deinit(gpa);
+  try std.testing.expect(lua.luaL_loadbufferx(B, fuse_cases, fuse_cases.len, "=fuse", "t") == 0);
+  var out: Chunk = .{ .gpa = gpa, .buf = &dump };
+  try std.testing.expect(lua.lua_dumpx(B, appendChunk, &out, 0, 1) == 0);
+  lua.lua_settop(B, 0);
+  const code = try gpa.alignedAlloc(u8, .@"16", dump.items.len);
+  defer gpa.free(code);
+  @memcpy(code, dump.items);
+  try std.testing.expect(lua.luaL_loadbufferx(B, code.ptr, code.len, "=fuse", "bF") == 0);
+  try std.testing.expect(lua.lua_pcallk(B, 0, 1, 0, 0, null) == 0);
+
+  // same results, error messages and line hook traces
+  const fused = std.mem.span(lua.lua_tolstring(A, -1, null));
+  const unfused = std.mem.span(lua.lua_tolstring(B, -1, null));
+  try std.testing.expectEqualStrings(unfused, fused);
+  try std.testing.expect(std.mem.indexOf(u8, fused, "(field 'vel')") != null);
+}
+
+test " stringSearch" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\local s = string.rep("status=200,size=17 ", 1000) .. "status=500 ERROR code=42"
+    \\assert(s:find("status=500", 1, true) == 19001)
+    \\assert(s:match("ERROR code=(%d+)") == "42")
+    \\local n = 0
+    \\for d in s:gmatch("%d+") do n = n + 1 end
+    \\assert(n == 2002)
+    \\assert(select(2, s:gsub("[^,]+", "")) == 1001)
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+}
+
+const Vec2 = struct { x: f64, y: f64 = 0 };
+
+const Counter = struct {
+  n: i64,
+
+  fn bump(self: *Counter, by: ?i64) i64 {
+    self.n += by orelse 1;
+    return self.n;
+  }
+};
+
+fn zigAdd(a: f64, b: f64) f64 {
+  return a + b;
+}
+
+fn zigScale(v: Vec2, k: f64) Vec2 {
+  return .{ .x = v.x * k, .y = v.y * k };
+}
+
+fn zigDivmod(a: i32, b: i32) !struct { i32, i32 } {
+  if (b == 0) return error.DivisionByZero;
+  return .{ @divFloor(a, b), @mod(a, b) };
+}
+
+fn zigSum(xs: []const f64) f64 {
+  var s: f64 = 0;
+  for (xs) |x| s += x;
+  return s;
+}
+
+fn zigRound(x: f64, mode: enum { floor, ceil }) f64 {
+  return if (mode == .floor) @floor(x) else @ceil(x);
+}
+
+fn zigCounter(start: i64) bind.Userdata(Counter) {
+  return .{ .value = .{ .n = start } };
+}
+
+// the same binding written by hand against the C API
+fn handAdd(L: ?*lua.lua_State) callconv(.c) c_int {
+  const a = lua.luaL_checknumber(L, 1);
+  const b = lua.luaL_checknumber(L, 2);
+  lua.lua_pushnumber(L, a + b);
+  return 1;
+}
+
+test " zigBindings" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  lua.lua_createtable(L, 0, 6);
+  bind.setFuncs(L, .{ .add = zigAdd, .scale = zigScale, .divmod = zigDivmod,
+                      .sum = zigSum, .round = zigRound, .counter = zigCounter });
+  lua.lua_setglobal(L, "zig");
+  bind.newMetatable(L, Counter, .{ .bump = Counter.bump });
+  lua.lua_settop(L, 0);
+
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\assert(zig.add(1, 2) == 3)
+    \\local v = zig.scale({x = 1, y = 2}, 3)
+    \\assert(v.x == 3 and v.y == 6 and zig.scale({x = 1}, 2).y == 0)
+    \\local q, r = zig.divmod(7, 2)
+    \\assert(q == 3 and r == 1)
+    \\local a = array.new("f64", 4); a:fill(2.5)
+    \\assert(zig.sum(a) == 10)
+    \\assert(zig.round(2.5, "ceil") == 3)
+    \\local c = zig.counter(10)
+    \\assert(c:bump() == 11 and c:bump(5) == 16)
+    \\assert(select(2, pcall(zig.divmod, 1, 0)):find("DivisionByZero"))
+    \\assert(select(2, pcall(zig.add, 1, {})):find("number expected, got table"))
+    \\assert(select(2, pcall(zig.divmod, 1.5, 1)):find("no integer representation"))
+    \\assert(select(2, pcall(zig.round, 1, "up")):find("invalid option"))
+    \\assert(select(2, pcall(zig.sum, array.new("i32", 1))):find("array expected"))
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+}
+
+test " zigBindingsMatchHand" {
+  const L = lua.luaL_newstate() orelse return error.OutOfMemory;
+  defer lua.lua_close(L);
+  lua.luaL_openlibs(L);
+
+  // a generated binding behaves like the one written by hand
+  lua.lua_pushcclosure(L, bind.wrap(zigAdd), 0);
+  lua.lua_setglobal(L, "zigadd");
+  lua.lua_pushcclosure(L, handAdd, 0);
+  lua.lua_setglobal(L, "handadd");
+  try std.testing.expect(lua.luaL_loadstring(L,
+    \\for _, a in ipairs({0, 1, -2.5, 2^53, "3", 1/0}) do
+    \\  assert(zigadd(a, 1.5) == handadd(a, 1.5))
+    \\end
+    \\local function err(f, ...) return select(2, pcall(f, ...)):match("number expected.*") end
+    \\assert(err(zigadd, 1, {}) == err(handadd, 1, {}))
+    \\assert(err(zigadd, nil, 1) == err(handadd, nil, 1))
+    \\local x = 0
+    \\for i = 1, 1000 do x = zigadd(x, i) end
+    \\assert(x == 500500)
+  ) == 0);
+  try std.testing.expect(lua.lua_pcallk(L, 0, 0, 0, 0, null) == 0);
+}
+
 //#endregion ==================================================================
 //=============================================================================
\ No newline at end of file